@@ -0,0 +1,55 @@
+# Benchmarks for the drawing code, built with qmake on Linux:
+#   qmake Benchmarks.pro && make
+#   ./drawit-benchmark --output results.json [trace.ditrace ...]
+#   ./drawit-benchmark --micro --output kernels.json
+# The offscreen platform is used unless QT_QPA_PLATFORM is set.
+
+QT += core gui widgets
+CONFIG += c++11 console
+CONFIG -= app_bundle
+TARGET = drawit-benchmark
+TEMPLATE = app
+
+INCLUDEPATH += ../DrawIt
+LIBS += -lz
+
+HEADERS += microbenchmark.h \
+	replaybenchmark.h \
+	../DrawIt/bufferpool.h \
+	../DrawIt/drawingboard.h \
+	../DrawIt/drawingengine.h \
+	../DrawIt/floodfill.h \
+	../DrawIt/imagetilesource.h \
+	../DrawIt/latencyprobe.h \
+	../DrawIt/layerstack.h \
+	../DrawIt/performancehud.h \
+	../DrawIt/pngreader.h \
+	../DrawIt/pngwriter.h \
+	../DrawIt/selectionmask.h \
+	../DrawIt/strokeplayer.h \
+	../DrawIt/stroketrace.h \
+	../DrawIt/tiledcanvas.h \
+	../DrawIt/tilefile.h \
+	../DrawIt/tilestore.h \
+	../DrawIt/tracelog.h
+
+SOURCES += main.cpp \
+	microbenchmark.cpp \
+	replaybenchmark.cpp \
+	../DrawIt/bufferpool.cpp \
+	../DrawIt/drawingboard.cpp \
+	../DrawIt/drawingengine.cpp \
+	../DrawIt/floodfill.cpp \
+	../DrawIt/imagetilesource.cpp \
+	../DrawIt/latencyprobe.cpp \
+	../DrawIt/layerstack.cpp \
+	../DrawIt/performancehud.cpp \
+	../DrawIt/pngreader.cpp \
+	../DrawIt/pngwriter.cpp \
+	../DrawIt/selectionmask.cpp \
+	../DrawIt/strokeplayer.cpp \
+	../DrawIt/stroketrace.cpp \
+	../DrawIt/tiledcanvas.cpp \
+	../DrawIt/tilefile.cpp \
+	../DrawIt/tilestore.cpp \
+	../DrawIt/tracelog.cpp
@@ -0,0 +1,137 @@
+#include "microbenchmark.h"
+#include "replaybenchmark.h"
+
+#include <QApplication>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTextStream>
+
+/*
+Parses a list like 800x600,1920x1080
+*/
+static QList<QSize> parseSizes(const QString &text)
+{
+	QList<QSize> sizes;
+	foreach(const QString &item, text.split(',', QString::SkipEmptyParts)) {
+		const QStringList size = item.split('x');
+		sizes.append(QSize(size.value(0).toInt(), size.value(1).toInt()));
+		if (sizes.last().isEmpty()){
+			return QList<QSize>();
+		}
+	}
+	return sizes;
+}
+
+/*
+Replays the stored traces given on the command line and the synthetic
+workloads, or runs the micro benchmarks, and writes the results as JSON
+*/
+int main(int argc, char *argv[])
+{
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")){
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	}
+	QApplication a(argc, argv);
+	QCoreApplication::setApplicationName("drawit-benchmark");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Replays stroke traces and synthetic workloads against DrawingBoard, or times its drawing functions.");
+	parser.addHelpOption();
+	QCommandLineOption sizeOption("size", "Canvas size of the synthetic workloads.", "WxH", "1920x1080");
+	QCommandLineOption outputOption(QStringList() << "o" << "output", "File to write the JSON results to.", "file");
+	QCommandLineOption tracesOnlyOption("traces-only", "Only replay the traces given on the command line.");
+	QCommandLineOption repetitionsOption("repetitions",
+		"Saves and opens per image format, or timed batches per micro benchmark.", "count", "10");
+	QCommandLineOption microOption("micro", "Run the micro benchmarks instead of the replays.");
+	QCommandLineOption sizesOption("sizes", "Canvas sizes of the micro benchmarks.", "WxH,...",
+		"800x600,1920x1080,3840x2160");
+	QCommandLineOption penWidthsOption("pen-widths", "Pen widths of the micro benchmarks.", "width,...", "1,8,32");
+	QCommandLineOption warmupOption("warmup", "Untimed operations before a micro benchmark.", "count", "20");
+	QCommandLineOption batchOption("batch", "Operations timed together in a micro benchmark.", "count", "20");
+	QCommandLineOption filterOption("filter", "Only run micro benchmarks whose name contains this.", "text");
+	parser.addOption(sizeOption);
+	parser.addOption(outputOption);
+	parser.addOption(tracesOnlyOption);
+	parser.addOption(repetitionsOption);
+	parser.addOption(microOption);
+	parser.addOption(sizesOption);
+	parser.addOption(penWidthsOption);
+	parser.addOption(warmupOption);
+	parser.addOption(batchOption);
+	parser.addOption(filterOption);
+	parser.addPositionalArgument("traces", "Recorded stroke traces (.ditrace) to replay.", "[trace...]");
+	parser.process(a);
+
+	const QStringList size = parser.value(sizeOption).split('x');
+	const QSize canvasSize(size.value(0).toInt(), size.value(1).toInt());
+	if (canvasSize.isEmpty()){
+		QTextStream(stderr) << "invalid canvas size " << parser.value(sizeOption) << '\n';
+		return 1;
+	}
+
+	QJsonObject results;
+	results["qtVersion"] = QString(qVersion());
+	results["platform"] = QApplication::platformName();
+
+	QStringList mismatches;
+	if (parser.isSet(microOption)){
+		const QList<QSize> canvasSizes = parseSizes(parser.value(sizesOption));
+		QList<int> penWidths;
+		foreach(const QString &width, parser.value(penWidthsOption).split(',', QString::SkipEmptyParts)) {
+			penWidths.append(qMax(1, width.toInt()));
+		}
+		if (canvasSizes.isEmpty() || penWidths.isEmpty()){
+			QTextStream(stderr) << "invalid canvas sizes or pen widths\n";
+			return 1;
+		}
+		MicroBenchmark micro;
+		micro.setWarmup(parser.value(warmupOption).toInt());
+		micro.setRepetitions(parser.value(repetitionsOption).toInt());
+		micro.setBatchSize(parser.value(batchOption).toInt());
+		micro.setFilter(parser.value(filterOption));
+		results["kernels"] = micro.run(canvasSizes, penWidths);
+		mismatches = micro.getMismatches();
+	}
+	else{
+		ReplayBenchmark benchmark(canvasSize);
+		QJsonArray workloads;
+		foreach(const QString &fileName, parser.positionalArguments()) {
+			StrokeTrace trace;
+			if (!trace.load(fileName)){
+				QTextStream(stderr) << fileName << " is not a stroke trace\n";
+				return 1;
+			}
+			workloads.append(benchmark.runTrace("trace-" + QFileInfo(fileName).completeBaseName(), trace));
+		}
+		if (!parser.isSet(tracesOnlyOption)){
+			workloads.append(benchmark.runTrace("long-freehand", benchmark.longFreehand()));
+			workloads.append(benchmark.runTrace("rapid-shapes", benchmark.rapidShapes()));
+			workloads.append(benchmark.runTrace("large-fills", benchmark.largeFills()));
+			workloads.append(benchmark.runTrace("undo-redo-storm", benchmark.undoRedoStorm()));
+			const int repetitions = parser.value(repetitionsOption).toInt();
+			workloads.append(benchmark.runOpenSave("png", repetitions));
+			workloads.append(benchmark.runOpenSave("bmp", repetitions));
+			workloads.append(benchmark.runOpenSave("jpg", repetitions));
+		}
+		results["workloads"] = workloads;
+	}
+	const QByteArray json = QJsonDocument(results).toJson();
+	if (parser.isSet(outputOption)){
+		QFile file(parser.value(outputOption));
+		if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()){
+			QTextStream(stderr) << "could not write " << parser.value(outputOption) << '\n';
+			return 1;
+		}
+	}
+	else{
+		QTextStream(stdout) << json;
+	}
+	foreach(const QString &mismatch, mismatches) {
+		QTextStream(stderr) << mismatch << '\n';
+	}
+	return mismatches.isEmpty() ? 0 : 1;
+}
@@ -0,0 +1,469 @@
+#include "microbenchmark.h"
+#include "drawingboard.h"
+#include "drawingengine.h"
+#include "floodfill.h"
+
+#include <QElapsedTimer>
+#include <QPainter>
+#include <QRegion>
+#include <QTemporaryDir>
+#include <QVector>
+#include <QtMath>
+#include <algorithm>
+
+//A fixed zigzag over the canvas, so every run draws the same segments
+static QPoint pathPoint(const QSize &canvasSize, int index)
+{
+	const int x = (index * 23) % canvasSize.width();
+	const int y = (index * 17 + (index % 2) * 40) % canvasSize.height();
+	return QPoint(x, y);
+}
+
+MicroBenchmark::MicroBenchmark()
+{
+	warmup = 20;
+	repetitions = 15;
+	batchSize = 20;
+}
+
+MicroBenchmark::~MicroBenchmark()
+{
+
+}
+
+/**
+* Sets how many untimed operations run before a kernel is measured
+* @param int newWarmup - The number of operations
+*/
+void MicroBenchmark::setWarmup(int newWarmup)
+{
+	warmup = qMax(0, newWarmup);
+}
+
+/**
+* Sets how many timed batches a kernel runs
+* @param int newRepetitions - The number of batches
+*/
+void MicroBenchmark::setRepetitions(int newRepetitions)
+{
+	repetitions = qMax(1, newRepetitions);
+}
+
+/**
+* Sets how many operations are timed together in one batch
+* @param int newBatchSize - The number of operations
+*/
+void MicroBenchmark::setBatchSize(int newBatchSize)
+{
+	batchSize = qMax(1, newBatchSize);
+}
+
+/**
+* Only runs the kernels whose name contains the filter
+* @param QString newFilter - Part of a kernel name, empty runs all
+*/
+void MicroBenchmark::setFilter(const QString &newFilter)
+{
+	filter = newFilter;
+}
+
+/**
+* Runs every kernel for every canvas size, the drawing kernels also for every pen width
+* @param QList canvasSizes - The canvas sizes
+* @param QList penWidths - The pen widths
+* @return QJsonArray - One result per kernel and parameters
+*/
+QJsonArray MicroBenchmark::run(const QList<QSize> &canvasSizes, const QList<int> &penWidths)
+{
+	results = QJsonArray();
+	mismatches.clear();
+	foreach(const QSize &canvasSize, canvasSizes) {
+		currentCanvasSize = canvasSize;
+		foreach(int penWidth, penWidths) {
+			runFreehand(canvasSize, penWidth);
+			runShapes(canvasSize, penWidth);
+		}
+		runCompositing(canvasSize);
+		runLayers(canvasSize);
+		runFloodFill(canvasSize);
+		checkFloodFill(canvasSize);
+		runSelection(canvasSize);
+		runHistory(canvasSize);
+		runResize(canvasSize);
+		runFiles(canvasSize);
+	}
+	return results;
+}
+
+/**
+* Returns what differed between fill() and fillParallel() in the last run()
+* @return QStringList - One line per case that differed, empty if none did
+*/
+QStringList MicroBenchmark::getMismatches()
+{
+	return mismatches;
+}
+
+/**
+* Times drawFreehand, one short segment per operation
+* @param QSize canvasSize - The canvas size
+* @param int penWidth - The pen width
+*/
+void MicroBenchmark::runFreehand(const QSize &canvasSize, int penWidth)
+{
+	DrawingEngine engine(canvasSize);
+	engine.setPenWidth(penWidth);
+	engine.lastPoint = pathPoint(canvasSize, 0);
+	QJsonObject parameters;
+	parameters["penWidth"] = penWidth;
+	measure("drawFreehand", parameters, [&](int i) {
+		engine.drawFreehand(pathPoint(canvasSize, i + 1));
+	});
+}
+
+/**
+* Times drawShape for every mode, both the preview while dragging and the
+* final shape on the canvas, with and without fill and in every pen style
+* @param QSize canvasSize - The canvas size
+* @param int penWidth - The pen width
+*/
+void MicroBenchmark::runShapes(const QSize &canvasSize, int penWidth)
+{
+	const int modes[] = { DrawingEngine::modeLine, DrawingEngine::modeCircle, DrawingEngine::modeRectangle };
+	const char *modeNames[] = { "line", "circle", "rectangle" };
+	const char *styleNames[] = { "solid", "dash", "dot", "dashdot" };
+	for (int mode = 0; mode < 3; ++mode){
+		for (int style = DrawingEngine::styleSolidLine; style <= DrawingEngine::styleDashedDottedLine; ++style){
+			for (int filled = 0; filled < 2; ++filled){
+				for (int preview = 0; preview < 2; ++preview){
+					DrawingEngine engine(canvasSize);
+					engine.setPenWidth(penWidth);
+					engine.setPenStyle(style);
+					engine.setPaintMode(modes[mode]);
+					if (filled){
+						engine.setColorFill(Qt::red);
+					}
+					engine.startPoint = QPoint(canvasSize.width() / 4, canvasSize.height() / 4);
+					engine.scribbling = preview;
+					QJsonObject parameters;
+					parameters["penWidth"] = penWidth;
+					parameters["mode"] = modeNames[mode];
+					parameters["style"] = styleNames[style];
+					parameters["fill"] = bool(filled);
+					measure(preview ? "drawShape-preview" : "drawShape", parameters, [&](int i) {
+						engine.drawShape(pathPoint(canvasSize, i) / 2 + engine.startPoint, modes[mode]);
+					});
+				}
+			}
+		}
+	}
+}
+
+/**
+* Times the paint event of DrawingBoard, compositing the canvas tiles and
+* the preview overlay, for the whole board and for a small dirty rect
+* @param QSize canvasSize - The canvas size
+*/
+void MicroBenchmark::runCompositing(const QSize &canvasSize)
+{
+	DrawingBoard board(0, 0, canvasSize.width(), canvasSize.height());
+	QImage target(canvasSize, QImage::Format_ARGB32_Premultiplied);
+	const QRect areas[] = { QRect(QPoint(0, 0), canvasSize), QRect(canvasSize.width() / 2, canvasSize.height() / 2, 64, 64) };
+	const char *areaNames[] = { "full", "64x64" };
+	for (int area = 0; area < 2; ++area){
+		QJsonObject parameters;
+		parameters["area"] = areaNames[area];
+		const QRegion region(areas[area]);
+		measure("paintEvent", parameters, [&](int) {
+			board.render(&target, QPoint(), region);
+		});
+	}
+}
+
+/**
+* Times a freehand segment on the middle layer of a canvas with 1 and with 20
+* layers that all have pixels, including composing the changed tiles
+* @param QSize canvasSize - The canvas size
+*/
+void MicroBenchmark::runLayers(const QSize &canvasSize)
+{
+	const int layerCounts[] = { 1, 20 };
+	for (int count = 0; count < 2; ++count){
+		DrawingEngine engine(canvasSize);
+		engine.setPenWidth(8);
+		for (int i = 1; i < layerCounts[count]; ++i){
+			engine.addLayer();
+			engine.lastPoint = pathPoint(canvasSize, i * 7);
+			engine.drawFreehand(pathPoint(canvasSize, i * 7 + 100));
+		}
+		engine.setCurrentLayer(layerCounts[count] / 2);
+		engine.canvas();
+		engine.lastPoint = pathPoint(canvasSize, 0);
+		QJsonObject parameters;
+		parameters["layers"] = layerCounts[count];
+		measure("drawFreehand-layers", parameters, [&](int i) {
+			engine.drawFreehand(pathPoint(canvasSize, i + 1));
+			engine.canvas();
+		});
+	}
+}
+
+/**
+* Times floodFill of the area around the middle of a canvas crossed by a
+* few freehand lines, switching between two colors so every fill repaints it,
+* and finding the area alone on one thread and on the thread pool
+* @param QSize canvasSize - The canvas size
+*/
+void MicroBenchmark::runFloodFill(const QSize &canvasSize)
+{
+	DrawingEngine engine(canvasSize);
+	engine.setPenWidth(4);
+	engine.penColor = Qt::black;
+	for (int i = 0; i < 10; ++i){
+		engine.lastPoint = pathPoint(canvasSize, i * 37);
+		engine.drawFreehand(pathPoint(canvasSize, i * 37 + 200));
+	}
+	const QPoint middle(canvasSize.width() / 2, canvasSize.height() / 2);
+	measure("floodFill", QJsonObject(), [&](int i) {
+		engine.penColor = i % 2 == 0 ? Qt::red : Qt::blue;
+		engine.floodFill(middle);
+	});
+	for (int parallel = 0; parallel < 2; ++parallel){
+		QJsonObject parameters;
+		parameters["parallel"] = parallel != 0;
+		measure("floodFill-region", parameters, [&](int) {
+			FloodFill region(engine.canvas(), engine.canvas().rect(), engine.fillTolerance);
+			if (parallel){
+				region.fillParallel(middle);
+			}
+			else{
+				region.fill(middle);
+			}
+		});
+	}
+}
+
+/**
+* Compares the areas fill() and fillParallel() find on a maze that winds
+* through every tile border, on a canvas of one color and on an expandable
+* canvas that grew to the left and the top
+* @param QSize canvasSize - The canvas size
+*/
+void MicroBenchmark::checkFloodFill(const QSize &canvasSize)
+{
+	if (!filter.isEmpty() && !QString("floodFill-check").contains(filter)){
+		return;
+	}
+	//fillParallel() only uses the thread pool on areas of more than FloodFill::parallelTiles tiles
+	const QSize size = canvasSize.expandedTo(QSize(1280, 1280));
+	//Walls every 8 pixels, open at the bottom and at the top in turn, so the path runs through every column
+	TiledCanvas maze(size);
+	maze.paint(maze.rect(), [&](QPainter &painter) {
+		for (int x = 4, wall = 0; x < size.width(); x += 8, ++wall){
+			painter.fillRect(QRect(x, wall % 2 == 0 ? 0 : 4, 2, size.height() - 4), Qt::black);
+		}
+	});
+	compareFills("maze", maze, QPoint(0, 0));
+
+	TiledCanvas solid(size);
+	compareFills("solid", solid, QPoint(size.width() / 2, size.height() / 2));
+
+	TiledCanvas expandable(size);
+	expandable.setExpandable(true);
+	expandable.paint(QRect(-300, -200, size.width() + 300, size.height() + 200), [&](QPainter &painter) {
+		painter.setPen(QPen(Qt::black, 3));
+		for (int i = 0; i < 10; ++i){
+			painter.drawLine(pathPoint(size, i * 37) - QPoint(300, 200), pathPoint(size, i * 37 + 200));
+		}
+	});
+	compareFills("expandable", expandable, expandable.rect().topLeft() + QPoint(50, 50));
+}
+
+/**
+* Fills a canvas from a seed with fill() and with fillParallel() and adds a
+* mismatch if the two masks differ in a single bit
+* @param QString name - The name of the case
+* @param TiledCanvas canvas - The canvas to fill
+* @param QPoint seed - Where the fills start
+*/
+void MicroBenchmark::compareFills(const QString &name, const TiledCanvas &canvas, const QPoint &seed)
+{
+	FloodFill serial(canvas, canvas.rect(), 0);
+	FloodFill parallel(canvas, canvas.rect(), 0);
+	const QRect serialRect = serial.fill(seed);
+	const QRect parallelRect = parallel.fillParallel(seed);
+	//Both differences are empty only if the masks are the same
+	SelectionMask onlySerial = serial.toMask();
+	onlySerial.combine(parallel.toMask(), SelectionMask::combineSubtract);
+	SelectionMask onlyParallel = parallel.toMask();
+	onlyParallel.combine(serial.toMask(), SelectionMask::combineSubtract);
+	const bool match = serialRect == parallelRect && onlySerial.isEmpty() && onlyParallel.isEmpty();
+
+	QJsonObject result;
+	result["kernel"] = QString("floodFill-check");
+	result["case"] = name;
+	result["canvasWidth"] = currentCanvasSize.width();
+	result["canvasHeight"] = currentCanvasSize.height();
+	result["match"] = match;
+	results.append(result);
+	if (!match){
+		mismatches.append(QString("floodFill %1 on %2x%3: fillParallel() differs from fill()")
+			.arg(name).arg(currentCanvasSize.width()).arg(currentCanvasSize.height()));
+	}
+}
+
+/**
+* Times combining an ellipse into a selection of most of a canvas in every
+* combine mode, inverting it and the magic wand on a canvas crossed by a few
+* freehand lines
+* @param QSize canvasSize - The canvas size
+*/
+void MicroBenchmark::runSelection(const QSize &canvasSize)
+{
+	DrawingEngine engine(canvasSize);
+	engine.setPenWidth(4);
+	engine.penColor = Qt::black;
+	for (int i = 0; i < 10; ++i){
+		engine.lastPoint = pathPoint(canvasSize, i * 37);
+		engine.drawFreehand(pathPoint(canvasSize, i * 37 + 200));
+	}
+	const QRect canvasRect(QPoint(0, 0), canvasSize);
+	const SelectionMask base = SelectionMask::fromRect(canvasRect.adjusted(3, 3, -3, -3));
+	const SelectionMask ellipse = SelectionMask::fromEllipse(QRect(canvasSize.width() / 4, canvasSize.height() / 4,
+		canvasSize.width() / 2, canvasSize.height() / 2));
+	const char *combineNames[] = { "replace", "add", "subtract", "intersect" };
+	for (int operation = 0; operation < 4; ++operation){
+		QJsonObject parameters;
+		parameters["combine"] = combineNames[operation];
+		measure("selectionCombine", parameters, [&](int) {
+			SelectionMask combined = base;
+			combined.combine(ellipse, operation);
+		});
+	}
+	SelectionMask inverted = ellipse;
+	measure("selectionInvert", QJsonObject(), [&](int) {
+		inverted.invert(canvasRect);
+	});
+	const QPoint middle(canvasSize.width() / 2, canvasSize.height() / 2);
+	measure("magicWand", QJsonObject(), [&](int) {
+		engine.select(engine.similarArea(middle));
+	});
+}
+
+/**
+* Times checkImageCount while the history fills up and rearrangeImages once it is full
+* @param QSize canvasSize - The canvas size
+*/
+void MicroBenchmark::runHistory(const QSize &canvasSize)
+{
+	DrawingEngine engine(canvasSize);
+	engine.setPenWidth(8);
+	//Paint on every history step so the steps don't all share their tiles
+	for (int i = 0; i < 10; ++i){
+		engine.checkImageCount();
+		engine.lastPoint = pathPoint(canvasSize, i * 7);
+		engine.drawFreehand(pathPoint(canvasSize, i * 7 + 100));
+	}
+	measure("rearrangeImages", QJsonObject(), [&](int) {
+		engine.rearrangeImages();
+	});
+	measure("checkImageCount", QJsonObject(), [&](int) {
+		if (engine.currentImageCounter == 9){
+			engine.currentImageCounter = 0;
+		}
+		engine.checkImageCount();
+	});
+}
+
+/**
+* Times resizeImage, growing a half size image to the canvas size
+* @param QSize canvasSize - The canvas size
+*/
+void MicroBenchmark::runResize(const QSize &canvasSize)
+{
+	DrawingEngine engine(canvasSize);
+	QImage source(canvasSize / 2, QImage::Format_RGB32);
+	source.fill(Qt::blue);
+	measure("resizeImage", QJsonObject(), [&](int) {
+		QImage image = source;
+		engine.resizeImage(&image, canvasSize);
+	});
+}
+
+/**
+* Times saveImage and openImage for every format that can be written
+* @param QSize canvasSize - The canvas size
+*/
+void MicroBenchmark::runFiles(const QSize &canvasSize)
+{
+	QTemporaryDir directory;
+	const char *formats[] = { "png", "bmp", "jpg" };
+	for (int format = 0; format < 3; ++format){
+		DrawingEngine engine(canvasSize);
+		engine.setPenWidth(8);
+		for (int i = 0; i < 200; ++i){
+			engine.drawFreehand(pathPoint(canvasSize, i));
+		}
+		const QString fileName = directory.path() + "/micro." + formats[format];
+		QJsonObject parameters;
+		parameters["format"] = formats[format];
+		measure("saveImage", parameters, [&](int) {
+			engine.saveImage(fileName, formats[format]);
+		});
+		measure("openImage", parameters, [&](int) {
+			engine.openImage(fileName);
+		});
+	}
+}
+
+/**
+* Runs a kernel for the warm-up operations, then times it in batches and
+* adds the nanoseconds per operation to the results
+* @param QString kernel - The kernel name
+* @param QJsonObject parameters - The parameters the kernel ran with
+* @param std::function operation - Runs operation number i
+*/
+void MicroBenchmark::measure(const QString &kernel, QJsonObject parameters, const std::function<void (int)> &operation)
+{
+	if (!filter.isEmpty() && !kernel.contains(filter)){
+		return;
+	}
+	int index = 0;
+	for (int i = 0; i < warmup; ++i){
+		operation(index++);
+	}
+	QVector<double> samples;
+	QElapsedTimer timer;
+	for (int repetition = 0; repetition < repetitions; ++repetition){
+		timer.start();
+		for (int i = 0; i < batchSize; ++i){
+			operation(index++);
+		}
+		samples.append(double(timer.nsecsElapsed()) / batchSize);
+	}
+	std::sort(samples.begin(), samples.end());
+	double sum = 0;
+	foreach(double sample, samples) {
+		sum += sample;
+	}
+	const double mean = sum / samples.size();
+	double variance = 0;
+	foreach(double sample, samples) {
+		variance += (sample - mean) * (sample - mean);
+	}
+	QJsonObject nanoseconds;
+	nanoseconds["median"] = samples[samples.size() / 2];
+	nanoseconds["min"] = samples.first();
+	nanoseconds["max"] = samples.last();
+	nanoseconds["mean"] = mean;
+	nanoseconds["stddev"] = qSqrt(variance / samples.size());
+
+	parameters["kernel"] = kernel;
+	parameters["canvasWidth"] = currentCanvasSize.width();
+	parameters["canvasHeight"] = currentCanvasSize.height();
+	parameters["nsPerOperation"] = nanoseconds;
+	parameters["warmup"] = warmup;
+	parameters["repetitions"] = repetitions;
+	parameters["batchSize"] = batchSize;
+	results.append(parameters);
+}
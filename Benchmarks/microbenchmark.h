@@ -0,0 +1,60 @@
+#ifndef MICROBENCHMARK_H
+#define MICROBENCHMARK_H
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QList>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+class TiledCanvas;
+class QPoint;
+
+/**
+* Times the drawing hot paths one kernel at a time: freehand segments, every
+* shape mode with and without fill and in every pen style, compositing in
+* the paint event, drawing on a layer of a layered canvas, the paint bucket,
+* the selection, the undo history, resizing and opening and saving every format. Each kernel is run for a
+* number of warm-up operations first, then timed in repeated batches for
+* every canvas size and pen width. The areas fill() and fillParallel() of
+* FloodFill find are also compared bit for bit, every difference is kept in
+* getMismatches().
+*/
+class MicroBenchmark
+{
+public:
+	MicroBenchmark();
+	~MicroBenchmark();
+	void setWarmup(int newWarmup);
+	void setRepetitions(int newRepetitions);
+	void setBatchSize(int newBatchSize);
+	void setFilter(const QString &newFilter);
+	QJsonArray run(const QList<QSize> &canvasSizes, const QList<int> &penWidths);
+	QStringList getMismatches();
+
+private:
+	int warmup;
+	int repetitions;
+	int batchSize;
+	QString filter;
+	QSize currentCanvasSize;
+	QJsonArray results;
+	QStringList mismatches;
+
+	void runFreehand(const QSize &canvasSize, int penWidth);
+	void runShapes(const QSize &canvasSize, int penWidth);
+	void runCompositing(const QSize &canvasSize);
+	void runLayers(const QSize &canvasSize);
+	void runFloodFill(const QSize &canvasSize);
+	void checkFloodFill(const QSize &canvasSize);
+	void compareFills(const QString &name, const TiledCanvas &canvas, const QPoint &seed);
+	void runSelection(const QSize &canvasSize);
+	void runHistory(const QSize &canvasSize);
+	void runResize(const QSize &canvasSize);
+	void runFiles(const QSize &canvasSize);
+	void measure(const QString &kernel, QJsonObject parameters, const std::function<void (int)> &operation);
+};
+
+#endif // MICROBENCHMARK_H
@@ -0,0 +1,351 @@
+#include "replaybenchmark.h"
+#include "bufferpool.h"
+#include "drawingboard.h"
+#include "strokeplayer.h"
+
+#include <QApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QTemporaryDir>
+#include <QtMath>
+#include <algorithm>
+
+ReplayBenchmark::ReplayBenchmark(const QSize &newCanvasSize)
+{
+	canvasSize = newCanvasSize;
+	syntheticTime = 0;
+	randomState = 1;
+}
+
+ReplayBenchmark::~ReplayBenchmark()
+{
+
+}
+
+/**
+* Replays a trace on a new board, timing each event together with the repaint it causes
+* @param QString name - The workload name in the results
+* @param StrokeTrace trace - The trace to replay
+* @return QJsonObject - The results
+*/
+QJsonObject ReplayBenchmark::runTrace(const QString &name, const StrokeTrace &trace)
+{
+	const QSize size = trace.getCanvasSize().isEmpty() ? canvasSize : trace.getCanvasSize();
+	DrawingBoard board(0, 0, size.width(), size.height());
+	board.show();
+	board.newCanvas(size);
+	QApplication::processEvents();
+	resetPeakMemory();
+
+	const qint64 allocations = BufferPool::global()->allocationCount();
+	QVector<qint64> latencies;
+	latencies.reserve(trace.count());
+	QElapsedTimer total;
+	total.start();
+	QElapsedTimer timer;
+	for (int i = 0; i < trace.count(); ++i){
+		timer.start();
+		StrokePlayer::playEvent(&board, trace.at(i));
+		QApplication::processEvents();
+		latencies.append(timer.nsecsElapsed());
+	}
+	const qint64 totalNanoseconds = total.nsecsElapsed();
+
+	QJsonObject result = statistics(latencies, totalNanoseconds);
+	result["name"] = name;
+	result["canvasWidth"] = size.width();
+	result["canvasHeight"] = size.height();
+	result["peakMemoryKb"] = double(peakMemory());
+	result["memory"] = memoryUsage(&board);
+	result["bufferAllocations"] = double(BufferPool::global()->allocationCount() - allocations);
+	return result;
+}
+
+/**
+* Saves and opens a drawn canvas in one format over and over
+* @param QString format - The image format
+* @param int repetitions - How many times to save and open
+* @return QJsonObject - The results, with save and open timed separately
+*/
+QJsonObject ReplayBenchmark::runOpenSave(const QString &format, int repetitions)
+{
+	QTemporaryDir directory;
+	const QString fileName = directory.path() + "/benchmark." + format;
+	const QByteArray fileFormat = format.toLatin1();
+	DrawingBoard board(0, 0, canvasSize.width(), canvasSize.height());
+	const StrokeTrace content = largeFills();
+	for (int i = 0; i < content.count(); ++i){
+		StrokePlayer::playEvent(&board, content.at(i));
+	}
+	resetPeakMemory();
+
+	QVector<qint64> saveLatencies;
+	QVector<qint64> openLatencies;
+	qint64 saveTotal = 0;
+	qint64 openTotal = 0;
+	QElapsedTimer timer;
+	for (int i = 0; i < repetitions; ++i){
+		timer.start();
+		board.saveImage(fileName, fileFormat.constData());
+		saveLatencies.append(timer.nsecsElapsed());
+		saveTotal += saveLatencies.last();
+		timer.start();
+		board.openImage(fileName);
+		openLatencies.append(timer.nsecsElapsed());
+		openTotal += openLatencies.last();
+	}
+
+	QJsonObject result;
+	result["name"] = "open-save-" + format;
+	result["canvasWidth"] = canvasSize.width();
+	result["canvasHeight"] = canvasSize.height();
+	result["fileBytes"] = double(QFile(fileName).size());
+	result["save"] = statistics(saveLatencies, saveTotal);
+	result["open"] = statistics(openLatencies, openTotal);
+	result["peakMemoryKb"] = double(peakMemory());
+	result["memory"] = memoryUsage(&board);
+	return result;
+}
+
+/**
+* One long freehand stroke spiralling over the canvas
+* @return StrokeTrace - The trace
+*/
+StrokeTrace ReplayBenchmark::longFreehand()
+{
+	StrokeTrace trace;
+	beginTrace(&trace);
+	addEvent(&trace, StrokeTrace::eventPaintMode, DrawingBoard::modeFreehand);
+	addEvent(&trace, StrokeTrace::eventPenWidth, 4);
+	const QPointF center(canvasSize.width() / 2.0, canvasSize.height() / 2.0);
+	const double radius = qMin(canvasSize.width(), canvasSize.height()) / 2.0 - 10;
+	const int moves = 20000;
+	addEvent(&trace, StrokeTrace::eventPress, 0, center.toPoint(), Qt::LeftButton);
+	QPoint pos;
+	for (int i = 1; i <= moves; ++i){
+		const double angle = i * 0.01;
+		const double distance = radius * i / moves;
+		pos = (center + QPointF(qCos(angle), qSin(angle)) * distance).toPoint();
+		addEvent(&trace, StrokeTrace::eventMove, 0, pos, Qt::LeftButton);
+	}
+	addEvent(&trace, StrokeTrace::eventRelease, 0, pos, Qt::LeftButton);
+	return trace;
+}
+
+/**
+* Many short drags in every shape mode, the preview is redrawn on every move
+* @return StrokeTrace - The trace
+*/
+StrokeTrace ReplayBenchmark::rapidShapes()
+{
+	StrokeTrace trace;
+	beginTrace(&trace);
+	addEvent(&trace, StrokeTrace::eventPenWidth, 2);
+	const int modes[] = { DrawingBoard::modeLine, DrawingBoard::modeCircle, DrawingBoard::modeRectangle };
+	for (int mode = 0; mode < 3; ++mode){
+		addEvent(&trace, StrokeTrace::eventPaintMode, modes[mode]);
+		for (int i = 0; i < 200; ++i){
+			addDrag(&trace, randomPoint(), randomPoint(), 10);
+		}
+	}
+	return trace;
+}
+
+/**
+* Filled shapes covering most of the canvas with every pen style
+* @return StrokeTrace - The trace
+*/
+StrokeTrace ReplayBenchmark::largeFills()
+{
+	StrokeTrace trace;
+	beginTrace(&trace);
+	addEvent(&trace, StrokeTrace::eventPenWidth, 8);
+	const QPoint topLeft(canvasSize.width() / 10, canvasSize.height() / 10);
+	const QPoint bottomRight(canvasSize.width() * 9 / 10, canvasSize.height() * 9 / 10);
+	for (int i = 0; i < 100; ++i){
+		addEvent(&trace, StrokeTrace::eventPaintMode, i % 2 ? DrawingBoard::modeCircle : DrawingBoard::modeRectangle);
+		addEvent(&trace, StrokeTrace::eventPenStyle, i % 4);
+		addEvent(&trace, StrokeTrace::eventColorFill, qRgb(i * 37 % 256, i * 91 % 256, i * 53 % 256));
+		addDrag(&trace, topLeft + QPoint(i, i), bottomRight - QPoint(i, i), 5);
+	}
+	return trace;
+}
+
+/**
+* A few strokes followed by runs of undo and redo through the whole history
+* @return StrokeTrace - The trace
+*/
+StrokeTrace ReplayBenchmark::undoRedoStorm()
+{
+	StrokeTrace trace;
+	beginTrace(&trace);
+	addEvent(&trace, StrokeTrace::eventPaintMode, DrawingBoard::modeFreehand);
+	addEvent(&trace, StrokeTrace::eventPenWidth, 6);
+	for (int i = 0; i < 20; ++i){
+		addDrag(&trace, randomPoint(), randomPoint(), 20);
+	}
+	for (int i = 0; i < 100; ++i){
+		for (int step = 0; step < 9; ++step){
+			addEvent(&trace, StrokeTrace::eventUndo);
+		}
+		for (int step = 0; step < 9; ++step){
+			addEvent(&trace, StrokeTrace::eventRedo);
+		}
+	}
+	return trace;
+}
+
+/**
+* Computes latency percentiles and throughput
+* @param QVector nanoseconds - The time of every operation
+* @param qint64 totalNanoseconds - The time of the whole run
+* @return QJsonObject - The statistics, latencies in microseconds
+*/
+QJsonObject ReplayBenchmark::statistics(QVector<qint64> nanoseconds, qint64 totalNanoseconds)
+{
+	QJsonObject result;
+	result["events"] = nanoseconds.size();
+	result["totalMs"] = totalNanoseconds / 1e6;
+	result["eventsPerSecond"] = totalNanoseconds > 0 ? nanoseconds.size() * 1e9 / totalNanoseconds : 0.0;
+	if (nanoseconds.isEmpty()){
+		return result;
+	}
+	std::sort(nanoseconds.begin(), nanoseconds.end());
+	qint64 sum = 0;
+	foreach(qint64 value, nanoseconds) {
+		sum += value;
+	}
+	const double percentiles[] = { 50, 90, 99, 99.9 };
+	const char *names[] = { "p50", "p90", "p99", "p999" };
+	QJsonObject latency;
+	for (int i = 0; i < 4; ++i){
+		const int index = qBound(0, int(qCeil(percentiles[i] / 100 * nanoseconds.size())) - 1, nanoseconds.size() - 1);
+		latency[names[i]] = nanoseconds[index] / 1e3;
+	}
+	latency["min"] = nanoseconds.first() / 1e3;
+	latency["max"] = nanoseconds.last() / 1e3;
+	latency["mean"] = sum / 1e3 / nanoseconds.size();
+	result["latencyUs"] = latency;
+	return result;
+}
+
+/**
+* Resets the peak resident memory of the process, so the next peak belongs to one workload
+*/
+void ReplayBenchmark::resetPeakMemory()
+{
+#ifdef Q_OS_LINUX
+	QFile file("/proc/self/clear_refs");
+	if (file.open(QIODevice::WriteOnly)){
+		file.write("5");
+	}
+#endif
+}
+
+/**
+* Returns the peak resident memory of the process
+* @return qint64 - The peak in kilobytes, -1 where it can't be read
+*/
+qint64 ReplayBenchmark::peakMemory()
+{
+#ifdef Q_OS_LINUX
+	QFile file("/proc/self/status");
+	if (file.open(QIODevice::ReadOnly | QIODevice::Text)){
+		foreach(const QByteArray &line, file.readAll().split('\n')) {
+			if (line.startsWith("VmHWM:")){
+				return line.mid(6).trimmed().split(' ').first().toLongLong();
+			}
+		}
+	}
+#endif
+	return -1;
+}
+
+/**
+* Returns the memory of the drawing buffers of a board by kind
+* @param DrawingBoard* board - The board
+* @return QJsonObject - The bytes per kind
+*/
+QJsonObject ReplayBenchmark::memoryUsage(DrawingBoard *board)
+{
+	const DrawingEngine::MemoryUsage usage = board->memoryUsage();
+	QJsonObject result;
+	result["canvasBytes"] = double(usage.canvas);
+	result["overlayBytes"] = double(usage.overlay);
+	result["selectionBytes"] = double(usage.selection);
+	result["undoBytes"] = double(usage.undo);
+	result["redoBytes"] = double(usage.redo);
+	result["cacheBytes"] = double(usage.caches);
+	result["ioBufferBytes"] = double(usage.ioBuffers);
+	result["tileStoreBytes"] = double(usage.tileStore);
+	result["deduplicatedBytes"] = double(usage.deduplicated);
+	result["totalBytes"] = double(usage.total());
+	return result;
+}
+
+/**
+* Starts a synthetic trace on the benchmark canvas with the default tools
+* @param StrokeTrace* trace - The trace to start
+*/
+void ReplayBenchmark::beginTrace(StrokeTrace *trace)
+{
+	trace->clear();
+	trace->setCanvasSize(canvasSize);
+	syntheticTime = 0;
+	randomState = 1;
+	addEvent(trace, StrokeTrace::eventPrimaryColor, qRgb(0, 0, 0));
+	addEvent(trace, StrokeTrace::eventSecondaryColor, qRgb(255, 255, 255));
+	addEvent(trace, StrokeTrace::eventPenStyle, DrawingBoard::styleSolidLine);
+	addEvent(trace, StrokeTrace::eventEmptyFill);
+}
+
+/**
+* Adds an event one mouse interval after the previous one
+* @param StrokeTrace* trace - The trace
+* @param int type - The event type
+* @param quint32 value - The new setting
+* @param QPoint pos - The mouse position
+* @param int buttons - The mouse buttons
+*/
+void ReplayBenchmark::addEvent(StrokeTrace *trace, int type, quint32 value, const QPoint &pos, int buttons)
+{
+	StrokeTrace::Event event;
+	event.type = type;
+	event.time = syntheticTime;
+	event.pos = pos;
+	event.buttons = buttons;
+	event.value = value;
+	trace->append(event);
+	syntheticTime += syntheticInterval;
+}
+
+/**
+* Adds a left button drag along a straight line
+* @param StrokeTrace* trace - The trace
+* @param QPoint from - Where the button is pressed
+* @param QPoint to - Where it is released
+* @param int moves - Number of moves in between
+*/
+void ReplayBenchmark::addDrag(StrokeTrace *trace, const QPoint &from, const QPoint &to, int moves)
+{
+	addEvent(trace, StrokeTrace::eventPress, 0, from, Qt::LeftButton);
+	for (int i = 1; i <= moves; ++i){
+		addEvent(trace, StrokeTrace::eventMove, 0, from + (to - from) * i / moves, Qt::LeftButton);
+	}
+	addEvent(trace, StrokeTrace::eventRelease, 0, to, Qt::LeftButton);
+}
+
+/**
+* Returns a point on the canvas from a fixed sequence, so every run draws the same
+* @return QPoint - The point
+*/
+QPoint ReplayBenchmark::randomPoint()
+{
+	randomState = randomState * 1103515245 + 12345;
+	const int x = (randomState >> 8) % canvasSize.width();
+	randomState = randomState * 1103515245 + 12345;
+	const int y = (randomState >> 8) % canvasSize.height();
+	return QPoint(x, y);
+}
@@ -0,0 +1,48 @@
+#ifndef REPLAYBENCHMARK_H
+#define REPLAYBENCHMARK_H
+
+#include <QJsonObject>
+#include <QSize>
+#include <QString>
+#include <QVector>
+#include "stroketrace.h"
+
+class DrawingBoard;
+
+/**
+* Replays stroke traces on a DrawingBoard and measures every event, from
+* sending it to the board until the repaint it caused is done. The results
+* are JSON objects with latency percentiles, throughput and peak memory.
+*/
+class ReplayBenchmark
+{
+public:
+	ReplayBenchmark(const QSize &newCanvasSize);
+	~ReplayBenchmark();
+	QJsonObject runTrace(const QString &name, const StrokeTrace &trace);
+	QJsonObject runOpenSave(const QString &format, int repetitions);
+	StrokeTrace longFreehand();
+	StrokeTrace rapidShapes();
+	StrokeTrace largeFills();
+	StrokeTrace undoRedoStorm();
+	static QJsonObject statistics(QVector<qint64> nanoseconds, qint64 totalNanoseconds);
+	static void resetPeakMemory();
+	static qint64 peakMemory();
+	static QJsonObject memoryUsage(DrawingBoard *board);
+
+	//Milliseconds between the events of a synthetic trace, like a 125 Hz mouse
+	static const int syntheticInterval = 8;
+
+private:
+	QSize canvasSize;
+	qint64 syntheticTime;
+	quint32 randomState;
+
+	void beginTrace(StrokeTrace *trace);
+	void addEvent(StrokeTrace *trace, int type, quint32 value = 0,
+		const QPoint &pos = QPoint(), int buttons = 0);
+	void addDrag(StrokeTrace *trace, const QPoint &from, const QPoint &to, int moves);
+	QPoint randomPoint();
+};
+
+#endif // REPLAYBENCHMARK_H
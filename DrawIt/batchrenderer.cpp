@@ -0,0 +1,496 @@
+#include "batchrenderer.h"
+
+#include <QAtomicInt>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRegExp>
+#include <QRunnable>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include "tilefile.h"
+
+static QMutex outputMutex;
+
+/**
+* Prints a line to the standard output, lines of different jobs don't mix
+* @param QString message - The line to print
+*/
+static void report(const QString &message)
+{
+	QMutexLocker locker(&outputMutex);
+	QTextStream out(stdout);
+	out << message << '\n';
+}
+
+/**
+* Parses a color name like "red" or "#ff0000"
+* @param QString name - The color name
+* @param QColor* color - Receives the color
+* @return bool - if the name was a valid color
+*/
+static bool parseColor(const QString &name, QColor *color)
+{
+	const QColor parsed(name);
+	if (!parsed.isValid()){
+		return false;
+	}
+	*color = parsed;
+	return true;
+}
+
+/**
+* Parses a point written as x,y
+* @param QString text - The point
+* @param QPoint* point - Receives the point
+* @return bool - if the text was a valid point
+*/
+static bool parsePoint(const QString &text, QPoint *point)
+{
+	const QStringList parts = text.split(',');
+	if (parts.size() != 2){
+		return false;
+	}
+	bool xValid;
+	bool yValid;
+	const int x = parts[0].toInt(&xValid);
+	const int y = parts[1].toInt(&yValid);
+	*point = QPoint(x, y);
+	return xValid && yValid;
+}
+
+/**
+* Resolves a file name of a command against the directory of the job. A
+* confined name has to stay inside that directory once links and .. are
+* followed, a file that doesn't exist yet is checked by its directory
+* @param QDir directory - The directory of the job
+* @param QString name - The file name of the command
+* @param bool confined - if the name has to stay inside the directory
+* @param QString* path - Receives the absolute path
+* @return bool - false if a confined name leads outside of the directory
+*/
+static bool resolvePath(const QDir &directory, const QString &name, bool confined, QString *path)
+{
+	*path = directory.absoluteFilePath(name);
+	if (!confined){
+		return true;
+	}
+	const QString root = directory.canonicalPath();
+	const QFileInfo info(*path);
+	QString resolved;
+	if (info.exists()){
+		resolved = info.canonicalFilePath();
+	}
+	else if (!info.isSymLink()){
+		const QString parent = QFileInfo(info.absolutePath()).canonicalFilePath();
+		if (!parent.isEmpty()){
+			resolved = parent + '/' + info.fileName();
+		}
+	}
+	return !root.isEmpty() && !resolved.isEmpty() && resolved.startsWith(root + '/');
+}
+
+/**
+* Runs one script on a worker thread and reports how it went
+*/
+class BatchJob : public QRunnable
+{
+public:
+	BatchJob(const QString &fileName, QAtomicInt *failures)
+		: fileName(fileName), failures(failures)
+	{
+	}
+
+	void run()
+	{
+		QElapsedTimer timer;
+		timer.start();
+		QString error;
+		if (BatchRenderer::runScript(fileName, &error)){
+			report(QString("ok %1 %2 ms").arg(fileName).arg(timer.elapsed()));
+		}
+		else{
+			failures->ref();
+			report(QString("failed %1").arg(error));
+		}
+	}
+
+private:
+	QString fileName;
+	QAtomicInt *failures;
+};
+
+BatchRenderer::BatchRenderer()
+{
+	threadCount = QThread::idealThreadCount();
+}
+
+BatchRenderer::~BatchRenderer()
+{
+
+}
+
+/**
+* Sets how many scripts are rendered at the same time
+* @param int newThreadCount - The number of worker threads
+*/
+void BatchRenderer::setThreadCount(int newThreadCount)
+{
+	threadCount = qMax(1, newThreadCount);
+}
+
+/**
+* Returns how many scripts are rendered at the same time
+* @return int - The number of worker threads
+*/
+int BatchRenderer::getThreadCount()
+{
+	return threadCount;
+}
+
+/**
+* Renders the scripts on the worker threads and waits for all of them
+* @param QStringList scripts - The script files
+* @return bool - true if every script succeeded
+*/
+bool BatchRenderer::render(const QStringList &scripts)
+{
+	//A pool of its own, the global pool stays free for the png bands the jobs queue
+	QThreadPool pool;
+	pool.setMaxThreadCount(threadCount);
+	QAtomicInt failures(0);
+	foreach(const QString &script, scripts) {
+		pool.start(new BatchJob(script, &failures));
+	}
+	pool.waitForDone();
+	return failures.load() == 0;
+}
+
+/**
+* Runs the batch mode from the command line arguments
+* @param QStringList arguments - The application arguments
+* @return int - The exit code, 0 if every script succeeded
+*/
+int BatchRenderer::exec(const QStringList &arguments)
+{
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Renders drawing scripts without a window.");
+	parser.addHelpOption();
+	QCommandLineOption batchOption("batch", "Render the scripts and exit.");
+	QCommandLineOption jobsOption(QStringList() << "j" << "jobs",
+		"Number of scripts rendered at the same time.", "count",
+		QString::number(QThread::idealThreadCount()));
+	parser.addOption(batchOption);
+	parser.addOption(jobsOption);
+	parser.addPositionalArgument("scripts", "Drawing scripts to render.", "<script>...");
+	parser.process(arguments);
+
+	const QStringList scripts = parser.positionalArguments();
+	if (scripts.isEmpty()){
+		parser.showHelp(1);
+	}
+
+	BatchRenderer renderer;
+	renderer.setThreadCount(parser.value(jobsOption).toInt());
+	QElapsedTimer timer;
+	timer.start();
+	const bool succeeded = renderer.render(scripts);
+	report(QString("%1 scripts on %2 threads in %3 ms")
+		.arg(scripts.size()).arg(renderer.getThreadCount()).arg(timer.elapsed()));
+	return succeeded ? 0 : 1;
+}
+
+/**
+* Runs every command of a script on a new engine
+* @param QString fileName - The script file
+* @param QString* error - Receives the file, line and reason when it fails
+* @return bool - if the whole script succeeded
+*/
+bool BatchRenderer::runScript(const QString &fileName, QString *error)
+{
+	DrawingEngine engine(QSize(defaultCanvasWidth, defaultCanvasHeight));
+	return runScript(&engine, fileName, error);
+}
+
+/**
+* Runs every command of a script on an engine
+* @param DrawingEngine* engine - The engine to draw with
+* @param QString fileName - The script file
+* @param QString* error - Receives the file, line and reason when it fails
+* @param bool saving - if false the save commands are skipped
+* @return bool - if the whole script succeeded
+*/
+bool BatchRenderer::runScript(DrawingEngine *engine, const QString &fileName, QString *error,
+	bool saving)
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text)){
+		*error = QString("%1: could not be read").arg(fileName);
+		return false;
+	}
+	const QDir directory = QFileInfo(fileName).absoluteDir();
+	QTextStream stream(&file);
+	int lineNumber = 0;
+	while (!stream.atEnd()){
+		const QString line = stream.readLine();
+		++lineNumber;
+		if (!saving && line.trimmed().section(' ', 0, 0).toLower() == "save"){
+			continue;
+		}
+		QString commandError;
+		if (!runCommand(engine, line, directory, &commandError)){
+			*error = QString("%1:%2: %3").arg(fileName).arg(lineNumber).arg(commandError);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+* Runs one script command on an engine
+* @param DrawingEngine* engine - The engine to draw with
+* @param QString line - The command line
+* @param QDir directory - Directory relative file names are resolved against
+* @param QString* error - Receives the reason when it fails
+* @param bool confined - if files outside of the directory and canvases above
+* the threshold of the TileFile are refused, for commands of socket clients
+* @return bool - if the command succeeded
+*/
+bool BatchRenderer::runCommand(DrawingEngine *engine, const QString &line,
+	const QDir &directory, QString *error, bool confined)
+{
+	const QString trimmed = line.trimmed();
+	if (trimmed.isEmpty() || trimmed.startsWith('#')){
+		return true;
+	}
+	const QStringList words = trimmed.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+	const QString command = words.first().toLower();
+	const QStringList arguments = words.mid(1);
+	QColor color;
+
+	if (command == "canvas"){
+		bool widthValid;
+		bool heightValid;
+		const int width = arguments.value(0).toInt(&widthValid);
+		const int height = arguments.value(1).toInt(&heightValid);
+		if (!widthValid || !heightValid || width <= 0 || height <= 0){
+			*error = "canvas needs a width and a height";
+			return false;
+		}
+		if (confined && qint64(width) * height * 4 > TileFile::global()->threshold()){
+			*error = QString("canvas %1x%2 is larger than %3 MB").arg(width).arg(height)
+				.arg(TileFile::global()->threshold() >> 20);
+			return false;
+		}
+		color = Qt::white;
+		if (arguments.size() > 2 && !parseColor(arguments[2], &color)){
+			*error = QString("unknown color %1").arg(arguments[2]);
+			return false;
+		}
+		engine->newCanvas(QSize(width, height), color);
+	}
+	else if (command == "open"){
+		QString fileName;
+		if (!arguments.isEmpty() && !resolvePath(directory, arguments[0], confined, &fileName)){
+			*error = QString("%1 is outside of the job directory").arg(arguments[0]);
+			return false;
+		}
+		if (arguments.isEmpty() || !engine->openImage(fileName)){
+			*error = QString("could not open %1").arg(arguments.value(0));
+			return false;
+		}
+	}
+	else if (command == "background" || command == "primary" || command == "secondary"){
+		if (!parseColor(arguments.value(0), &color)){
+			*error = QString("unknown color %1").arg(arguments.value(0));
+			return false;
+		}
+		if (command == "background"){
+			engine->setBackgroundColor(color);
+		}
+		else if (command == "primary"){
+			engine->setPrimaryColor(color);
+		}
+		else{
+			engine->setSecondaryColor(color);
+		}
+	}
+	else if (command == "pen"){
+		bool widthValid;
+		const int width = arguments.value(0).toInt(&widthValid);
+		if (!widthValid || width <= 0){
+			*error = "pen needs a width";
+			return false;
+		}
+		engine->setPenWidth(width);
+		const QString style = arguments.value(1, "solid").toLower();
+		if (style == "solid"){
+			engine->setPenStyle(DrawingEngine::styleSolidLine);
+		}
+		else if (style == "dash"){
+			engine->setPenStyle(DrawingEngine::styleDashedLine);
+		}
+		else if (style == "dot"){
+			engine->setPenStyle(DrawingEngine::styleDottedLine);
+		}
+		else if (style == "dashdot"){
+			engine->setPenStyle(DrawingEngine::styleDashedDottedLine);
+		}
+		else{
+			*error = QString("unknown pen style %1").arg(style);
+			return false;
+		}
+	}
+	else if (command == "fill"){
+		if (arguments.value(0).toLower() == "none"){
+			engine->setEmptyFill();
+		}
+		else if (parseColor(arguments.value(0), &color)){
+			engine->setColorFill(color);
+		}
+		else{
+			*error = QString("unknown color %1").arg(arguments.value(0));
+			return false;
+		}
+	}
+	else if (command == "tolerance"){
+		bool toleranceValid;
+		const int tolerance = arguments.value(0).toInt(&toleranceValid);
+		if (!toleranceValid || tolerance < 0 || tolerance > 255){
+			*error = "tolerance needs a value from 0 to 255";
+			return false;
+		}
+		engine->setFillTolerance(tolerance);
+	}
+	else if (command == "mode"){
+		const QString mode = arguments.value(0).toLower();
+		if (mode == "freehand"){
+			engine->setPaintMode(DrawingEngine::modeFreehand);
+		}
+		else if (mode == "line"){
+			engine->setPaintMode(DrawingEngine::modeLine);
+		}
+		else if (mode == "circle"){
+			engine->setPaintMode(DrawingEngine::modeCircle);
+		}
+		else if (mode == "rectangle"){
+			engine->setPaintMode(DrawingEngine::modeRectangle);
+		}
+		else if (mode == "bucket"){
+			engine->setPaintMode(DrawingEngine::modeFill);
+		}
+		else if (mode == "select-rectangle"){
+			engine->setPaintMode(DrawingEngine::modeSelectRectangle);
+		}
+		else if (mode == "select-ellipse"){
+			engine->setPaintMode(DrawingEngine::modeSelectEllipse);
+		}
+		else if (mode == "wand"){
+			engine->setPaintMode(DrawingEngine::modeMagicWand);
+		}
+		else{
+			*error = QString("unknown mode %1").arg(mode);
+			return false;
+		}
+	}
+	else if (command == "selection"){
+		const QString operation = arguments.value(0).toLower();
+		if (operation == "replace"){
+			engine->setSelectionCombine(SelectionMask::combineReplace);
+		}
+		else if (operation == "add"){
+			engine->setSelectionCombine(SelectionMask::combineAdd);
+		}
+		else if (operation == "subtract"){
+			engine->setSelectionCombine(SelectionMask::combineSubtract);
+		}
+		else if (operation == "intersect"){
+			engine->setSelectionCombine(SelectionMask::combineIntersect);
+		}
+		else if (operation == "all"){
+			engine->selectAll();
+		}
+		else if (operation == "none"){
+			engine->deselect();
+		}
+		else if (operation == "invert"){
+			engine->invertSelection();
+		}
+		else if (operation == "fill"){
+			engine->fillSelection();
+		}
+		else{
+			*error = QString("unknown selection operation %1").arg(operation);
+			return false;
+		}
+	}
+	else if (command == "stroke"){
+		Qt::MouseButton button = Qt::LeftButton;
+		QStringList pointArguments = arguments;
+		if (!pointArguments.isEmpty() && pointArguments.first().toLower() == "right"){
+			button = Qt::RightButton;
+			pointArguments.removeFirst();
+		}
+		else if (!pointArguments.isEmpty() && pointArguments.first().toLower() == "left"){
+			pointArguments.removeFirst();
+		}
+		QVector<QPoint> points;
+		foreach(const QString &argument, pointArguments) {
+			QPoint point;
+			if (!parsePoint(argument, &point)){
+				*error = QString("invalid point %1").arg(argument);
+				return false;
+			}
+			points.append(point);
+		}
+		if (points.isEmpty()){
+			*error = "stroke needs at least one point";
+			return false;
+		}
+		engine->mousePress(points.first(), button);
+		//Shapes only depend on the first and last point, the moves would just redraw the preview
+		if (engine->getPaintMode() == DrawingEngine::modeFreehand){
+			for (int i = 1; i < points.size(); ++i){
+				engine->mouseMove(points[i], button);
+			}
+		}
+		engine->mouseRelease(points.last(), button);
+	}
+	else if (command == "undo"){
+		engine->undo();
+	}
+	else if (command == "redo"){
+		engine->redo();
+	}
+	else if (command == "save"){
+		if (arguments.isEmpty()){
+			*error = "save needs a file name";
+			return false;
+		}
+		QString fileName;
+		if (!resolvePath(directory, arguments[0], confined, &fileName)){
+			*error = QString("%1 is outside of the job directory").arg(arguments[0]);
+			return false;
+		}
+		QString format = arguments.value(1, QFileInfo(fileName).suffix()).toLower();
+		if (format.isEmpty()){
+			format = "png";
+		}
+		const QByteArray fileFormat = format.toLatin1();
+		if (!engine->saveImage(fileName, fileFormat.constData())){
+			*error = QString("could not save %1").arg(fileName);
+			return false;
+		}
+	}
+	else{
+		*error = QString("unknown command %1").arg(command);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,62 @@
+#ifndef BATCHRENDERER_H
+#define BATCHRENDERER_H
+
+#include <QDir>
+#include <QString>
+#include <QStringList>
+#include "drawingengine.h"
+
+/**
+* Renders drawing scripts without a window, one DrawingEngine per script on a
+* pool of worker threads. A script has one command per line, # starts a comment.
+* Relative file names are resolved against the directory of the script.
+* Commands from a socket client run confined: open and save may only name
+* files inside the directory of the job, and the canvas may not take more
+* memory than the threshold of the TileFile.
+*
+*   canvas <width> <height> [color]   starts a new canvas, white by default
+*   open <file>                       loads an input image
+*   background <color>                clears the canvas with a color
+*   primary <color>                   color used by strokes with the left button
+*   secondary <color>                 color used by strokes with the right button
+*   pen <width> [solid|dash|dot|dashdot]
+*   fill <color>|none                 fill color for circles and rectangles
+*   mode freehand|line|circle|rectangle|bucket|select-rectangle|select-ellipse|wand
+*   tolerance <0-255>                 largest channel difference the bucket and
+*                                     the wand spread over
+*   selection replace|add|subtract|intersect
+*                                     how the marquees and the wand change the selection
+*   selection all|none|invert|fill    selects the canvas, nothing or the rest,
+*                                     or fills the selection with the primary color
+*   stroke [left|right] <x,y> [<x,y> ...]
+*                                     presses at the first point, moves through
+*                                     the others and releases at the last one,
+*                                     with the left button by default
+*   undo
+*   redo
+*   save <file> [format]              format defaults to the file suffix
+*/
+class BatchRenderer
+{
+public:
+	BatchRenderer();
+	~BatchRenderer();
+	void setThreadCount(int newThreadCount);
+	int getThreadCount();
+	bool render(const QStringList &scripts);
+	static int exec(const QStringList &arguments);
+	static bool runScript(const QString &fileName, QString *error);
+	static bool runScript(DrawingEngine *engine, const QString &fileName, QString *error,
+		bool saving = true);
+	static bool runCommand(DrawingEngine *engine, const QString &line,
+		const QDir &directory, QString *error, bool confined = false);
+
+	//Canvas size of a script that doesn't start with a canvas command
+	static const int defaultCanvasWidth = 800;
+	static const int defaultCanvasHeight = 600;
+
+private:
+	int threadCount;
+};
+
+#endif // BATCHRENDERER_H
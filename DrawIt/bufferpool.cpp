@@ -0,0 +1,299 @@
+#include "bufferpool.h"
+
+#include <QGlobalStatic>
+#include <QMutexLocker>
+#include <cstdlib>
+#include <cstring>
+#ifdef Q_OS_WIN
+#include <malloc.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/mman.h>
+#endif
+
+/**
+* The only BufferPool, the constructor is private to the class and its friends
+*/
+struct GlobalBufferPool
+{
+	BufferPool pool;
+};
+
+Q_GLOBAL_STATIC(GlobalBufferPool, globalPool)
+
+BufferPool::BufferPool()
+{
+	idleTotal = 0;
+	allocations = 0;
+	reuses = 0;
+	clock.start();
+	hugePages = qgetenv("DRAWIT_HUGE_PAGES") == "1";
+}
+
+BufferPool::~BufferPool()
+{
+	trim();
+}
+
+/**
+* Returns the pool the drawing code shares
+* @return BufferPool* - The pool
+*/
+BufferPool *BufferPool::global()
+{
+	return &globalPool()->pool;
+}
+
+/**
+* Makes an uninitialized image over a pooled buffer. Only formats with 32
+* bits per pixel are supported
+* @param QSize size - The image size
+* @param QImage::Format format - The pixel format
+* @return QImage - The image, it gives the buffer back when its last copy goes away
+*/
+QImage BufferPool::image(const QSize &size, QImage::Format format)
+{
+	if (size.isEmpty()){
+		return QImage();
+	}
+	const int bytesPerLine = (size.width() * 4 + alignment - 1) / alignment * alignment;
+	Block *block = take(qint64(bytesPerLine) * size.height());
+	if (!block){
+		return QImage(size, format);
+	}
+	return QImage(block->data, size.width(), size.height(), bytesPerLine, format, release, block);
+}
+
+/**
+* Copies an image into a pooled buffer, used instead of letting QImage
+* detach into a buffer of its own
+* @param QImage source - An image with 32 bits per pixel
+* @return QImage - The copy
+*/
+QImage BufferPool::copy(const QImage &source)
+{
+	QImage copied = image(source.size(), source.format());
+	const int rowBytes = source.width() * 4;
+	for (int y = 0; y < source.height(); ++y){
+		memcpy(copied.scanLine(y), source.constScanLine(y), rowBytes);
+	}
+	return copied;
+}
+
+/**
+* Turns the huge page backing of large buffers on or off, only on Linux
+* @param bool enabled - if large buffers should use huge pages
+*/
+void BufferPool::setHugePages(bool enabled)
+{
+	QMutexLocker locker(&mutex);
+	hugePages = enabled;
+}
+
+/**
+* Checks if large buffers are backed by huge pages
+* @return bool - true if they are
+*/
+bool BufferPool::usesHugePages()
+{
+	QMutexLocker locker(&mutex);
+	return hugePages;
+}
+
+/**
+* Returns the memory of the buffers waiting to be reused
+* @return qint64 - The bytes
+*/
+qint64 BufferPool::idleBytes()
+{
+	QMutexLocker locker(&mutex);
+	return idleTotal;
+}
+
+/**
+* Returns how many buffers were taken from the system
+* @return qint64 - The number of allocations
+*/
+qint64 BufferPool::allocationCount()
+{
+	QMutexLocker locker(&mutex);
+	return allocations;
+}
+
+/**
+* Returns how many buffers were handed out again
+* @return qint64 - The number of reuses
+*/
+qint64 BufferPool::reuseCount()
+{
+	QMutexLocker locker(&mutex);
+	return reuses;
+}
+
+/**
+* Gives every buffer waiting to be reused back to the system
+*/
+void BufferPool::trim()
+{
+	QMutexLocker locker(&mutex);
+	foreach(const QList<Block *> &blocks, idle) {
+		foreach(Block *block, blocks) {
+			freeBlock(block);
+		}
+	}
+	idle.clear();
+	sizeOrder.clear();
+	lastUsed.clear();
+	idleTotal = 0;
+}
+
+/**
+* Takes a free buffer of the size, or allocates one
+* @param qint64 bytes - The buffer size
+* @return Block* - The buffer, 0 if there was no memory
+*/
+BufferPool::Block *BufferPool::take(qint64 bytes)
+{
+	QMutexLocker locker(&mutex);
+	evict(0);
+	QHash<qint64, QList<Block *> >::iterator free = idle.find(bytes);
+	if (free != idle.end() && !free->isEmpty()){
+		Block *block = free->takeLast();
+		idleTotal -= bytes;
+		++reuses;
+		if (free->isEmpty()){
+			idle.erase(free);
+			sizeOrder.removeOne(bytes);
+			lastUsed.remove(bytes);
+		}
+		else{
+			touch(bytes);
+		}
+		return block;
+	}
+	Block *block = new Block;
+	block->bytes = bytes;
+	block->mapped = false;
+	block->data = 0;
+#ifdef Q_OS_LINUX
+	if (hugePages && bytes >= hugePageSize){
+		void *mapped = mmap(0, size_t(bytes), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapped != MAP_FAILED){
+			madvise(mapped, size_t(bytes), MADV_HUGEPAGE);
+			block->data = static_cast<uchar *>(mapped);
+			block->mapped = true;
+		}
+	}
+#endif
+	if (!block->data){
+#ifdef Q_OS_WIN
+		block->data = static_cast<uchar *>(_aligned_malloc(size_t(bytes), alignment));
+#else
+		void *allocated = 0;
+		if (posix_memalign(&allocated, alignment, size_t(bytes)) == 0){
+			block->data = static_cast<uchar *>(allocated);
+		}
+#endif
+	}
+	if (!block->data){
+		delete block;
+		return 0;
+	}
+	++allocations;
+	return block;
+}
+
+/**
+* Keeps a buffer for reuse, the sizes used least recently are freed to make room
+* @param Block* block - The buffer
+*/
+void BufferPool::give(Block *block)
+{
+	QMutexLocker locker(&mutex);
+	if (block->bytes > maximumIdleBytes){
+		freeBlock(block);
+		return;
+	}
+	evict(block->bytes);
+	idle[block->bytes].append(block);
+	idleTotal += block->bytes;
+	touch(block->bytes);
+}
+
+/**
+* Moves a size to the end of the least recently used order. Call with the mutex locked
+* @param qint64 bytes - The buffer size
+*/
+void BufferPool::touch(qint64 bytes)
+{
+	sizeOrder.removeOne(bytes);
+	sizeOrder.append(bytes);
+	lastUsed[bytes] = clock.elapsed();
+}
+
+/**
+* Frees the sizes used least recently until there is room for more free
+* buffers, and every size that wasn't used within idleTimeout. Call with
+* the mutex locked
+* @param qint64 needed - The bytes that have to fit
+*/
+void BufferPool::evict(qint64 needed)
+{
+	const qint64 now = clock.elapsed();
+	while (!sizeOrder.isEmpty()){
+		const qint64 bytes = sizeOrder.first();
+		if (idleTotal + needed <= maximumIdleBytes && now - lastUsed.value(bytes) < idleTimeout){
+			break;
+		}
+		freeSize(bytes);
+	}
+}
+
+/**
+* Gives the free buffers of one size back to the system. Call with the mutex locked
+* @param qint64 bytes - The buffer size
+*/
+void BufferPool::freeSize(qint64 bytes)
+{
+	foreach(Block *block, idle.take(bytes)) {
+		freeBlock(block);
+		idleTotal -= bytes;
+	}
+	sizeOrder.removeOne(bytes);
+	lastUsed.remove(bytes);
+}
+
+/**
+* Cleanup function of the pooled images
+* @param void* block - The Block of the image
+*/
+void BufferPool::release(void *block)
+{
+	//Images can outlive the pool at exit
+	if (globalPool.isDestroyed()){
+		freeBlock(static_cast<Block *>(block));
+		return;
+	}
+	globalPool()->pool.give(static_cast<Block *>(block));
+}
+
+/**
+* Gives a buffer back to the system
+* @param Block* block - The buffer
+*/
+void BufferPool::freeBlock(Block *block)
+{
+#ifdef Q_OS_LINUX
+	if (block->mapped){
+		munmap(block->data, size_t(block->bytes));
+		delete block;
+		return;
+	}
+#endif
+#ifdef Q_OS_WIN
+	_aligned_free(block->data);
+#else
+	free(block->data);
+#endif
+	delete block;
+}
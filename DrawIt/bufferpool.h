@@ -0,0 +1,80 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QSize>
+
+/**
+* Hands out pixel buffers for the canvas tiles, the overlay and resized
+* images, and takes them back when the last QImage using one goes away.
+* Buffers start on a 64 byte boundary and every row is padded to one, freed
+* buffers are kept by size and given out again, so drawing that keeps
+* detaching tiles of the same size doesn't allocate once the pool is warm.
+* When the free buffers grow past maximumIdleBytes, the sizes used least
+* recently are given back to the system first. A size not asked for within
+* idleTimeout is given back the next time the pool is used. There is one
+* pool, global(), the buffers of every image it hands out go back to it.
+*
+* On Linux large buffers can be backed by transparent huge pages, set
+* DRAWIT_HUGE_PAGES=1 or call setHugePages().
+*/
+class BufferPool
+{
+public:
+	static BufferPool *global();
+	QImage image(const QSize &size, QImage::Format format);
+	QImage copy(const QImage &source);
+	void setHugePages(bool enabled);
+	bool usesHugePages();
+	qint64 idleBytes();
+	qint64 allocationCount();
+	qint64 reuseCount();
+	void trim();
+
+	//Alignment of the buffers and their rows
+	static const int alignment = 64;
+	//Free buffers kept for reuse, larger ones are given back to the system
+	static const int maximumIdleBytes = 256 * 1024 * 1024;
+	//Milliseconds the free buffers of a size are kept without being used
+	static const int idleTimeout = 30000;
+	//Buffers from this size on are mapped on huge pages when they are enabled
+	static const int hugePageSize = 2 * 1024 * 1024;
+
+private:
+	//Holds the instance global() returns
+	friend struct GlobalBufferPool;
+
+	struct Block
+	{
+		uchar *data;
+		qint64 bytes;
+		bool mapped;
+	};
+
+	QMutex mutex;
+	QHash<qint64, QList<Block *> > idle;
+	//Sizes with free buffers, least recently used first
+	QList<qint64> sizeOrder;
+	QHash<qint64, qint64> lastUsed;
+	QElapsedTimer clock;
+	qint64 idleTotal;
+	qint64 allocations;
+	qint64 reuses;
+	bool hugePages;
+
+	BufferPool();
+	~BufferPool();
+	Block *take(qint64 bytes);
+	void give(Block *block);
+	void touch(qint64 bytes);
+	void evict(qint64 needed);
+	void freeSize(qint64 bytes);
+	static void release(void *block);
+	static void freeBlock(Block *block);
+};
+
+#endif // BUFFERPOOL_H
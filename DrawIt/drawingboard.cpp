@@ -1,32 +1,26 @@
 #include "drawingboard.h"
+#include "tracelog.h"
+
+#include <QtMath>
 
 DrawingBoard::DrawingBoard(int posX, int posY, int width, int height, QWidget *parent)
-	: QWidget(parent)
+	: QWidget(parent), engine(QSize(width, height))
 {
 	setGeometry(posX, posY, width, height);
-
-	modified = false;
-	scribbling = false;
-	fill = false;
-	
-	undoImageCounter = 0;
-	currentImageCounter = 0;
-	penWidth = 1;
-	primaryColor = Qt::black;
-	secondaryColor = Qt::white;
-	penColor = primaryColor;
-	penStyle = Qt::SolidLine;
-	paintMode = modeFreehand;
-
-	
-
-	currentImage[0] = QImage(QSize(width, height), QImage::Format_RGB32);
-	currentImage[0].fill(qRgb(255, 255, 255));
-
-	tempImage = QImage(QSize(width, height), QImage::Format_ARGB32);
-	tempImage.fill(qRgba(0, 0, 0, 0));
-
 	setCursor(Qt::CrossCursor);
+	recording = false;
+	latencyProbe = 0;
+	hudVisible = false;
+	hudInputArrival = 0;
+	timestampOffset = 0;
+	timestampOffsetKnown = false;
+	inputClock.start();
+	memoryWarning = 0;
+	memoryWarned = false;
+	panning = false;
+	engine.setExpandable(true);
+	hudTimer.setInterval(PerformanceHud::refreshInterval);
+	connect(&hudTimer, SIGNAL(timeout()), this, SLOT(refreshHud()));
 }
 
 DrawingBoard::~DrawingBoard()
@@ -40,7 +34,8 @@ DrawingBoard::~DrawingBoard()
 */
 void DrawingBoard::setPrimaryColor(const QColor &newColor)
 {
-	primaryColor = newColor;
+	engine.setPrimaryColor(newColor);
+	record(StrokeTrace::eventPrimaryColor, newColor.rgba());
 }
 
 /**
@@ -49,7 +44,8 @@ void DrawingBoard::setPrimaryColor(const QColor &newColor)
 */
 void DrawingBoard::setSecondaryColor(const QColor &newColor)
 {
-	secondaryColor = newColor;
+	engine.setSecondaryColor(newColor);
+	record(StrokeTrace::eventSecondaryColor, newColor.rgba());
 }
 
 /**
@@ -58,7 +54,8 @@ void DrawingBoard::setSecondaryColor(const QColor &newColor)
 */
 void DrawingBoard::setPenWidth(int newWidth)
 {
-	penWidth = newWidth;
+	engine.setPenWidth(newWidth);
+	record(StrokeTrace::eventPenWidth, newWidth);
 }
 
 /**
@@ -67,8 +64,8 @@ void DrawingBoard::setPenWidth(int newWidth)
 */
 void DrawingBoard::setColorFill(const QColor &newColor)
 {
-	fillColor = newColor;
-	fill = true;
+	engine.setColorFill(newColor);
+	record(StrokeTrace::eventColorFill, newColor.rgba());
 }
 
 /**
@@ -76,7 +73,8 @@ void DrawingBoard::setColorFill(const QColor &newColor)
 */
 void DrawingBoard::setEmptyFill()
 {
-	fill = false;
+	engine.setEmptyFill();
+	record(StrokeTrace::eventEmptyFill);
 }
 
 /**
@@ -84,11 +82,29 @@ void DrawingBoard::setEmptyFill()
 */
 void DrawingBoard::setBackgroundColor(const QColor &newColor)
 {
-	checkImageCount();
-	tempImage.fill(qRgba(0, 0, 0, 0));
-	currentImage[currentImageCounter].fill(newColor);
-	update();
-	modified = true;
+	engine.setBackgroundColor(newColor);
+	record(StrokeTrace::eventBackground, newColor.rgba());
+	updateDirtyRect();
+}
+
+/**
+* Sets the speed/ratio preset used when saving as png
+* @param int newPngPreset - One of the PngWriter presets
+*/
+void DrawingBoard::setPngPreset(int newPngPreset)
+{
+	engine.setPngPreset(newPngPreset);
+}
+
+/**
+* Sets how much a color may differ from the clicked one for the paint bucket
+* to fill over it
+* @param int newTolerance - The largest difference per color channel, 0 to 255
+*/
+void DrawingBoard::setFillTolerance(int newTolerance)
+{
+	engine.setFillTolerance(newTolerance);
+	record(StrokeTrace::eventFillTolerance, newTolerance);
 }
 
 /**
@@ -96,7 +112,7 @@ void DrawingBoard::setBackgroundColor(const QColor &newColor)
 * @return QColor - The primary color
 */
 QColor DrawingBoard::getPrimaryColor(){
-	return primaryColor;
+	return engine.getPrimaryColor();
 }
 
 /**
@@ -104,7 +120,7 @@ QColor DrawingBoard::getPrimaryColor(){
 * @return QColor - The secondary color
 */
 QColor DrawingBoard::getSecondaryColor(){
-	return secondaryColor;
+	return engine.getSecondaryColor();
 }
 
 /**
@@ -112,7 +128,7 @@ QColor DrawingBoard::getSecondaryColor(){
 * @return QColor - The fill color
 */
 QColor DrawingBoard::getFillColor(){
-	return fillColor;
+	return engine.getFillColor();
 }
 
 /**
@@ -120,7 +136,23 @@ QColor DrawingBoard::getFillColor(){
 * @return int - The pen width
 */
 int DrawingBoard::getPenWidth(){
-	return penWidth;
+	return engine.getPenWidth();
+}
+
+/**
+* Returns the png preset
+* @return int - The png preset
+*/
+int DrawingBoard::getPngPreset(){
+	return engine.getPngPreset();
+}
+
+/**
+* Returns the tolerance of the paint bucket
+* @return int - The largest difference per color channel
+*/
+int DrawingBoard::getFillTolerance(){
+	return engine.getFillTolerance();
 }
 
 /**
@@ -129,10 +161,29 @@ int DrawingBoard::getPenWidth(){
 * @param QPaintEvent* event - Pointer to QPaintEvent
 */
 void DrawingBoard::paintEvent(QPaintEvent *event){
+	TRACE_ZONE("DrawingBoard::paintEvent");
+	const qint64 paintStart = hudVisible ? hud.now() : 0;
 	QPainter painter(this);
 	QRect dirtyRect = event->rect();
-	painter.drawImage(dirtyRect, currentImage[currentImageCounter], dirtyRect);
-	painter.drawImage(dirtyRect, tempImage, dirtyRect);
+	painter.scale(engine.getZoom(), engine.getZoom());
+	painter.translate(-engine.getViewOrigin());
+	engine.canvas().draw(&painter, canvasArea(dirtyRect), engine.getZoom());
+	engine.selection().draw(&painter, canvasArea(dirtyRect), QColor(0, 120, 215, 60), engine.getZoom());
+	painter.resetTransform();
+	painter.drawImage(dirtyRect, engine.overlay(), dirtyRect);
+	if (latencyProbe){
+		latencyProbe->presented(event->region());
+	}
+	if (hudVisible){
+		hud.framePainted(paintStart, dirtyRect);
+		if (hud.needsRefresh()){
+			const DrawingEngine::MemoryUsage usage = engine.memoryUsage();
+			hud.refresh(engine.historyCount(), usage, memoryWarning > 0 && usage.total() > memoryWarning);
+		}
+		if (dirtyRect.intersects(hud.rect())){
+			hud.draw(&painter);
+		}
+	}
 }
 
 /**
@@ -140,19 +191,17 @@ void DrawingBoard::paintEvent(QPaintEvent *event){
 * @param QMouseEvent* event - Pointer to QMouseEvent
 */
 void DrawingBoard::mousePressEvent(QMouseEvent* event){
-	checkImageCount();
-	if (event->button() == Qt::LeftButton) {
-		penColor = primaryColor;
-		lastPoint = event->pos();
-		startPoint = event->pos();
-		scribbling = true;
-	}
-	else if (event->button() == Qt::RightButton){
-		penColor = secondaryColor;
-		lastPoint = event->pos();
-		startPoint = event->pos();
-		scribbling = true;
+	TRACE_ZONE("DrawingBoard::mousePressEvent");
+	if (event->button() == Qt::MiddleButton){
+		panning = true;
+		panPosition = event->pos();
+		return;
 	}
+	const qint64 arrival = inputArrival(event);
+	const QPoint pos = canvasPosition(event->pos());
+	engine.mousePress(pos, event->button());
+	record(StrokeTrace::eventPress, 0, pos, event->button());
+	updateDirtyRect(arrival, LatencyProbe::toolName(engine.getPaintMode()));
 }
 
 /**
@@ -161,12 +210,17 @@ void DrawingBoard::mousePressEvent(QMouseEvent* event){
 */
 void DrawingBoard::mouseMoveEvent(QMouseEvent *event)
 {
-	if ((event->buttons() & Qt::LeftButton) && scribbling){
-		Draw(event);
-	}
-	else if ((event->buttons() & Qt::RightButton) && scribbling){
-		Draw(event);
+	TRACE_ZONE("DrawingBoard::mouseMoveEvent");
+	if (panning){
+		scrollBy(panPosition - event->pos());
+		panPosition = event->pos();
+		return;
 	}
+	const qint64 arrival = inputArrival(event);
+	const QPoint pos = canvasPosition(event->pos());
+	engine.mouseMove(pos, event->buttons());
+	record(StrokeTrace::eventMove, 0, pos, event->buttons());
+	updateDirtyRect(arrival, LatencyProbe::toolName(engine.getPaintMode()));
 }
 
 /**
@@ -175,256 +229,627 @@ void DrawingBoard::mouseMoveEvent(QMouseEvent *event)
 */
 void DrawingBoard::mouseReleaseEvent(QMouseEvent *event)
 {
-	if (event->button() == Qt::LeftButton && scribbling) {
-		scribbling = false;
-		Draw(event);
-	}
-	else if (event->button() == Qt::RightButton && scribbling) {
-		scribbling = false;
-		Draw(event);
+	TRACE_ZONE("DrawingBoard::mouseReleaseEvent");
+	if (event->button() == Qt::MiddleButton){
+		panning = false;
+		return;
 	}
-	modified = true;
+	const qint64 arrival = inputArrival(event);
+	const QPoint pos = canvasPosition(event->pos());
+	engine.mouseRelease(pos, event->button());
+	record(StrokeTrace::eventRelease, 0, pos, event->button());
+	updateDirtyRect(arrival, LatencyProbe::toolName(engine.getPaintMode()));
+	checkMemory();
 }
 
 /**
-* Check the image count if the array of undo images is full rearrange them
-* Otherwise create a new one
+* Scrolls the view, shift turns the wheel sideways. With control held the
+* view is zoomed around the mouse, four steps of the wheel double the zoom
+* @param QWheelEvent* event - Pointer to QWheelEvent
 */
-void DrawingBoard::checkImageCount(){
-	undoImageCounter = 0;
-	undoing = false;
-	if (currentImageCounter < 9){
-		currentImage[currentImageCounter + 1] = currentImage[currentImageCounter];
-		++currentImageCounter;
+void DrawingBoard::wheelEvent(QWheelEvent *event)
+{
+	if (event->modifiers() & Qt::ControlModifier){
+		setZoom(engine.getZoom() * qPow(2.0, event->angleDelta().y() / 480.0), event->pos());
+		event->accept();
+		return;
 	}
-	else{
-		rearrangeImages();
+	QPoint delta = event->angleDelta();
+	if (event->modifiers() & Qt::ShiftModifier){
+		delta = QPoint(delta.y(), delta.x());
 	}
+	scrollBy(-delta);
+	event->accept();
 }
 
 /**
-* Rearrange the array of images that is used for the undo and redo function
+* Stamps the arrival of an input for the overlay and returns it for the latency probe
+* @param QInputEvent* event - The input, 0 for one that didn't come from the window system
+* @return qint64 - The time on the clock of the probe, 0 without one
 */
-void DrawingBoard::rearrangeImages(){
-	for (int i = 0; i < currentImageCounter; ++i){
-		currentImage[i] = currentImage[i + 1];
+qint64 DrawingBoard::inputArrival(const QInputEvent *event){
+	const qint64 queued = queueDelay(event);
+	if (hudVisible){
+		hudInputArrival = hud.now() - queued;
 	}
+	return latencyProbe ? latencyProbe->now() - queued : 0;
 }
 
 /**
-* Set and call the relevant drawing mode
-* @param QMouseEvent* event - Pointer to QMouseEvent
+* Returns how long an input waited in the event queue. The timestamps of the
+* window system are in milliseconds on a clock of its own, the smallest
+* difference to inputClock seen so far is taken as the input that didn't
+* wait. A wait longer than maximumQueueDelay means the clock of the window
+* system jumped or wrapped, the difference is measured again from there
+* @param QInputEvent* event - The input, 0 or without a timestamp for none
+* @return qint64 - The wait in nanoseconds
+*/
+qint64 DrawingBoard::queueDelay(const QInputEvent *event){
+	if (!event || event->timestamp() == 0){
+		return 0;
+	}
+	const qint64 offset = inputClock.nsecsElapsed() - qint64(event->timestamp()) * 1000000;
+	if (!timestampOffsetKnown || offset < timestampOffset
+		|| offset - timestampOffset > maximumQueueDelay * qint64(1000000)){
+		timestampOffset = offset;
+		timestampOffsetKnown = true;
+	}
+	return offset - timestampOffset;
+}
+
+/**
+* Schedules a repaint of the area the engine changed
+* @param qint64 arrival - When the input that changed it arrived, from inputArrival()
+* @param char* tool - The tool the latency probe measures the input for, 0 for none
 */
-void DrawingBoard::Draw(QMouseEvent *event){
-	switch (paintMode){
-		case modeFreehand:
-			drawFreehand(event->pos());
-			break;
-		case modeLine:
-			drawShape(event->pos(), modeLine);
-			break;
-		case modeCircle:
-			drawShape(event->pos(), modeCircle);
-			break;
-		case modeRectangle:
-			drawShape(event->pos(), modeRectangle);
-			break;
+void DrawingBoard::updateDirtyRect(qint64 arrival, const char *tool){
+	const QRect canvasDirtyRect = engine.takeDirtyRect();
+	if (!canvasDirtyRect.isEmpty()){
+		emit changed();
 	}
+	const QRect dirtyRect = boardArea(canvasDirtyRect).intersected(rect());
+	if (!dirtyRect.isEmpty()){
+		if (latencyProbe && tool){
+			latencyProbe->inputHandled(tool, arrival, dirtyRect);
+		}
+		if (hudVisible && tool){
+			hud.inputHandled(hudInputArrival);
+		}
+		update(dirtyRect);
+	}
+}
+
+/**
+* Undo the last action
+*/
+void DrawingBoard::undo(){
+	TRACE_ZONE("DrawingBoard::undo");
+	const qint64 arrival = inputArrival();
+	engine.undo();
+	record(StrokeTrace::eventUndo);
+	updateDirtyRect(arrival, "undo");
+}
+
+/**
+* Redo the last action
+*/
+void DrawingBoard::redo(){
+	TRACE_ZONE("DrawingBoard::redo");
+	const qint64 arrival = inputArrival();
+	engine.redo();
+	record(StrokeTrace::eventRedo);
+	updateDirtyRect(arrival, "redo");
 }
 
 /**
-* Draws the freehand line
-* @param QPoint endPoint - endpoint to draw to
+* Sets the new paint mode
+* @param int newPaintMode - The new paint mode
 */
-void DrawingBoard::drawFreehand(const QPoint &endPoint)
+void DrawingBoard::setPaintMode(int newPaintMode){
+	engine.setPaintMode(newPaintMode);
+	record(StrokeTrace::eventPaintMode, newPaintMode);
+}
+
+/**
+* Sets the pen style to draw with
+* @param int newPenStyle - The new pen style
+*/
+void DrawingBoard::setPenStyle(int newPenStyle){
+	engine.setPenStyle(newPenStyle);
+	record(StrokeTrace::eventPenStyle, newPenStyle);
+}
+
+/**
+* Opens the image file
+* @param QString fileName - The image filename to be loaded
+* @return bool - if the load succeeded
+*/
+bool DrawingBoard::openImage(const QString &fileName)
 {
-	QPainter painter(&currentImage[currentImageCounter]);
-	painter.setPen(QPen(penColor, penWidth, Qt::SolidLine, Qt::RoundCap,
-		Qt::RoundJoin));
-	painter.drawLine(lastPoint, endPoint);
+	TRACE_ZONE("DrawingBoard::openImage");
+	const bool opened = engine.openImage(fileName);
+	updateDirtyRect();
+	checkMemory();
+	return opened;
+}
 
-	int rad = (penWidth / 2) + 2;
-	update(QRect(lastPoint, endPoint).normalized()
-		.adjusted(-rad, -rad, +rad, +rad));
-	lastPoint = endPoint;
+/**
+* Saves the image file
+* @param QString fileName - The image filename to be loaded
+* @return bool - if the save succeeded
+*/
+bool DrawingBoard::saveImage(const QString &fileName, const char *fileFormat)
+{
+	TRACE_ZONE("DrawingBoard::saveImage");
+	return engine.saveImage(fileName, fileFormat);
 }
 
 /**
-* Draws the selected shape
-* @param QPoint endPoint - endpoint to draw to
-* @param int mode - drawing mode to use
+* Checks if the image is modified since the last save
+* @return bool - true if changed
 */
-void DrawingBoard::drawShape(const QPoint &endPoint, int mode){
-	QPainter painter;
-	if (scribbling){
-		tempImage.fill(qRgba(0, 0, 0, 0));
-		update();
-		painter.begin(&tempImage);
+bool DrawingBoard::isModified(){
+	return engine.isModified();
+}
+
+/**
+* Starts a new canvas and clears the history
+* @param QSize newSize - Size of the new canvas
+* @param QColor color - Background color of the new canvas
+*/
+void DrawingBoard::newCanvas(const QSize &newSize, const QColor &color)
+{
+	engine.newCanvas(newSize, color);
+	updateDirtyRect();
+}
+
+/**
+* Starts recording the input on a new white canvas. The current tool
+* settings are recorded first so a replay starts with the same tools
+*/
+void DrawingBoard::startRecording()
+{
+	newCanvas(size());
+	trace.clear();
+	trace.setCanvasSize(size());
+	recording = true;
+	recordingClock.start();
+	record(StrokeTrace::eventPaintMode, engine.getPaintMode());
+	record(StrokeTrace::eventPenWidth, engine.getPenWidth());
+	record(StrokeTrace::eventPenStyle, engine.getPenStyle());
+	record(StrokeTrace::eventFillTolerance, engine.getFillTolerance());
+	record(StrokeTrace::eventPrimaryColor, engine.getPrimaryColor().rgba());
+	record(StrokeTrace::eventSecondaryColor, engine.getSecondaryColor().rgba());
+	if (engine.isFilled()){
+		record(StrokeTrace::eventColorFill, engine.getFillColor().rgba());
 	}
 	else{
-		painter.begin(&currentImage[currentImageCounter]);
+		record(StrokeTrace::eventEmptyFill);
 	}
-	if (fill){
-		painter.setBrush(QBrush(fillColor, Qt::SolidPattern));
-	}	
-	painter.setPen(QPen(penColor, penWidth, penStyle, Qt::RoundCap,
-		Qt::RoundJoin));
-	double const hypotenuse = calculateHypotenuse(endPoint);
-	QPointF const middlePoint = calculateMiddlePoint(endPoint);
-	int const rad = (penWidth / 2) + 2;
-	switch (paintMode){
-		case modeLine:
-			painter.drawLine(startPoint, endPoint);
-			break;
-		case modeCircle:
-			painter.drawEllipse(middlePoint, hypotenuse / 2, hypotenuse / 2);		
-			break;
-		case modeRectangle:		
-			painter.drawRect(startPoint.x(), startPoint.y(), endPoint.x() - startPoint.x(), endPoint.y() - startPoint.y());
-			break;
-	}
-	update(QRect(startPoint, endPoint).normalized()
-		.adjusted(-rad, -rad, +rad, +rad));
 }
 
 /**
-* Calculates the hypotenuse of the triangle thats is made up of the 
-startingpoint, the endpoint and the delta distance in the y direction.
-Used to get the length between the start and endpoint
-* @param QPoint endPoint - endpoint to calculate distance with
+* Stops recording, the recording stays available from getTrace()
 */
-double DrawingBoard::calculateHypotenuse(const QPoint &endPoint){	
-	const double x = abs(endPoint.x() - startPoint.x());
-	const double y = abs(endPoint.y() - startPoint.y());
-	return hypot(x, y);
+void DrawingBoard::stopRecording()
+{
+	recording = false;
 }
 
 /**
-* Calculates the middlepoint between the start and the endpoint
-* @param QPoint endPoint - endpoint to calculate distance with
+* Checks if the input is being recorded
+* @return bool - true if recording
 */
-QPointF DrawingBoard::calculateMiddlePoint(const QPoint &endPoint){
-	const double x = (double)(endPoint.x() + startPoint.x()) / 2;
-	const double y = (double)(endPoint.y() + startPoint.y()) / 2;
-	const QPointF middlePoint(x, y);
-	return middlePoint;
+bool DrawingBoard::isRecording()
+{
+	return recording;
 }
- 
+
 /**
-* Undo the last action
+* Returns the last recording
+* @return StrokeTrace - The recording
 */
-void DrawingBoard::undo(){
-	if (!undoing){
-		undoImageCounter = currentImageCounter;
-		undoing = true;
-	}
-	if (currentImageCounter > 0){		
-		--currentImageCounter;
-		tempImage.fill(qRgba(0, 0, 0, 0));
-		update();
-		
-	}	
+const StrokeTrace &DrawingBoard::getTrace()
+{
+	return trace;
 }
 
 /**
-* Redo the last action
+* Sets the probe that measures the time from input to painted pixels
+* @param LatencyProbe* newLatencyProbe - The probe, 0 to stop measuring
 */
-void DrawingBoard::redo(){
-	if (currentImageCounter < undoImageCounter){
-		++currentImageCounter;
-		update();	
+void DrawingBoard::setLatencyProbe(LatencyProbe *newLatencyProbe)
+{
+	latencyProbe = newLatencyProbe;
+}
+
+/**
+* Shows or hides the performance overlay
+* @param bool visible - if the overlay should be shown
+*/
+void DrawingBoard::setHudVisible(bool visible)
+{
+	hudVisible = visible;
+	if (visible){
+		hudTimer.start();
+	}
+	else{
+		hudTimer.stop();
 	}
+	update(hud.rect());
 }
 
 /**
-* Sets the new paint mode
-* @param int newPaintMode - The new paint mode
+* Checks if the performance overlay is shown
+* @return bool - true if shown
 */
-void DrawingBoard::setPaintMode(int newPaintMode){
-	paintMode = newPaintMode;
+bool DrawingBoard::isHudVisible()
+{
+	return hudVisible;
 }
 
 /**
-* Sets the pen style to draw with
-* @param int newPenStyle - The new pen style
+* Returns the memory the canvas, overlay, history, caches and I/O buffers use
+* @return DrawingEngine::MemoryUsage - The bytes per kind
 */
-void DrawingBoard::setPenStyle(int newPenStyle){
-	
-	switch (newPenStyle){
-		case styleSolidLine:
-			penStyle = Qt::SolidLine;
-			break;
-		case styleDashedLine:
-			penStyle = Qt::DashLine;
-			break;
-		case styleDottedLine:
-			penStyle = Qt::DotLine;
-			break;
-		case styleDashedDottedLine:
-			penStyle = Qt::DashDotLine;
-			break;
+DrawingEngine::MemoryUsage DrawingBoard::memoryUsage()
+{
+	return engine.memoryUsage();
+}
+
+/**
+* Sets the memory above which a warning is logged and the overlay shows the total in red
+* @param qint64 bytes - The warning level, 0 for none
+*/
+void DrawingBoard::setMemoryWarning(qint64 bytes)
+{
+	memoryWarning = bytes;
+	memoryWarned = false;
+}
+
+/**
+* Returns the memory above which a warning is given
+* @return qint64 - The warning level in bytes, 0 for none
+*/
+qint64 DrawingBoard::getMemoryWarning()
+{
+	return memoryWarning;
+}
+
+/**
+* Logs a warning when the memory goes above the warning level, once until it goes below again
+*/
+void DrawingBoard::checkMemory()
+{
+	if (memoryWarning <= 0){
+		return;
+	}
+	const DrawingEngine::MemoryUsage usage = engine.memoryUsage();
+	if (usage.total() <= memoryWarning){
+		memoryWarned = false;
+		return;
+	}
+	if (!memoryWarned){
+		memoryWarned = true;
+		qWarning("Drawing memory %lld MB is above the warning level of %lld MB (canvas %lld, overlay %lld, "
+			"selection %lld, undo %lld, redo %lld, caches %lld, I/O %lld MB)", usage.total() >> 20, memoryWarning >> 20,
+			usage.canvas >> 20, usage.overlay >> 20, usage.selection >> 20, usage.undo >> 20, usage.redo >> 20,
+			usage.caches >> 20, usage.ioBuffers >> 20);
 	}
 }
 
 /**
-* Resizes the given image to the given size
-* @param QImage* image - The image to be resized
-* @param Qsize* newSize - The size to set the image to
+* Moves the view over the canvas, the canvas grows wherever is drawn so the
+* view can go anywhere. The pixels still in view are moved instead of painted again
+* @param QPoint delta - The distance in canvas pixels, positive moves right and down
 */
-void DrawingBoard::resizeImage(QImage *image, const QSize &newSize)
+void DrawingBoard::scrollBy(const QPoint &delta)
 {
-	if (image->size() == newSize)
-	return;
+	TRACE_ZONE("DrawingBoard::scrollBy");
+	if (delta.isNull()){
+		return;
+	}
+	engine.setView(engine.getViewOrigin() + QPointF(delta) / engine.getZoom(), engine.getZoom());
+	if (hudVisible){
+		//The overlay stays in the corner, moved pixels would leave a copy of it behind
+		update();
+	}
+	else{
+		scroll(-delta.x(), -delta.y());
+	}
+	emit changed();
+}
 
-	QImage newImage(newSize, QImage::Format_RGB32);
-	newImage.fill(qRgb(255, 255, 255));
-	QPainter painter(&newImage);
-	painter.drawImage(QPoint(0, 0), *image);
-	*image = newImage;
+/**
+* Returns the canvas point shown in the top left corner
+* @return QPointF - The canvas point
+*/
+QPointF DrawingBoard::getViewOrigin()
+{
+	return engine.getViewOrigin();
 }
 
 /**
-* Opens the image file
-* @param QString fileName - The image filename to be loaded
-* @return bool - if the load succeeded
+* Zooms the view, the canvas point under the anchor stays where it is
+* @param double newZoom - The new scale, kept between minimumZoom and maximumZoom percent
+* @param QPoint anchor - The point on the board to zoom around
 */
-bool DrawingBoard::openImage(const QString &fileName)
+void DrawingBoard::setZoom(double newZoom, const QPoint &anchor)
 {
-	QImage loadedImage;
-	if (!loadedImage.load(fileName)){
-		return false;
-	}	
-	QSize newSize = loadedImage.size().expandedTo(size());
-	resizeImage(&loadedImage, newSize);
-	currentImageCounter = 0;
-	currentImage[currentImageCounter] = loadedImage;
-	modified = false;
+	TRACE_ZONE("DrawingBoard::setZoom");
+	const double zoom = engine.getZoom();
+	newZoom = qBound(minimumZoom / 100.0, newZoom, maximumZoom / 100.0);
+	if (newZoom == zoom){
+		return;
+	}
+	QPointF origin = engine.getViewOrigin() + QPointF(anchor) / zoom - QPointF(anchor) / newZoom;
+	if (newZoom == 1.0){
+		//Whole canvas pixels on whole board pixels, so the canvas is drawn without scaling
+		origin = QPointF(qRound(origin.x()), qRound(origin.y()));
+	}
+	engine.setView(origin, newZoom);
 	update();
-	return true;
+	emit changed();
 }
 
 /**
-* Saves the image file
-* @param QString fileName - The image filename to be loaded
-* @return bool - if the save succeeded
+* Returns the scale the canvas is shown at
+* @return double - The scale, 1 for 100%
 */
-bool DrawingBoard::saveImage(const QString &fileName, const char *fileFormat)
+double DrawingBoard::getZoom()
 {
-	QImage visibleImage = currentImage[currentImageCounter];
+	return engine.getZoom();
+}
 
-	if (visibleImage.save(fileName, fileFormat)) {
-		modified = false;
-		return true;
+/**
+* Moves the view so a canvas point is in the middle of the board
+* @param QPointF canvasPoint - The canvas point
+*/
+void DrawingBoard::centerOn(const QPointF &canvasPoint)
+{
+	const double zoom = engine.getZoom();
+	QPointF origin = canvasPoint - QPointF(width(), height()) / (2 * zoom);
+	if (zoom == 1.0){
+		origin = QPointF(qRound(origin.x()), qRound(origin.y()));
 	}
-	else {
-		return false;
+	if (origin == engine.getViewOrigin()){
+		return;
 	}
+	engine.setView(origin, zoom);
+	update();
+	emit changed();
 }
 
 /**
-* Checks if the image is modified since the last save
-* @return bool - true if changed
+* Returns the canvas pixels the board shows
+* @return QRect - The area on the canvas
 */
-bool DrawingBoard::isModified(){
-	return modified;
+QRect DrawingBoard::visibleArea()
+{
+	return canvasArea(rect());
+}
+
+/**
+* Returns the canvas shown on the board
+* @return TiledCanvas - The canvas, valid until the board changes it
+*/
+const TiledCanvas &DrawingBoard::canvas()
+{
+	return engine.canvas();
+}
+
+/**
+* Returns the layers of the canvas
+* @return LayerStack - The layers, valid until the board changes them
+*/
+const LayerStack &DrawingBoard::layers()
+{
+	return engine.layers();
+}
+
+/**
+* Chooses the layer to draw on
+* @param int index - The index of the layer, 0 is the background
+*/
+void DrawingBoard::setCurrentLayer(int index)
+{
+	engine.setCurrentLayer(index);
+	record(StrokeTrace::eventCurrentLayer, index);
+}
+
+/**
+* Adds an empty layer above the current one to draw on
+*/
+void DrawingBoard::addLayer()
+{
+	engine.addLayer();
+	record(StrokeTrace::eventAddLayer);
+	updateDirtyRect();
+}
+
+/**
+* Removes the current layer
+*/
+void DrawingBoard::removeLayer()
+{
+	engine.removeLayer();
+	record(StrokeTrace::eventRemoveLayer);
+	updateDirtyRect();
+}
+
+/**
+* Moves the current layer to another place in the order
+* @param int to - The index it gets
+*/
+void DrawingBoard::moveLayer(int to)
+{
+	engine.moveLayer(to);
+	record(StrokeTrace::eventMoveLayer, to);
+	updateDirtyRect();
+}
+
+/**
+* Sets the opacity of the current layer
+* @param int percent - The opacity, from 0 to 100
+*/
+void DrawingBoard::setLayerOpacity(int percent)
+{
+	engine.setLayerOpacity(percent);
+	record(StrokeTrace::eventLayerOpacity, percent);
+	updateDirtyRect();
+}
+
+/**
+* Shows or hides a layer
+* @param int index - The index of the layer
+* @param bool visible - if the layer is shown
+*/
+void DrawingBoard::setLayerVisible(int index, bool visible)
+{
+	engine.setLayerVisible(index, visible);
+	record(StrokeTrace::eventLayerVisible, quint32(index) << 1 | (visible ? 1 : 0));
+	updateDirtyRect();
+}
+
+/**
+* Sets how the current layer is blended with the layers below it
+* @param int mode - One of the LayerStack blend modes
+*/
+void DrawingBoard::setLayerBlendMode(int mode)
+{
+	engine.setLayerBlendMode(mode);
+	record(StrokeTrace::eventLayerBlendMode, mode);
+	updateDirtyRect();
+}
+
+/**
+* Returns the selected pixels of the canvas
+* @return SelectionMask - The selection, valid until the board changes it
+*/
+const SelectionMask &DrawingBoard::selection()
+{
+	return engine.selection();
+}
+
+/**
+* Sets how the marquees and the magic wand change the selection
+* @param int operation - One of the SelectionMask combine constants
+*/
+void DrawingBoard::setSelectionCombine(int operation)
+{
+	engine.setSelectionCombine(operation);
+	record(StrokeTrace::eventSelectionCombine, operation);
+}
+
+/**
+* Returns how the marquees and the magic wand change the selection
+* @return int - One of the SelectionMask combine constants
+*/
+int DrawingBoard::getSelectionCombine()
+{
+	return engine.getSelectionCombine();
+}
+
+/**
+* Selects the whole canvas
+*/
+void DrawingBoard::selectAll()
+{
+	engine.selectAll();
+	record(StrokeTrace::eventSelectAll);
+	updateDirtyRect();
+}
+
+/**
+* Selects nothing
+*/
+void DrawingBoard::deselect()
+{
+	engine.deselect();
+	record(StrokeTrace::eventDeselect);
+	updateDirtyRect();
+}
+
+/**
+* Selects the pixels of the canvas that aren't selected and deselects the others
+*/
+void DrawingBoard::invertSelection()
+{
+	engine.invertSelection();
+	record(StrokeTrace::eventInvertSelection);
+	updateDirtyRect();
+}
+
+/**
+* Fills the selection with the primary color
+*/
+void DrawingBoard::fillSelection()
+{
+	engine.fillSelection();
+	record(StrokeTrace::eventFillSelection);
+	updateDirtyRect();
+}
+
+/**
+* Returns the canvas pixel under a point of the board
+* @param QPoint pos - The point on the board
+* @return QPoint - The canvas position
+*/
+QPoint DrawingBoard::canvasPosition(const QPoint &pos)
+{
+	const QPointF canvasPos = engine.getViewOrigin() + QPointF(pos) / engine.getZoom();
+	return QPoint(qFloor(canvasPos.x()), qFloor(canvasPos.y()));
+}
+
+/**
+* Returns the canvas pixels an area of the board shows
+* @param QRect boardArea - The area on the board
+* @return QRect - The area on the canvas, partly covered pixels included
+*/
+QRect DrawingBoard::canvasArea(const QRect &boardArea)
+{
+	const double zoom = engine.getZoom();
+	return QRectF(engine.getViewOrigin() + QPointF(boardArea.topLeft()) / zoom,
+		QSizeF(boardArea.size()) / zoom).toAlignedRect();
+}
+
+/**
+* Returns the area of the board that shows an area of the canvas
+* @param QRect canvasArea - The area on the canvas
+* @return QRect - The area on the board, partly covered pixels included
+*/
+QRect DrawingBoard::boardArea(const QRect &canvasArea)
+{
+	const double zoom = engine.getZoom();
+	return QRectF((QPointF(canvasArea.topLeft()) - engine.getViewOrigin()) * zoom,
+		QSizeF(canvasArea.size()) * zoom).toAlignedRect();
+}
+
+/**
+* Repaints the overlay so its numbers also change while nothing is drawn
+*/
+void DrawingBoard::refreshHud()
+{
+	update(hud.rect());
+}
+
+/**
+* Adds an event to the recording if one is running
+* @param int type - One of the StrokeTrace event types
+* @param quint32 value - The new setting
+* @param QPoint pos - The mouse position
+* @param int buttons - The mouse buttons
+*/
+void DrawingBoard::record(int type, quint32 value, const QPoint &pos, int buttons)
+{
+	if (!recording){
+		return;
+	}
+	StrokeTrace::Event event;
+	event.type = type;
+	event.time = recordingClock.elapsed();
+	event.pos = pos;
+	event.buttons = buttons;
+	event.value = value;
+	trace.append(event);
 }
\ No newline at end of file
@@ -1,13 +1,20 @@
 #ifndef DRAWINGBOARD_H
 #define DRAWINGBOARD_H
 
+#include <QElapsedTimer>
 #include <QMouseEvent>
+#include <QWheelEvent>
 #include <QPainter>
 #include <QWidget>
 #include <QColor>
 #include <QImage>
 #include <QLineEdit>
+#include <QTimer>
 #include <QtWidgets/QMainWindow>
+#include "drawingengine.h"
+#include "latencyprobe.h"
+#include "performancehud.h"
+#include "stroketrace.h"
 
 class DrawingBoard : public QWidget
 {
@@ -23,62 +30,115 @@ public:
 	void setColorFill(const QColor &newColor);
 	void setEmptyFill();
 	void setBackgroundColor(const QColor &newColor = Qt::white);
+	void setPngPreset(int newPngPreset);
+	void setFillTolerance(int newTolerance);
 	QColor getPrimaryColor();
 	QColor getSecondaryColor();
 	QColor getFillColor();
 	int getPenWidth();
+	int getPngPreset();
+	int getFillTolerance();
 	void undo();
 	void redo();	
 	void setPaintMode(int newPaintMode);
 	bool openImage(const QString &fileName);
 	bool saveImage(const QString &fileName, const char *fileFormat);
 	bool isModified();
+	void newCanvas(const QSize &newSize, const QColor &color = Qt::white);
+	void startRecording();
+	void stopRecording();
+	bool isRecording();
+	const StrokeTrace &getTrace();
+	void setLatencyProbe(LatencyProbe *newLatencyProbe);
+	void setHudVisible(bool visible);
+	bool isHudVisible();
+	DrawingEngine::MemoryUsage memoryUsage();
+	void setMemoryWarning(qint64 bytes);
+	qint64 getMemoryWarning();
+	void scrollBy(const QPoint &delta);
+	QPointF getViewOrigin();
+	void setZoom(double newZoom, const QPoint &anchor);
+	double getZoom();
+	void centerOn(const QPointF &canvasPoint);
+	QRect visibleArea();
+	const TiledCanvas &canvas();
+	const LayerStack &layers();
+	void setCurrentLayer(int index);
+	void addLayer();
+	void removeLayer();
+	void moveLayer(int to);
+	void setLayerOpacity(int percent);
+	void setLayerVisible(int index, bool visible);
+	void setLayerBlendMode(int mode);
+	const SelectionMask &selection();
+	void setSelectionCombine(int operation);
+	int getSelectionCombine();
+	void selectAll();
+	void deselect();
+	void invertSelection();
+	void fillSelection();
 	
 	
 	//Sets the modes to constant numbers. Public to be reachable from the DrawIt class
-	static const int modeFreehand = 0;
-	static const int modeLine = 1;
-	static const int modeCircle = 2;
-	static const int modeRectangle = 3;
+	static const int modeFreehand = DrawingEngine::modeFreehand;
+	static const int modeLine = DrawingEngine::modeLine;
+	static const int modeCircle = DrawingEngine::modeCircle;
+	static const int modeRectangle = DrawingEngine::modeRectangle;
+	static const int modeFill = DrawingEngine::modeFill;
+	static const int modeSelectRectangle = DrawingEngine::modeSelectRectangle;
+	static const int modeSelectEllipse = DrawingEngine::modeSelectEllipse;
+	static const int modeMagicWand = DrawingEngine::modeMagicWand;
 
-	static const int styleSolidLine = 0;
-	static const int styleDashedLine = 1;
-	static const int styleDottedLine = 2;	
-	static const int styleDashedDottedLine = 3;
+	static const int styleSolidLine = DrawingEngine::styleSolidLine;
+	static const int styleDashedLine = DrawingEngine::styleDashedLine;
+	static const int styleDottedLine = DrawingEngine::styleDottedLine;
+	static const int styleDashedDottedLine = DrawingEngine::styleDashedDottedLine;
+
+	//Zoom limits in percent
+	static const int minimumZoom = 1;
+	static const int maximumZoom = 3200;
+	//Milliseconds an input can wait in the event queue before its timestamp is not trusted
+	static const int maximumQueueDelay = 10000;
 	
+signals:
+	void changed();
+
 public slots:
 	void mousePressEvent(QMouseEvent* event);
 	void mouseMoveEvent(QMouseEvent *event);
 	void mouseReleaseEvent(QMouseEvent *event);
+	void wheelEvent(QWheelEvent *event);
 	void paintEvent(QPaintEvent * event);
-	void Draw(QMouseEvent *event);
+
+private slots:
+	void refreshHud();
 	
 private:	
-	int paintMode;
-	bool modified;
-	bool undoing;
-	bool scribbling;
-	bool fill;
-	int penWidth;
-	QColor penColor;
-	QColor primaryColor;
-	QColor secondaryColor;
-	QColor fillColor;
-	Qt::PenStyle penStyle;
-	QImage tempImage;
-	QImage currentImage[10];
-	int undoImageCounter;
-	int currentImageCounter;
-	QPoint lastPoint;
-	QPoint startPoint;
+	DrawingEngine engine;
+	StrokeTrace trace;
+	bool recording;
+	QElapsedTimer recordingClock;
+	LatencyProbe *latencyProbe;
+	PerformanceHud hud;
+	bool hudVisible;
+	qint64 hudInputArrival;
+	QElapsedTimer inputClock;
+	qint64 timestampOffset;
+	bool timestampOffsetKnown;
+	QTimer hudTimer;
+	qint64 memoryWarning;
+	bool memoryWarned;
+	bool panning;
+	QPoint panPosition;
 
-	void drawFreehand(const QPoint &endPoint);
-	void drawShape(const QPoint &endPoint, int mode);
-	double calculateHypotenuse(const QPoint &endPoint);
-	QPointF calculateMiddlePoint(const QPoint &endPoint);
-	void checkImageCount();
-	void rearrangeImages();
-	void resizeImage(QImage *image, const QSize &newSize);	
+	qint64 inputArrival(const QInputEvent *event = 0);
+	qint64 queueDelay(const QInputEvent *event);
+	QPoint canvasPosition(const QPoint &pos);
+	QRect canvasArea(const QRect &boardArea);
+	QRect boardArea(const QRect &canvasArea);
+	void updateDirtyRect(qint64 arrival = 0, const char *tool = 0);
+	void checkMemory();
+	void record(int type, quint32 value = 0, const QPoint &pos = QPoint(), int buttons = 0);
 };
 
 #endif // DRAWINGBOARD_H
\ No newline at end of file
@@ -0,0 +1,1144 @@
+#include "drawingengine.h"
+#include "tracelog.h"
+#include "bufferpool.h"
+#include "tilestore.h"
+#include "floodfill.h"
+
+#include <QImageReader>
+#include <QSharedPointer>
+#include <QThreadPool>
+
+//Images with more pixels than this are decoded tile by tile when needed
+static const qint64 streamingPixelLimit = qint64(4096) * 4096;
+
+DrawingEngine::DrawingEngine(const QSize &newViewSize)
+{
+	viewSize = newViewSize;
+	modified = false;
+	undoing = false;
+	scribbling = false;
+	fill = false;
+	clipping = false;
+	expandable = false;
+	zoom = 1.0;
+	
+	undoImageCounter = 0;
+	currentImageCounter = 0;
+	ioBufferBytes = 0;
+	penWidth = 1;
+	pngPreset = PngWriter::presetBalanced;
+	fillTolerance = 32;
+	selectionCombine = SelectionMask::combineReplace;
+	primaryColor = Qt::black;
+	secondaryColor = Qt::white;
+	penColor = primaryColor;
+	penStyle = Qt::SolidLine;
+	paintMode = modeFreehand;
+
+	currentImage[0] = LayerStack(TiledCanvas(viewSize, Qt::white));
+
+	tempImage = BufferPool::global()->image(viewSize, QImage::Format_ARGB32);
+	tempImage.fill(qRgba(0, 0, 0, 0));
+}
+
+DrawingEngine::~DrawingEngine()
+{
+
+}
+
+/**
+* Sets the primary color thats being used when the left mouse button is hold down
+* @param Qcolor newColor - Color to use
+*/
+void DrawingEngine::setPrimaryColor(const QColor &newColor)
+{
+	primaryColor = newColor;
+}
+
+/**
+* Sets the secondary color thats being used when the right mouse button is hold down
+* @param Qcolor newColor - Color to use
+*/
+void DrawingEngine::setSecondaryColor(const QColor &newColor)
+{
+	secondaryColor = newColor;
+}
+
+/**
+* Sets the width of the pen
+* @param int newWidth - The new width of the pen
+*/
+void DrawingEngine::setPenWidth(int newWidth)
+{
+	penWidth = newWidth;
+}
+
+/**
+* Turns on and sets the color to use to fill shapes
+* @param Qcolor newColor - Color to use
+*/
+void DrawingEngine::setColorFill(const QColor &newColor)
+{
+	fillColor = newColor;
+	fill = true;
+}
+
+/**
+* Turns off the fill option
+*/
+void DrawingEngine::setEmptyFill()
+{
+	fill = false;
+}
+
+/**
+* Clears the image
+*/
+void DrawingEngine::setBackgroundColor(const QColor &newColor)
+{
+	TRACE_ZONE("DrawingEngine::setBackgroundColor");
+	checkImageCount();
+	tempImage.fill(qRgba(0, 0, 0, 0));
+	currentImage[currentImageCounter].fill(newColor);
+	markCanvasDirty();
+	modified = true;
+}
+
+/**
+* Starts a new canvas of the given size and clears the history
+* @param QSize newSize - Size of the new canvas
+* @param QColor color - Background color of the new canvas
+*/
+void DrawingEngine::newCanvas(const QSize &newSize, const QColor &color)
+{
+	TRACE_ZONE("DrawingEngine::newCanvas");
+	viewSize = newSize;
+	viewOrigin = QPointF(0, 0);
+	zoom = 1.0;
+	TiledCanvas background(newSize, color);
+	background.setExpandable(expandable);
+	currentImage[0] = LayerStack(background);
+	clearHistory();
+	currentSelection.clear();
+	scribbling = false;
+	tempImage = BufferPool::global()->image(viewSize, QImage::Format_ARGB32);
+	tempImage.fill(qRgba(0, 0, 0, 0));
+	modified = false;
+	storeTiles();
+	markCanvasDirty();
+}
+
+/**
+* Sets the speed/ratio preset used when saving as png
+* @param int newPngPreset - One of the PngWriter presets
+*/
+void DrawingEngine::setPngPreset(int newPngPreset)
+{
+	pngPreset = newPngPreset;
+}
+
+/**
+* Sets how much a color may differ from the clicked one for the paint bucket
+* to fill over it
+* @param int newTolerance - The largest difference per color channel, 0 to 255
+*/
+void DrawingEngine::setFillTolerance(int newTolerance)
+{
+	fillTolerance = qBound(0, newTolerance, 255);
+}
+
+/**
+* Returns the primary color
+* @return QColor - The primary color
+*/
+QColor DrawingEngine::getPrimaryColor(){
+	return primaryColor;
+}
+
+/**
+* Returns the secondary color
+* @return QColor - The secondary color
+*/
+QColor DrawingEngine::getSecondaryColor(){
+	return secondaryColor;
+}
+
+/**
+* Returns the fill color
+* @return QColor - The fill color
+*/
+QColor DrawingEngine::getFillColor(){
+	return fillColor;
+}
+
+/**
+* Returns the pen width
+* @return int - The pen width
+*/
+int DrawingEngine::getPenWidth(){
+	return penWidth;
+}
+
+/**
+* Returns the paint mode
+* @return int - The paint mode
+*/
+int DrawingEngine::getPaintMode(){
+	return paintMode;
+}
+
+/**
+* Returns the pen style
+* @return int - One of the style constants
+*/
+int DrawingEngine::getPenStyle(){
+	switch (penStyle){
+		case Qt::DashLine:
+			return styleDashedLine;
+		case Qt::DotLine:
+			return styleDottedLine;
+		case Qt::DashDotLine:
+			return styleDashedDottedLine;
+		default:
+			return styleSolidLine;
+	}
+}
+
+/**
+* Checks if shapes are filled
+* @return bool - true if shapes are filled with the fill color
+*/
+bool DrawingEngine::isFilled(){
+	return fill;
+}
+
+/**
+* Returns the visible canvas
+* @return TiledCanvas - The composite of the layers at the current history position
+*/
+const TiledCanvas &DrawingEngine::canvas() const
+{
+	return currentImage[currentImageCounter].composite();
+}
+
+/**
+* Returns the layers at the current history position
+* @return LayerStack - The layers
+*/
+const LayerStack &DrawingEngine::layers() const
+{
+	return currentImage[currentImageCounter];
+}
+
+/**
+* Chooses the layer the tools paint on, this isn't a step in the history
+* @param int index - The index of the layer, 0 is the background
+*/
+void DrawingEngine::setCurrentLayer(int index)
+{
+	currentImage[currentImageCounter].setCurrentLayer(index);
+}
+
+/**
+* Adds an empty layer above the current one and paints on it from now on
+*/
+void DrawingEngine::addLayer()
+{
+	TRACE_ZONE("DrawingEngine::addLayer");
+	checkImageCount();
+	LayerStack &stack = currentImage[currentImageCounter];
+	stack.addLayer(QString("Layer %1").arg(stack.count()));
+	modified = true;
+}
+
+/**
+* Removes the current layer, the background stays
+*/
+void DrawingEngine::removeLayer()
+{
+	TRACE_ZONE("DrawingEngine::removeLayer");
+	if (currentImage[currentImageCounter].currentLayer() == 0){
+		return;
+	}
+	checkImageCount();
+	LayerStack &stack = currentImage[currentImageCounter];
+	stack.removeLayer(stack.currentLayer());
+	markCanvasDirty();
+	modified = true;
+}
+
+/**
+* Moves the current layer to another place in the order
+* @param int to - The index it gets, the background stays at 0
+*/
+void DrawingEngine::moveLayer(int to)
+{
+	TRACE_ZONE("DrawingEngine::moveLayer");
+	const LayerStack &stack = currentImage[currentImageCounter];
+	if (stack.currentLayer() == 0 || to <= 0 || to >= stack.count() || to == stack.currentLayer()){
+		return;
+	}
+	checkImageCount();
+	currentImage[currentImageCounter].moveLayer(currentImage[currentImageCounter].currentLayer(), to);
+	markCanvasDirty();
+	modified = true;
+}
+
+/**
+* Sets the opacity of the current layer
+* @param int percent - The opacity, from 0 to 100
+*/
+void DrawingEngine::setLayerOpacity(int percent)
+{
+	TRACE_ZONE("DrawingEngine::setLayerOpacity");
+	const LayerStack &current = currentImage[currentImageCounter];
+	if (current.layer(current.currentLayer()).opacity == qBound(0, percent, 100)){
+		return;
+	}
+	checkImageCount();
+	LayerStack &stack = currentImage[currentImageCounter];
+	stack.setOpacity(stack.currentLayer(), percent);
+	markCanvasDirty();
+	modified = true;
+}
+
+/**
+* Shows or hides a layer
+* @param int index - The index of the layer
+* @param bool visible - if the layer is shown
+*/
+void DrawingEngine::setLayerVisible(int index, bool visible)
+{
+	TRACE_ZONE("DrawingEngine::setLayerVisible");
+	const LayerStack &current = currentImage[currentImageCounter];
+	if (index < 0 || index >= current.count() || current.layer(index).visible == visible){
+		return;
+	}
+	checkImageCount();
+	currentImage[currentImageCounter].setVisible(index, visible);
+	markCanvasDirty();
+	modified = true;
+}
+
+/**
+* Sets how the current layer is blended with the layers below it
+* @param int mode - One of the LayerStack blend modes
+*/
+void DrawingEngine::setLayerBlendMode(int mode)
+{
+	TRACE_ZONE("DrawingEngine::setLayerBlendMode");
+	const LayerStack &current = currentImage[currentImageCounter];
+	if (current.currentLayer() == 0 || current.layer(current.currentLayer()).blendMode == mode){
+		return;
+	}
+	checkImageCount();
+	LayerStack &stack = currentImage[currentImageCounter];
+	stack.setBlendMode(stack.currentLayer(), mode);
+	markCanvasDirty();
+	modified = true;
+}
+
+/**
+* Returns the overlay that shapes are previewed on while they are dragged,
+* its top left pixel is the view origin
+* @return QImage - The preview overlay
+*/
+const QImage &DrawingEngine::overlay() const
+{
+	return tempImage;
+}
+
+/**
+* Lets the canvas grow in every direction when something is painted outside
+* of it, for this and every later canvas
+* @param bool enabled - if the canvas should grow
+*/
+void DrawingEngine::setExpandable(bool enabled)
+{
+	expandable = enabled;
+	for (int i = 0; i < 10; ++i){
+		currentImage[i].setExpandable(enabled);
+	}
+}
+
+/**
+* Sets the part of the canvas the view shows. A canvas point p is shown at
+* (p - origin) * zoom in the view. Positions given to the mouse functions are
+* canvas positions, the overlay covers the view and is drawn at its scale.
+* Nothing is marked dirty, the view decides how to repaint
+* @param QPointF newViewOrigin - The canvas point in the top left corner, also negative
+* @param double newZoom - The scale, 1 shows every canvas pixel on one view pixel
+*/
+void DrawingEngine::setView(const QPointF &newViewOrigin, double newZoom)
+{
+	viewOrigin = newViewOrigin;
+	zoom = newZoom;
+	//The last shape is left on the overlay, it would no longer line up with the canvas
+	tempImage.fill(qRgba(0, 0, 0, 0));
+}
+
+/**
+* Returns the canvas point that is shown in the top left corner of the view
+* @return QPointF - The canvas point
+*/
+QPointF DrawingEngine::getViewOrigin()
+{
+	return viewOrigin;
+}
+
+/**
+* Returns the scale the view shows the canvas at
+* @return double - The scale
+*/
+double DrawingEngine::getZoom()
+{
+	return zoom;
+}
+
+/**
+* Returns the area of the canvas the view and the overlay cover
+* @return QRect - The area in canvas coordinates
+*/
+QRect DrawingEngine::viewRect()
+{
+	return QRectF(viewOrigin, QSizeF(tempImage.size()) / zoom).toAlignedRect();
+}
+
+/**
+* Returns the area that changed since the last call and resets it
+* @return QRect - The changed area in canvas coordinates
+*/
+QRect DrawingEngine::takeDirtyRect()
+{
+	const QRect changed = dirtyRect;
+	dirtyRect = QRect();
+	return changed;
+}
+
+/**
+* Limits painting to an area of the canvas. Worker processes that render one
+* band of a big canvas skip everything outside their band
+* @param QRect newClipRect - The area to paint in, an empty area paints nothing
+*/
+void DrawingEngine::setClipRect(const QRect &newClipRect)
+{
+	clipRect = newClipRect;
+	clipping = true;
+}
+
+/**
+* Limits an area that is about to be painted to the clip rect
+* @param QRect bounds - The area the drawing covers
+* @return QRect - The part of it that should be painted
+*/
+QRect DrawingEngine::clipped(const QRect &bounds)
+{
+	return clipping ? bounds.intersected(clipRect) : bounds;
+}
+
+/**
+* Adds an area to the changed area
+* @param QRect rect - The area that changed
+*/
+void DrawingEngine::markDirty(const QRect &rect)
+{
+	dirtyRect = dirtyRect.united(rect);
+}
+
+/**
+* Marks the whole canvas and the view as changed, for changes like undo that
+* replace every pixel and not only the visible ones
+*/
+void DrawingEngine::markCanvasDirty()
+{
+	markDirty(viewRect().united(canvas().rect()));
+}
+
+/**
+* Handles mouseclicks
+* @param QPoint pos - Position of the click
+* @param Qt::MouseButton button - The button that was pressed
+*/
+void DrawingEngine::mousePress(const QPoint &pos, Qt::MouseButton button){
+	TRACE_ZONE("DrawingEngine::mousePress");
+	if (!isSelecting() && paintMode != modeFill){
+		checkImageCount();
+	}
+	if (button == Qt::LeftButton) {
+		penColor = primaryColor;
+		lastPoint = pos;
+		startPoint = pos;
+		scribbling = true;
+	}
+	else if (button == Qt::RightButton){
+		penColor = secondaryColor;
+		lastPoint = pos;
+		startPoint = pos;
+		scribbling = true;
+	}
+	//The paint bucket fills at once, there is nothing to drag
+	if (paintMode == modeFill && scribbling){
+		scribbling = false;
+		floodFill(pos);
+	}
+	else if (paintMode == modeMagicWand && scribbling){
+		scribbling = false;
+		select(similarArea(pos));
+	}
+}
+
+/**
+* Handles mousemovements
+* @param QPoint pos - Position of the mouse
+* @param Qt::MouseButtons buttons - The buttons that are held down
+*/
+void DrawingEngine::mouseMove(const QPoint &pos, Qt::MouseButtons buttons)
+{
+	TRACE_ZONE("DrawingEngine::mouseMove");
+	if ((buttons & Qt::LeftButton) && scribbling){
+		Draw(pos);
+	}
+	else if ((buttons & Qt::RightButton) && scribbling){
+		Draw(pos);
+	}
+}
+
+/**
+* Handles mouseclick releases
+* @param QPoint pos - Position of the release
+* @param Qt::MouseButton button - The button that was released
+*/
+void DrawingEngine::mouseRelease(const QPoint &pos, Qt::MouseButton button)
+{
+	TRACE_ZONE("DrawingEngine::mouseRelease");
+	if (button == Qt::LeftButton && scribbling) {
+		scribbling = false;
+		Draw(pos);
+	}
+	else if (button == Qt::RightButton && scribbling) {
+		scribbling = false;
+		Draw(pos);
+	}
+	//Selecting leaves the canvas and the history as they are, the paint bucket took its step when it filled
+	if (isSelecting() || paintMode == modeFill){
+		return;
+	}
+	storeTiles();
+	modified = true;
+}
+
+/**
+* Check the image count if the array of undo images is full rearrange them
+* Otherwise create a new one
+*/
+void DrawingEngine::checkImageCount(){
+	TRACE_ZONE("DrawingEngine::checkImageCount");
+	undoImageCounter = 0;
+	undoing = false;
+	if (currentImageCounter < 9){
+		currentImage[currentImageCounter + 1] = currentImage[currentImageCounter];
+		++currentImageCounter;
+	}
+	else{
+		rearrangeImages();
+	}
+}
+
+/**
+* Makes the first image the current one and drops the rest of the history
+* so it doesn't keep old images in memory
+*/
+void DrawingEngine::clearHistory(){
+	for (int i = 1; i < 10; ++i){
+		currentImage[i] = LayerStack();
+	}
+	currentImageCounter = 0;
+	undoImageCounter = 0;
+	undoing = false;
+}
+
+/**
+* Rearrange the array of images that is used for the undo and redo function
+*/
+void DrawingEngine::rearrangeImages(){
+	TRACE_ZONE("DrawingEngine::rearrangeImages");
+	for (int i = 0; i < currentImageCounter; ++i){
+		currentImage[i] = currentImage[i + 1];
+	}
+}
+
+/**
+* Looks the tiles painted since the last call up in the tile store, so the
+* canvas and the history keep one copy of identical tiles, and drops the
+* stored tiles no canvas uses anymore
+*/
+void DrawingEngine::storeTiles(){
+	TRACE_ZONE("DrawingEngine::storeTiles");
+	currentImage[currentImageCounter].deduplicate(TileStore::global());
+	TileStore::global()->collect();
+}
+
+/**
+* Set and call the relevant drawing mode
+* @param QPoint pos - Position to draw to
+*/
+void DrawingEngine::Draw(const QPoint &pos){
+	TRACE_ZONE("DrawingEngine::Draw");
+	switch (paintMode){
+		case modeFreehand:
+			drawFreehand(pos);
+			break;
+		case modeLine:
+			drawShape(pos, modeLine);
+			break;
+		case modeCircle:
+			drawShape(pos, modeCircle);
+			break;
+		case modeRectangle:
+			drawShape(pos, modeRectangle);
+			break;
+		case modeSelectRectangle:
+		case modeSelectEllipse:
+			drawMarquee(pos);
+			break;
+	}
+}
+
+/**
+* Draws the freehand line
+* @param QPoint endPoint - endpoint to draw to
+*/
+void DrawingEngine::drawFreehand(const QPoint &endPoint)
+{
+	TRACE_ZONE("DrawingEngine::drawFreehand");
+	int rad = (penWidth / 2) + 2;
+	const QRect bounds = QRect(lastPoint, endPoint).normalized()
+		.adjusted(-rad, -rad, +rad, +rad);
+	currentImage[currentImageCounter].paint(clipped(bounds), [&](QPainter &painter){
+		painter.setPen(QPen(penColor, penWidth, Qt::SolidLine, Qt::RoundCap,
+			Qt::RoundJoin));
+		painter.drawLine(lastPoint, endPoint);
+	});
+
+	markDirty(bounds);
+	lastPoint = endPoint;
+}
+
+/**
+* Fills the area of similar color around a point of the composite on the
+* current layer with the pen color, only where it is selected if there is a
+* selection. Only the tiles the area covers are painted, so the history step
+* only holds copies of those. An empty area takes no history step
+* @param QPoint seed - The point that was clicked
+*/
+void DrawingEngine::floodFill(const QPoint &seed)
+{
+	TRACE_ZONE("DrawingEngine::floodFill");
+	SelectionMask area = similarArea(seed);
+	if (!currentSelection.isEmpty()){
+		area.combine(currentSelection, SelectionMask::combineIntersect);
+	}
+	if (clipped(area.bounds()).isEmpty()){
+		return;
+	}
+	checkImageCount();
+	paintMask(area, penColor);
+	storeTiles();
+	modified = true;
+}
+
+/**
+* Finds the area of similar color around a point of the composite, for the
+* paint bucket and the magic wand. Large canvases are filled on the thread pool
+* @param QPoint seed - The point that was clicked
+* @return SelectionMask - The area, empty if the point is outside of the canvas
+*/
+SelectionMask DrawingEngine::similarArea(const QPoint &seed)
+{
+	TRACE_ZONE("DrawingEngine::similarArea");
+	const TiledCanvas &composite = canvas();
+	FloodFill region(composite, composite.rect(), fillTolerance);
+	const qint64 tilePixels = qint64(TiledCanvas::tileSize) * TiledCanvas::tileSize;
+	const bool parallel = QThreadPool::globalInstance()->maxThreadCount() > 1
+		&& qint64(composite.rect().width()) * composite.rect().height() > FloodFill::parallelTiles * tilePixels;
+	if (parallel){
+		region.fillParallel(seed);
+	}
+	else{
+		region.fill(seed);
+	}
+	return region.toMask();
+}
+
+/**
+* Paints the pixels of a mask on the current layer in a color. Full tiles are
+* filled, the others get an image of their bits drawn over them
+* @param SelectionMask mask - The pixels to paint
+* @param QColor color - The color to paint with
+*/
+void DrawingEngine::paintMask(const SelectionMask &mask, const QColor &color)
+{
+	TRACE_ZONE("DrawingEngine::paintMask");
+	const QRect painted = clipped(mask.bounds());
+	if (painted.isEmpty()){
+		return;
+	}
+	const TiledCanvas &composite = canvas();
+	foreach(qint64 index, mask.tileKeys()) {
+		const int column = int(quint32(index));
+		const int row = int(index >> 32);
+		const QRect tileArea = composite.tileRect(column, row);
+		const QRect part = tileArea.intersected(painted);
+		if (part.isEmpty()){
+			continue;
+		}
+		if (mask.isFull(column, row)){
+			currentImage[currentImageCounter].paint(part, [&](QPainter &painter){
+				painter.fillRect(part, color);
+			});
+			continue;
+		}
+		const QImage covered = mask.tileImage(column, row, color);
+		currentImage[currentImageCounter].paint(part, [&](QPainter &painter){
+			painter.setClipRect(part);
+			painter.drawImage(tileArea.topLeft(), covered);
+		});
+	}
+	markDirty(painted);
+}
+
+/**
+* Previews the selection marquee on the overlay while it is dragged and
+* selects the rectangle or the ellipse in it when it is let go. A click
+* without dragging selects nothing
+* @param QPoint endPoint - The corner opposite of the start point
+*/
+void DrawingEngine::drawMarquee(const QPoint &endPoint)
+{
+	TRACE_ZONE("DrawingEngine::drawMarquee");
+	const QRect bounds = endPoint == startPoint ? QRect() : QRect(startPoint, endPoint).normalized();
+	tempImage.fill(qRgba(0, 0, 0, 0));
+	markDirty(viewRect());
+	if (scribbling){
+		QPainter painter(&tempImage);
+		painter.scale(zoom, zoom);
+		painter.translate(-viewOrigin);
+		painter.setPen(QPen(Qt::black, 0, Qt::DashLine));
+		if (paintMode == modeSelectEllipse){
+			painter.drawEllipse(bounds);
+		}
+		else{
+			painter.drawRect(bounds);
+		}
+	}
+	else if (paintMode == modeSelectEllipse){
+		select(SelectionMask::fromEllipse(bounds));
+	}
+	else{
+		select(SelectionMask::fromRect(bounds));
+	}
+}
+
+/**
+* Combines a mask into the selection with the current combine mode. A canvas
+* that doesn't grow can't have pixels selected outside of it
+* @param SelectionMask mask - The pixels to combine
+*/
+void DrawingEngine::select(const SelectionMask &mask)
+{
+	TRACE_ZONE("DrawingEngine::select");
+	const QRect before = currentSelection.bounds();
+	currentSelection.combine(mask, selectionCombine);
+	if (!expandable){
+		currentSelection.combine(SelectionMask::fromRect(canvas().rect()), SelectionMask::combineIntersect);
+	}
+	markDirty(before.united(currentSelection.bounds()));
+}
+
+/**
+* Checks if the paint mode selects instead of painting
+* @return bool - true for the marquees and the magic wand
+*/
+bool DrawingEngine::isSelecting()
+{
+	return paintMode == modeSelectRectangle || paintMode == modeSelectEllipse || paintMode == modeMagicWand;
+}
+
+/**
+* Draws the selected shape
+* @param QPoint endPoint - endpoint to draw to
+* @param int mode - drawing mode to use
+*/
+void DrawingEngine::drawShape(const QPoint &endPoint, int mode){
+	TRACE_ZONE("DrawingEngine::drawShape");
+	const QRect bounds = shapeBounds(endPoint);
+	if (scribbling){
+		tempImage.fill(qRgba(0, 0, 0, 0));
+		markDirty(viewRect());
+		QPainter painter(&tempImage);
+		painter.scale(zoom, zoom);
+		painter.translate(-viewOrigin);
+		paintShape(painter, endPoint);
+	}
+	else{
+		currentImage[currentImageCounter].paint(clipped(bounds), [&](QPainter &painter){
+			paintShape(painter, endPoint);
+		});
+	}
+	markDirty(bounds);
+}
+
+/**
+* Draws the selected shape with the current pen and fill
+* @param QPainter painter - painter to draw with
+* @param QPoint endPoint - endpoint to draw to
+*/
+void DrawingEngine::paintShape(QPainter &painter, const QPoint &endPoint){
+	if (fill){
+		painter.setBrush(QBrush(fillColor, Qt::SolidPattern));
+	}	
+	painter.setPen(QPen(penColor, penWidth, penStyle, Qt::RoundCap,
+		Qt::RoundJoin));
+	double const hypotenuse = calculateHypotenuse(endPoint);
+	QPointF const middlePoint = calculateMiddlePoint(endPoint);
+	switch (paintMode){
+		case modeLine:
+			painter.drawLine(startPoint, endPoint);
+			break;
+		case modeCircle:
+			painter.drawEllipse(middlePoint, hypotenuse / 2, hypotenuse / 2);		
+			break;
+		case modeRectangle:		
+			painter.drawRect(startPoint.x(), startPoint.y(), endPoint.x() - startPoint.x(), endPoint.y() - startPoint.y());
+			break;
+	}
+}
+
+/**
+* Calculates the area the selected shape covers, including the pen
+* @param QPoint endPoint - endpoint of the shape
+* @return QRect - The area of the shape
+*/
+QRect DrawingEngine::shapeBounds(const QPoint &endPoint){
+	int const rad = (penWidth / 2) + 2;
+	QRect bounds = QRect(startPoint, endPoint).normalized();
+	if (paintMode == modeCircle){
+		double const radius = calculateHypotenuse(endPoint) / 2;
+		QPointF const middlePoint = calculateMiddlePoint(endPoint);
+		bounds = QRectF(middlePoint.x() - radius, middlePoint.y() - radius,
+			radius * 2, radius * 2).toAlignedRect();
+	}
+	return bounds.adjusted(-rad, -rad, +rad, +rad);
+}
+
+/**
+* Calculates the hypotenuse of the triangle thats is made up of the 
+startingpoint, the endpoint and the delta distance in the y direction.
+Used to get the length between the start and endpoint
+* @param QPoint endPoint - endpoint to calculate distance with
+*/
+double DrawingEngine::calculateHypotenuse(const QPoint &endPoint){	
+	const double x = abs(endPoint.x() - startPoint.x());
+	const double y = abs(endPoint.y() - startPoint.y());
+	return hypot(x, y);
+}
+
+/**
+* Calculates the middlepoint between the start and the endpoint
+* @param QPoint endPoint - endpoint to calculate distance with
+*/
+QPointF DrawingEngine::calculateMiddlePoint(const QPoint &endPoint){
+	const double x = (double)(endPoint.x() + startPoint.x()) / 2;
+	const double y = (double)(endPoint.y() + startPoint.y()) / 2;
+	const QPointF middlePoint(x, y);
+	return middlePoint;
+}
+ 
+/**
+* Returns the png preset
+* @return int - The png preset
+*/
+int DrawingEngine::getPngPreset(){
+	return pngPreset;
+}
+
+/**
+* Returns the tolerance of the paint bucket
+* @return int - The largest difference per color channel
+*/
+int DrawingEngine::getFillTolerance(){
+	return fillTolerance;
+}
+
+/**
+* Returns the number of canvases kept for undo and redo besides the current one
+* @return int - The number of history entries
+*/
+int DrawingEngine::historyCount(){
+	return undoing ? undoImageCounter : currentImageCounter;
+}
+
+/**
+* Returns the selected pixels, empty if nothing is selected
+* @return SelectionMask - The selection
+*/
+const SelectionMask &DrawingEngine::selection() const
+{
+	return currentSelection;
+}
+
+/**
+* Sets how the marquees and the magic wand change the selection
+* @param int operation - One of the SelectionMask combine constants
+*/
+void DrawingEngine::setSelectionCombine(int operation)
+{
+	selectionCombine = operation;
+}
+
+/**
+* Returns how the marquees and the magic wand change the selection
+* @return int - One of the SelectionMask combine constants
+*/
+int DrawingEngine::getSelectionCombine()
+{
+	return selectionCombine;
+}
+
+/**
+* Selects the whole canvas
+*/
+void DrawingEngine::selectAll()
+{
+	const QRect before = currentSelection.bounds();
+	currentSelection = SelectionMask::fromRect(canvas().rect());
+	markDirty(before.united(currentSelection.bounds()));
+}
+
+/**
+* Selects nothing
+*/
+void DrawingEngine::deselect()
+{
+	markDirty(currentSelection.bounds());
+	currentSelection.clear();
+}
+
+/**
+* Selects the pixels of the canvas that aren't selected and deselects the others
+*/
+void DrawingEngine::invertSelection()
+{
+	TRACE_ZONE("DrawingEngine::invertSelection");
+	const QRect before = currentSelection.bounds();
+	currentSelection.invert(canvas().rect());
+	markDirty(before.united(currentSelection.bounds()));
+}
+
+/**
+* Fills the selected pixels of the current layer with the primary color, as
+* one history step
+*/
+void DrawingEngine::fillSelection()
+{
+	TRACE_ZONE("DrawingEngine::fillSelection");
+	if (currentSelection.isEmpty()){
+		return;
+	}
+	checkImageCount();
+	paintMask(currentSelection, primaryColor);
+	storeTiles();
+	modified = true;
+}
+
+/**
+* Adds up the memory of the canvas, the overlay shapes are previewed on, the
+* selection, the undo and redo history, the tiles decoded from an opened file
+* and the buffers the last open or save used
+* @return MemoryUsage - The bytes per kind
+*/
+DrawingEngine::MemoryUsage DrawingEngine::memoryUsage(){
+	QSet<qint64> counted;
+	MemoryUsage usage;
+	usage.canvas = currentImage[currentImageCounter].memoryUsage(&counted);
+	usage.overlay = tempImage.byteCount();
+	usage.selection = currentSelection.memoryUsage();
+	usage.undo = 0;
+	for (int i = 0; i < currentImageCounter; ++i){
+		usage.undo += currentImage[i].memoryUsage(&counted);
+	}
+	usage.redo = 0;
+	for (int i = currentImageCounter + 1; i <= historyCount(); ++i){
+		usage.redo += currentImage[i].memoryUsage(&counted);
+	}
+	usage.caches = currentImage[currentImageCounter].cacheBytes(&counted) + canvas().sourceCacheBytes()
+		+ TiledCanvas::mipmapBytes() + SelectionMask::tintBytes() + BufferPool::global()->idleBytes();
+	usage.ioBuffers = ioBufferBytes;
+	usage.tileStore = TileStore::global()->bytes();
+	usage.deduplicated = TileStore::global()->savedBytes();
+	return usage;
+}
+
+/**
+* Undo the last action
+*/
+void DrawingEngine::undo(){
+	TRACE_ZONE("DrawingEngine::undo");
+	if (!undoing){
+		undoImageCounter = currentImageCounter;
+		undoing = true;
+	}
+	if (currentImageCounter > 0){		
+		--currentImageCounter;
+		tempImage.fill(qRgba(0, 0, 0, 0));
+		markCanvasDirty();
+		
+	}	
+}
+
+/**
+* Redo the last action
+*/
+void DrawingEngine::redo(){
+	TRACE_ZONE("DrawingEngine::redo");
+	if (currentImageCounter < undoImageCounter){
+		++currentImageCounter;
+		markCanvasDirty();
+	}
+}
+
+/**
+* Sets the new paint mode
+* @param int newPaintMode - The new paint mode
+*/
+void DrawingEngine::setPaintMode(int newPaintMode){
+	paintMode = newPaintMode;
+}
+
+/**
+* Sets the pen style to draw with
+* @param int newPenStyle - The new pen style
+*/
+void DrawingEngine::setPenStyle(int newPenStyle){
+	
+	switch (newPenStyle){
+		case styleSolidLine:
+			penStyle = Qt::SolidLine;
+			break;
+		case styleDashedLine:
+			penStyle = Qt::DashLine;
+			break;
+		case styleDottedLine:
+			penStyle = Qt::DotLine;
+			break;
+		case styleDashedDottedLine:
+			penStyle = Qt::DashDotLine;
+			break;
+	}
+}
+
+/**
+* Resizes the given image to the given size
+* @param QImage* image - The image to be resized
+* @param Qsize* newSize - The size to set the image to
+*/
+void DrawingEngine::resizeImage(QImage *image, const QSize &newSize)
+{
+	TRACE_ZONE("DrawingEngine::resizeImage");
+	if (image->size() == newSize)
+	return;
+
+	QImage newImage = BufferPool::global()->image(newSize, QImage::Format_RGB32);
+	newImage.fill(qRgb(255, 255, 255));
+	QPainter painter(&newImage);
+	painter.drawImage(QPoint(0, 0), *image);
+	*image = newImage;
+}
+
+/**
+* Opens the image file
+* @param QString fileName - The image filename to be loaded
+* @return bool - if the load succeeded
+*/
+bool DrawingEngine::openImage(const QString &fileName)
+{
+	TRACE_ZONE("DrawingEngine::openImage");
+	const QSize imageSize = QImageReader(fileName).size();
+	if (imageSize.isValid() && qint64(imageSize.width()) * imageSize.height() > streamingPixelLimit){
+		//Too large to decode at once, tiles are decoded when they are shown or painted on
+		QSharedPointer<ImageTileSource> source(new ImageTileSource(fileName, TiledCanvas::tileSize));
+		if (!source->open()){
+			return false;
+		}
+		currentImage[0] = LayerStack(TiledCanvas(source, imageSize.expandedTo(viewSize)));
+		ioBufferBytes = 0;
+	}
+	else{
+		QImage loadedImage;
+		if (!loadedImage.load(fileName)){
+			return false;
+		}
+		QSize newSize = loadedImage.size().expandedTo(viewSize);
+		//The decoded file and the copy it is padded into when it is smaller than the view
+		ioBufferBytes = loadedImage.byteCount();
+		if (loadedImage.size() != newSize){
+			ioBufferBytes += qint64(newSize.width()) * newSize.height() * 4;
+		}
+		resizeImage(&loadedImage, newSize);
+		TiledCanvas loaded;
+		loaded.setImage(loadedImage);
+		currentImage[0] = LayerStack(loaded);
+	}
+	currentImage[0].setExpandable(expandable);
+	viewOrigin = QPointF(0, 0);
+	zoom = 1.0;
+	clearHistory();
+	currentSelection.clear();
+	storeTiles();
+	modified = false;
+	markCanvasDirty();
+	return true;
+}
+
+/**
+* Saves the image file
+* @param QString fileName - The image filename to be loaded
+* @return bool - if the save succeeded
+*/
+bool DrawingEngine::saveImage(const QString &fileName, const char *fileFormat)
+{
+	TRACE_ZONE("DrawingEngine::saveImage");
+	const TiledCanvas visibleImage = canvas();
+	bool saved;
+	if (QByteArray(fileFormat).toLower() == "png"){
+		//Compress the bands on all cores instead of using the single threaded Qt writer.
+		//Rows are copied out of the tiles band by band so the canvas is never flattened
+		PngWriter writer;
+		writer.setPreset(pngPreset);
+		saved = writer.write(visibleImage.size(), [&visibleImage](const QRect &rows){
+			return visibleImage.copy(rows.translated(visibleImage.rect().topLeft()));
+		}, fileName);
+		ioBufferBytes = writer.getBufferBytes();
+	}
+	else{
+		const QImage flattened = visibleImage.toImage();
+		ioBufferBytes = flattened.byteCount();
+		saved = flattened.save(fileName, fileFormat);
+	}
+
+	if (saved) {
+		modified = false;
+		return true;
+	}
+	else {
+		return false;
+	}
+}
+
+/**
+* Checks if the image is modified since the last save
+* @return bool - true if changed
+*/
+bool DrawingEngine::isModified(){
+	return modified;
+}
\ No newline at end of file
@@ -0,0 +1,187 @@
+#ifndef DRAWINGENGINE_H
+#define DRAWINGENGINE_H
+
+#include <QPainter>
+#include <QColor>
+#include <QImage>
+#include <QPoint>
+#include <QPointF>
+#include <QRect>
+#include <QSize>
+#include "layerstack.h"
+#include "pngwriter.h"
+#include "selectionmask.h"
+#include "tiledcanvas.h"
+
+/**
+* The drawing tools, canvas and undo history without any widget. DrawingBoard
+* feeds it the mouse events of the window, the batch renderer runs one per
+* job on worker threads. The area that has to be repainted is collected and
+* handed out by takeDirtyRect(). The canvas is a LayerStack, the tools paint
+* on its current layer and every history step holds the whole stack. The
+* selection is kept apart from the history, it limits the paint bucket and
+* what fillSelection() paints.
+*/
+class DrawingEngine
+{
+public:
+	DrawingEngine(const QSize &newViewSize);
+	~DrawingEngine();
+	void setPrimaryColor(const QColor &newColor);
+	void setSecondaryColor(const QColor &newColor);
+	void setPenWidth(int newWidth);
+	void setPenStyle(int newPenStyle);
+	void setColorFill(const QColor &newColor);
+	void setEmptyFill();
+	void setBackgroundColor(const QColor &newColor = Qt::white);
+	void newCanvas(const QSize &newSize, const QColor &color = Qt::white);
+	void setPngPreset(int newPngPreset);
+	void setFillTolerance(int newTolerance);
+	QColor getPrimaryColor();
+	QColor getSecondaryColor();
+	QColor getFillColor();
+	int getPenWidth();
+	int getPaintMode();
+	int getPenStyle();
+	bool isFilled();
+	int getPngPreset();
+	int getFillTolerance();
+	void undo();
+	void redo();
+	void setPaintMode(int newPaintMode);
+	bool openImage(const QString &fileName);
+	bool saveImage(const QString &fileName, const char *fileFormat);
+	bool isModified();
+	void mousePress(const QPoint &pos, Qt::MouseButton button);
+	void mouseMove(const QPoint &pos, Qt::MouseButtons buttons);
+	void mouseRelease(const QPoint &pos, Qt::MouseButton button);
+	void Draw(const QPoint &pos);
+	const TiledCanvas &canvas() const;
+	const LayerStack &layers() const;
+	void setCurrentLayer(int index);
+	void addLayer();
+	void removeLayer();
+	void moveLayer(int to);
+	void setLayerOpacity(int percent);
+	void setLayerVisible(int index, bool visible);
+	void setLayerBlendMode(int mode);
+	const QImage &overlay() const;
+	QRect takeDirtyRect();
+	void setClipRect(const QRect &newClipRect);
+	void setExpandable(bool enabled);
+	void setView(const QPointF &newViewOrigin, double newZoom);
+	QPointF getViewOrigin();
+	double getZoom();
+	int historyCount();
+	const SelectionMask &selection() const;
+	void setSelectionCombine(int operation);
+	int getSelectionCombine();
+	void selectAll();
+	void deselect();
+	void invertSelection();
+	void fillSelection();
+
+	//Sets the modes to constant numbers. Public to be reachable from the DrawIt class
+	static const int modeFreehand = 0;
+	static const int modeLine = 1;
+	static const int modeCircle = 2;
+	static const int modeRectangle = 3;
+	static const int modeFill = 4;
+	static const int modeSelectRectangle = 5;
+	static const int modeSelectEllipse = 6;
+	static const int modeMagicWand = 7;
+
+	static const int styleSolidLine = 0;
+	static const int styleDashedLine = 1;
+	static const int styleDottedLine = 2;
+	static const int styleDashedDottedLine = 3;
+
+	/**
+	* Bytes of memory per kind of buffer. A tile shared by several canvases is
+	* counted once, in the first of canvas, undo and redo that holds it. The
+	* caches are the decoded tiles of an opened file, the composite of the
+	* layers, the mipmaps of all canvases, the tinted selection tiles and the
+	* idle buffers of the BufferPool. The tile store holds the distinct tiles
+	* canvas and history share, deduplicated is the memory of the duplicate
+	* tiles it has replaced since the start. Both are already part of the
+	* other kinds and left out of the total. The selection is the bits of its
+	* tiles
+	*/
+	struct MemoryUsage
+	{
+		qint64 canvas;
+		qint64 overlay;
+		qint64 selection;
+		qint64 undo;
+		qint64 redo;
+		qint64 caches;
+		qint64 ioBuffers;
+		qint64 tileStore;
+		qint64 deduplicated;
+
+		qint64 total() const
+		{
+			return canvas + overlay + selection + undo + redo + caches + ioBuffers;
+		}
+	};
+
+	MemoryUsage memoryUsage();
+
+private:
+	//Times the private drawing and history functions one by one
+	friend class MicroBenchmark;
+
+	int paintMode;
+	bool modified;
+	bool undoing;
+	bool scribbling;
+	bool fill;
+	int penWidth;
+	int pngPreset;
+	int fillTolerance;
+	int selectionCombine;
+	QColor penColor;
+	QColor primaryColor;
+	QColor secondaryColor;
+	QColor fillColor;
+	Qt::PenStyle penStyle;
+	QSize viewSize;
+	QRect dirtyRect;
+	QRect clipRect;
+	bool clipping;
+	bool expandable;
+	QPointF viewOrigin;
+	double zoom;
+	QImage tempImage;
+	LayerStack currentImage[10];
+	SelectionMask currentSelection;
+	int undoImageCounter;
+	int currentImageCounter;
+	QPoint lastPoint;
+	QPoint startPoint;
+	qint64 ioBufferBytes;
+
+	void markDirty(const QRect &rect);
+	void markCanvasDirty();
+	QRect viewRect();
+	QRect clipped(const QRect &bounds);
+	void drawFreehand(const QPoint &endPoint);
+	void drawShape(const QPoint &endPoint, int mode);
+	void floodFill(const QPoint &seed);
+	SelectionMask similarArea(const QPoint &seed);
+	void drawMarquee(const QPoint &endPoint);
+	void select(const SelectionMask &mask);
+	void paintMask(const SelectionMask &mask, const QColor &color);
+	bool isSelecting();
+	void paintShape(QPainter &painter, const QPoint &endPoint);
+	QRect shapeBounds(const QPoint &endPoint);
+	double calculateHypotenuse(const QPoint &endPoint);
+	QPointF calculateMiddlePoint(const QPoint &endPoint);
+	void checkImageCount();
+	void clearHistory();
+	void rearrangeImages();
+	void storeTiles();
+	void resizeImage(QImage *image, const QSize &newSize);
+};
+
+#endif // DRAWINGENGINE_H
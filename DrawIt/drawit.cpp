@@ -10,6 +10,9 @@ DrawIt::DrawIt(QWidget *parent)
 	height = QApplication::desktop()->height();	
 	
 	drawingBoard = new DrawingBoard(100, 60, width - 200, height - 160, this);
+	strokePlayer = new StrokePlayer(drawingBoard, this);
+	//DRAWIT_MEMORY_WARNING sets the drawing memory in megabytes above which a warning is logged
+	drawingBoard->setMemoryWarning(qgetenv("DRAWIT_MEMORY_WARNING").toLongLong() * 1024 * 1024);
 
 	setupGUI();
 	createActions();
@@ -73,11 +76,43 @@ void DrawIt::setupGUI(){
 	rectangleButton->setCheckable(true);
 	rectangleButton->setToolTip("Draw a rectangle");
 
+	bucketButton = new QToolButton(this);
+	bucketButton->setGeometry(15, 180, buttonSize, buttonSize);
+	bucketButton->setIcon(QIcon(":/DrawIt/ic_bucket"));
+	bucketButton->setIconSize(QSize(buttonSize, buttonSize));
+	bucketButton->setCheckable(true);
+	bucketButton->setToolTip("Fill an area of similar color");
+
+	selectRectangleButton = new QToolButton(this);
+	selectRectangleButton->setGeometry(55, 180, buttonSize, buttonSize);
+	selectRectangleButton->setIcon(QIcon(":/DrawIt/ic_select_rectangle"));
+	selectRectangleButton->setIconSize(QSize(buttonSize, buttonSize));
+	selectRectangleButton->setCheckable(true);
+	selectRectangleButton->setToolTip("Select a rectangle");
+
+	selectEllipseButton = new QToolButton(this);
+	selectEllipseButton->setGeometry(15, 220, buttonSize, buttonSize);
+	selectEllipseButton->setIcon(QIcon(":/DrawIt/ic_select_ellipse"));
+	selectEllipseButton->setIconSize(QSize(buttonSize, buttonSize));
+	selectEllipseButton->setCheckable(true);
+	selectEllipseButton->setToolTip("Select an ellipse");
+
+	magicWandButton = new QToolButton(this);
+	magicWandButton->setGeometry(55, 220, buttonSize, buttonSize);
+	magicWandButton->setIcon(QIcon(":/DrawIt/ic_magic_wand"));
+	magicWandButton->setIconSize(QSize(buttonSize, buttonSize));
+	magicWandButton->setCheckable(true);
+	magicWandButton->setToolTip("Select an area of similar color");
+
 	QButtonGroup* modeGroup = new QButtonGroup();
 	modeGroup->addButton(freehandButton, drawingBoard->modeFreehand);
 	modeGroup->addButton(lineButton, drawingBoard->modeLine);
 	modeGroup->addButton(circleButton, drawingBoard->modeCircle);
 	modeGroup->addButton(rectangleButton, drawingBoard->modeRectangle);
+	modeGroup->addButton(bucketButton, drawingBoard->modeFill);
+	modeGroup->addButton(selectRectangleButton, drawingBoard->modeSelectRectangle);
+	modeGroup->addButton(selectEllipseButton, drawingBoard->modeSelectEllipse);
+	modeGroup->addButton(magicWandButton, drawingBoard->modeMagicWand);
 	connect(modeGroup, SIGNAL(buttonClicked(int)), this, SLOT(setDrawingMode(int)));
 
 	primaryColorButton = new QToolButton(this);
@@ -137,6 +172,13 @@ void DrawIt::setupGUI(){
 	vColor = drawingBoard->getSecondaryColor();
 	color = vColor.toString();
 	secondaryColorButton->setStyleSheet("background-color: " + color);
+
+	//The board isn't in a layout, so the navigator floats instead of taking room from it
+	navigatorDock = new QDockWidget(tr("Navigator"), this);
+	navigatorDock->setWidget(new NavigatorWidget(drawingBoard, navigatorDock));
+	addDockWidget(Qt::RightDockWidgetArea, navigatorDock);
+	navigatorDock->setFloating(true);
+	navigatorDock->hide();
 }
 
 /*
@@ -168,6 +210,127 @@ void DrawIt::createActions()
 	connect(clearScreenAct, SIGNAL(triggered()),
 		this, SLOT(clearImage()));
 
+	fillToleranceAct = new QAction(tr("Fill &Tolerance..."), this);
+	connect(fillToleranceAct, SIGNAL(triggered()), this, SLOT(setFillTolerance()));
+
+	pngPresetGroup = new QActionGroup(this);
+	QAction *pngPresetAct = new QAction(tr("&Fastest"), pngPresetGroup);
+	pngPresetAct->setData(PngWriter::presetFastest);
+	pngPresetAct = new QAction(tr("&Balanced"), pngPresetGroup);
+	pngPresetAct->setData(PngWriter::presetBalanced);
+	pngPresetAct = new QAction(tr("&Smallest"), pngPresetGroup);
+	pngPresetAct->setData(PngWriter::presetSmallest);
+	foreach(QAction *action, pngPresetGroup->actions()) {
+		action->setCheckable(true);
+		action->setChecked(action->data().toInt() == drawingBoard->getPngPreset());
+	}
+	connect(pngPresetGroup, SIGNAL(triggered(QAction *)), this, SLOT(setPngPreset(QAction *)));
+
+	recordAct = new QAction(tr("&Record Strokes"), this);
+	recordAct->setCheckable(true);
+	connect(recordAct, SIGNAL(toggled(bool)), this, SLOT(setRecording(bool)));
+
+	replayAct = new QAction(tr("Re&play Strokes..."), this);
+	connect(replayAct, SIGNAL(triggered()), this, SLOT(replay()));
+
+	replayRealTimeAct = new QAction(tr("Replay Strokes in Real &Time..."), this);
+	connect(replayRealTimeAct, SIGNAL(triggered()), this, SLOT(replay()));
+
+	measureLatencyAct = new QAction(tr("Measure Input &Latency"), this);
+	measureLatencyAct->setCheckable(true);
+	connect(measureLatencyAct, SIGNAL(toggled(bool)), this, SLOT(setLatencyMeasuring(bool)));
+
+	hudAct = new QAction(tr("Show Performance &Overlay"), this);
+	hudAct->setCheckable(true);
+	hudAct->setShortcut(Qt::Key_F12);
+	connect(hudAct, SIGNAL(toggled(bool)), this, SLOT(setHudVisible(bool)));
+
+	traceAct = new QAction(tr("&Record Trace"), this);
+	traceAct->setCheckable(true);
+	traceAct->setChecked(TraceLog::isEnabled());
+	connect(traceAct, SIGNAL(toggled(bool)), this, SLOT(setTracing(bool)));
+
+	saveTraceAct = new QAction(tr("&Save Trace..."), this);
+	connect(saveTraceAct, SIGNAL(triggered()), this, SLOT(saveTrace()));
+
+	zoomInAct = new QAction(tr("Zoom &In"), this);
+	zoomInAct->setShortcuts(QKeySequence::ZoomIn);
+	connect(zoomInAct, SIGNAL(triggered()), this, SLOT(zoomIn()));
+
+	zoomOutAct = new QAction(tr("Zoom &Out"), this);
+	zoomOutAct->setShortcuts(QKeySequence::ZoomOut);
+	connect(zoomOutAct, SIGNAL(triggered()), this, SLOT(zoomOut()));
+
+	actualSizeAct = new QAction(tr("&Actual Size"), this);
+	actualSizeAct->setShortcut(tr("Ctrl+0"));
+	connect(actualSizeAct, SIGNAL(triggered()), this, SLOT(actualSize()));
+
+	navigatorAct = navigatorDock->toggleViewAction();
+	navigatorAct->setText(tr("&Navigator"));
+	navigatorAct->setShortcut(Qt::Key_F9);
+
+	newLayerAct = new QAction(tr("&New Layer"), this);
+	newLayerAct->setShortcut(tr("Ctrl+Shift+N"));
+	connect(newLayerAct, SIGNAL(triggered()), this, SLOT(addLayer()));
+
+	deleteLayerAct = new QAction(tr("&Delete Layer"), this);
+	connect(deleteLayerAct, SIGNAL(triggered()), this, SLOT(removeLayer()));
+
+	raiseLayerAct = new QAction(tr("Move Layer &Up"), this);
+	connect(raiseLayerAct, SIGNAL(triggered()), this, SLOT(raiseLayer()));
+
+	lowerLayerAct = new QAction(tr("Move Layer Do&wn"), this);
+	connect(lowerLayerAct, SIGNAL(triggered()), this, SLOT(lowerLayer()));
+
+	layerOpacityAct = new QAction(tr("Layer &Opacity..."), this);
+	connect(layerOpacityAct, SIGNAL(triggered()), this, SLOT(setLayerOpacity()));
+
+	layerVisibleAct = new QAction(tr("&Show Layer"), this);
+	layerVisibleAct->setCheckable(true);
+	connect(layerVisibleAct, SIGNAL(triggered(bool)), this, SLOT(setLayerVisible(bool)));
+
+	blendModeGroup = new QActionGroup(this);
+	for (int mode = 0; mode < LayerStack::blendModeCount; ++mode){
+		QAction *blendModeAct = new QAction(tr(LayerStack::blendModeName(mode)), blendModeGroup);
+		blendModeAct->setData(mode);
+		blendModeAct->setCheckable(true);
+	}
+	connect(blendModeGroup, SIGNAL(triggered(QAction *)), this, SLOT(setLayerBlendMode(QAction *)));
+
+	//Filled with the layers every time the menu opens
+	layerGroup = new QActionGroup(this);
+	connect(layerGroup, SIGNAL(triggered(QAction *)), this, SLOT(selectLayer(QAction *)));
+
+	selectAllAct = new QAction(tr("Select &All"), this);
+	selectAllAct->setShortcuts(QKeySequence::SelectAll);
+	connect(selectAllAct, SIGNAL(triggered()), this, SLOT(selectAll()));
+
+	deselectAct = new QAction(tr("&Deselect"), this);
+	deselectAct->setShortcut(tr("Ctrl+D"));
+	connect(deselectAct, SIGNAL(triggered()), this, SLOT(deselect()));
+
+	invertSelectionAct = new QAction(tr("&Invert Selection"), this);
+	invertSelectionAct->setShortcut(tr("Ctrl+Shift+I"));
+	connect(invertSelectionAct, SIGNAL(triggered()), this, SLOT(invertSelection()));
+
+	fillSelectionAct = new QAction(tr("&Fill Selection"), this);
+	connect(fillSelectionAct, SIGNAL(triggered()), this, SLOT(fillSelection()));
+
+	selectionCombineGroup = new QActionGroup(this);
+	QAction *selectionCombineAct = new QAction(tr("&Replace Selection"), selectionCombineGroup);
+	selectionCombineAct->setData(SelectionMask::combineReplace);
+	selectionCombineAct = new QAction(tr("Add &to Selection"), selectionCombineGroup);
+	selectionCombineAct->setData(SelectionMask::combineAdd);
+	selectionCombineAct = new QAction(tr("&Subtract from Selection"), selectionCombineGroup);
+	selectionCombineAct->setData(SelectionMask::combineSubtract);
+	selectionCombineAct = new QAction(tr("Intersect &with Selection"), selectionCombineGroup);
+	selectionCombineAct->setData(SelectionMask::combineIntersect);
+	foreach(QAction *action, selectionCombineGroup->actions()) {
+		action->setCheckable(true);
+		action->setChecked(action->data().toInt() == drawingBoard->getSelectionCombine());
+	}
+	connect(selectionCombineGroup, SIGNAL(triggered(QAction *)), this, SLOT(setSelectionCombine(QAction *)));
+
 	aboutAct = new QAction(tr("&About"), this);
 	connect(aboutAct, SIGNAL(triggered()), this, SLOT(about()));
 
@@ -194,6 +357,55 @@ void DrawIt::createMenus()
 	optionMenu = new QMenu(tr("&Options"), this);
 	optionMenu->addAction(changeBackgroundColorAct);
 	optionMenu->addAction(clearScreenAct);
+	optionMenu->addAction(fillToleranceAct);
+
+	pngPresetMenu = new QMenu(tr("&PNG Compression"), this);
+	pngPresetMenu->addActions(pngPresetGroup->actions());
+	optionMenu->addSeparator();
+	optionMenu->addMenu(pngPresetMenu);
+
+	recordingMenu = new QMenu(tr("Stroke &Recording"), this);
+	recordingMenu->addAction(recordAct);
+	recordingMenu->addAction(replayAct);
+	recordingMenu->addAction(replayRealTimeAct);
+	optionMenu->addMenu(recordingMenu);
+	optionMenu->addAction(measureLatencyAct);
+	optionMenu->addAction(hudAct);
+
+	traceMenu = new QMenu(tr("Performance &Trace"), this);
+	traceMenu->addAction(traceAct);
+	traceMenu->addAction(saveTraceAct);
+	optionMenu->addMenu(traceMenu);
+
+	viewMenu = new QMenu(tr("&View"), this);
+	viewMenu->addAction(zoomInAct);
+	viewMenu->addAction(zoomOutAct);
+	viewMenu->addAction(actualSizeAct);
+	viewMenu->addSeparator();
+	viewMenu->addAction(navigatorAct);
+
+	layerMenu = new QMenu(tr("&Layers"), this);
+	layerMenu->addAction(newLayerAct);
+	layerMenu->addAction(deleteLayerAct);
+	layerMenu->addAction(raiseLayerAct);
+	layerMenu->addAction(lowerLayerAct);
+	layerMenu->addSeparator();
+	layerMenu->addAction(layerVisibleAct);
+	layerMenu->addAction(layerOpacityAct);
+	blendModeMenu = new QMenu(tr("&Blend Mode"), this);
+	blendModeMenu->addActions(blendModeGroup->actions());
+	layerMenu->addMenu(blendModeMenu);
+	layerMenu->addSeparator();
+	connect(layerMenu, SIGNAL(aboutToShow()), this, SLOT(updateLayerMenu()));
+
+	selectMenu = new QMenu(tr("&Select"), this);
+	selectMenu->addAction(selectAllAct);
+	selectMenu->addAction(deselectAct);
+	selectMenu->addAction(invertSelectionAct);
+	selectMenu->addSeparator();
+	selectMenu->addActions(selectionCombineGroup->actions());
+	selectMenu->addSeparator();
+	selectMenu->addAction(fillSelectionAct);
 
 	helpMenu = new QMenu(tr("&Help"), this);
 	helpMenu->addAction(aboutAct);
@@ -201,6 +413,9 @@ void DrawIt::createMenus()
 
 	menuBar()->addMenu(fileMenu);
 	menuBar()->addMenu(optionMenu);
+	menuBar()->addMenu(viewMenu);
+	menuBar()->addMenu(layerMenu);
+	menuBar()->addMenu(selectMenu);
 	menuBar()->addMenu(helpMenu);
 }
 
@@ -438,3 +653,269 @@ void DrawIt::setBackgroundColor(){
 void DrawIt::clearImage(){
 	drawingBoard->setBackgroundColor();
 }
+
+/*
+* Sets the speed/ratio preset used when saving as png
+* @param QAction* action - the checked preset action, its data holds the preset
+*/
+void DrawIt::setPngPreset(QAction *action){
+	drawingBoard->setPngPreset(action->data().toInt());
+}
+
+/*
+* Asks how much a color may differ from the clicked one for the paint bucket
+* to fill over it
+*/
+void DrawIt::setFillTolerance(){
+	bool ok;
+	int tolerance = QInputDialog::getInt(this, tr("Draw It"),
+		tr("Select the largest difference per color channel:"),
+		drawingBoard->getFillTolerance(),
+		0, 255, 1, &ok);
+	if (ok){
+		drawingBoard->setFillTolerance(tolerance);
+	}
+}
+
+/*
+* Starts recording on a new canvas, or stops and saves the recording
+* @param bool enabled - if the recording should run
+*/
+void DrawIt::setRecording(bool enabled){
+	if (enabled){
+		if (!maybeSave()){
+			recordAct->setChecked(false);
+			return;
+		}
+		drawingBoard->startRecording();
+		return;
+	}
+	if (!drawingBoard->isRecording()){
+		return;
+	}
+	drawingBoard->stopRecording();
+	QString fileName = QFileDialog::getSaveFileName(this, tr("Save Recording"),
+		QDir::currentPath() + "/untitled.ditrace",
+		tr("Stroke Recordings (*.ditrace);;All Files (*)"));
+	if (!fileName.isEmpty() && !drawingBoard->getTrace().save(fileName)){
+		QMessageBox::warning(this, tr("Draw It"), tr("The recording could not be saved."));
+	}
+}
+
+/*
+* Starts measuring the time from input to painted pixels, or stops and shows the results
+* @param bool enabled - if the measuring should run
+*/
+void DrawIt::setLatencyMeasuring(bool enabled){
+	if (enabled){
+		latencyProbe.clear();
+		drawingBoard->setLatencyProbe(&latencyProbe);
+		return;
+	}
+	drawingBoard->setLatencyProbe(0);
+	QMessageBox::information(this, tr("Input Latency"), "<pre>" + latencyProbe.report().toHtmlEscaped() + "</pre>");
+}
+
+/*
+* Shows or hides the performance overlay on the drawing board
+* @param bool visible - if the overlay should be shown
+*/
+void DrawIt::setHudVisible(bool visible){
+	drawingBoard->setHudVisible(visible);
+}
+
+/*
+* Doubles the zoom around the middle of the drawing board
+*/
+void DrawIt::zoomIn(){
+	drawingBoard->setZoom(drawingBoard->getZoom() * 2, drawingBoard->rect().center());
+}
+
+/*
+* Halves the zoom around the middle of the drawing board
+*/
+void DrawIt::zoomOut(){
+	drawingBoard->setZoom(drawingBoard->getZoom() / 2, drawingBoard->rect().center());
+}
+
+/*
+* Shows every canvas pixel on one screen pixel again
+*/
+void DrawIt::actualSize(){
+	drawingBoard->setZoom(1.0, drawingBoard->rect().center());
+}
+
+/*
+* Adds a layer above the current one to draw on
+*/
+void DrawIt::addLayer(){
+	drawingBoard->addLayer();
+}
+
+/*
+* Removes the current layer, the background can't be removed
+*/
+void DrawIt::removeLayer(){
+	drawingBoard->removeLayer();
+}
+
+/*
+* Moves the current layer one place up
+*/
+void DrawIt::raiseLayer(){
+	drawingBoard->moveLayer(drawingBoard->layers().currentLayer() + 1);
+}
+
+/*
+* Moves the current layer one place down, it stays above the background
+*/
+void DrawIt::lowerLayer(){
+	drawingBoard->moveLayer(drawingBoard->layers().currentLayer() - 1);
+}
+
+/*
+* Asks for the opacity of the current layer
+*/
+void DrawIt::setLayerOpacity(){
+	const LayerStack &layers = drawingBoard->layers();
+	bool ok;
+	int percent = QInputDialog::getInt(this, tr("Draw It"),
+		tr("Select layer opacity in percent:"),
+		layers.layer(layers.currentLayer()).opacity,
+		0, 100, 1, &ok);
+	if (ok){
+		drawingBoard->setLayerOpacity(percent);
+	}
+}
+
+/*
+* Shows or hides the current layer
+* @param bool visible - if the layer should be shown
+*/
+void DrawIt::setLayerVisible(bool visible){
+	drawingBoard->setLayerVisible(drawingBoard->layers().currentLayer(), visible);
+}
+
+/*
+* Sets the blend mode of the current layer
+* @param QAction* action - The action of the blend mode, its data is the mode
+*/
+void DrawIt::setLayerBlendMode(QAction *action){
+	drawingBoard->setLayerBlendMode(action->data().toInt());
+}
+
+/*
+* Makes a layer from the menu the one to draw on
+* @param QAction* action - The action of the layer, its data is the index
+*/
+void DrawIt::selectLayer(QAction *action){
+	drawingBoard->setCurrentLayer(action->data().toInt());
+}
+
+/*
+* Lists the layers, the top one first, and updates the actions for the current one
+*/
+void DrawIt::updateLayerMenu(){
+	const LayerStack &layers = drawingBoard->layers();
+	const int current = layers.currentLayer();
+	qDeleteAll(layerGroup->actions());
+	for (int i = layers.count() - 1; i >= 0; --i){
+		const LayerStack::Layer &listed = layers.layer(i);
+		QString text = listed.name;
+		if (!listed.visible){
+			text += tr(" (hidden)");
+		}
+		else if (listed.opacity < 100){
+			text += QString(" (%1%)").arg(listed.opacity);
+		}
+		QAction *layerAct = new QAction(text, layerGroup);
+		layerAct->setData(i);
+		layerAct->setCheckable(true);
+		layerAct->setChecked(i == current);
+		layerMenu->addAction(layerAct);
+	}
+	deleteLayerAct->setEnabled(current > 0);
+	raiseLayerAct->setEnabled(current > 0 && current < layers.count() - 1);
+	lowerLayerAct->setEnabled(current > 1);
+	layerVisibleAct->setChecked(layers.layer(current).visible);
+	blendModeMenu->setEnabled(current > 0);
+	foreach(QAction *action, blendModeGroup->actions()) {
+		action->setChecked(action->data().toInt() == layers.layer(current).blendMode);
+	}
+}
+
+/*
+* Selects the whole canvas
+*/
+void DrawIt::selectAll(){
+	drawingBoard->selectAll();
+}
+
+/*
+* Selects nothing
+*/
+void DrawIt::deselect(){
+	drawingBoard->deselect();
+}
+
+/*
+* Selects what isn't selected and deselects the rest
+*/
+void DrawIt::invertSelection(){
+	drawingBoard->invertSelection();
+}
+
+/*
+* Fills the selection with the primary color
+*/
+void DrawIt::fillSelection(){
+	drawingBoard->fillSelection();
+}
+
+/*
+* Sets how the marquees and the magic wand change the selection
+* @param QAction* action - The chosen action, its data is the combine mode
+*/
+void DrawIt::setSelectionCombine(QAction *action){
+	drawingBoard->setSelectionCombine(action->data().toInt());
+}
+
+/*
+* Starts recording how long the drawing code takes, or stops it. The zones recorded so far are kept
+* @param bool enabled - if the trace should be recorded
+*/
+void DrawIt::setTracing(bool enabled){
+	TraceLog::setEnabled(enabled);
+}
+
+/*
+* Saves the recorded trace as a Chrome trace event file
+*/
+void DrawIt::saveTrace(){
+	QString fileName = QFileDialog::getSaveFileName(this, tr("Save Trace"),
+		QDir::currentPath() + "/drawit-trace.json", tr("Chrome Trace Files (*.json);;All Files (*)"));
+	if (!fileName.isEmpty() && !TraceLog::save(fileName)){
+		QMessageBox::warning(this, tr("Draw It"), tr("The trace could not be saved."));
+	}
+}
+
+/*
+* Plays a saved recording on a new canvas, in real time if the sender was replayRealTimeAct
+*/
+void DrawIt::replay(){
+	const bool realTime = sender() == replayRealTimeAct;
+	if (!maybeSave()){
+		return;
+	}
+	QString fileName = QFileDialog::getOpenFileName(this, tr("Replay Recording"),
+		QDir::currentPath(), tr("Stroke Recordings (*.ditrace);;All Files (*)"));
+	if (fileName.isEmpty()){
+		return;
+	}
+	StrokeTrace trace;
+	if (!trace.load(fileName)){
+		QMessageBox::warning(this, tr("Draw It"), tr("The file is not a stroke recording."));
+		return;
+	}
+	strokePlayer->play(trace, realTime);
+}
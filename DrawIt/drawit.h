@@ -3,6 +3,9 @@
 
 #include <QtWidgets/QMainWindow>
 #include "drawingboard.h"
+#include "navigatorwidget.h"
+#include "strokeplayer.h"
+#include "tracelog.h"
 #include <QDesktopWidget>
 #include <QApplication>
 #include <QPushButton>
@@ -16,10 +19,12 @@
 #include <QString>
 #include <QFileDialog>
 #include <QAction>
+#include <QActionGroup>
 #include <QMessageBox>
 #include <QMenu>
 #include <QImageWriter>
 #include <QMenuBar>
+#include <QDockWidget>
 
 class DrawIt : public QMainWindow
 {
@@ -31,6 +36,9 @@ public:
 
 private:
 	DrawingBoard* drawingBoard;
+	StrokePlayer* strokePlayer;
+	LatencyProbe latencyProbe;
+	QDockWidget* navigatorDock;
 
 	int const buttonSize = 30;
 	int height;
@@ -42,6 +50,10 @@ private:
 	QToolButton* lineButton;
 	QToolButton* circleButton;
 	QToolButton* rectangleButton;
+	QToolButton* bucketButton;
+	QToolButton* selectRectangleButton;
+	QToolButton* selectEllipseButton;
+	QToolButton* magicWandButton;
 	QToolButton* primaryColorButton;
 	QToolButton* secondaryColorButton;
 	QToolButton* emptyFillButton;
@@ -52,12 +64,45 @@ private:
 	QMenu *saveAsMenu;
 	QMenu *fileMenu;
 	QMenu *optionMenu;
+	QMenu *pngPresetMenu;
+	QMenu *recordingMenu;
+	QMenu *traceMenu;
+	QMenu *viewMenu;
+	QMenu *layerMenu;
+	QMenu *blendModeMenu;
+	QMenu *selectMenu;
 	QMenu *helpMenu;
 	QAction *openAct;
 	QList<QAction *> saveAsActs;
 	QAction *exitAct;
 	QAction *changeBackgroundColorAct;
 	QAction *clearScreenAct;
+	QAction *fillToleranceAct;
+	QActionGroup *pngPresetGroup;
+	QAction *recordAct;
+	QAction *replayAct;
+	QAction *replayRealTimeAct;
+	QAction *measureLatencyAct;
+	QAction *hudAct;
+	QAction *traceAct;
+	QAction *saveTraceAct;
+	QAction *zoomInAct;
+	QAction *zoomOutAct;
+	QAction *actualSizeAct;
+	QAction *navigatorAct;
+	QAction *newLayerAct;
+	QAction *deleteLayerAct;
+	QAction *raiseLayerAct;
+	QAction *lowerLayerAct;
+	QAction *layerOpacityAct;
+	QAction *layerVisibleAct;
+	QActionGroup *blendModeGroup;
+	QActionGroup *layerGroup;
+	QAction *selectAllAct;
+	QAction *deselectAct;
+	QAction *invertSelectionAct;
+	QAction *fillSelectionAct;
+	QActionGroup *selectionCombineGroup;
 	QAction *aboutAct;
 	QAction *aboutQtAct;
 
@@ -73,6 +118,31 @@ public slots:
 	void save();
 	void setBackgroundColor();
 	void clearImage();
+	void setPngPreset(QAction *action);
+	void setFillTolerance();
+	void setRecording(bool enabled);
+	void replay();
+	void setLatencyMeasuring(bool enabled);
+	void setHudVisible(bool visible);
+	void setTracing(bool enabled);
+	void saveTrace();
+	void zoomIn();
+	void zoomOut();
+	void actualSize();
+	void addLayer();
+	void removeLayer();
+	void raiseLayer();
+	void lowerLayer();
+	void setLayerOpacity();
+	void setLayerVisible(bool visible);
+	void setLayerBlendMode(QAction *action);
+	void selectLayer(QAction *action);
+	void updateLayerMenu();
+	void selectAll();
+	void deselect();
+	void invertSelection();
+	void fillSelection();
+	void setSelectionCombine(QAction *action);
 	void about();
 	void setPrimaryColor();
 	void setSecondaryColor();
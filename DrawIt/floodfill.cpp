@@ -0,0 +1,483 @@
+#include "floodfill.h"
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <climits>
+
+/**
+* Grows the area inside one tile from the spans handed over by its
+* neighbours. It only writes the bitmap of its tile, the spans that reach the
+* borders are collected for the neighbours and the next round
+*/
+class FloodTileJob : public QRunnable
+{
+public:
+	FloodTileJob(const FloodFill *fill, int column, int row, const FloodFill::Block &tile,
+		const QVector<FloodFill::Span> &incoming, QSemaphore *done);
+	void run();
+
+	static const int sideAbove = 0;
+	static const int sideBelow = 1;
+	static const int sideLeft = 2;
+	static const int sideRight = 3;
+
+	int column;
+	int row;
+	//The spans handed to the neighbour on each side
+	QVector<FloodFill::Span> outgoing[4];
+	int left;
+	int top;
+	int right;
+	int bottom;
+
+private:
+	const FloodFill *fill;
+	FloodFill::Block tile;
+	QVector<FloodFill::Span> incoming;
+	QSemaphore *done;
+	int originX;
+	int originY;
+	//The part of the tile inside the area, in tile coordinates
+	QRect inside;
+
+	FloodFill::Line line(int y) const;
+	void pushRuns(int from, int to, int y, QVector<QPoint> *seeds) const;
+};
+
+FloodTileJob::FloodTileJob(const FloodFill *fill, int column, int row, const FloodFill::Block &tile,
+	const QVector<FloodFill::Span> &incoming, QSemaphore *done)
+	: column(column), row(row), fill(fill), tile(tile), incoming(incoming), done(done)
+{
+	setAutoDelete(false);
+	originX = column * TiledCanvas::tileSize;
+	originY = row * TiledCanvas::tileSize;
+	inside = fill->area.intersected(QRect(originX, originY, TiledCanvas::tileSize, TiledCanvas::tileSize))
+		.translated(-originX, -originY);
+	left = INT_MAX;
+	top = INT_MAX;
+	right = INT_MIN;
+	bottom = INT_MIN;
+}
+
+void FloodTileJob::run()
+{
+	QVector<QPoint> seeds;
+	foreach(const FloodFill::Span &span, incoming) {
+		pushRuns(span.from - originX, span.to - originX, span.y - originY, &seeds);
+	}
+	while (!seeds.isEmpty()){
+		const QPoint point = seeds.last();
+		seeds.removeLast();
+		const int y = point.y();
+		const FloodFill::Line pixels = line(y);
+		if (!fill->isOpen(pixels, point.x())){
+			continue;
+		}
+		int from = point.x();
+		while (from > inside.left() && fill->isOpen(pixels, from - 1)){
+			--from;
+		}
+		int to = point.x();
+		while (to < inside.right() && fill->isOpen(pixels, to + 1)){
+			++to;
+		}
+		SelectionMask::setBits(pixels.visited, from, to);
+		left = qMin(left, from + originX);
+		right = qMax(right, to + originX);
+		top = qMin(top, y + originY);
+		bottom = qMax(bottom, y + originY);
+		const FloodFill::Span above = { from + originX, to + originX, y + originY - 1 };
+		const FloodFill::Span below = { from + originX, to + originX, y + originY + 1 };
+		if (y > inside.top()){
+			pushRuns(from, to, y - 1, &seeds);
+		}
+		else if (above.y >= fill->area.top()){
+			outgoing[sideAbove].append(above);
+		}
+		if (y < inside.bottom()){
+			pushRuns(from, to, y + 1, &seeds);
+		}
+		else if (below.y <= fill->area.bottom()){
+			outgoing[sideBelow].append(below);
+		}
+		if (from == 0 && originX > fill->area.left()){
+			const FloodFill::Span leftOf = { originX - 1, originX - 1, y + originY };
+			outgoing[sideLeft].append(leftOf);
+		}
+		if (to == TiledCanvas::tileSize - 1 && originX + to < fill->area.right()){
+			const FloodFill::Span rightOf = { originX + to + 1, originX + to + 1, y + originY };
+			outgoing[sideRight].append(rightOf);
+		}
+	}
+	if (done){
+		done->release();
+	}
+}
+
+/**
+* Returns a row of the tile
+* @param int y - The y coordinate within the tile
+* @return Line - The pixels and visited bits of the row
+*/
+FloodFill::Line FloodTileJob::line(int y) const
+{
+	FloodFill::Line result;
+	result.pixels = tile.pixels + y * tile.stride;
+	result.visited = tile.visited + y * FloodFill::rowWords;
+	return result;
+}
+
+/**
+* Adds a seed for every run of pixels the area can grow over in a row of the
+* tile next to a filled span
+* @param int from - The first x coordinate within the tile
+* @param int to - The last x coordinate within the tile
+* @param int y - The row within the tile
+* @param QVector* seeds - The seeds still to grow from
+*/
+void FloodTileJob::pushRuns(int from, int to, int y, QVector<QPoint> *seeds) const
+{
+	const FloodFill::Line pixels = line(y);
+	bool open = false;
+	for (int x = from; x <= to; ++x){
+		//Nothing to seed in a word that is filled already
+		if ((x & 31) == 0 && x + 31 <= to && pixels.visited[x >> 5] == ~0u){
+			open = false;
+			x += 31;
+			continue;
+		}
+		const bool now = fill->isOpen(pixels, x);
+		if (now && !open){
+			seeds->append(QPoint(x, y));
+		}
+		open = now;
+	}
+}
+
+/**
+* @param TiledCanvas newCanvas - The Format_RGB32 canvas to look at, it has to outlive the fill
+* @param QRect newArea - The area the fill stays in
+* @param int newTolerance - The largest difference per color channel to the seed, 0 to 255
+*/
+FloodFill::FloodFill(const TiledCanvas &newCanvas, const QRect &newArea, int newTolerance) :
+	canvas(newCanvas)
+{
+	area = newArea;
+	tolerance = newTolerance;
+	target = 0;
+	left = INT_MAX;
+	top = INT_MAX;
+	right = INT_MIN;
+	bottom = INT_MIN;
+}
+
+FloodFill::~FloodFill()
+{
+
+}
+
+/**
+* Grows the area around a point over every connected pixel similar to the
+* pixel at that point. Several seeds add up
+* @param QPoint seed - The point to start at
+* @return QRect - The bounding box of everything filled so far, empty if the seed is outside the area
+*/
+QRect FloodFill::fill(const QPoint &seed)
+{
+	if (!area.contains(seed)){
+		return filledRect();
+	}
+	const int tileSize = TiledCanvas::tileSize;
+	const int seedColumn = TiledCanvas::tileOf(seed.x());
+	target = line(seedColumn, seed.y()).pixels[seed.x() - seedColumn * tileSize];
+	QVector<QPoint> seeds;
+	seeds.append(seed);
+	while (!seeds.isEmpty()){
+		const QPoint point = seeds.last();
+		seeds.removeLast();
+		const int y = point.y();
+		const int column = TiledCanvas::tileOf(point.x());
+		if (!isOpen(line(column, y), point.x() - column * tileSize)){
+			continue;
+		}
+		const int from = spanStart(point.x(), y);
+		const int to = spanEnd(point.x(), y);
+		markSpan(from, to, y);
+		if (y > area.top()){
+			pushRuns(from, to, y - 1, &seeds);
+		}
+		if (y < area.bottom()){
+			pushRuns(from, to, y + 1, &seeds);
+		}
+	}
+	return filledRect();
+}
+
+/**
+* Grows the same area as fill() with the tiles filled on the thread pool.
+* Every round fills the tiles that were handed spans in the round before, the
+* first of them on this thread
+* @param QPoint seed - The point to start at
+* @return QRect - The bounding box of everything filled so far, empty if the seed is outside the area
+*/
+QRect FloodFill::fillParallel(const QPoint &seed)
+{
+	if (!area.contains(seed)){
+		return filledRect();
+	}
+	const int seedColumn = TiledCanvas::tileOf(seed.x());
+	target = line(seedColumn, seed.y()).pixels[seed.x() - seedColumn * TiledCanvas::tileSize];
+	QHash<qint64, QVector<Span> > frontier;
+	const Span first = { seed.x(), seed.x(), seed.y() };
+	frontier[TiledCanvas::key(seedColumn, TiledCanvas::tileOf(seed.y()))].append(first);
+	//Tile offsets of the sides of FloodTileJob
+	static const int neighbourColumns[] = { 0, 0, -1, 1 };
+	static const int neighbourRows[] = { -1, 1, 0, 0 };
+	while (!frontier.isEmpty()){
+		//The bitmaps are made here, the jobs don't change the hashes
+		QSemaphore done;
+		QList<FloodTileJob *> jobs;
+		for (QHash<qint64, QVector<Span> >::const_iterator spans = frontier.constBegin(); spans != frontier.constEnd(); ++spans){
+			const int column = int(quint32(spans.key()));
+			const int row = int(spans.key() >> 32);
+			jobs.append(new FloodTileJob(this, column, row, block(column, row), *spans, &done));
+		}
+		for (int i = 1; i < jobs.size(); ++i){
+			QThreadPool::globalInstance()->start(jobs[i]);
+		}
+		jobs[0]->run();
+		done.acquire(jobs.size());
+
+		frontier.clear();
+		foreach(FloodTileJob *job, jobs) {
+			left = qMin(left, job->left);
+			right = qMax(right, job->right);
+			top = qMin(top, job->top);
+			bottom = qMax(bottom, job->bottom);
+			for (int side = 0; side < 4; ++side){
+				if (!job->outgoing[side].isEmpty()){
+					frontier[TiledCanvas::key(job->column + neighbourColumns[side], job->row + neighbourRows[side])]
+						+= job->outgoing[side];
+				}
+			}
+			delete job;
+		}
+	}
+	return filledRect();
+}
+
+/**
+* Returns the bounding box of the filled pixels
+* @return QRect - The box, empty if nothing was filled
+*/
+QRect FloodFill::filledRect() const
+{
+	if (left > right){
+		return QRect();
+	}
+	return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+/**
+* Checks if a pixel was filled
+* @param QPoint point - The pixel
+* @return bool - true if the pixel is part of the area
+*/
+bool FloodFill::isFilled(const QPoint &point) const
+{
+	const int column = TiledCanvas::tileOf(point.x());
+	const int row = TiledCanvas::tileOf(point.y());
+	QHash<qint64, QVector<quint32> >::const_iterator found = visited.constFind(TiledCanvas::key(column, row));
+	if (found == visited.constEnd()){
+		return false;
+	}
+	const int x = point.x() - column * TiledCanvas::tileSize;
+	const int y = point.y() - row * TiledCanvas::tileSize;
+	return ((*found)[y * rowWords + (x >> 5)] & (1u << (x & 31))) != 0;
+}
+
+/**
+* Returns the filled pixels as a selection, the bitmaps are shared with it
+* @return SelectionMask - The area
+*/
+SelectionMask FloodFill::toMask() const
+{
+	SelectionMask mask;
+	for (QHash<qint64, QVector<quint32> >::const_iterator bits = visited.constBegin(); bits != visited.constEnd(); ++bits){
+		mask.setTile(int(quint32(bits.key())), int(bits.key() >> 32), *bits);
+	}
+	return mask;
+}
+
+/**
+* Returns a tile, reading its pixels and making its bitmap the first time it
+* is needed
+* @param int column - The tile column
+* @param int row - The tile row
+* @return Block - The pixels and visited bits of the tile
+*/
+FloodFill::Block FloodFill::block(int column, int row)
+{
+	const qint64 index = TiledCanvas::key(column, row);
+	QHash<qint64, Pixels>::iterator found = pixels.find(index);
+	if (found == pixels.end()){
+		Pixels tile;
+		const QRgb solid = canvas.colorOf(column, row);
+		if (solid != TiledCanvas::noColor){
+			tile.solid.fill(solid, TiledCanvas::tileSize);
+		}
+		else{
+			tile.image = canvas.tile(column, row);
+		}
+		found = pixels.insert(index, tile);
+	}
+	QHash<qint64, QVector<quint32> >::iterator bits = visited.find(index);
+	if (bits == visited.end()){
+		bits = visited.insert(index, QVector<quint32>(tileWords, 0));
+	}
+	Block result;
+	if (found->solid.isEmpty()){
+		result.pixels = reinterpret_cast<const QRgb *>(found->image.constBits());
+		result.stride = found->image.bytesPerLine() / sizeof(QRgb);
+	}
+	else{
+		result.pixels = found->solid.constData();
+		result.stride = 0;
+	}
+	result.visited = bits->data();
+	return result;
+}
+
+/**
+* Returns a row of a tile, see block()
+* @param int column - The tile column
+* @param int y - The canvas y coordinate of the row
+* @return Line - The pixels and visited bits of the row
+*/
+FloodFill::Line FloodFill::line(int column, int y)
+{
+	const int row = TiledCanvas::tileOf(y);
+	const Block tile = block(column, row);
+	const int tileY = y - row * TiledCanvas::tileSize;
+	Line result;
+	result.pixels = tile.pixels + tileY * tile.stride;
+	result.visited = tile.visited + tileY * rowWords;
+	return result;
+}
+
+/**
+* Follows the pixels the area can grow over from a point to the left
+* @param int x - The x coordinate of a pixel the area grows over
+* @param int y - The y coordinate
+* @return int - The x coordinate of the leftmost pixel of the span
+*/
+int FloodFill::spanStart(int x, int y)
+{
+	const int tileSize = TiledCanvas::tileSize;
+	int column = TiledCanvas::tileOf(x);
+	Line row = line(column, y);
+	for (;;){
+		const int offset = column * tileSize;
+		const int limit = qMax(area.left(), offset) - offset;
+		int inTile = x - offset;
+		while (inTile > limit && isOpen(row, inTile - 1)){
+			--inTile;
+		}
+		x = inTile + offset;
+		if (inTile > limit || x == area.left()){
+			return x;
+		}
+		--column;
+		row = line(column, y);
+		if (!isOpen(row, tileSize - 1)){
+			return x;
+		}
+		--x;
+	}
+}
+
+/**
+* Follows the pixels the area can grow over from a point to the right
+* @param int x - The x coordinate of a pixel the area grows over
+* @param int y - The y coordinate
+* @return int - The x coordinate of the rightmost pixel of the span
+*/
+int FloodFill::spanEnd(int x, int y)
+{
+	const int tileSize = TiledCanvas::tileSize;
+	int column = TiledCanvas::tileOf(x);
+	Line row = line(column, y);
+	for (;;){
+		const int offset = column * tileSize;
+		const int limit = qMin(area.right(), offset + tileSize - 1) - offset;
+		int inTile = x - offset;
+		while (inTile < limit && isOpen(row, inTile + 1)){
+			++inTile;
+		}
+		x = inTile + offset;
+		if (inTile < limit || x == area.right()){
+			return x;
+		}
+		++column;
+		row = line(column, y);
+		if (!isOpen(row, 0)){
+			return x;
+		}
+		++x;
+	}
+}
+
+/**
+* Sets the bits of a span of one row, a word at a time
+* @param int from - The first x coordinate
+* @param int to - The last x coordinate
+* @param int y - The y coordinate
+*/
+void FloodFill::markSpan(int from, int to, int y)
+{
+	const int tileSize = TiledCanvas::tileSize;
+	left = qMin(left, from);
+	right = qMax(right, to);
+	top = qMin(top, y);
+	bottom = qMax(bottom, y);
+	for (int start = from; start <= to;){
+		const int column = TiledCanvas::tileOf(start);
+		const int end = qMin(to, column * tileSize + tileSize - 1);
+		SelectionMask::setBits(line(column, y).visited, start - column * tileSize, end - column * tileSize);
+		start = end + 1;
+	}
+}
+
+/**
+* Adds a seed for every run of pixels the area can grow over in a row next
+* to a filled span
+* @param int from - The first x coordinate of the span
+* @param int to - The last x coordinate of the span
+* @param int y - The row next to the span
+* @param QVector* seeds - The seeds still to grow from
+*/
+void FloodFill::pushRuns(int from, int to, int y, QVector<QPoint> *seeds)
+{
+	const int tileSize = TiledCanvas::tileSize;
+	bool open = false;
+	for (int start = from; start <= to;){
+		const int column = TiledCanvas::tileOf(start);
+		const int offset = column * tileSize;
+		const int end = qMin(to, offset + tileSize - 1) - offset;
+		const Line row = line(column, y);
+		for (int x = start - offset; x <= end; ++x){
+			//Nothing to seed in a word that is filled already
+			if ((x & 31) == 0 && x + 31 <= end && row.visited[x >> 5] == ~0u){
+				open = false;
+				x += 31;
+				continue;
+			}
+			const bool now = isOpen(row, x);
+			if (now && !open){
+				seeds->append(QPoint(x + offset, y));
+			}
+			open = now;
+		}
+		start = end + offset + 1;
+	}
+}
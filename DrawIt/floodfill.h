@@ -0,0 +1,122 @@
+#ifndef FLOODFILL_H
+#define FLOODFILL_H
+
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QPoint>
+#include <QRect>
+#include <QVector>
+#include "selectionmask.h"
+#include "tiledcanvas.h"
+
+/**
+* Finds the connected area of similar color around a point of a Format_RGB32
+* TiledCanvas, for the paint bucket. The area is grown one horizontal span at
+* a time straight on the tile pixels, every span seeds the runs of matching
+* pixels in the rows above and below it. Which pixels were reached is kept as
+* one bit per pixel in a bitmap per tile, only for the tiles the area enters,
+* and handed on as a SelectionMask to paint or select the area.
+*
+* fillParallel() finds the same area with the tiles filled on the thread
+* pool. Each tile grows the area inside itself from the spans its neighbours
+* handed over and hands over the spans that reach its own borders, round
+* after round until no tile has spans left.
+*/
+class FloodFill
+{
+public:
+	FloodFill(const TiledCanvas &newCanvas, const QRect &newArea, int newTolerance);
+	~FloodFill();
+	QRect fill(const QPoint &seed);
+	QRect fillParallel(const QPoint &seed);
+	QRect filledRect() const;
+	bool isFilled(const QPoint &point) const;
+	SelectionMask toMask() const;
+
+	//Words of a tile bitmap, laid out like the tiles of SelectionMask
+	static const int tileWords = SelectionMask::tileWords;
+	//Words of one row of a tile bitmap
+	static const int rowWords = SelectionMask::rowWords;
+	//Areas of more tiles than this are worth filling on the thread pool
+	static const int parallelTiles = 16;
+
+private:
+	//Fills one tile of fillParallel() on the thread pool
+	friend class FloodTileJob;
+
+	//The pixels of a tile, a tile of one color is kept as a single row
+	struct Pixels
+	{
+		QImage image;
+		QVector<QRgb> solid;
+	};
+
+	//One row of a tile, both indexed by the x coordinate within the tile
+	struct Line
+	{
+		const QRgb *pixels;
+		quint32 *visited;
+	};
+
+	//A whole tile, row y starts at pixels + y * stride and visited + y * rowWords
+	struct Block
+	{
+		const QRgb *pixels;
+		int stride;
+		quint32 *visited;
+	};
+
+	//Pixels of one row next to a filled span that still have to be looked at
+	struct Span
+	{
+		int from;
+		int to;
+		int y;
+	};
+
+	const TiledCanvas &canvas;
+	QRect area;
+	int tolerance;
+	QRgb target;
+	QHash<qint64, Pixels> pixels;
+	QHash<qint64, QVector<quint32> > visited;
+	int left;
+	int top;
+	int right;
+	int bottom;
+
+	Block block(int column, int row);
+	Line line(int column, int y);
+	bool isOpen(const Line &row, int x) const;
+	bool isSimilar(QRgb color) const;
+	int spanStart(int x, int y);
+	int spanEnd(int x, int y);
+	void markSpan(int from, int to, int y);
+	void pushRuns(int from, int to, int y, QVector<QPoint> *seeds);
+};
+
+/**
+* Checks if a pixel of a row is similar to the seed and not yet reached
+* @param Line row - The row
+* @param int x - The x coordinate within the tile
+* @return bool - true if the area grows over the pixel
+*/
+inline bool FloodFill::isOpen(const Line &row, int x) const
+{
+	return (row.visited[x >> 5] & (1u << (x & 31))) == 0 && isSimilar(row.pixels[x]);
+}
+
+/**
+* Checks if a color differs from the seed color by at most the tolerance in
+* every channel
+* @param QRgb color - The color
+* @return bool - true if the color is similar
+*/
+inline bool FloodFill::isSimilar(QRgb color) const
+{
+	return qAbs(qRed(color) - qRed(target)) <= tolerance && qAbs(qGreen(color) - qGreen(target)) <= tolerance
+		&& qAbs(qBlue(color) - qBlue(target)) <= tolerance;
+}
+
+#endif // FLOODFILL_H
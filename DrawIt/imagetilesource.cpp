@@ -0,0 +1,280 @@
+#include "imagetilesource.h"
+
+#include <QMutexLocker>
+#include <QPainter>
+#include <cstring>
+
+//Memory the decoded tiles may use before the least recently used are dropped
+static const qint64 defaultCacheLimit = qint64(256) << 20;
+
+ImageTileSource::ImageTileSource(const QString &fileName, int tileSize)
+	: fileName(fileName), tileSize(tileSize)
+{
+	columns = 0;
+	clipSupported = false;
+	spilled = 0;
+	setCacheLimit(defaultCacheLimit);
+}
+
+ImageTileSource::~ImageTileSource()
+{
+
+}
+
+/**
+* Reads the image header and prepares the tiles. Only formats that can't
+* decode a clip rect are decoded here, PNG files that aren't interlaced one
+* band of rows at a time
+* @return bool - if the image could be read
+*/
+bool ImageTileSource::open()
+{
+	QImageReader reader(fileName);
+	if (!reader.canRead()){
+		return false;
+	}
+	imageSize = reader.size();
+	if (!imageSize.isValid() || imageSize.isEmpty()){
+		return false;
+	}
+	columns = (imageSize.width() + tileSize - 1) / tileSize;
+	clipSupported = reader.supportsOption(QImageIOHandler::ClipRect);
+	if (!clipSupported){
+		if (reader.format() == "png"){
+			PngReader rows;
+			if (rows.open(fileName) && !rows.isInterlaced() && rows.size() == imageSize){
+				return spillRows(&rows);
+			}
+		}
+		return spill(&reader);
+	}
+	return true;
+}
+
+/**
+* Returns the size of the image
+* @return QSize - The image size
+*/
+QSize ImageTileSource::size() const
+{
+	return imageSize;
+}
+
+/**
+* Returns a tile of the image, tiles outside the image are white
+* @param int column - The tile column
+* @param int row - The tile row
+* @return QImage - The tile in Format_RGB32
+*/
+QImage ImageTileSource::tile(int column, int row)
+{
+	if (column < 0 || row < 0 || column >= columns || row * tileSize >= imageSize.height()){
+		return blankTile();
+	}
+	const int key = row * columns + column;
+	const int cost = tileSize * tileSize * 4 / 1024;
+	QMutexLocker locker(&mutex);
+	QImage *cached = cache.object(key);
+	while (!cached && decodingRows.contains(row)){
+		bandDecoded.wait(&mutex);
+		cached = cache.object(key);
+	}
+	if (cached){
+		return *cached;
+	}
+	if (!clipSupported){
+		if (spilled){
+			locker.unlock();
+		}
+		const QImage spilledTile = readSpilledTile(column, row);
+		locker.relock();
+		cache.insert(key, new QImage(spilledTile), cost);
+		return spilledTile;
+	}
+	decodingRows.insert(row);
+	locker.unlock();
+	const QList<QImage> band = decodeBand(row);
+	locker.relock();
+	decodingRows.remove(row);
+	for (int bandColumn = 0; bandColumn < columns; ++bandColumn){
+		if (bandColumn != column){
+			cache.insert(row * columns + bandColumn, new QImage(band[bandColumn]), cost);
+		}
+	}
+	//Inserted last so the rest of the band can't push it out
+	cache.insert(key, new QImage(band[column]), cost);
+	bandDecoded.wakeAll();
+	return band[column];
+}
+
+/**
+* Sets how much memory the decoded tiles may use
+* @param qint64 bytes - The cache limit
+*/
+void ImageTileSource::setCacheLimit(qint64 bytes)
+{
+	QMutexLocker locker(&mutex);
+	cache.setMaxCost(int(bytes / 1024));
+}
+
+/**
+* Returns how much memory the decoded tiles may use
+* @return qint64 - The cache limit in bytes
+*/
+qint64 ImageTileSource::getCacheLimit()
+{
+	QMutexLocker locker(&mutex);
+	return qint64(cache.maxCost()) * 1024;
+}
+
+/**
+* Returns how much memory the decoded tiles use now
+* @return qint64 - The bytes in the cache
+*/
+qint64 ImageTileSource::cacheBytes()
+{
+	QMutexLocker locker(&mutex);
+	return qint64(cache.totalCost()) * 1024;
+}
+
+/**
+* Creates a white tile
+* @return QImage - The new tile
+*/
+QImage ImageTileSource::blankTile()
+{
+	QImage blank(tileSize, tileSize, QImage::Format_RGB32);
+	blank.fill(qRgb(255, 255, 255));
+	return blank;
+}
+
+/**
+* Decodes the whole image once and writes it to a temporary file tile by tile
+* @param QImageReader* reader - Reader for the image
+* @return bool - if the image could be decoded
+*/
+bool ImageTileSource::spill(QImageReader *reader)
+{
+	QImage decoded = reader->read();
+	if (decoded.isNull() || !spillFile.open()){
+		return false;
+	}
+	const int rows = (imageSize.height() + tileSize - 1) / tileSize;
+	for (int row = 0; row < rows; ++row){
+		if (!writeBand(decoded, row * tileSize)){
+			return false;
+		}
+	}
+	return finishSpill();
+}
+
+/**
+* Decodes a PNG one band of tile rows at a time and writes each band to a
+* temporary file tile by tile, so only one band is ever in memory
+* @param PngReader* reader - Reader positioned at the first row
+* @return bool - if the image could be decoded
+*/
+bool ImageTileSource::spillRows(PngReader *reader)
+{
+	if (!spillFile.open()){
+		return false;
+	}
+	for (int top = 0; top < imageSize.height(); top += tileSize){
+		QImage band(imageSize.width(), qMin(tileSize, imageSize.height() - top), QImage::Format_ARGB32);
+		if (band.isNull()){
+			return false;
+		}
+		for (int y = 0; y < band.height(); ++y){
+			if (!reader->readRow(reinterpret_cast<QRgb *>(band.scanLine(y)))){
+				return false;
+			}
+		}
+		if (!writeBand(band, 0)){
+			return false;
+		}
+	}
+	return finishSpill();
+}
+
+/**
+* Cuts one row of tiles out of an image onto white and appends them to the spill file
+* @param QImage image - The image holding the rows
+* @param int top - The row of the image the tiles start at
+* @return bool - if the tiles were written
+*/
+bool ImageTileSource::writeBand(const QImage &image, int top)
+{
+	for (int column = 0; column < columns; ++column){
+		QImage spilledTile = blankTile();
+		QPainter painter(&spilledTile);
+		painter.drawImage(0, 0, image, column * tileSize, top, tileSize, tileSize);
+		painter.end();
+		const qint64 bytes = spilledTile.byteCount();
+		if (spillFile.write(reinterpret_cast<const char *>(spilledTile.constBits()), bytes) != bytes){
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+* Flushes the spill file and maps it, so tiles can be copied out of it
+* without the lock. Tiles are read from the file if it can't be mapped
+* @return bool - if the file was written
+*/
+bool ImageTileSource::finishSpill()
+{
+	if (!spillFile.flush()){
+		return false;
+	}
+	spilled = spillFile.map(0, spillFile.size());
+	return true;
+}
+
+/**
+* Decodes one row of tiles through a clip rect. Called without the lock
+* @param int row - The tile row
+* @return QList<QImage> - The tiles of the row, white where decoding failed
+*/
+QList<QImage> ImageTileSource::decodeBand(int row)
+{
+	const QRect band = QRect(0, row * tileSize, imageSize.width(), tileSize)
+		.intersected(QRect(QPoint(0, 0), imageSize));
+	QImageReader reader(fileName);
+	reader.setClipRect(band);
+	const QImage decoded = reader.read();
+
+	QList<QImage> tiles;
+	for (int bandColumn = 0; bandColumn < columns; ++bandColumn){
+		QImage decodedTile = blankTile();
+		if (!decoded.isNull()){
+			QPainter painter(&decodedTile);
+			painter.drawImage(0, 0, decoded, bandColumn * tileSize, 0, tileSize, tileSize);
+		}
+		tiles.append(decodedTile);
+	}
+	return tiles;
+}
+
+/**
+* Reads a tile back from the temporary file, from the mapping without the
+* lock or from the file with it
+* @param int column - The tile column
+* @param int row - The tile row
+* @return QImage - The tile
+*/
+QImage ImageTileSource::readSpilledTile(int column, int row)
+{
+	QImage spilledTile(tileSize, tileSize, QImage::Format_RGB32);
+	const qint64 bytes = spilledTile.byteCount();
+	const qint64 offset = qint64(row * columns + column) * bytes;
+	if (spilled){
+		memcpy(spilledTile.bits(), spilled + offset, bytes);
+		return spilledTile;
+	}
+	if (!spillFile.seek(offset)
+		|| spillFile.read(reinterpret_cast<char *>(spilledTile.bits()), bytes) != bytes){
+		return blankTile();
+	}
+	return spilledTile;
+}
@@ -0,0 +1,60 @@
+#ifndef IMAGETILESOURCE_H
+#define IMAGETILESOURCE_H
+
+#include <QCache>
+#include <QImage>
+#include <QImageReader>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QSize>
+#include <QString>
+#include <QTemporaryFile>
+#include <QWaitCondition>
+#include "pngreader.h"
+
+/**
+* Decodes the tiles of an image file on demand instead of loading the whole
+* image. Formats that can decode a clip rect are read one band of tiles at a
+* time, without holding the lock, so tiles of other bands can be faulted in
+* meanwhile. Other formats are spilled once to a temporary file that tiles
+* are paged in from, PNG one band of rows at a time through PngReader and the
+* rest decoded whole. Decoded tiles are kept in a size limited cache.
+*/
+class ImageTileSource
+{
+public:
+	ImageTileSource(const QString &fileName, int tileSize);
+	~ImageTileSource();
+	bool open();
+	QSize size() const;
+	QImage tile(int column, int row);
+	void setCacheLimit(qint64 bytes);
+	qint64 getCacheLimit();
+	qint64 cacheBytes();
+
+private:
+	QString fileName;
+	int tileSize;
+	QSize imageSize;
+	int columns;
+	bool clipSupported;
+	QTemporaryFile spillFile;
+	//The spill file mapped into memory, 0 if it couldn't be mapped
+	const uchar *spilled;
+	QCache<int, QImage> cache;
+	QMutex mutex;
+	//Tile rows being decoded, the threads that want their tiles wait for bandDecoded
+	QSet<int> decodingRows;
+	QWaitCondition bandDecoded;
+
+	QImage blankTile();
+	bool spill(QImageReader *reader);
+	bool spillRows(PngReader *reader);
+	bool writeBand(const QImage &image, int top);
+	bool finishSpill();
+	QList<QImage> decodeBand(int row);
+	QImage readSpilledTile(int column, int row);
+};
+
+#endif // IMAGETILESOURCE_H
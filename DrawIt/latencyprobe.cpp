@@ -0,0 +1,304 @@
+#include "latencyprobe.h"
+#include "drawingboard.h"
+#include "strokeplayer.h"
+
+#include <QApplication>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QEventLoop>
+#include <QTextStream>
+#include <QtMath>
+#include <algorithm>
+
+LatencyProbe::LatencyProbe()
+{
+	droppedCount = 0;
+	clock.start();
+}
+
+LatencyProbe::~LatencyProbe()
+{
+
+}
+
+/**
+* Returns the time to stamp an arriving input with
+* @return qint64 - Nanoseconds on the clock of the probe
+*/
+qint64 LatencyProbe::now() const
+{
+	return clock.nsecsElapsed();
+}
+
+/**
+* Remembers an input that changed pixels until a paint presents them
+* @param char* tool - The tool the input was for, a string that stays valid
+* @param qint64 arrival - When the input arrived, from now()
+* @param QRect dirtyRect - The area the input changed
+*/
+void LatencyProbe::inputHandled(const char *tool, qint64 arrival, const QRect &dirtyRect)
+{
+	if (pending.size() >= maximumPending){
+		pending.removeFirst();
+		++droppedCount;
+	}
+	PendingInput input;
+	input.tool = tool;
+	input.arrival = arrival;
+	input.remaining = QRegion(dirtyRect);
+	pending.append(input);
+}
+
+/**
+* Ends the measurement of every waiting input whose whole area has been painted
+* @param QRegion region - The region paintEvent drew
+*/
+void LatencyProbe::presented(const QRegion &region)
+{
+	const qint64 presentation = now();
+	QList<PendingInput>::iterator i = pending.begin();
+	while (i != pending.end()){
+		if (region.intersects(i->remaining)){
+			i->remaining -= region;
+		}
+		if (i->remaining.isEmpty()){
+			latencies[i->tool].append(presentation - i->arrival);
+			i = pending.erase(i);
+		}
+		else{
+			++i;
+		}
+	}
+}
+
+/**
+* Forgets every measurement and waiting input
+*/
+void LatencyProbe::clear()
+{
+	pending.clear();
+	latencies.clear();
+	droppedCount = 0;
+}
+
+/**
+* Returns the number of inputs measured so far
+* @return int - The number of latencies
+*/
+int LatencyProbe::sampleCount()
+{
+	int count = 0;
+	foreach(const QVector<qint64> &samples, latencies) {
+		count += samples.size();
+	}
+	return count;
+}
+
+/**
+* Formats the latency percentiles per tool as a table
+* @return QString - One line per tool, times in milliseconds
+*/
+QString LatencyProbe::report()
+{
+	QString text = QString("%1 %2 %3 %4 %5 %6\n").arg("tool", -10).arg("inputs", 8)
+		.arg("p50 ms", 9).arg("p95 ms", 9).arg("p99 ms", 9).arg("max ms", 9);
+	QMap<QString, QVector<qint64> >::iterator i;
+	for (i = latencies.begin(); i != latencies.end(); ++i){
+		QVector<qint64> sorted = i.value();
+		std::sort(sorted.begin(), sorted.end());
+		text += QString("%1 %2 %3 %4 %5 %6\n").arg(i.key(), -10).arg(sorted.size(), 8)
+			.arg(percentile(sorted, 50) / 1e6, 9, 'f', 2)
+			.arg(percentile(sorted, 95) / 1e6, 9, 'f', 2)
+			.arg(percentile(sorted, 99) / 1e6, 9, 'f', 2)
+			.arg(sorted.last() / 1e6, 9, 'f', 2);
+	}
+	if (droppedCount > 0 || !pending.isEmpty()){
+		text += QString("%1 inputs were never painted\n").arg(droppedCount + pending.size());
+	}
+	return text;
+}
+
+/**
+* Returns a percentile of the tool with the highest one
+* @param double percentile - The percentile, 0 to 100
+* @return double - The latency in milliseconds, 0 without measurements
+*/
+double LatencyProbe::worstPercentile(double percentile)
+{
+	double worst = 0;
+	foreach(QVector<qint64> sorted, latencies) {
+		std::sort(sorted.begin(), sorted.end());
+		worst = qMax(worst, LatencyProbe::percentile(sorted, percentile) / 1e6);
+	}
+	return worst;
+}
+
+/**
+* Returns the tool name of a paint mode
+* @param int paintMode - One of the DrawingEngine modes
+* @return char* - The name
+*/
+const char *LatencyProbe::toolName(int paintMode)
+{
+	switch (paintMode){
+		case DrawingEngine::modeLine:
+			return "line";
+		case DrawingEngine::modeCircle:
+			return "circle";
+		case DrawingEngine::modeRectangle:
+			return "rectangle";
+		case DrawingEngine::modeFill:
+			return "bucket";
+		case DrawingEngine::modeSelectRectangle:
+		case DrawingEngine::modeSelectEllipse:
+			return "marquee";
+		case DrawingEngine::modeMagicWand:
+			return "wand";
+		default:
+			return "freehand";
+	}
+}
+
+/**
+* Makes input like a mouse that reports at a fixed rate: strokes with every
+* tool, then undo and redo through them
+* @param QSize canvasSize - The canvas to draw on
+* @param int eventsPerSecond - The rate of the mouse
+* @param int strokesPerTool - Strokes drawn with each tool
+* @return StrokeTrace - The input
+*/
+StrokeTrace LatencyProbe::syntheticInput(const QSize &canvasSize, int eventsPerSecond, int strokesPerTool)
+{
+	StrokeTrace trace;
+	trace.setCanvasSize(canvasSize);
+	const double interval = 1000.0 / qMax(1, eventsPerSecond);
+	StrokeTrace::Event event;
+	event.pos = QPoint();
+	event.buttons = 0;
+	event.value = 0;
+	int eventCount = 0;
+
+	event.type = StrokeTrace::eventPenWidth;
+	event.value = 4;
+	event.time = 0;
+	trace.append(event);
+	const int modes[] = { DrawingEngine::modeFreehand, DrawingEngine::modeLine,
+		DrawingEngine::modeCircle, DrawingEngine::modeRectangle };
+	const QPointF center(canvasSize.width() / 2.0, canvasSize.height() / 2.0);
+	const double radius = qMin(canvasSize.width(), canvasSize.height()) * 0.4;
+	for (int mode = 0; mode < 4; ++mode){
+		event.type = StrokeTrace::eventPaintMode;
+		event.value = modes[mode];
+		event.buttons = 0;
+		trace.append(event);
+		event.value = 0;
+		for (int stroke = 0; stroke < strokesPerTool; ++stroke){
+			//Every stroke is an arc of its own around the middle of the canvas
+			const double start = stroke * 2.4;
+			for (int move = 0; move <= syntheticMoves + 1; ++move){
+				const double angle = start + qMin(move, syntheticMoves) * 0.05;
+				const double distance = radius * (0.3 + 0.7 * qMin(move, syntheticMoves) / syntheticMoves);
+				event.type = move == 0 ? StrokeTrace::eventPress
+					: move > syntheticMoves ? StrokeTrace::eventRelease : StrokeTrace::eventMove;
+				event.pos = (center + QPointF(qCos(angle), qSin(angle)) * distance).toPoint();
+				event.buttons = Qt::LeftButton;
+				event.time = qint64(++eventCount * interval);
+				trace.append(event);
+			}
+		}
+	}
+	event.pos = QPoint();
+	event.buttons = 0;
+	for (int step = 0; step < 2 * strokesPerTool; ++step){
+		event.type = step < strokesPerTool ? StrokeTrace::eventUndo : StrokeTrace::eventRedo;
+		event.time = qint64(++eventCount * interval);
+		trace.append(event);
+	}
+	return trace;
+}
+
+/**
+* Plays synthetic input or recorded traces in real time on a shown board and
+* prints the latency percentiles per tool
+* @param QStringList arguments - The command line
+* @return int - The exit code, 1 if a limit was exceeded
+*/
+int LatencyProbe::exec(const QStringList &arguments)
+{
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Measures the latency from input to painted pixels.");
+	parser.addHelpOption();
+	QCommandLineOption latencyOption("latency", "Measure and exit.");
+	QCommandLineOption sizeOption("size", "Canvas size of the synthetic input.", "WxH", "1280x720");
+	QCommandLineOption rateOption("rate", "Mouse events per second of the synthetic input.", "rate", "125");
+	QCommandLineOption strokesOption("strokes", "Synthetic strokes per tool.", "count", "10");
+	QCommandLineOption limitOption("max-p99", "Fail if the p99 of a tool is above this.", "ms");
+	parser.addOption(latencyOption);
+	parser.addOption(sizeOption);
+	parser.addOption(rateOption);
+	parser.addOption(strokesOption);
+	parser.addOption(limitOption);
+	parser.addPositionalArgument("traces", "Recorded stroke traces to play instead.", "[trace...]");
+	parser.process(arguments);
+
+	QList<StrokeTrace> traces;
+	foreach(const QString &fileName, parser.positionalArguments()) {
+		StrokeTrace trace;
+		if (!trace.load(fileName)){
+			QTextStream(stderr) << fileName << " is not a stroke trace\n";
+			return 1;
+		}
+		traces.append(trace);
+	}
+	if (traces.isEmpty()){
+		const QStringList size = parser.value(sizeOption).split('x');
+		const QSize canvasSize(size.value(0).toInt(), size.value(1).toInt());
+		if (canvasSize.isEmpty()){
+			QTextStream(stderr) << "invalid canvas size " << parser.value(sizeOption) << '\n';
+			return 1;
+		}
+		traces.append(syntheticInput(canvasSize, parser.value(rateOption).toInt(),
+			parser.value(strokesOption).toInt()));
+	}
+
+	LatencyProbe probe;
+	foreach(const StrokeTrace &trace, traces) {
+		const QSize canvasSize = trace.getCanvasSize();
+		DrawingBoard board(0, 0, canvasSize.width(), canvasSize.height());
+		board.show();
+		QApplication::processEvents();
+		board.setLatencyProbe(&probe);
+		StrokePlayer player(&board);
+		QEventLoop loop;
+		QObject::connect(&player, SIGNAL(finished()), &loop, SLOT(quit()));
+		player.play(trace, true);
+		if (player.isPlaying()){
+			loop.exec();
+		}
+		//Lets the paint of the last input happen
+		QApplication::processEvents();
+		board.setLatencyProbe(0);
+	}
+
+	QTextStream(stdout) << probe.report();
+	if (parser.isSet(limitOption) && probe.worstPercentile(99) > parser.value(limitOption).toDouble()){
+		QTextStream(stderr) << "p99 latency above " << parser.value(limitOption) << " ms\n";
+		return 1;
+	}
+	return probe.sampleCount() > 0 ? 0 : 1;
+}
+
+/**
+* Returns a percentile with the nearest rank method
+* @param QVector sorted - The values in ascending order
+* @param double percentile - The percentile, 0 to 100
+* @return double - The value, 0 if there are none
+*/
+double LatencyProbe::percentile(const QVector<qint64> &sorted, double percentile)
+{
+	if (sorted.isEmpty()){
+		return 0;
+	}
+	const int index = qBound(0, int(qCeil(percentile / 100 * sorted.size())) - 1, sorted.size() - 1);
+	return sorted[index];
+}
@@ -0,0 +1,66 @@
+#ifndef LATENCYPROBE_H
+#define LATENCYPROBE_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QMap>
+#include <QRect>
+#include <QRegion>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "stroketrace.h"
+
+/**
+* Measures the time from an input event arriving at a DrawingBoard to the
+* paintEvent that puts the pixels it changed on the screen. The board stamps
+* every input with the time the window system made the event, so the time
+* it waited in the event queue is counted, and hands over the area the input
+* dirtied. The measurement ends with the paint that completes that area, an
+* area split over several paints is only done with the last of them.
+* Latencies are kept per tool, the paint modes and undo/redo.
+*
+* With --latency the program drives a board with synthetic input at a fixed
+* rate, or with recorded stroke traces, and prints the percentiles per tool.
+* It runs on the offscreen platform unless QT_QPA_PLATFORM is set.
+*/
+class LatencyProbe
+{
+public:
+	LatencyProbe();
+	~LatencyProbe();
+	qint64 now() const;
+	void inputHandled(const char *tool, qint64 arrival, const QRect &dirtyRect);
+	void presented(const QRegion &region);
+	void clear();
+	int sampleCount();
+	QString report();
+	double worstPercentile(double percentile);
+	static const char *toolName(int paintMode);
+	static StrokeTrace syntheticInput(const QSize &canvasSize, int eventsPerSecond, int strokesPerTool);
+	static int exec(const QStringList &arguments);
+
+	//Inputs waiting for a paint, the oldest are given up beyond this
+	static const int maximumPending = 4096;
+	//Mouse moves in one synthetic stroke
+	static const int syntheticMoves = 40;
+
+private:
+	struct PendingInput
+	{
+		const char *tool;
+		qint64 arrival;
+		//The part of the dirty area that wasn't painted yet
+		QRegion remaining;
+	};
+
+	QElapsedTimer clock;
+	QList<PendingInput> pending;
+	QMap<QString, QVector<qint64> > latencies;
+	int droppedCount;
+
+	static double percentile(const QVector<qint64> &sorted, double percentile);
+};
+
+#endif // LATENCYPROBE_H
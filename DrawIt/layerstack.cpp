@@ -0,0 +1,604 @@
+#include "layerstack.h"
+#include "bufferpool.h"
+
+LayerStack::LayerStack()
+{
+	Layer background;
+	background.name = "Background";
+	background.opacity = 100;
+	background.visible = true;
+	background.blendMode = blendNormal;
+	layers.append(background);
+	current = 0;
+	cacheValid = false;
+}
+
+LayerStack::LayerStack(const TiledCanvas &background)
+{
+	Layer bottom;
+	bottom.canvas = background;
+	bottom.name = "Background";
+	bottom.opacity = 100;
+	bottom.visible = true;
+	bottom.blendMode = blendNormal;
+	layers.append(bottom);
+	current = 0;
+	cacheValid = false;
+}
+
+LayerStack::~LayerStack()
+{
+
+}
+
+/**
+* Returns the number of layers, the background included
+* @return int - The number of layers
+*/
+int LayerStack::count() const
+{
+	return layers.size();
+}
+
+/**
+* Returns a layer
+* @param int index - The layer, 0 is the background at the bottom
+* @return Layer - The layer
+*/
+const LayerStack::Layer &LayerStack::layer(int index) const
+{
+	return layers.at(index);
+}
+
+/**
+* Returns the layer that is painted on
+* @return int - The index of the layer
+*/
+int LayerStack::currentLayer() const
+{
+	return current;
+}
+
+/**
+* Chooses the layer to paint on. The parts kept for the old one are dropped
+* @param int index - The index of the layer
+*/
+void LayerStack::setCurrentLayer(int index)
+{
+	index = qBound(0, index, layers.size() - 1);
+	if (index == current){
+		return;
+	}
+	current = index;
+	parts.clear();
+}
+
+/**
+* Adds an empty layer above the current one and makes it the current layer
+* @param QString name - The name of the layer
+*/
+void LayerStack::addLayer(const QString &name)
+{
+	const TiledCanvas &background = layers.first().canvas;
+	Layer added;
+	added.canvas = TiledCanvas(background.size(), Qt::transparent, QImage::Format_ARGB32_Premultiplied);
+	added.canvas.setRect(layerBounds());
+	added.canvas.setExpandable(background.isExpandable());
+	added.name = name;
+	added.opacity = 100;
+	added.visible = true;
+	added.blendMode = blendNormal;
+	layers.insert(current + 1, added);
+	++current;
+	parts.clear();
+}
+
+/**
+* Removes a layer, the background stays
+* @param int index - The index of the layer
+*/
+void LayerStack::removeLayer(int index)
+{
+	if (index <= 0 || index >= layers.size()){
+		return;
+	}
+	invalidate(index);
+	layers.remove(index);
+	if (current >= index){
+		--current;
+	}
+}
+
+/**
+* Moves a layer to another place in the order, the current layer stays current.
+* The background stays at the bottom
+* @param int from - The index of the layer
+* @param int to - The index it gets
+*/
+void LayerStack::moveLayer(int from, int to)
+{
+	if (from <= 0 || from >= layers.size() || to <= 0 || to >= layers.size() || from == to){
+		return;
+	}
+	//Only where the moved layer has pixels does the order change anything
+	invalidate(from);
+	const Layer moved = layers.at(from);
+	layers.remove(from);
+	layers.insert(to, moved);
+	if (current == from){
+		current = to;
+	}
+	else if (from < current && to >= current){
+		--current;
+	}
+	else if (from > current && to <= current){
+		++current;
+	}
+}
+
+/**
+* Sets how strongly a layer covers the ones below it
+* @param int index - The index of the layer
+* @param int percent - The opacity, from 0 to 100
+*/
+void LayerStack::setOpacity(int index, int percent)
+{
+	percent = qBound(0, percent, 100);
+	if (layers.at(index).opacity == percent){
+		return;
+	}
+	layers[index].opacity = percent;
+	invalidate(index);
+}
+
+/**
+* Shows or hides a layer
+* @param int index - The index of the layer
+* @param bool visible - if the layer is part of the composite
+*/
+void LayerStack::setVisible(int index, bool visible)
+{
+	if (layers.at(index).visible == visible){
+		return;
+	}
+	layers[index].visible = visible;
+	invalidate(index);
+}
+
+/**
+* Sets how a layer is blended with the ones below it. The background is always drawn normally
+* @param int index - The index of the layer
+* @param int mode - One of the blend modes
+*/
+void LayerStack::setBlendMode(int index, int mode)
+{
+	if (index <= 0 || layers.at(index).blendMode == mode){
+		return;
+	}
+	layers[index].blendMode = mode;
+	invalidate(index);
+}
+
+/**
+* Lets all layers grow when something is painted outside of them
+* @param bool enabled - if the layers should grow
+*/
+void LayerStack::setExpandable(bool enabled)
+{
+	for (int i = 0; i < layers.size(); ++i){
+		layers[i].canvas.setExpandable(enabled);
+	}
+	cacheValid = false;
+}
+
+/**
+* Fills the background with a color and clears the other layers
+* @param QColor color - Color to fill with
+*/
+void LayerStack::fill(const QColor &color)
+{
+	layers[0].canvas.fill(color);
+	for (int i = 1; i < layers.size(); ++i){
+		layers[i].canvas.fill(Qt::transparent);
+	}
+	cacheValid = false;
+}
+
+/**
+* Paints on the current layer, the tiles it paints on are composed again
+* @param QRect area - The area that the drawing covers
+* @param std::function draw - Function that does the drawing
+*/
+void LayerStack::paint(const QRect &area, const std::function<void (QPainter &)> &draw)
+{
+	TiledCanvas &canvas = layers[current].canvas;
+	canvas.paint(area, draw);
+	const QRect painted = area.intersected(canvas.rect());
+	if (painted.isEmpty()){
+		return;
+	}
+	for (int row = TiledCanvas::tileOf(painted.top()); row <= TiledCanvas::tileOf(painted.bottom()); ++row){
+		for (int column = TiledCanvas::tileOf(painted.left()); column <= TiledCanvas::tileOf(painted.right()); ++column){
+			dirty.insert(TiledCanvas::key(column, row));
+		}
+	}
+}
+
+/**
+* Returns the visible layers flattened, the tiles that changed are composed first
+* @return TiledCanvas - The composite, valid until the stack changes
+*/
+const TiledCanvas &LayerStack::composite() const
+{
+	if (isFlat()){
+		if (cacheValid){
+			cache = TiledCanvas();
+			parts.clear();
+			cacheValid = false;
+		}
+		return layers.first().canvas;
+	}
+	if (!cacheValid){
+		rebuild();
+		return cache;
+	}
+	if (!dirty.isEmpty()){
+		cache.setRect(layerBounds());
+		foreach(qint64 index, dirty) {
+			compose(int(quint32(index)), int(index >> 32));
+		}
+		dirty.clear();
+	}
+	return cache;
+}
+
+/**
+* Looks the tiles of every layer up in the tile store, see TiledCanvas::deduplicate()
+* @param TileStore* store - The store to look the tiles up in
+*/
+void LayerStack::deduplicate(TileStore *store)
+{
+	for (int i = 0; i < layers.size(); ++i){
+		layers[i].canvas.deduplicate(store);
+	}
+}
+
+/**
+* Adds up the bytes of the tiles of every layer
+* @param QSet* counted - Cache keys of tiles counted before, see TiledCanvas::memoryUsage()
+* @return qint64 - The bytes not counted before
+*/
+qint64 LayerStack::memoryUsage(QSet<qint64> *counted) const
+{
+	qint64 bytes = 0;
+	foreach(const Layer &counting, layers) {
+		bytes += counting.canvas.memoryUsage(counted);
+	}
+	return bytes;
+}
+
+/**
+* Adds up the bytes of the composed tiles and the parts kept for the current layer
+* @param QSet* counted - Cache keys of tiles counted before, tiles shared with a layer aren't counted again
+* @return qint64 - The bytes not counted before
+*/
+qint64 LayerStack::cacheBytes(QSet<qint64> *counted) const
+{
+	qint64 bytes = cacheValid ? cache.memoryUsage(counted) : 0;
+	foreach(const Parts &kept, parts) {
+		const QImage images[] = { kept.below, kept.above };
+		for (int i = 0; i < 2; ++i){
+			if (!images[i].isNull() && !counted->contains(images[i].cacheKey())){
+				counted->insert(images[i].cacheKey());
+				bytes += images[i].byteCount();
+			}
+		}
+	}
+	return bytes;
+}
+
+/**
+* Returns the name of a blend mode
+* @param int mode - One of the blend modes
+* @return char* - The name
+*/
+const char *LayerStack::blendModeName(int mode)
+{
+	switch (mode){
+		case blendMultiply:
+			return "Multiply";
+		case blendScreen:
+			return "Screen";
+		case blendOverlay:
+			return "Overlay";
+		case blendDarken:
+			return "Darken";
+		case blendLighten:
+			return "Lighten";
+		default:
+			return "Normal";
+	}
+}
+
+/**
+* Checks if the composite is just the background, because no other layer shows anything
+* @return bool - true if only the background counts
+*/
+bool LayerStack::isFlat() const
+{
+	if (!isBackgroundPlain()){
+		return false;
+	}
+	for (int i = 1; i < layers.size(); ++i){
+		const Layer &above = layers.at(i);
+		if (above.visible && above.opacity > 0 && above.canvas.tileCount() > 0){
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+* Checks if the background covers the white below it
+* @return bool - true if the background is visible at full opacity
+*/
+bool LayerStack::isBackgroundPlain() const
+{
+	return layers.first().visible && layers.first().opacity == 100;
+}
+
+/**
+* Checks if the layers above the current one can be merged into one, which
+* they can when they all blend normally
+* @return bool - true if they can be merged
+*/
+bool LayerStack::isAboveMerged() const
+{
+	for (int i = current + 1; i < layers.size(); ++i){
+		const Layer &above = layers.at(i);
+		if (above.visible && above.opacity > 0 && above.blendMode != blendNormal){
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+* Checks if a layer changes a tile of the composite
+* @param int index - The index of the layer
+* @param int column - The tile column
+* @param int row - The tile row
+* @return bool - true if the layer is visible and not transparent on the tile
+*/
+bool LayerStack::contributes(int index, int column, int row) const
+{
+	const Layer &checked = layers.at(index);
+	return checked.visible && checked.opacity > 0 && !checked.canvas.isTransparent(column, row);
+}
+
+/**
+* Marks the tiles a layer has pixels on to be composed again after the layer
+* changed, the background changes every tile. The parts depend on every
+* layer and are dropped
+* @param int index - The index of the layer
+*/
+void LayerStack::invalidate(int index)
+{
+	parts.clear();
+	if (index == 0){
+		cacheValid = false;
+		return;
+	}
+	foreach(qint64 key, layers.at(index).canvas.tileKeys()) {
+		dirty.insert(key);
+	}
+}
+
+/**
+* Composes the cache from scratch. With a plain background it starts as a
+* copy of the background, so only the tiles other layers have pixels on are
+* composed. Otherwise every tile the background has pixels on is composed
+* too, for an opened file all of them
+*/
+void LayerStack::rebuild() const
+{
+	const Layer &bottom = layers.first();
+	QSet<qint64> keys;
+	if (isBackgroundPlain()){
+		cache = bottom.canvas;
+	}
+	else{
+		//The background over white at its opacity
+		const QColor color = bottom.canvas.backgroundColor();
+		const int opacity = bottom.visible ? bottom.opacity : 0;
+		cache = TiledCanvas(bottom.canvas.size(), QColor((255 * (100 - opacity) + color.red() * opacity) / 100,
+			(255 * (100 - opacity) + color.green() * opacity) / 100, (255 * (100 - opacity) + color.blue() * opacity) / 100));
+		cache.setRect(bottom.canvas.rect());
+		cache.setExpandable(bottom.canvas.isExpandable());
+		foreach(qint64 key, bottom.canvas.tileKeys()) {
+			keys.insert(key);
+		}
+		if (bottom.canvas.hasSource()){
+			const QRect area = bottom.canvas.rect();
+			for (int row = TiledCanvas::tileOf(area.top()); row <= TiledCanvas::tileOf(area.bottom()); ++row){
+				for (int column = TiledCanvas::tileOf(area.left()); column <= TiledCanvas::tileOf(area.right()); ++column){
+					keys.insert(TiledCanvas::key(column, row));
+				}
+			}
+		}
+	}
+	for (int i = 1; i < layers.size(); ++i){
+		if (layers.at(i).visible && layers.at(i).opacity > 0){
+			foreach(qint64 key, layers.at(i).canvas.tileKeys()) {
+				keys.insert(key);
+			}
+		}
+	}
+	cache.setRect(layerBounds());
+	parts.clear();
+	dirty.clear();
+	cacheValid = true;
+	foreach(qint64 key, keys) {
+		compose(int(quint32(key)), int(key >> 32));
+	}
+}
+
+/**
+* Composes one tile of the cache from the parts below and above the current
+* layer and the current layer itself. A tile only a plain background has
+* pixels on is shared with the background
+* @param int column - The tile column
+* @param int row - The tile row
+*/
+void LayerStack::compose(int column, int row) const
+{
+	const QRect tileArea = cache.tileRect(column, row);
+	const QRect area = tileArea.intersected(cache.rect());
+	if (area.isEmpty()){
+		return;
+	}
+	if (isBackgroundPlain()){
+		bool covered = false;
+		for (int i = 1; i < layers.size() && !covered; ++i){
+			covered = contributes(i, column, row);
+		}
+		if (!covered){
+			cache.shareTile(layers.first().canvas, column, row);
+			return;
+		}
+	}
+	const Parts &tileParts = partsOf(column, row);
+	const bool merged = isAboveMerged();
+	cache.paint(area, [&](QPainter &painter){
+		painter.setCompositionMode(QPainter::CompositionMode_Source);
+		if (tileParts.below.isNull()){
+			painter.fillRect(area, Qt::white);
+		}
+		else{
+			painter.drawImage(tileArea.topLeft(), tileParts.below);
+		}
+		painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+		drawLayer(&painter, current, column, row, area);
+		if (!merged){
+			for (int i = current + 1; i < layers.size(); ++i){
+				drawLayer(&painter, i, column, row, area);
+			}
+		}
+		else if (!tileParts.above.isNull()){
+			painter.drawImage(tileArea.topLeft(), tileParts.above);
+		}
+	});
+}
+
+/**
+* Returns the parts of a tile for the current layer, they are made the first
+* time. Below is left null when it is white and shares the background tile
+* when only the background is below, above is left null when nothing is
+* above or the layers above can't be merged
+* @param int column - The tile column
+* @param int row - The tile row
+* @return Parts - The parts of the tile
+*/
+const LayerStack::Parts &LayerStack::partsOf(int column, int row) const
+{
+	const qint64 index = TiledCanvas::key(column, row);
+	QHash<qint64, Parts>::const_iterator found = parts.constFind(index);
+	if (found != parts.constEnd()){
+		return *found;
+	}
+	const QRect tileArea = cache.tileRect(column, row);
+	const QSize tileSize(TiledCanvas::tileSize, TiledCanvas::tileSize);
+	Parts built;
+	if (current > 0){
+		bool between = false;
+		for (int i = 1; i < current && !between; ++i){
+			between = contributes(i, column, row);
+		}
+		if (isBackgroundPlain() && !between){
+			built.below = layers.first().canvas.tile(column, row);
+		}
+		else{
+			built.below = BufferPool::global()->image(tileSize, QImage::Format_RGB32);
+			built.below.fill(qRgb(255, 255, 255));
+			QPainter painter(&built.below);
+			painter.translate(-tileArea.topLeft());
+			for (int i = 0; i < current; ++i){
+				drawLayer(&painter, i, column, row, tileArea);
+			}
+		}
+	}
+	if (isAboveMerged()){
+		bool above = false;
+		for (int i = current + 1; i < layers.size() && !above; ++i){
+			above = contributes(i, column, row);
+		}
+		if (above){
+			built.above = BufferPool::global()->image(tileSize, QImage::Format_ARGB32_Premultiplied);
+			built.above.fill(qRgba(0, 0, 0, 0));
+			QPainter painter(&built.above);
+			painter.translate(-tileArea.topLeft());
+			for (int i = current + 1; i < layers.size(); ++i){
+				drawLayer(&painter, i, column, row, tileArea);
+			}
+		}
+	}
+	return *parts.insert(index, built);
+}
+
+/**
+* Draws a layer on a tile with its opacity and blend mode, layers that don't
+* change the tile are skipped
+* @param QPainter* painter - The painter to draw with, in canvas coordinates
+* @param int index - The index of the layer
+* @param int column - The tile column
+* @param int row - The tile row
+* @param QRect area - The part of the tile to draw
+*/
+void LayerStack::drawLayer(QPainter *painter, int index, int column, int row, const QRect &area) const
+{
+	if (!contributes(index, column, row)){
+		return;
+	}
+	const Layer &drawn = layers.at(index);
+	painter->setOpacity(drawn.opacity / 100.0);
+	painter->setCompositionMode(index == 0 ? QPainter::CompositionMode_SourceOver : compositionMode(drawn.blendMode));
+	drawn.canvas.draw(painter, area);
+	painter->setOpacity(1.0);
+	painter->setCompositionMode(QPainter::CompositionMode_SourceOver);
+}
+
+/**
+* Returns the area all layers together cover
+* @return QRect - The united canvas rectangles
+*/
+QRect LayerStack::layerBounds() const
+{
+	QRect bounds;
+	foreach(const Layer &bounded, layers) {
+		bounds = bounds.united(bounded.canvas.rect());
+	}
+	return bounds;
+}
+
+/**
+* Returns the composition mode QPainter blends a layer with
+* @param int mode - One of the blend modes
+* @return QPainter::CompositionMode - The composition mode
+*/
+QPainter::CompositionMode LayerStack::compositionMode(int mode)
+{
+	switch (mode){
+		case blendMultiply:
+			return QPainter::CompositionMode_Multiply;
+		case blendScreen:
+			return QPainter::CompositionMode_Screen;
+		case blendOverlay:
+			return QPainter::CompositionMode_Overlay;
+		case blendDarken:
+			return QPainter::CompositionMode_Darken;
+		case blendLighten:
+			return QPainter::CompositionMode_Lighten;
+		default:
+			return QPainter::CompositionMode_SourceOver;
+	}
+}
@@ -0,0 +1,99 @@
+#ifndef LAYERSTACK_H
+#define LAYERSTACK_H
+
+#include <QHash>
+#include <QImage>
+#include <QPainter>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include <functional>
+#include "tiledcanvas.h"
+#include "tilestore.h"
+
+/**
+* The layers of a document, bottom first, and their composite. The bottom
+* layer is the opaque background, it can't be moved or removed and is always
+* drawn normally over white. The layers above it are transparent, with an
+* opacity, a visibility and a blend mode.
+*
+* The composite is a TiledCanvas that is kept per tile. Painting on a layer
+* or changing one marks only the tiles that layer has pixels on, those are
+* composed again when composite() is asked for. For the current layer every
+* composed tile keeps the layers below it flattened and, when they all blend
+* normally, the layers above it merged, so composing a tile draws three
+* tiles however many layers there are. While only the background is visible
+* the composite is the background itself.
+*/
+class LayerStack
+{
+public:
+	struct Layer
+	{
+		TiledCanvas canvas;
+		QString name;
+		//0 to 100
+		int opacity;
+		bool visible;
+		int blendMode;
+	};
+
+	LayerStack();
+	LayerStack(const TiledCanvas &background);
+	~LayerStack();
+	int count() const;
+	const Layer &layer(int index) const;
+	int currentLayer() const;
+	void setCurrentLayer(int index);
+	void addLayer(const QString &name);
+	void removeLayer(int index);
+	void moveLayer(int from, int to);
+	void setOpacity(int index, int percent);
+	void setVisible(int index, bool visible);
+	void setBlendMode(int index, int mode);
+	void setExpandable(bool enabled);
+	void fill(const QColor &color);
+	void paint(const QRect &area, const std::function<void (QPainter &)> &draw);
+	const TiledCanvas &composite() const;
+	void deduplicate(TileStore *store);
+	qint64 memoryUsage(QSet<qint64> *counted) const;
+	qint64 cacheBytes(QSet<qint64> *counted) const;
+	static const char *blendModeName(int mode);
+
+	static const int blendNormal = 0;
+	static const int blendMultiply = 1;
+	static const int blendScreen = 2;
+	static const int blendOverlay = 3;
+	static const int blendDarken = 4;
+	static const int blendLighten = 5;
+	static const int blendModeCount = 6;
+
+private:
+	//One tile of the flattened layers below the current one and the merged layers above it
+	struct Parts
+	{
+		QImage below;
+		QImage above;
+	};
+
+	QVector<Layer> layers;
+	int current;
+	mutable TiledCanvas cache;
+	mutable bool cacheValid;
+	mutable QSet<qint64> dirty;
+	mutable QHash<qint64, Parts> parts;
+
+	bool isFlat() const;
+	bool isBackgroundPlain() const;
+	bool isAboveMerged() const;
+	bool contributes(int index, int column, int row) const;
+	void invalidate(int index);
+	void rebuild() const;
+	void compose(int column, int row) const;
+	const Parts &partsOf(int column, int row) const;
+	void drawLayer(QPainter *painter, int index, int column, int row, const QRect &area) const;
+	QRect layerBounds() const;
+	static QPainter::CompositionMode compositionMode(int mode);
+};
+
+#endif // LAYERSTACK_H
@@ -1,10 +1,79 @@
 #include "drawit.h"
+#include "batchrenderer.h"
+#include "renderserver.h"
+#include "renderfarm.h"
+#include "latencyprobe.h"
+#include "tracelog.h"
+#include "stallwatchdog.h"
 #include <QtWidgets/QApplication>
+#include <QGuiApplication>
+#include <cstring>
+
+/*
+Checks if an option was given on the command line, either alone or as option=value
+*/
+static bool hasArgument(int argc, char *argv[], const char *argument)
+{
+	const size_t length = strlen(argument);
+	for (int i = 1; i < argc; ++i){
+		if (strncmp(argv[i], argument, length) == 0 && (argv[i][length] == '\0' || argv[i][length] == '=')){
+			return true;
+		}
+	}
+	return false;
+}
 
 int main(int argc, char *argv[])
 {
+	if (hasArgument(argc, argv, "--batch")){
+		//No window is shown, the offscreen platform works without a display
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+		QGuiApplication a(argc, argv);
+		QCoreApplication::setApplicationName("Draw It");
+		TraceLog::startFromEnvironment();
+		return BatchRenderer::exec(QCoreApplication::arguments());
+	}
+	if (hasArgument(argc, argv, "--server")){
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+		QGuiApplication a(argc, argv);
+		QCoreApplication::setApplicationName("Draw It");
+		TraceLog::startFromEnvironment();
+		return RenderServer::exec(QCoreApplication::arguments());
+	}
+	if (hasArgument(argc, argv, "--farm") || hasArgument(argc, argv, "--batch-worker")){
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+		QGuiApplication a(argc, argv);
+		QCoreApplication::setApplicationName("Draw It");
+		TraceLog::startFromEnvironment();
+		if (hasArgument(argc, argv, "--batch-worker")){
+			return RenderFarm::execWorker();
+		}
+		return RenderFarm::exec(QCoreApplication::arguments());
+	}
+	if (hasArgument(argc, argv, "--latency")){
+		//Runs on a display when one is asked for, so real presentation can be measured too
+		if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")){
+			qputenv("QT_QPA_PLATFORM", "offscreen");
+		}
+		QApplication a(argc, argv);
+		QCoreApplication::setApplicationName("Draw It");
+		TraceLog::startFromEnvironment();
+		return LatencyProbe::exec(QCoreApplication::arguments());
+	}
+	if (hasArgument(argc, argv, "--stall-statistics")){
+		QCoreApplication a(argc, argv);
+		return StallWatchdog::printStatistics();
+	}
 	QApplication a(argc, argv);
 	QCoreApplication::setApplicationName("Draw It");
+	TraceLog::startFromEnvironment();
+	//DRAWIT_STALL_THRESHOLD sets the milliseconds of a stall, 0 turns the watchdog off
+	const QByteArray stallThreshold = qgetenv("DRAWIT_STALL_THRESHOLD");
+	StallWatchdog watchdog;
+	watchdog.setThreshold(stallThreshold.isEmpty() ? int(StallWatchdog::defaultThreshold) : stallThreshold.toInt());
+	if (stallThreshold != "0"){
+		watchdog.start();
+	}
 	DrawIt w;
 	w.show();
 	return a.exec();
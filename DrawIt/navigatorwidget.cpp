@@ -0,0 +1,198 @@
+#include "navigatorwidget.h"
+#include "tracelog.h"
+
+NavigatorWidget::NavigatorWidget(DrawingBoard *newBoard, QWidget *parent)
+	: QWidget(parent)
+{
+	board = newBoard;
+	level = 0;
+	shown.background = 0;
+	shown.source = 0;
+	refreshTimer.setSingleShot(true);
+	refreshTimer.setInterval(refreshDelay);
+	connect(&refreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
+	connect(board, SIGNAL(changed()), this, SLOT(boardChanged()));
+	setMinimumSize(100, 100);
+	setCursor(Qt::PointingHandCursor);
+}
+
+NavigatorWidget::~NavigatorWidget()
+{
+
+}
+
+/**
+* Returns the size the navigator would like to have
+* @return QSize - The size
+*/
+QSize NavigatorWidget::sizeHint() const
+{
+	return QSize(240, 180);
+}
+
+/**
+* Gathers the changes of the board, the thumbnail is updated when the delay is over
+*/
+void NavigatorWidget::boardChanged()
+{
+	if (isVisible() && !refreshTimer.isActive()){
+		refreshTimer.start();
+	}
+}
+
+/**
+* Brings the thumbnail and the view rectangle up to date with the board. The
+* thumbnail is made again when the canvas or the navigator changed size,
+* otherwise only the tiles that changed are drawn into it
+*/
+void NavigatorWidget::refresh()
+{
+	TRACE_ZONE("NavigatorWidget::refresh");
+	const TiledCanvas &canvas = board->canvas();
+	const int newLevel = fittingLevel(canvas.size());
+	if (thumbnail.isNull() || canvas.rect() != area || newLevel != level){
+		rebuild(canvas, newLevel);
+	}
+	else{
+		drawTiles(canvas, canvas.changedTiles(shown));
+	}
+	shown = canvas.versions();
+	view = board->visibleArea();
+	update();
+}
+
+/**
+* Makes the thumbnail of the whole canvas, the mipmaps of tiles that didn't
+* change are drawn as they are
+* @param TiledCanvas canvas - The canvas of the board
+* @param int newLevel - The mipmap level of the thumbnail
+*/
+void NavigatorWidget::rebuild(const TiledCanvas &canvas, int newLevel)
+{
+	area = canvas.rect();
+	level = newLevel;
+	const int step = 1 << level;
+	thumbnail = QImage(qMax(1, (area.width() + step - 1) >> level), qMax(1, (area.height() + step - 1) >> level),
+		QImage::Format_RGB32);
+	thumbnail.fill(palette().color(QPalette::Window));
+	drawTiles(canvas, QVector<QRect>() << area);
+}
+
+/**
+* Draws areas of the canvas into the thumbnail at its level
+* @param TiledCanvas canvas - The canvas of the board
+* @param QVector<QRect> areas - The areas of the canvas to draw
+*/
+void NavigatorWidget::drawTiles(const TiledCanvas &canvas, const QVector<QRect> &areas)
+{
+	if (areas.isEmpty()){
+		return;
+	}
+	QPainter painter(&thumbnail);
+	painter.scale(scale(), scale());
+	painter.translate(-area.topLeft());
+	foreach(const QRect &changed, areas) {
+		canvas.draw(&painter, changed.intersected(area), scale());
+	}
+}
+
+/**
+* Returns the smallest mipmap level at which the canvas fits in the navigator
+* @param QSize canvasSize - The size of the canvas
+* @return int - The level
+*/
+int NavigatorWidget::fittingLevel(const QSize &canvasSize) const
+{
+	int fitting = 0;
+	while (fitting < 30 && ((canvasSize.width() >> fitting) > width() || (canvasSize.height() >> fitting) > height())){
+		++fitting;
+	}
+	return fitting;
+}
+
+/**
+* Returns the size of a thumbnail pixel
+* @return double - The scale from canvas to thumbnail
+*/
+double NavigatorWidget::scale() const
+{
+	return 1.0 / (1 << level);
+}
+
+/**
+* Returns where the thumbnail is drawn, in the middle of the navigator
+* @return QPoint - The top left corner of the thumbnail
+*/
+QPoint NavigatorWidget::thumbnailOrigin() const
+{
+	return QPoint((width() - thumbnail.width()) / 2, (height() - thumbnail.height()) / 2);
+}
+
+/**
+* Returns where an area of the canvas is on the navigator
+* @param QRect canvasArea - The area on the canvas
+* @return QRectF - The area on the navigator
+*/
+QRectF NavigatorWidget::widgetArea(const QRect &canvasArea) const
+{
+	return QRectF(QPointF(thumbnailOrigin()) + QPointF(canvasArea.topLeft() - area.topLeft()) * scale(),
+		QSizeF(canvasArea.size()) * scale());
+}
+
+/**
+* Draws the thumbnail and the area the board shows
+* @param QPaintEvent* event - Pointer to QPaintEvent
+*/
+void NavigatorWidget::paintEvent(QPaintEvent *event)
+{
+	QPainter painter(this);
+	painter.fillRect(event->rect(), palette().color(QPalette::Dark));
+	if (thumbnail.isNull()){
+		return;
+	}
+	painter.drawImage(thumbnailOrigin(), thumbnail);
+	painter.setPen(QPen(Qt::red, 1));
+	painter.drawRect(widgetArea(view).adjusted(0, 0, -1, -1));
+}
+
+/**
+* Moves the view of the board to the clicked point
+* @param QMouseEvent* event - Pointer to QMouseEvent
+*/
+void NavigatorWidget::mousePressEvent(QMouseEvent *event)
+{
+	if (event->button() == Qt::LeftButton && !thumbnail.isNull()){
+		board->centerOn(QPointF(area.topLeft()) + QPointF(event->pos() - thumbnailOrigin()) / scale());
+	}
+}
+
+/**
+* Moves the view of the board along while the mouse is dragged
+* @param QMouseEvent* event - Pointer to QMouseEvent
+*/
+void NavigatorWidget::mouseMoveEvent(QMouseEvent *event)
+{
+	if ((event->buttons() & Qt::LeftButton) && !thumbnail.isNull()){
+		board->centerOn(QPointF(area.topLeft()) + QPointF(event->pos() - thumbnailOrigin()) / scale());
+	}
+}
+
+/**
+* Picks the level again for the new size
+* @param QResizeEvent* event - Pointer to QResizeEvent
+*/
+void NavigatorWidget::resizeEvent(QResizeEvent *event)
+{
+	QWidget::resizeEvent(event);
+	refreshTimer.start();
+}
+
+/**
+* Catches up with the changes made while the navigator was hidden
+* @param QShowEvent* event - Pointer to QShowEvent
+*/
+void NavigatorWidget::showEvent(QShowEvent *event)
+{
+	QWidget::showEvent(event);
+	refresh();
+}
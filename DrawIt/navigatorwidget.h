@@ -0,0 +1,62 @@
+#ifndef NAVIGATORWIDGET_H
+#define NAVIGATORWIDGET_H
+
+#include <QImage>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QTimer>
+#include <QWidget>
+#include "drawingboard.h"
+#include "tiledcanvas.h"
+
+/**
+* Shows a thumbnail of the whole canvas of a DrawingBoard with the area the
+* board shows on top of it, clicking or dragging on it moves the view there.
+* The thumbnail is a power of two smaller than the canvas so its pixels are
+* the mipmaps of the tiles. When the board changes only the tiles whose
+* versions changed are drawn into it again, at most every refreshDelay
+* milliseconds, so it keeps up with drawing without downsampling the canvas.
+*/
+class NavigatorWidget : public QWidget
+{
+	Q_OBJECT
+
+public:
+	NavigatorWidget(DrawingBoard *newBoard, QWidget *parent = 0);
+	~NavigatorWidget();
+	QSize sizeHint() const;
+
+	//Milliseconds changes of the board are gathered before the thumbnail is updated
+	static const int refreshDelay = 50;
+
+protected:
+	void paintEvent(QPaintEvent *event);
+	void mousePressEvent(QMouseEvent *event);
+	void mouseMoveEvent(QMouseEvent *event);
+	void resizeEvent(QResizeEvent *event);
+	void showEvent(QShowEvent *event);
+
+private slots:
+	void boardChanged();
+	void refresh();
+
+private:
+	DrawingBoard *board;
+	QImage thumbnail;
+	//Canvas area the thumbnail shows
+	QRect area;
+	//Thumbnail pixels are 2^level canvas pixels wide
+	int level;
+	TiledCanvas::Versions shown;
+	QRect view;
+	QTimer refreshTimer;
+
+	void rebuild(const TiledCanvas &canvas, int newLevel);
+	void drawTiles(const TiledCanvas &canvas, const QVector<QRect> &areas);
+	int fittingLevel(const QSize &canvasSize) const;
+	double scale() const;
+	QPoint thumbnailOrigin() const;
+	QRectF widgetArea(const QRect &canvasArea) const;
+};
+
+#endif // NAVIGATORWIDGET_H
@@ -0,0 +1,138 @@
+#include "performancehud.h"
+
+PerformanceHud::PerformanceHud()
+{
+	clock.start();
+	windowStart = 0;
+	lastRefresh = -refreshInterval * qint64(1000000);
+	frameCount = 0;
+	paintTime = 0;
+	maximumPaintTime = 0;
+	pendingInput = -1;
+	inputLatency = -1;
+	memoryWarning = false;
+	for (int i = 0; i < 12; ++i){
+		lines << "";
+	}
+	lines[0] = "Performance";
+}
+
+PerformanceHud::~PerformanceHud()
+{
+
+}
+
+/**
+* Returns the time to stamp inputs and paints with
+* @return qint64 - Nanoseconds on the clock of the overlay
+*/
+qint64 PerformanceHud::now() const
+{
+	return clock.nsecsElapsed();
+}
+
+/**
+* Notes an input that changed the canvas, the next frame ends its latency
+* @param qint64 arrival - When the input arrived, from now()
+*/
+void PerformanceHud::inputHandled(qint64 arrival)
+{
+	if (pendingInput < 0){
+		pendingInput = arrival;
+	}
+}
+
+/**
+* Counts a painted frame. Frames that only repaint the overlay aren't counted
+* @param qint64 start - When the paint started, from now()
+* @param QRect area - The area that was painted
+*/
+void PerformanceHud::framePainted(qint64 start, const QRect &area)
+{
+	if (rect().contains(area)){
+		return;
+	}
+	const qint64 end = now();
+	++frameCount;
+	paintTime += end - start;
+	maximumPaintTime = qMax(maximumPaintTime, end - start);
+	frameArea = area;
+	if (pendingInput >= 0){
+		inputLatency = end - pendingInput;
+		pendingInput = -1;
+	}
+}
+
+/**
+* Checks if the text is older than the refresh interval
+* @return bool - true if refresh() should be called
+*/
+bool PerformanceHud::needsRefresh() const
+{
+	return now() - lastRefresh >= refreshInterval * qint64(1000000);
+}
+
+/**
+* Puts the text together from the frames since the last refresh
+* @param int historyEntries - Canvases kept for undo and redo
+* @param DrawingEngine::MemoryUsage usage - Memory of the buffers
+* @param bool memoryHigh - if the memory is above the warning level, the total is shown in red
+*/
+void PerformanceHud::refresh(int historyEntries, const DrawingEngine::MemoryUsage &usage, bool memoryHigh)
+{
+	const qint64 current = now();
+	const double seconds = (current - windowStart) / 1e9;
+	const double megabyte = 1024.0 * 1024.0;
+	lines[1] = QString("%1 fps").arg(seconds > 0 ? frameCount / seconds : 0.0, 0, 'f', 1);
+	lines[2] = frameCount > 0
+		? QString("paint %1 ms, max %2 ms").arg(paintTime / 1e6 / frameCount, 0, 'f', 2)
+			.arg(maximumPaintTime / 1e6, 0, 'f', 2)
+		: QString("paint -");
+	lines[3] = inputLatency >= 0
+		? QString("input latency %1 ms").arg(inputLatency / 1e6, 0, 'f', 2) : QString("input latency -");
+	lines[4] = QString("dirty area %1x%2").arg(frameArea.width()).arg(frameArea.height());
+	lines[5] = QString("history %1 entries").arg(historyEntries);
+	lines[6] = QString("canvas %1 MB, overlay %2 MB").arg(usage.canvas / megabyte, 0, 'f', 1)
+		.arg(usage.overlay / megabyte, 0, 'f', 1);
+	lines[7] = QString("selection %1 MB").arg(usage.selection / megabyte, 0, 'f', 1);
+	lines[8] = QString("undo %1 MB, redo %2 MB").arg(usage.undo / megabyte, 0, 'f', 1)
+		.arg(usage.redo / megabyte, 0, 'f', 1);
+	lines[9] = QString("caches %1 MB, I/O %2 MB").arg(usage.caches / megabyte, 0, 'f', 1)
+		.arg(usage.ioBuffers / megabyte, 0, 'f', 1);
+	lines[10] = QString("tile store %1 MB, deduplicated %2 MB").arg(usage.tileStore / megabyte, 0, 'f', 1)
+		.arg(usage.deduplicated / megabyte, 0, 'f', 1);
+	lines[11] = QString("total %1 MB").arg(usage.total() / megabyte, 0, 'f', 1);
+	memoryWarning = memoryHigh;
+	windowStart = current;
+	lastRefresh = current;
+	frameCount = 0;
+	paintTime = 0;
+	maximumPaintTime = 0;
+}
+
+/**
+* Paints the overlay
+* @param QPainter* painter - Painter on the board
+*/
+void PerformanceHud::draw(QPainter *painter) const
+{
+	const QRect box = rect();
+	painter->save();
+	painter->fillRect(box, QColor(0, 0, 0, 170));
+	const int lineHeight = (box.height() - 8) / lines.size();
+	for (int i = 0; i < lines.size(); ++i){
+		painter->setPen(memoryWarning && i == lines.size() - 1 ? QColor(255, 90, 90) : QColor(Qt::white));
+		painter->drawText(QRect(box.left() + 6, box.top() + 4 + i * lineHeight, box.width() - 12, lineHeight),
+			Qt::AlignLeft | Qt::AlignVCenter, lines.at(i));
+	}
+	painter->restore();
+}
+
+/**
+* Returns the area of the board the overlay covers
+* @return QRect - The area
+*/
+QRect PerformanceHud::rect() const
+{
+	return QRect(8, 8, 240, lines.size() * 16 + 8);
+}
@@ -0,0 +1,47 @@
+#ifndef PERFORMANCEHUD_H
+#define PERFORMANCEHUD_H
+
+#include <QElapsedTimer>
+#include <QPainter>
+#include <QRect>
+#include <QStringList>
+#include "drawingengine.h"
+
+/**
+* The performance overlay DrawingBoard paints in its corner: frames per
+* second, paint time, latency of the last input, the area of the last frame,
+* the undo history and the memory of every kind of buffer. The board feeds
+* it timestamps on its hot paths, the text is only put together when it is
+* refreshed.
+*/
+class PerformanceHud
+{
+public:
+	PerformanceHud();
+	~PerformanceHud();
+	qint64 now() const;
+	void inputHandled(qint64 arrival);
+	void framePainted(qint64 start, const QRect &area);
+	bool needsRefresh() const;
+	void refresh(int historyEntries, const DrawingEngine::MemoryUsage &usage, bool memoryHigh);
+	void draw(QPainter *painter) const;
+	QRect rect() const;
+
+	//Milliseconds between two refreshes of the text
+	static const int refreshInterval = 250;
+
+private:
+	QElapsedTimer clock;
+	qint64 windowStart;
+	qint64 lastRefresh;
+	int frameCount;
+	qint64 paintTime;
+	qint64 maximumPaintTime;
+	qint64 pendingInput;
+	qint64 inputLatency;
+	QRect frameArea;
+	QStringList lines;
+	bool memoryWarning;
+};
+
+#endif // PERFORMANCEHUD_H
@@ -0,0 +1,382 @@
+#include "pngreader.h"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+static const int filterNone = 0;
+static const int filterSub = 1;
+static const int filterUp = 2;
+static const int filterAverage = 3;
+static const int filterPaeth = 4;
+
+static const int colorGray = 0;
+static const int colorRgb = 2;
+static const int colorPalette = 3;
+static const int colorGrayAlpha = 4;
+static const int colorRgba = 6;
+
+//Compressed bytes read from the file at a time
+static const int inputSize = 65536;
+
+/**
+* Reads a 32 bit value in network byte order
+* @param char* data - The four bytes
+* @return quint32 - The value
+*/
+static quint32 readUInt32(const char *data)
+{
+	const uchar *bytes = reinterpret_cast<const uchar *>(data);
+	return (quint32(bytes[0]) << 24) | (quint32(bytes[1]) << 16) | (quint32(bytes[2]) << 8) | quint32(bytes[3]);
+}
+
+/**
+* Predicts a byte from its neighbours the way the Paeth filter does
+* @param int a - The byte to the left
+* @param int b - The byte above
+* @param int c - The byte above and to the left
+* @return int - The neighbour closest to a + b - c
+*/
+static int paethPredictor(int a, int b, int c)
+{
+	const int p = a + b - c;
+	const int pa = abs(p - a);
+	const int pb = abs(p - b);
+	const int pc = abs(p - c);
+	if (pa <= pb && pa <= pc){
+		return a;
+	}
+	return pb <= pc ? b : c;
+}
+
+PngReader::PngReader()
+{
+	memset(&stream, 0, sizeof(stream));
+	streamOpen = false;
+	bitDepth = 0;
+	colorType = 0;
+	interlaced = false;
+	channels = 0;
+	bytesPerPixel = 0;
+	rowBytes = 0;
+	hasTransparentColor = false;
+	transparentColor[0] = transparentColor[1] = transparentColor[2] = 0;
+	chunkRemaining = 0;
+	rowsRead = 0;
+}
+
+PngReader::~PngReader()
+{
+	if (streamOpen){
+		inflateEnd(&stream);
+	}
+}
+
+/**
+* Reads the chunks in front of the image data
+* @param QString fileName - The PNG file
+* @return bool - if the file is a PNG this reader can decode
+*/
+bool PngReader::open(const QString &fileName)
+{
+	static const char signature[] = "\x89PNG\r\n\x1a\n";
+	file.setFileName(fileName);
+	if (!file.open(QIODevice::ReadOnly) || file.read(8) != QByteArray(signature, 8)){
+		return false;
+	}
+	quint32 length;
+	QByteArray type;
+	forever {
+		if (!readChunkHeader(&length, &type)){
+			return false;
+		}
+		if (type == "IDAT"){
+			break;
+		}
+		if (type == "IEND"){
+			return false;
+		}
+		if (type == "IHDR" || type == "PLTE" || type == "tRNS"){
+			const QByteArray data = file.read(length);
+			if (quint32(data.size()) != length){
+				return false;
+			}
+			const uchar *bytes = reinterpret_cast<const uchar *>(data.constData());
+			if (type == "IHDR" && length >= 13){
+				imageSize = QSize(int(readUInt32(data.constData())), int(readUInt32(data.constData() + 4)));
+				bitDepth = bytes[8];
+				colorType = bytes[9];
+				interlaced = bytes[12] != 0;
+				if (bytes[10] != 0 || bytes[11] != 0){
+					return false;
+				}
+			}
+			else if (type == "PLTE"){
+				palette.clear();
+				for (quint32 i = 0; i + 2 < length; i += 3){
+					palette.append(qRgb(bytes[i], bytes[i + 1], bytes[i + 2]));
+				}
+			}
+			else if (type == "tRNS"){
+				if (colorType == colorPalette){
+					for (int i = 0; i < palette.size() && quint32(i) < length; ++i){
+						palette[i] = qRgba(qRed(palette[i]), qGreen(palette[i]), qBlue(palette[i]), bytes[i]);
+					}
+				}
+				else if (length >= 2){
+					hasTransparentColor = true;
+					for (quint32 i = 0; i < 3 && i * 2 + 1 < length; ++i){
+						transparentColor[i] = quint16((bytes[i * 2] << 8) | bytes[i * 2 + 1]);
+					}
+				}
+			}
+		}
+		else if (!file.seek(file.pos() + length)){
+			return false;
+		}
+		//The CRC
+		if (file.read(4).size() != 4){
+			return false;
+		}
+	}
+	chunkRemaining = length;
+
+	switch (colorType){
+		case colorGray:
+			channels = 1;
+			break;
+		case colorRgb:
+			channels = 3;
+			break;
+		case colorPalette:
+			channels = 1;
+			break;
+		case colorGrayAlpha:
+			channels = 2;
+			break;
+		case colorRgba:
+			channels = 4;
+			break;
+		default:
+			return false;
+	}
+	const bool lowDepth = bitDepth == 1 || bitDepth == 2 || bitDepth == 4;
+	if (imageSize.isEmpty() || !(bitDepth == 8 || (bitDepth == 16 && colorType != colorPalette)
+		|| (lowDepth && (colorType == colorGray || colorType == colorPalette)))){
+		return false;
+	}
+	const qint64 bits = qint64(imageSize.width()) * channels * bitDepth;
+	if ((bits + 7) / 8 >= INT_MAX){
+		return false;
+	}
+	rowBytes = int((bits + 7) / 8);
+	bytesPerPixel = qMax(1, channels * bitDepth / 8);
+	row.fill(0, rowBytes + 1);
+	previous.fill(0, rowBytes);
+	input.resize(inputSize);
+	if (inflateInit(&stream) != Z_OK){
+		return false;
+	}
+	streamOpen = true;
+	return true;
+}
+
+/**
+* Returns the size of the image
+* @return QSize - The size, empty before open()
+*/
+QSize PngReader::size() const
+{
+	return imageSize;
+}
+
+/**
+* Checks if the rows are stored in Adam7 order, which readRow() can't read
+* @return bool - true if the file is interlaced
+*/
+bool PngReader::isInterlaced() const
+{
+	return interlaced;
+}
+
+/**
+* Decodes the next row of the image
+* @param QRgb* out - Room for a row of pixels, in Format_ARGB32
+* @return bool - false at the end of the image or if the file is broken
+*/
+bool PngReader::readRow(QRgb *out)
+{
+	if (!streamOpen || interlaced || rowsRead >= imageSize.height()){
+		return false;
+	}
+	stream.next_out = reinterpret_cast<Bytef *>(row.data());
+	stream.avail_out = uInt(rowBytes + 1);
+	while (stream.avail_out > 0){
+		if (stream.avail_in == 0 && !fillInput()){
+			return false;
+		}
+		const int result = inflate(&stream, Z_NO_FLUSH);
+		if (result == Z_STREAM_END){
+			if (stream.avail_out > 0){
+				return false;
+			}
+			break;
+		}
+		if (result != Z_OK && result != Z_BUF_ERROR){
+			return false;
+		}
+	}
+	unfilter(uchar(row[0]));
+	convertRow(out);
+	memcpy(previous.data(), row.constData() + 1, rowBytes);
+	++rowsRead;
+	return true;
+}
+
+/**
+* Reads the length and type of the next chunk
+* @param quint32* length - Set to the length of the data
+* @param QByteArray* type - Set to the four letter type
+* @return bool - false at the end of the file
+*/
+bool PngReader::readChunkHeader(quint32 *length, QByteArray *type)
+{
+	const QByteArray header = file.read(8);
+	if (header.size() != 8){
+		return false;
+	}
+	*length = readUInt32(header.constData());
+	*type = header.mid(4, 4);
+	return true;
+}
+
+/**
+* Hands the inflater the next piece of the image data, moving on to the
+* following IDAT chunk when the current one is used up
+* @return bool - false when there is no image data left
+*/
+bool PngReader::fillInput()
+{
+	while (chunkRemaining == 0){
+		quint32 length;
+		QByteArray type;
+		//The CRC of the chunk that was used up
+		if (file.read(4).size() != 4 || !readChunkHeader(&length, &type) || type != "IDAT"){
+			return false;
+		}
+		chunkRemaining = length;
+	}
+	const qint64 read = file.read(input.data(), qMin<qint64>(chunkRemaining, input.size()));
+	if (read <= 0){
+		return false;
+	}
+	chunkRemaining -= quint32(read);
+	stream.next_in = reinterpret_cast<Bytef *>(input.data());
+	stream.avail_in = uInt(read);
+	return true;
+}
+
+/**
+* Undoes the filter of the row that was just inflated
+* @param int filter - The filter type in front of the row
+*/
+void PngReader::unfilter(int filter)
+{
+	uchar *current = reinterpret_cast<uchar *>(row.data()) + 1;
+	const uchar *above = reinterpret_cast<const uchar *>(previous.constData());
+	switch (filter){
+		case filterNone:
+			break;
+		case filterSub:
+			for (int i = bytesPerPixel; i < rowBytes; ++i){
+				current[i] = uchar(current[i] + current[i - bytesPerPixel]);
+			}
+			break;
+		case filterUp:
+			for (int i = 0; i < rowBytes; ++i){
+				current[i] = uchar(current[i] + above[i]);
+			}
+			break;
+		case filterAverage:
+			for (int i = 0; i < rowBytes; ++i){
+				const int left = i >= bytesPerPixel ? current[i - bytesPerPixel] : 0;
+				current[i] = uchar(current[i] + ((left + above[i]) >> 1));
+			}
+			break;
+		case filterPaeth:
+			for (int i = 0; i < rowBytes; ++i){
+				const int left = i >= bytesPerPixel ? current[i - bytesPerPixel] : 0;
+				const int upperLeft = i >= bytesPerPixel ? above[i - bytesPerPixel] : 0;
+				current[i] = uchar(current[i] + paethPredictor(left, above[i], upperLeft));
+			}
+			break;
+	}
+}
+
+/**
+* Turns the unfiltered row into pixels
+* @param QRgb* out - Room for a row of pixels
+*/
+void PngReader::convertRow(QRgb *out)
+{
+	const uchar *data = reinterpret_cast<const uchar *>(row.constData()) + 1;
+	//Scales a sample to 8 bits
+	const int shift = bitDepth == 16 ? 8 : 0;
+	const int scale = bitDepth == 1 ? 255 : bitDepth == 2 ? 85 : bitDepth == 4 ? 17 : 1;
+	const int width = imageSize.width();
+	for (int x = 0; x < width; ++x){
+		switch (colorType){
+			case colorGray: {
+				const quint16 gray = sample(data, x);
+				const int value = (gray >> shift) * scale;
+				const bool transparent = hasTransparentColor && gray == transparentColor[0];
+				out[x] = qRgba(value, value, value, transparent ? 0 : 255);
+				break;
+			}
+			case colorRgb: {
+				const quint16 red = sample(data, x * 3);
+				const quint16 green = sample(data, x * 3 + 1);
+				const quint16 blue = sample(data, x * 3 + 2);
+				const bool transparent = hasTransparentColor && red == transparentColor[0]
+					&& green == transparentColor[1] && blue == transparentColor[2];
+				out[x] = qRgba(red >> shift, green >> shift, blue >> shift, transparent ? 0 : 255);
+				break;
+			}
+			case colorPalette: {
+				const quint16 index = sample(data, x);
+				out[x] = index < palette.size() ? palette[index] : qRgb(0, 0, 0);
+				break;
+			}
+			case colorGrayAlpha: {
+				const int value = sample(data, x * 2) >> shift;
+				out[x] = qRgba(value, value, value, sample(data, x * 2 + 1) >> shift);
+				break;
+			}
+			case colorRgba:
+				out[x] = qRgba(sample(data, x * 4) >> shift, sample(data, x * 4 + 1) >> shift,
+					sample(data, x * 4 + 2) >> shift, sample(data, x * 4 + 3) >> shift);
+				break;
+		}
+	}
+}
+
+/**
+* Reads one sample of the unfiltered row at its bit depth
+* @param uchar* data - The row
+* @param int index - The number of the sample in the row
+* @return quint16 - The sample, not scaled
+*/
+quint16 PngReader::sample(const uchar *data, int index) const
+{
+	switch (bitDepth){
+		case 16:
+			return quint16((data[index * 2] << 8) | data[index * 2 + 1]);
+		case 8:
+			return data[index];
+		default: {
+			const int bit = index * bitDepth;
+			const int shift = 8 - bitDepth - (bit & 7);
+			return quint16((data[bit >> 3] >> shift) & ((1 << bitDepth) - 1));
+		}
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef PNGREADER_H
+#define PNGREADER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QSize>
+#include <QString>
+#include <QVector>
+#include <QColor>
+
+#ifdef Q_OS_WIN
+#include <QtZlib/zlib.h>
+#else
+#include <zlib.h>
+#endif
+
+/**
+* Reads the rows of a PNG file one at a time, so an image larger than the
+* memory can be decoded in bands. The IDAT chunks are inflated only as far
+* as the next row needs. Every bit depth and color type is read, interlaced
+* files are not, QImageReader has to decode those whole.
+*/
+class PngReader
+{
+public:
+	PngReader();
+	~PngReader();
+	bool open(const QString &fileName);
+	QSize size() const;
+	bool isInterlaced() const;
+	bool readRow(QRgb *out);
+
+private:
+	QFile file;
+	z_stream stream;
+	bool streamOpen;
+	QSize imageSize;
+	int bitDepth;
+	int colorType;
+	bool interlaced;
+	int channels;
+	int bytesPerPixel;
+	int rowBytes;
+	QVector<QRgb> palette;
+	bool hasTransparentColor;
+	quint16 transparentColor[3];
+	QByteArray input;
+	quint32 chunkRemaining;
+	QByteArray row;
+	QByteArray previous;
+	int rowsRead;
+
+	bool readChunkHeader(quint32 *length, QByteArray *type);
+	bool fillInput();
+	void unfilter(int filter);
+	void convertRow(QRgb *out);
+	quint16 sample(const uchar *data, int index) const;
+};
+
+#endif // PNGREADER_H
@@ -0,0 +1,543 @@
+#include "pngwriter.h"
+
+#include <QFile>
+#include <QList>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef Q_OS_WIN
+#include <QtZlib/zlib.h>
+#else
+#include <zlib.h>
+#endif
+
+static const int filterNone = 0;
+static const int filterSub = 1;
+static const int filterUp = 2;
+static const int filterAverage = 3;
+static const int filterPaeth = 4;
+
+//Size of the deflate window, used to prime a band with the data before it
+static const int windowSize = 32768;
+//Amount of uncompressed data each band aims for when the band height is automatic
+static const int targetBandBytes = 1 << 20;
+
+/**
+* Appends a 32 bit value in network byte order
+* @param QByteArray data - The array to append to
+* @param quint32 value - The value to append
+*/
+static void appendUInt32(QByteArray &data, quint32 value)
+{
+	data.append(char((value >> 24) & 0xff));
+	data.append(char((value >> 16) & 0xff));
+	data.append(char((value >> 8) & 0xff));
+	data.append(char(value & 0xff));
+}
+
+/**
+* Copies one row of the image into PNG byte order (RGB or RGBA)
+* @param QImage image - Image in Format_RGB32 or Format_ARGB32
+* @param int y - The row to copy
+* @param int bytesPerPixel - 3 for RGB, 4 for RGBA
+* @param uchar* out - Destination with room for width * bytesPerPixel bytes
+*/
+static void extractRow(const QImage &image, int y, int bytesPerPixel, uchar *out)
+{
+	const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+	const int width = image.width();
+	for (int x = 0; x < width; ++x){
+		const QRgb pixel = line[x];
+		out[0] = qRed(pixel);
+		out[1] = qGreen(pixel);
+		out[2] = qBlue(pixel);
+		if (bytesPerPixel == 4){
+			out[3] = qAlpha(pixel);
+		}
+		out += bytesPerPixel;
+	}
+}
+
+/**
+* Runs one of the PNG filters on a row
+* @param int filter - The filter type
+* @param uchar* row - The raw row
+* @param uchar* previous - The raw row above, all zeros for the first row
+* @param int rowBytes - Bytes in a row
+* @param int bytesPerPixel - Bytes in a pixel
+* @param uchar* out - Destination with room for rowBytes bytes
+*/
+static void filterRow(int filter, const uchar *row, const uchar *previous, int rowBytes, int bytesPerPixel, uchar *out)
+{
+	switch (filter){
+		case filterNone:
+			memcpy(out, row, rowBytes);
+			break;
+		case filterSub:
+			for (int i = 0; i < rowBytes; ++i){
+				const int left = i >= bytesPerPixel ? row[i - bytesPerPixel] : 0;
+				out[i] = uchar(row[i] - left);
+			}
+			break;
+		case filterUp:
+			for (int i = 0; i < rowBytes; ++i){
+				out[i] = uchar(row[i] - previous[i]);
+			}
+			break;
+		case filterAverage:
+			for (int i = 0; i < rowBytes; ++i){
+				const int left = i >= bytesPerPixel ? row[i - bytesPerPixel] : 0;
+				out[i] = uchar(row[i] - ((left + previous[i]) >> 1));
+			}
+			break;
+		case filterPaeth:
+			for (int i = 0; i < rowBytes; ++i){
+				const int a = i >= bytesPerPixel ? row[i - bytesPerPixel] : 0;
+				const int b = previous[i];
+				const int c = i >= bytesPerPixel ? previous[i - bytesPerPixel] : 0;
+				const int p = a + b - c;
+				const int pa = abs(p - a);
+				const int pb = abs(p - b);
+				const int pc = abs(p - c);
+				int predictor = c;
+				if (pa <= pb && pa <= pc){
+					predictor = a;
+				}
+				else if (pb <= pc){
+					predictor = b;
+				}
+				out[i] = uchar(row[i] - predictor);
+			}
+			break;
+	}
+}
+
+/**
+* Sum of the filtered bytes seen as signed values, the usual heuristic
+* for picking the filter that compresses best
+*/
+static quint64 filterCost(const uchar *data, int length)
+{
+	quint64 cost = 0;
+	for (int i = 0; i < length; ++i){
+		cost += abs(int(static_cast<signed char>(data[i])));
+	}
+	return cost;
+}
+
+/**
+* Filters and deflates one band of rows. The band is primed with the
+* filtered rows before it so the independently compressed bands lose
+* almost nothing compared to a single stream.
+*/
+class PngBandJob : public QRunnable
+{
+public:
+	PngBandJob(const PngWriter::RowReader &readRows, int width, int firstRow, int lastRow,
+		int bytesPerPixel, int preset, bool last, QSemaphore *done);
+	void run();
+
+	QByteArray output;
+	uLong adler;
+	uLong length;
+	bool ok;
+
+private:
+	PngWriter::RowReader readRows;
+	int width;
+	int firstRow;
+	int lastRow;
+	int bytesPerPixel;
+	int preset;
+	bool last;
+	QSemaphore *done;
+
+	void filterRows(int from, int to, QByteArray *filtered);
+	bool deflateBand(const QByteArray &dictionary, const QByteArray &filtered);
+};
+
+PngBandJob::PngBandJob(const PngWriter::RowReader &readRows, int width, int firstRow, int lastRow,
+	int bytesPerPixel, int preset, bool last, QSemaphore *done)
+	: readRows(readRows), width(width), firstRow(firstRow), lastRow(lastRow),
+	bytesPerPixel(bytesPerPixel), preset(preset), last(last), done(done)
+{
+	setAutoDelete(false);
+	adler = adler32(0L, Z_NULL, 0);
+	length = 0;
+	ok = false;
+}
+
+void PngBandJob::run()
+{
+	const int rowBytes = width * bytesPerPixel;
+	QByteArray dictionary;
+	if (preset == PngWriter::presetSmallest && firstRow > 0){
+		const int primeRows = qMin(firstRow, windowSize / (rowBytes + 1) + 1);
+		filterRows(firstRow - primeRows, firstRow, &dictionary);
+		if (dictionary.size() > windowSize){
+			dictionary = dictionary.right(windowSize);
+		}
+	}
+	QByteArray filtered;
+	filterRows(firstRow, lastRow, &filtered);
+	length = filtered.size();
+	adler = adler32(adler, reinterpret_cast<const Bytef *>(filtered.constData()), filtered.size());
+	ok = deflateBand(dictionary, filtered);
+	if (done){
+		done->release();
+	}
+}
+
+/**
+* Filters the rows [from, to) into PNG scanlines, each prefixed with its filter type
+*/
+void PngBandJob::filterRows(int from, int to, QByteArray *filtered)
+{
+	const int rowBytes = width * bytesPerPixel;
+	const int top = qMax(0, from - 1);
+	const QImage image = readRows(QRect(0, top, width, to - top))
+		.convertToFormat(bytesPerPixel == 4 ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+	QByteArray previous(rowBytes, 0);
+	QByteArray current(rowBytes, 0);
+	QByteArray candidate(rowBytes, 0);
+	QByteArray best(rowBytes, 0);
+	if (from > 0){
+		extractRow(image, 0, bytesPerPixel, reinterpret_cast<uchar *>(previous.data()));
+	}
+	filtered->resize((to - from) * (rowBytes + 1));
+	uchar *out = reinterpret_cast<uchar *>(filtered->data());
+	for (int y = from; y < to; ++y){
+		extractRow(image, y - top, bytesPerPixel, reinterpret_cast<uchar *>(current.data()));
+		const uchar *row = reinterpret_cast<const uchar *>(current.constData());
+		const uchar *above = reinterpret_cast<const uchar *>(previous.constData());
+		if (preset == PngWriter::presetFastest){
+			out[0] = filterSub;
+			filterRow(filterSub, row, above, rowBytes, bytesPerPixel, out + 1);
+		}
+		else{
+			//Adaptive filtering, keep the filter with the lowest cost
+			quint64 bestCost = 0;
+			int bestFilter = filterNone;
+			for (int filter = filterNone; filter <= filterPaeth; ++filter){
+				uchar *data = reinterpret_cast<uchar *>(candidate.data());
+				filterRow(filter, row, above, rowBytes, bytesPerPixel, data);
+				const quint64 cost = filterCost(data, rowBytes);
+				if (filter == filterNone || cost < bestCost){
+					bestCost = cost;
+					bestFilter = filter;
+					candidate.swap(best);
+				}
+			}
+			out[0] = uchar(bestFilter);
+			memcpy(out + 1, best.constData(), rowBytes);
+		}
+		out += rowBytes + 1;
+		previous.swap(current);
+	}
+}
+
+/**
+* Deflates the filtered band as a raw deflate stream. All bands except the
+* last one end byte aligned with a sync flush so they can be concatenated.
+*/
+bool PngBandJob::deflateBand(const QByteArray &dictionary, const QByteArray &filtered)
+{
+	int level = Z_DEFAULT_COMPRESSION;
+	int strategy = Z_FILTERED;
+	switch (preset){
+		case PngWriter::presetFastest:
+			level = 1;
+			strategy = Z_RLE;
+			break;
+		case PngWriter::presetBalanced:
+			level = 6;
+			break;
+		case PngWriter::presetSmallest:
+			level = 9;
+			strategy = Z_DEFAULT_STRATEGY;
+			break;
+	}
+
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, strategy) != Z_OK){
+		return false;
+	}
+	if (!dictionary.isEmpty()){
+		deflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(dictionary.constData()),
+			dictionary.size());
+	}
+
+	output.resize(int(deflateBound(&stream, filtered.size())) + 64);
+	stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(filtered.constData()));
+	stream.avail_in = filtered.size();
+	stream.next_out = reinterpret_cast<Bytef *>(output.data());
+	stream.avail_out = output.size();
+
+	const int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+	bool succeeded = true;
+	for (;;){
+		const int result = deflate(&stream, flush);
+		if (result == Z_STREAM_ERROR){
+			succeeded = false;
+			break;
+		}
+		if (last ? result == Z_STREAM_END : stream.avail_out != 0){
+			break;
+		}
+		if (stream.avail_out != 0){
+			succeeded = false;
+			break;
+		}
+		const int used = output.size();
+		output.resize(used * 2);
+		stream.next_out = reinterpret_cast<Bytef *>(output.data()) + used;
+		stream.avail_out = output.size() - used;
+	}
+	output.resize(output.size() - stream.avail_out);
+	deflateEnd(&stream);
+	return succeeded;
+}
+
+PngWriter::PngWriter()
+{
+	preset = presetBalanced;
+	bandHeight = 0;
+	bufferBytes = 0;
+}
+
+PngWriter::~PngWriter()
+{
+
+}
+
+/**
+* Sets the speed/ratio preset
+* @param int newPreset - One of presetFastest, presetBalanced or presetSmallest
+*/
+void PngWriter::setPreset(int newPreset)
+{
+	preset = newPreset;
+}
+
+/**
+* Sets how many rows go in each band. 0 picks a height from the image width
+* @param int newBandHeight - The new band height
+*/
+void PngWriter::setBandHeight(int newBandHeight)
+{
+	bandHeight = newBandHeight;
+}
+
+/**
+* Returns the speed/ratio preset
+* @return int - The preset
+*/
+int PngWriter::getPreset()
+{
+	return preset;
+}
+
+/**
+* Returns the band height, 0 if automatic
+* @return int - The band height
+*/
+int PngWriter::getBandHeight()
+{
+	return bandHeight;
+}
+
+/**
+* Returns how much memory the buffers of the last write took at the most,
+* estimated from the bands that run at the same time and the compressed output
+* @return qint64 - The bytes
+*/
+qint64 PngWriter::getBufferBytes()
+{
+	return bufferBytes;
+}
+
+/**
+* Calculates the number of rows in each band
+* @param int rowBytes - Bytes in a filtered row
+* @return int - Rows per band
+*/
+int PngWriter::calculateBandHeight(int rowBytes)
+{
+	if (bandHeight > 0){
+		return bandHeight;
+	}
+	return qMax(1, targetBandBytes / rowBytes);
+}
+
+/**
+* Writes the image to a file
+* @param QImage image - The image to write
+* @param QString fileName - The file to write to
+* @return bool - if the write succeeded
+*/
+bool PngWriter::write(const QImage &image, const QString &fileName)
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)){
+		return false;
+	}
+	if (!write(image, &file)){
+		file.close();
+		file.remove();
+		return false;
+	}
+	return true;
+}
+
+/**
+* Writes an image that is read a band of rows at a time to a file
+* @param QSize imageSize - The size of the image
+* @param RowReader readRows - Returns the rows of a rectangle as a Format_RGB32 image
+* @param QString fileName - The file to write to
+* @return bool - if the write succeeded
+*/
+bool PngWriter::write(const QSize &imageSize, const RowReader &readRows, const QString &fileName)
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)){
+		return false;
+	}
+	if (!write(imageSize, readRows, &file)){
+		file.close();
+		file.remove();
+		return false;
+	}
+	return true;
+}
+
+/**
+* Writes the image as a PNG stream to the device
+* @param QImage image - The image to write
+* @param QIODevice* device - Open device to write to
+* @return bool - if the write succeeded
+*/
+bool PngWriter::write(const QImage &image, QIODevice *device)
+{
+	if (image.isNull()){
+		return false;
+	}
+	const bool alpha = image.hasAlphaChannel();
+	const QImage source = image.convertToFormat(alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+	//Hands out the rows without copying them
+	RowReader readRows = [source](const QRect &rows){
+		return QImage(source.constScanLine(rows.top()), source.width(), rows.height(),
+			source.bytesPerLine(), source.format());
+	};
+	return writeRows(source.size(), alpha, readRows, device);
+}
+
+/**
+* Writes an image that is read a band of rows at a time as a PNG stream to the device
+* @param QSize imageSize - The size of the image
+* @param RowReader readRows - Returns the rows of a rectangle as a Format_RGB32 image
+* @param QIODevice* device - Open device to write to
+* @return bool - if the write succeeded
+*/
+bool PngWriter::write(const QSize &imageSize, const RowReader &readRows, QIODevice *device)
+{
+	if (imageSize.isEmpty()){
+		return false;
+	}
+	return writeRows(imageSize, false, readRows, device);
+}
+
+/**
+* Filters and compresses the bands on the thread pool and writes the chunks
+* @param QSize imageSize - The size of the image
+* @param bool alpha - if the rows have an alpha channel
+* @param RowReader readRows - Returns the rows of a rectangle
+* @param QIODevice* device - Open device to write to
+* @return bool - if the write succeeded
+*/
+bool PngWriter::writeRows(const QSize &imageSize, bool alpha, const RowReader &readRows, QIODevice *device)
+{
+	const int bytesPerPixel = alpha ? 4 : 3;
+	const int rowBytes = imageSize.width() * bytesPerPixel + 1;
+	const int rows = calculateBandHeight(rowBytes);
+	const int bandCount = (imageSize.height() + rows - 1) / rows;
+
+	QSemaphore done;
+	QList<PngBandJob *> jobs;
+	for (int band = 0; band < bandCount; ++band){
+		const int firstRow = band * rows;
+		const int lastRow = qMin(imageSize.height(), firstRow + rows);
+		jobs.append(new PngBandJob(readRows, imageSize.width(), firstRow, lastRow, bytesPerPixel,
+			preset, band == bandCount - 1, &done));
+	}
+	//The first band runs on this thread while the pool takes the rest
+	for (int band = 1; band < bandCount; ++band){
+		QThreadPool::globalInstance()->start(jobs[band]);
+	}
+	jobs[0]->run();
+	done.acquire(bandCount);
+
+	//Every running band holds its rows and their filtered copy, all compressed bands are kept until written
+	const int running = qMin(bandCount, QThreadPool::globalInstance()->maxThreadCount() + 1);
+	bufferBytes = qint64(running) * rows * (imageSize.width() * 4 + rowBytes);
+	for (int band = 0; band < bandCount; ++band){
+		bufferBytes += jobs[band]->output.size();
+	}
+
+	bool succeeded = true;
+	uLong adler = adler32(0L, Z_NULL, 0);
+	for (int band = 0; band < bandCount; ++band){
+		succeeded = succeeded && jobs[band]->ok;
+		adler = adler32_combine(adler, jobs[band]->adler, jobs[band]->length);
+	}
+
+	if (succeeded){
+		QByteArray header;
+		appendUInt32(header, imageSize.width());
+		appendUInt32(header, imageSize.height());
+		header.append(char(8));
+		header.append(char(alpha ? 6 : 2));
+		header.append(char(0));
+		header.append(char(0));
+		header.append(char(0));
+
+		static const char signature[] = { char(137), 'P', 'N', 'G', '\r', '\n', char(26), '\n' };
+		succeeded = device->write(signature, sizeof(signature)) == qint64(sizeof(signature))
+			&& writeChunk(device, "IHDR", header);
+
+		//zlib header matching the compression level, then the bands and the checksum
+		static const char zlibHeaders[3][2] = { { 0x78, 0x01 }, { 0x78, char(0x9c) }, { 0x78, char(0xda) } };
+		jobs[0]->output.prepend(zlibHeaders[qBound(0, preset, 2)], 2);
+		appendUInt32(jobs[bandCount - 1]->output, quint32(adler));
+		for (int band = 0; band < bandCount && succeeded; ++band){
+			succeeded = writeChunk(device, "IDAT", jobs[band]->output);
+		}
+		succeeded = succeeded && writeChunk(device, "IEND", QByteArray());
+	}
+
+	qDeleteAll(jobs);
+	return succeeded;
+}
+
+/**
+* Writes one PNG chunk with its length and checksum
+* @param QIODevice* device - Device to write to
+* @param char* type - The four letter chunk type
+* @param QByteArray data - The chunk data
+* @return bool - if the write succeeded
+*/
+bool PngWriter::writeChunk(QIODevice *device, const char *type, const QByteArray &data)
+{
+	QByteArray chunk;
+	chunk.reserve(data.size() + 12);
+	appendUInt32(chunk, data.size());
+	chunk.append(type, 4);
+	chunk.append(data);
+	uLong crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(crc, reinterpret_cast<const Bytef *>(chunk.constData()) + 4, data.size() + 4);
+	appendUInt32(chunk, quint32(crc));
+	return device->write(chunk) == chunk.size();
+}
@@ -0,0 +1,49 @@
+#ifndef PNGWRITER_H
+#define PNGWRITER_H
+
+#include <QImage>
+#include <QIODevice>
+#include <QString>
+#include <QByteArray>
+#include <QRect>
+#include <QSize>
+#include <functional>
+
+/**
+* Writes PNG files by splitting the image into bands of rows that are
+* filtered and deflated independently on the global thread pool. The
+* compressed bands are stitched together into one valid zlib stream.
+*/
+class PngWriter
+{
+public:
+	typedef std::function<QImage (const QRect &rows)> RowReader;
+
+	PngWriter();
+	~PngWriter();
+	void setPreset(int newPreset);
+	void setBandHeight(int newBandHeight);
+	int getPreset();
+	int getBandHeight();
+	qint64 getBufferBytes();
+	bool write(const QImage &image, const QString &fileName);
+	bool write(const QImage &image, QIODevice *device);
+	bool write(const QSize &imageSize, const RowReader &readRows, const QString &fileName);
+	bool write(const QSize &imageSize, const RowReader &readRows, QIODevice *device);
+
+	//Speed/ratio presets. Public to be reachable from the DrawIt class
+	static const int presetFastest = 0;
+	static const int presetBalanced = 1;
+	static const int presetSmallest = 2;
+
+private:
+	int preset;
+	int bandHeight;
+	qint64 bufferBytes;
+
+	int calculateBandHeight(int rowBytes);
+	bool writeRows(const QSize &imageSize, bool alpha, const RowReader &readRows, QIODevice *device);
+	bool writeChunk(QIODevice *device, const char *type, const QByteArray &data);
+};
+
+#endif // PNGWRITER_H
@@ -0,0 +1,458 @@
+#include "renderfarm.h"
+#include "batchrenderer.h"
+#include "drawingengine.h"
+#include "pngwriter.h"
+#include "tiledcanvas.h"
+
+#include <QAtomicInt>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QSharedPointer>
+#include <QTextStream>
+#include <QThread>
+#include <cstring>
+
+/**
+* Writes an area of a canvas to a file as raw Format_RGB32 rows
+* @param TiledCanvas canvas - The canvas
+* @param QRect area - The area to write
+* @param QString fileName - The file to write to
+* @param QString* error - Receives the reason when it fails
+* @return bool - if the area was written
+*/
+static bool writeBand(const TiledCanvas &canvas, const QRect &area, const QString &fileName, QString *error)
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly)){
+		*error = QString("could not write %1").arg(fileName);
+		return false;
+	}
+	for (int top = area.top(); top <= area.bottom(); top += TiledCanvas::tileSize){
+		const QImage rows = canvas.copy(QRect(area.left(), top, area.width(),
+			qMin(TiledCanvas::tileSize, area.bottom() - top + 1)));
+		if (file.write(reinterpret_cast<const char *>(rows.constBits()), rows.byteCount()) != rows.byteCount()){
+			*error = QString("could not write %1").arg(fileName);
+			return false;
+		}
+	}
+	return true;
+}
+
+RenderFarm::RenderFarm(QObject *parent)
+	: QObject(parent)
+{
+	workerCount = QThread::idealThreadCount();
+	jobCount = 0;
+	doneCount = 0;
+	failureCount = 0;
+	restartCount = 0;
+	stopping = false;
+	bandRows = 0;
+	connect(&progressTimer, SIGNAL(timeout()), this, SLOT(reportProgress()));
+}
+
+RenderFarm::~RenderFarm()
+{
+	stopping = true;
+	foreach(QProcess *worker, workers) {
+		worker->closeWriteChannel();
+		worker->waitForFinished();
+	}
+}
+
+/**
+* Sets how many worker processes are started
+* @param int newWorkerCount - The number of workers
+*/
+void RenderFarm::setWorkerCount(int newWorkerCount)
+{
+	workerCount = qMax(1, newWorkerCount);
+}
+
+/**
+* Returns how many worker processes are started
+* @return int - The number of workers
+*/
+int RenderFarm::getWorkerCount()
+{
+	return workerCount;
+}
+
+/**
+* Returns how many jobs failed
+* @return int - The number of failed jobs
+*/
+int RenderFarm::getFailureCount()
+{
+	return failureCount;
+}
+
+/**
+* Adds a job for every script
+* @param QStringList scripts - The script files
+*/
+void RenderFarm::addScripts(const QStringList &scripts)
+{
+	foreach(const QString &script, scripts) {
+		enqueue("script\t" + QFileInfo(script).absoluteFilePath());
+	}
+}
+
+/**
+* Renders one script in bands of tile rows and merges them into a PNG file.
+* A worker first finds the canvas size, the bands are added when it is known
+* @param QString script - The script file
+* @param QString output - The PNG file to write
+*/
+void RenderFarm::addRowShards(const QString &script, const QString &output)
+{
+	shardScript = QFileInfo(script).absoluteFilePath();
+	shardOutput = output;
+	enqueue("size\t" + shardScript);
+}
+
+/**
+* Runs the farm from the command line arguments
+* @param QStringList arguments - The application arguments
+* @return int - The exit code, 0 if every job succeeded
+*/
+int RenderFarm::exec(const QStringList &arguments)
+{
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Renders drawing scripts on several worker processes.");
+	parser.addHelpOption();
+	QCommandLineOption farmOption("farm", "Spread the scripts over worker processes.");
+	QCommandLineOption workersOption(QStringList() << "w" << "workers",
+		"Number of worker processes.", "count", QString::number(QThread::idealThreadCount()));
+	QCommandLineOption rowsOption("rows", "Split one script into bands of tile rows.");
+	QCommandLineOption outputOption(QStringList() << "o" << "output",
+		"PNG file the bands are merged into.", "file");
+	parser.addOption(farmOption);
+	parser.addOption(workersOption);
+	parser.addOption(rowsOption);
+	parser.addOption(outputOption);
+	parser.addPositionalArgument("scripts", "Drawing scripts to render.", "<script>...");
+	parser.process(arguments);
+
+	const QStringList scripts = parser.positionalArguments();
+	RenderFarm farm;
+	farm.setWorkerCount(parser.value(workersOption).toInt());
+	if (parser.isSet(rowsOption)){
+		if (scripts.size() != 1 || !parser.isSet(outputOption)){
+			QTextStream(stderr) << "--rows needs one script and an --output file\n";
+			return 1;
+		}
+		farm.addRowShards(scripts.first(), parser.value(outputOption));
+	}
+	else{
+		if (scripts.isEmpty()){
+			parser.showHelp(1);
+		}
+		farm.addScripts(scripts);
+	}
+	QObject::connect(&farm, SIGNAL(finished()), QCoreApplication::instance(), SLOT(quit()));
+	QTimer::singleShot(0, &farm, SLOT(start()));
+	QCoreApplication::exec();
+	return farm.getFailureCount() == 0 ? 0 : 1;
+}
+
+/**
+* Runs a worker process, reads jobs from the standard input until it closes
+* @return int - The exit code
+*/
+int RenderFarm::execWorker()
+{
+	QTextStream input(stdin);
+	QTextStream output(stdout);
+	forever {
+		const QString line = input.readLine();
+		if (line.isNull()){
+			return 0;
+		}
+		const QStringList fields = line.split('\t');
+		const QString command = fields.value(0);
+		DrawingEngine engine(QSize(BatchRenderer::defaultCanvasWidth, BatchRenderer::defaultCanvasHeight));
+		QString error;
+		QString reply = "ok";
+		if (command == "script"){
+			if (!BatchRenderer::runScript(&engine, fields.value(1), &error)){
+				reply = "failed\t" + error;
+			}
+		}
+		else if (command == "size"){
+			//Nothing has to be painted to know the size
+			engine.setClipRect(QRect());
+			if (BatchRenderer::runScript(&engine, fields.value(1), &error, false)){
+				reply = QString("ok\t%1\t%2").arg(engine.canvas().size().width()).arg(engine.canvas().size().height());
+			}
+			else{
+				reply = "failed\t" + error;
+			}
+		}
+		else if (command == "band"){
+			const QRect area(fields.value(2).toInt(), fields.value(3).toInt(),
+				fields.value(4).toInt(), fields.value(5).toInt());
+			engine.setClipRect(area);
+			if (!BatchRenderer::runScript(&engine, fields.value(1), &error, false) ||
+				!writeBand(engine.canvas(), area, fields.value(6), &error)){
+				reply = "failed\t" + error;
+			}
+		}
+		else{
+			reply = "failed\tunknown job " + command;
+		}
+		output << reply << '\n';
+		output.flush();
+	}
+}
+
+/**
+* Starts the workers and hands out the first jobs
+*/
+void RenderFarm::start()
+{
+	clock.start();
+	progressTimer.start(progressInterval);
+	for (int i = 0; i < workerCount; ++i){
+		startWorker();
+	}
+	dispatch();
+}
+
+/**
+* Handles the answers of a worker
+*/
+void RenderFarm::readWorker()
+{
+	QProcess *worker = qobject_cast<QProcess *>(sender());
+	while (worker->canReadLine()){
+		const QStringList reply = QString::fromUtf8(worker->readLine()).trimmed().split('\t');
+		if (running.contains(worker)){
+			jobDone(running.take(worker).command, reply);
+		}
+	}
+	dispatch();
+}
+
+/**
+* Starts a new worker in place of one that died. Its job is retried until
+* it has been tried maximumAttempts times
+*/
+void RenderFarm::workerFinished()
+{
+	QProcess *worker = qobject_cast<QProcess *>(sender());
+	//A crash is reported as an error and as finished, only handle it once
+	if (!workers.removeOne(worker)){
+		return;
+	}
+	worker->deleteLater();
+	if (stopping){
+		return;
+	}
+	const bool startFailed = worker->error() == QProcess::FailedToStart;
+	if (running.contains(worker)){
+		const FarmJob job = running.take(worker);
+		if (job.attempts < maximumAttempts && !startFailed){
+			pending.prepend(job);
+		}
+		else{
+			++doneCount;
+			++failureCount;
+			QTextStream(stderr) << "failed " << job.command.section('\t', 1, 1) << ": the worker died "
+				<< job.attempts << " times\n";
+		}
+	}
+	if (startFailed){
+		QTextStream(stderr) << "could not start a worker: " << worker->errorString() << '\n';
+		doneCount += pending.size();
+		failureCount += pending.size();
+		pending.clear();
+	}
+	else{
+		++restartCount;
+		startWorker();
+	}
+	dispatch();
+}
+
+/**
+* Prints how far the farm has come
+*/
+void RenderFarm::reportProgress()
+{
+	const double seconds = clock.elapsed() / 1000.0;
+	QTextStream(stdout) << QString("%1/%2 jobs done, %3 failed, %4 worker restarts, %5 jobs/s\n")
+		.arg(doneCount).arg(jobCount).arg(failureCount).arg(restartCount)
+		.arg(seconds > 0 ? doneCount / seconds : 0.0, 0, 'f', 1);
+}
+
+/**
+* Starts a worker process, which is this program in worker mode
+*/
+void RenderFarm::startWorker()
+{
+	QProcess *worker = new QProcess(this);
+	worker->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+	connect(worker, SIGNAL(readyReadStandardOutput()), this, SLOT(readWorker()));
+	connect(worker, SIGNAL(finished(int, QProcess::ExitStatus)), this, SLOT(workerFinished()));
+	connect(worker, SIGNAL(error(QProcess::ProcessError)), this, SLOT(workerFinished()));
+	workers.append(worker);
+	worker->start(QCoreApplication::applicationFilePath(), QStringList() << "--batch-worker");
+}
+
+/**
+* Adds a job to the end of the queue
+* @param QString command - The job line sent to a worker
+*/
+void RenderFarm::enqueue(const QString &command)
+{
+	FarmJob job;
+	job.command = command;
+	job.attempts = 0;
+	pending.enqueue(job);
+	++jobCount;
+}
+
+/**
+* Gives a job to every worker that has none, finishes when all jobs are done
+*/
+void RenderFarm::dispatch()
+{
+	foreach(QProcess *worker, workers) {
+		if (pending.isEmpty()){
+			break;
+		}
+		if (running.contains(worker) || worker->state() == QProcess::NotRunning){
+			continue;
+		}
+		FarmJob job = pending.dequeue();
+		++job.attempts;
+		running.insert(worker, job);
+		worker->write((job.command + '\n').toUtf8());
+	}
+	if (pending.isEmpty() && running.isEmpty()){
+		finish();
+	}
+}
+
+/**
+* Counts a job that a worker answered
+* @param QString command - The job line
+* @param QStringList reply - The fields of the answer
+*/
+void RenderFarm::jobDone(const QString &command, const QStringList &reply)
+{
+	++doneCount;
+	if (reply.value(0) != "ok"){
+		++failureCount;
+		QTextStream(stderr) << "failed " << reply.value(1) << '\n';
+		return;
+	}
+	if (command.startsWith("size\t")){
+		addBands(QSize(reply.value(1).toInt(), reply.value(2).toInt()));
+	}
+}
+
+/**
+* Splits a canvas into bands of whole tile rows, small enough to keep a
+* worker's copy of its band around bandBytes and enough for every worker
+* @param QSize canvasSize - The size of the canvas
+*/
+void RenderFarm::addBands(const QSize &canvasSize)
+{
+	if (canvasSize.isEmpty()){
+		++failureCount;
+		QTextStream(stderr) << "failed " << shardScript << ": the canvas is empty\n";
+		return;
+	}
+	shardSize = canvasSize;
+	int rows = qMax(1, bandBytes / (canvasSize.width() * 4));
+	rows = qMin(rows, (canvasSize.height() + workerCount - 1) / workerCount);
+	bandRows = qMax(1, rows / TiledCanvas::tileSize) * TiledCanvas::tileSize;
+	for (int top = 0, band = 0; top < canvasSize.height(); top += bandRows, ++band){
+		enqueue(QString("band\t%1\t0\t%2\t%3\t%4\t%5").arg(shardScript).arg(top)
+			.arg(canvasSize.width()).arg(qMin(bandRows, canvasSize.height() - top)).arg(bandFileName(band)));
+	}
+}
+
+/**
+* Merges the bands the workers wrote into the output PNG file. The writer
+* asks for rows from several threads at once, so the bands are mapped and
+* rows copied out of the mappings. A band that can't be mapped is read
+* through a file of its own in every call
+* @return bool - if the file was written
+*/
+bool RenderFarm::mergeBands()
+{
+	const qint64 rowBytes = qint64(shardSize.width()) * 4;
+	QList<QSharedPointer<QFile> > bands;
+	QList<const uchar *> mapped;
+	for (int band = 0; band * bandRows < shardSize.height(); ++band){
+		QSharedPointer<QFile> file(new QFile(bandFileName(band)));
+		const qint64 bytes = qMin(bandRows, shardSize.height() - band * bandRows) * rowBytes;
+		if (!file->open(QIODevice::ReadOnly) || file->size() < bytes){
+			return false;
+		}
+		bands.append(file);
+		mapped.append(file->map(0, bytes));
+	}
+	QAtomicInt readFailed(0);
+	PngWriter writer;
+	const bool written = writer.write(shardSize, [&](const QRect &rows) -> QImage {
+		QImage image(shardSize.width(), rows.height(), QImage::Format_RGB32);
+		int y = rows.top();
+		while (y <= rows.bottom()){
+			const int band = y / bandRows;
+			const int last = qMin(rows.bottom(), (band + 1) * bandRows - 1);
+			const qint64 bytes = (last - y + 1) * rowBytes;
+			const qint64 offset = (y - band * bandRows) * rowBytes;
+			char *out = reinterpret_cast<char *>(image.scanLine(y - rows.top()));
+			if (mapped[band]){
+				memcpy(out, mapped[band] + offset, bytes);
+			}
+			else{
+				QFile file(bands[band]->fileName());
+				if (!file.open(QIODevice::ReadOnly) || !file.seek(offset) || file.read(out, bytes) != bytes){
+					readFailed.storeRelease(1);
+				}
+			}
+			y = last + 1;
+		}
+		return image;
+	}, shardOutput);
+	return written && readFailed.loadAcquire() == 0;
+}
+
+/**
+* Returns the file a band is written to
+* @param int band - The band number
+* @return QString - The file name
+*/
+QString RenderFarm::bandFileName(int band)
+{
+	return bandDirectory.path() + QString("/band%1.raw").arg(band);
+}
+
+/**
+* Merges the bands if a canvas was split, stops the workers and reports the result
+*/
+void RenderFarm::finish()
+{
+	if (stopping){
+		return;
+	}
+	stopping = true;
+	progressTimer.stop();
+	if (bandRows > 0 && failureCount == 0 && !mergeBands()){
+		++failureCount;
+		QTextStream(stderr) << "could not write " << shardOutput << '\n';
+	}
+	reportProgress();
+	foreach(QProcess *worker, workers) {
+		worker->closeWriteChannel();
+	}
+	emit finished();
+}
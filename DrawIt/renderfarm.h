@@ -0,0 +1,101 @@
+#ifndef RENDERFARM_H
+#define RENDERFARM_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QProcess>
+#include <QQueue>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTimer>
+
+/**
+* Spreads batch jobs over several local worker processes, which are this
+* program started with --batch-worker. Either every script is a job of its
+* own, or one script that draws a huge canvas is split into bands of tile
+* rows that the workers render clipped to their band, and the bands are
+* merged into one PNG file.
+*
+* The coordinator sends one job per line on the standard input of a worker,
+* fields separated by tabs:
+*
+*   script <file>                                   runs a script with its save commands
+*   size <file>                                     answers the canvas size the script ends with
+*   band <file> <x> <y> <width> <height> <output>   writes that area as raw Format_RGB32 rows
+*
+* and the worker answers with a line "ok[\t<width>\t<height>]" or "failed\t<error>".
+* A worker that dies is started again and its job is retried.
+*/
+class RenderFarm : public QObject
+{
+	Q_OBJECT
+
+public:
+	RenderFarm(QObject *parent = 0);
+	~RenderFarm();
+	void setWorkerCount(int newWorkerCount);
+	int getWorkerCount();
+	int getFailureCount();
+	void addScripts(const QStringList &scripts);
+	void addRowShards(const QString &script, const QString &output);
+	static int exec(const QStringList &arguments);
+	static int execWorker();
+
+	//Times a job is started before a dying worker counts it as failed
+	static const int maximumAttempts = 3;
+	//Milliseconds between the progress lines
+	static const int progressInterval = 2000;
+	//Bytes of pixels a worker renders in one band
+	static const int bandBytes = 64 * 1024 * 1024;
+
+public slots:
+	void start();
+
+signals:
+	void finished();
+
+private slots:
+	void readWorker();
+	void workerFinished();
+	void reportProgress();
+
+private:
+	struct FarmJob
+	{
+		QString command;
+		int attempts;
+	};
+
+	int workerCount;
+	QList<QProcess *> workers;
+	QHash<QProcess *, FarmJob> running;
+	QQueue<FarmJob> pending;
+	QTimer progressTimer;
+	QElapsedTimer clock;
+	int jobCount;
+	int doneCount;
+	int failureCount;
+	int restartCount;
+	bool stopping;
+
+	QString shardScript;
+	QString shardOutput;
+	QSize shardSize;
+	int bandRows;
+	QTemporaryDir bandDirectory;
+
+	void startWorker();
+	void enqueue(const QString &command);
+	void dispatch();
+	void jobDone(const QString &command, const QStringList &reply);
+	void addBands(const QSize &canvasSize);
+	bool mergeBands();
+	QString bandFileName(int band);
+	void finish();
+};
+
+#endif // RENDERFARM_H
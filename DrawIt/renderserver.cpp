@@ -0,0 +1,469 @@
+#include "renderserver.h"
+#include "batchrenderer.h"
+#include "drawingengine.h"
+#include "pngwriter.h"
+#include "sharedimagebuffer.h"
+
+#include <QBuffer>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QQueue>
+#include <QRegExp>
+#include <QRunnable>
+#include <QTextStream>
+#include <QThread>
+#include <QtEndian>
+
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#endif
+
+/**
+* A request waiting for its canvas
+*/
+struct RenderRequest
+{
+	int connectionId;
+	qint64 peerPid;
+	QString id;
+	QString replyFormat;
+	QString target;
+	QStringList commands;
+	QElapsedTimer arrival;
+};
+
+/**
+* A named canvas of the server with the requests waiting for it. Only one
+* job at a time works through the queue, so the requests on a canvas run
+* in the order they arrived. The shared buffer stays mapped between requests
+* and only the area that changed since it was last written is copied into it
+*/
+class ServerCanvas
+{
+public:
+	ServerCanvas(int newSerial)
+		: engine(QSize(BatchRenderer::defaultCanvasWidth, BatchRenderer::defaultCanvasHeight))
+	{
+		serial = newSerial;
+		running = false;
+	}
+
+	int serial;
+	DrawingEngine engine;
+	SharedImageBuffer shared;
+	QString sharedTarget;
+	QRect sharedDirty;
+	QMutex queueMutex;
+	QQueue<RenderRequest> pending;
+	bool running;
+};
+
+/**
+* Works through the queue of a canvas on a worker thread
+*/
+class CanvasJob : public QRunnable
+{
+public:
+	CanvasJob(RenderServer *server, const QSharedPointer<ServerCanvas> &canvas)
+		: server(server), canvas(canvas)
+	{
+	}
+
+	void run()
+	{
+		forever {
+			RenderRequest request;
+			{
+				QMutexLocker locker(&canvas->queueMutex);
+				if (canvas->pending.isEmpty()){
+					canvas->running = false;
+					return;
+				}
+				request = canvas->pending.dequeue();
+			}
+			const QByteArray reply = render(request);
+			emit server->replyReady(request.connectionId, reply, request.arrival.nsecsElapsed() / 1000);
+		}
+	}
+
+private:
+	RenderServer *server;
+	QSharedPointer<ServerCanvas> canvas;
+
+	/**
+	* Runs the commands of a request and encodes the reply
+	* @param RenderRequest request - The request
+	* @return QByteArray - The reply
+	*/
+	QByteArray render(const RenderRequest &request)
+	{
+		DrawingEngine &engine = canvas->engine;
+		const QDir directory = QDir::current();
+		foreach(const QString &command, request.commands) {
+			QString error;
+			if (!BatchRenderer::runCommand(&engine, command, directory, &error, true)){
+				return QString("%1 error %2\n").arg(request.id).arg(error).toUtf8();
+			}
+		}
+		const TiledCanvas &image = engine.canvas();
+		canvas->sharedDirty = canvas->sharedDirty.united(engine.takeDirtyRect());
+		if (request.replyFormat == "shm" || request.replyFormat == "fd"){
+			return share(request);
+		}
+
+		QByteArray data;
+		if (request.replyFormat == "png"){
+			QBuffer buffer(&data);
+			buffer.open(QIODevice::WriteOnly);
+			PngWriter writer;
+			writer.setPreset(engine.getPngPreset());
+			writer.write(image.size(), [&image](const QRect &rows) { return image.copy(rows); }, &buffer);
+		}
+		else if (request.replyFormat == "raw"){
+			const QImage pixels = image.toImage();
+			data = QByteArray(reinterpret_cast<const char *>(pixels.constBits()), pixels.byteCount());
+		}
+		return QString("%1 ok %2 %3 %4\n").arg(request.id).arg(image.size().width())
+			.arg(image.size().height()).arg(request.arrival.nsecsElapsed() / 1000).toUtf8() + data;
+	}
+
+	/**
+	* Copies what changed into the shared buffer of the canvas, the buffer is
+	* mapped again when the target or the canvas size changes
+	* @param RenderRequest request - The request
+	* @return QByteArray - The reply with the buffer name and the changed area
+	*/
+	QByteArray share(const RenderRequest &request)
+	{
+		const TiledCanvas &image = canvas->engine.canvas();
+		SharedImageBuffer &shared = canvas->shared;
+		const QString target = request.replyFormat + ' ' + request.target;
+		if (!shared.isAttached() || shared.size() != image.size() || canvas->sharedTarget != target){
+			canvas->sharedTarget.clear();
+			bool attached;
+			if (request.replyFormat == "fd"){
+				attached = shared.attachFile(request.target, image.size(), request.peerPid);
+			}
+			else if (!request.target.isEmpty()){
+				const QRegExp clientName(QString("/drawit-client-%1-[A-Za-z0-9_.-]+").arg(request.peerPid));
+				if (request.peerPid <= 0 || !clientName.exactMatch(request.target)){
+					return QString("%1 error %2 is not a segment name of the client\n").arg(request.id)
+						.arg(request.target).toUtf8();
+				}
+				attached = shared.create(request.target, image.size());
+			}
+			else{
+				attached = shared.create(QString("/drawit-%1-%2").arg(QCoreApplication::applicationPid())
+					.arg(canvas->serial), image.size());
+			}
+			if (!attached){
+				return QString("%1 error %2\n").arg(request.id).arg(shared.errorString()).toUtf8();
+			}
+			canvas->sharedTarget = target;
+			canvas->sharedDirty = image.rect();
+		}
+		const QRect dirty = canvas->sharedDirty.intersected(image.rect());
+		QImage pixels = shared.image();
+		image.copyInto(&pixels, dirty, QPoint(0, 0));
+		canvas->sharedDirty = QRect();
+		return QString("%1 ok %2 %3 %4 %5 %6 %7,%8,%9,%10\n").arg(request.id)
+			.arg(image.size().width()).arg(image.size().height())
+			.arg(request.arrival.nsecsElapsed() / 1000).arg(shared.name()).arg(shared.bytesPerLine())
+			.arg(dirty.x()).arg(dirty.y()).arg(dirty.width()).arg(dirty.height()).toUtf8();
+	}
+};
+
+RenderServer::RenderServer(QObject *parent)
+	: QObject(parent)
+{
+	nextConnectionId = 0;
+	nextCanvasSerial = 0;
+	requestCount = 0;
+	totalLatency = 0;
+	maximumLatency = 0;
+	replyBytes = 0;
+	pool.setMaxThreadCount(QThread::idealThreadCount());
+
+	connect(&server, SIGNAL(newConnection()), this, SLOT(acceptConnections()));
+	connect(this, SIGNAL(replyReady(int, QByteArray, qint64)),
+		this, SLOT(writeReply(int, QByteArray, qint64)), Qt::QueuedConnection);
+	connect(&statisticsTimer, SIGNAL(timeout()), this, SLOT(reportStatistics()));
+}
+
+RenderServer::~RenderServer()
+{
+	server.close();
+	pool.waitForDone();
+}
+
+/**
+* Sets how many requests are rendered at the same time
+* @param int newThreadCount - The number of worker threads
+*/
+void RenderServer::setThreadCount(int newThreadCount)
+{
+	pool.setMaxThreadCount(qMax(1, newThreadCount));
+}
+
+/**
+* Returns how many requests are rendered at the same time
+* @return int - The number of worker threads
+*/
+int RenderServer::getThreadCount()
+{
+	return pool.maxThreadCount();
+}
+
+/**
+* Starts listening on a local socket. A socket left behind by a server that
+* crashed is removed first, a name a running server listens on is refused
+* @param QString name - The socket name or path
+* @return bool - if the server is listening
+*/
+bool RenderServer::listen(const QString &name)
+{
+	QLocalSocket probe;
+	probe.connectToServer(name);
+	if (probe.waitForConnected(probeTimeout)){
+		probe.abort();
+		listenError = QString("%1 is in use by another server").arg(name);
+		return false;
+	}
+	listenError.clear();
+	QLocalServer::removeServer(name);
+	if (!server.listen(name)){
+		return false;
+	}
+	statisticsClock.start();
+	statisticsTimer.start(statisticsInterval);
+	return true;
+}
+
+/**
+* Returns the full name of the socket the server listens on
+* @return QString - The socket name
+*/
+QString RenderServer::serverName() const
+{
+	return server.fullServerName();
+}
+
+/**
+* Returns why the server couldn't listen
+* @return QString - The error
+*/
+QString RenderServer::errorString() const
+{
+	return listenError.isEmpty() ? server.errorString() : listenError;
+}
+
+/**
+* Runs the server mode from the command line arguments
+* @param QStringList arguments - The application arguments
+* @return int - The exit code
+*/
+int RenderServer::exec(const QStringList &arguments)
+{
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Serves drawing requests on a local socket.");
+	parser.addHelpOption();
+	QCommandLineOption serverOption("server", "Name or path of the socket to listen on.", "name");
+	QCommandLineOption jobsOption(QStringList() << "j" << "jobs",
+		"Number of requests rendered at the same time.", "count",
+		QString::number(QThread::idealThreadCount()));
+	parser.addOption(serverOption);
+	parser.addOption(jobsOption);
+	parser.process(arguments);
+
+	RenderServer server;
+	server.setThreadCount(parser.value(jobsOption).toInt());
+	if (!server.listen(parser.value(serverOption))){
+		QTextStream(stderr) << "could not listen: " << server.errorString() << '\n';
+		return 1;
+	}
+	QTextStream(stdout) << "listening on " << server.serverName() << " with "
+		<< server.getThreadCount() << " threads\n";
+	return QCoreApplication::exec();
+}
+
+/**
+* Takes the waiting connections
+*/
+void RenderServer::acceptConnections()
+{
+	while (QLocalSocket *socket = server.nextPendingConnection()){
+		const int connectionId = nextConnectionId++;
+		socket->setProperty("connectionId", connectionId);
+		socket->setProperty("peerPid", peerPid(socket));
+		connections.insert(connectionId, socket);
+		connect(socket, SIGNAL(readyRead()), this, SLOT(readRequests()));
+		connect(socket, SIGNAL(disconnected()), this, SLOT(removeConnection()));
+	}
+}
+
+/**
+* Asks the system which process is on the other end of a connection
+* @param QLocalSocket* socket - The connection
+* @return qint64 - The process id, 0 where the system can't tell
+*/
+qint64 RenderServer::peerPid(QLocalSocket *socket)
+{
+#ifdef Q_OS_LINUX
+	struct ucred credentials;
+	socklen_t length = sizeof(credentials);
+	if (getsockopt(int(socket->socketDescriptor()), SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0){
+		return credentials.pid;
+	}
+#else
+	Q_UNUSED(socket);
+#endif
+	return 0;
+}
+
+/**
+* Starts every complete request that has arrived on a connection
+*/
+void RenderServer::readRequests()
+{
+	QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+	const int connectionId = socket->property("connectionId").toInt();
+	while (socket->bytesAvailable() >= 4){
+		uchar length[4];
+		socket->peek(reinterpret_cast<char *>(length), 4);
+		const quint32 requestSize = qFromBigEndian<quint32>(length);
+		if (requestSize > quint32(maximumRequestSize)){
+			socket->abort();
+			return;
+		}
+		if (socket->bytesAvailable() < 4 + qint64(requestSize)){
+			return;
+		}
+		socket->read(4);
+		startRequest(connectionId, socket->read(requestSize));
+	}
+}
+
+/**
+* Forgets a connection that was closed. Replies still being rendered for it are dropped
+*/
+void RenderServer::removeConnection()
+{
+	QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+	connections.remove(socket->property("connectionId").toInt());
+	socket->deleteLater();
+}
+
+/**
+* Sends a reply and counts it in the statistics
+* @param int connectionId - The connection the request came from
+* @param QByteArray reply - The reply
+* @param qint64 latency - Microseconds from the request arriving to the reply being ready
+*/
+void RenderServer::writeReply(int connectionId, const QByteArray &reply, qint64 latency)
+{
+	++requestCount;
+	totalLatency += latency;
+	maximumLatency = qMax(maximumLatency, latency);
+	QLocalSocket *socket = connections.value(connectionId);
+	if (!socket){
+		return;
+	}
+	uchar length[4];
+	qToBigEndian<quint32>(reply.size(), length);
+	socket->write(reinterpret_cast<const char *>(length), 4);
+	socket->write(reply);
+	replyBytes += 4 + reply.size();
+}
+
+/**
+* Prints the throughput and latency since the last statistics line
+*/
+void RenderServer::reportStatistics()
+{
+	const qint64 elapsed = statisticsClock.restart();
+	if (requestCount > 0 && elapsed > 0){
+		QTextStream(stdout) << QString("%1 requests, %2 requests/s, latency average %3 ms max %4 ms, %5 MB/s out\n")
+			.arg(requestCount)
+			.arg(requestCount * 1000.0 / elapsed, 0, 'f', 1)
+			.arg(totalLatency / 1000.0 / requestCount, 0, 'f', 2)
+			.arg(maximumLatency / 1000.0, 0, 'f', 2)
+			.arg(replyBytes / 1024.0 / 1024.0 * 1000.0 / elapsed, 0, 'f', 1);
+	}
+	requestCount = 0;
+	totalLatency = 0;
+	maximumLatency = 0;
+	replyBytes = 0;
+}
+
+/**
+* Parses a request and queues it on the worker threads
+* @param int connectionId - The connection the request came from
+* @param QByteArray request - The request without its length
+*/
+void RenderServer::startRequest(int connectionId, const QByteArray &request)
+{
+	QElapsedTimer arrival;
+	arrival.start();
+	QStringList lines = QString::fromUtf8(request).split('\n');
+	const QStringList header = lines.takeFirst().split(' ', QString::SkipEmptyParts);
+	const QString id = header.value(0, "-");
+	const QString replyFormat = header.value(2).toLower();
+	const QString target = header.value(3);
+	const bool valid = (header.size() == 3 && (replyFormat == "png" || replyFormat == "raw" ||
+		replyFormat == "none" || replyFormat == "shm")) ||
+		(header.size() == 4 && (replyFormat == "shm" || replyFormat == "fd"));
+	if (!valid){
+		writeReply(connectionId, QString("%1 error invalid request header\n").arg(id).toUtf8(), 0);
+		return;
+	}
+	QSharedPointer<ServerCanvas> canvas = canvases.value(header[1]);
+	if (!canvas){
+		if (canvases.size() >= maximumCanvases && !evictCanvas()){
+			writeReply(connectionId, QString("%1 error too many canvases in use\n").arg(id).toUtf8(), 0);
+			return;
+		}
+		canvas = QSharedPointer<ServerCanvas>(new ServerCanvas(nextCanvasSerial++));
+		canvases.insert(header[1], canvas);
+	}
+	canvasOrder.removeOne(header[1]);
+	canvasOrder.append(header[1]);
+	RenderRequest renderRequest;
+	renderRequest.connectionId = connectionId;
+	renderRequest.peerPid = connections.contains(connectionId) ?
+		connections.value(connectionId)->property("peerPid").toLongLong() : 0;
+	renderRequest.id = id;
+	renderRequest.replyFormat = replyFormat;
+	renderRequest.target = target;
+	renderRequest.commands = lines;
+	renderRequest.arrival = arrival;
+
+	QMutexLocker locker(&canvas->queueMutex);
+	canvas->pending.enqueue(renderRequest);
+	if (!canvas->running){
+		canvas->running = true;
+		pool.start(new CanvasJob(this, canvas));
+	}
+}
+
+/**
+* Drops the canvas used least recently that has no requests running or waiting
+* @return bool - false if every canvas is busy
+*/
+bool RenderServer::evictCanvas()
+{
+	foreach(const QString &name, canvasOrder) {
+		const QSharedPointer<ServerCanvas> canvas = canvases.value(name);
+		QMutexLocker locker(&canvas->queueMutex);
+		if (!canvas->running){
+			locker.unlock();
+			canvases.remove(name);
+			canvasOrder.removeOne(name);
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,124 @@
+#ifndef RENDERSERVER_H
+#define RENDERSERVER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+
+class ServerCanvas;
+
+/**
+* Serves drawing requests on a local socket (a UNIX socket, a named pipe on
+* Windows). Canvases are addressed by name and stay alive between requests,
+* requests on different canvases are rendered at the same time on a pool of
+* worker threads.
+*
+* Every message in both directions is a 32 bit big endian length followed by
+* that many bytes. A request is text, the first line is
+*
+*   <id> <canvas> png|raw|none
+*
+* and the following lines are commands as in BatchRenderer, run confined to
+* the working directory of the server on the named canvas. A canvas is
+* created with the default size on first use. At most maximumCanvases are
+* kept, the one used least recently without requests running or waiting is
+* dropped to make room for a new one, and a request for a new canvas fails
+* while all of them are busy. The reply starts with a text line
+*
+*   <id> ok <width> <height> <microseconds>
+*
+* followed by the canvas as a PNG file or as raw Format_RGB32 pixels row by
+* row, or nothing for none. A failed request gets the line
+*
+*   <id> error <message>
+*
+* On UNIX systems the pixels can be handed over in shared memory instead,
+* with the reply formats
+*
+*   shm                a segment the server creates and keeps for the canvas
+*   shm <name>         the same under a name the client chooses
+*   fd <path>          a descriptor of the client as /proc/<pid>/fd/<n>, like a memfd
+*
+* The server never maps a segment a client made, a client that shrank it
+* would crash the server on the next write. A shm name has to start with
+* /drawit-client-<pid>- for the process on the other end of the socket. An
+* fd path has to name a regular file of that process, sealed against
+* shrinking with F_SEAL_SHRINK. The server checks the process id, and named
+* shm and fd replies are refused where the system can't tell it (everywhere
+* but Linux).
+*
+* An fd buffer has to hold width * height * 4 bytes. The canvas is kept
+* mapped in the buffer, every reply only copies the area that changed since
+* the last one and ends with
+*
+*   <id> ok <width> <height> <microseconds> <buffer> <bytes per line> <x>,<y>,<width>,<height>
+*
+* naming the buffer and the area that changed. The buffer is written while a
+* request runs, a client shouldn't read it until the reply has arrived.
+*
+* The microseconds are the time from the request arriving to the reply being ready.
+*/
+class RenderServer : public QObject
+{
+	Q_OBJECT
+
+public:
+	RenderServer(QObject *parent = 0);
+	~RenderServer();
+	void setThreadCount(int newThreadCount);
+	int getThreadCount();
+	bool listen(const QString &name);
+	QString serverName() const;
+	QString errorString() const;
+	static int exec(const QStringList &arguments);
+
+	//Requests larger than this close the connection
+	static const int maximumRequestSize = 16 * 1024 * 1024;
+	//Milliseconds between the statistics lines
+	static const int statisticsInterval = 5000;
+	//Canvases kept alive at the same time
+	static const int maximumCanvases = 64;
+	//Milliseconds listen() waits for a running server on the socket name
+	static const int probeTimeout = 1000;
+
+signals:
+	void replyReady(int connectionId, const QByteArray &reply, qint64 latency);
+
+private slots:
+	void acceptConnections();
+	void readRequests();
+	void removeConnection();
+	void writeReply(int connectionId, const QByteArray &reply, qint64 latency);
+	void reportStatistics();
+
+private:
+	QLocalServer server;
+	QThreadPool pool;
+	QHash<QString, QSharedPointer<ServerCanvas> > canvases;
+	//Canvas names, least recently used first
+	QStringList canvasOrder;
+	int nextCanvasSerial;
+	QString listenError;
+	QHash<int, QLocalSocket *> connections;
+	int nextConnectionId;
+	QTimer statisticsTimer;
+	QElapsedTimer statisticsClock;
+	int requestCount;
+	qint64 totalLatency;
+	qint64 maximumLatency;
+	qint64 replyBytes;
+
+	void startRequest(int connectionId, const QByteArray &request);
+	bool evictCanvas();
+	static qint64 peerPid(QLocalSocket *socket);
+};
+
+#endif // RENDERSERVER_H
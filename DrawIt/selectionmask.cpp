@@ -0,0 +1,528 @@
+#include "selectionmask.h"
+#include "bufferpool.h"
+
+#include <QCache>
+#include <QGlobalStatic>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <cmath>
+
+/**
+* The tinted image of a partly selected tile. words share the data of the bits
+* it was made from, changing the bits of the tile detaches them from it
+*/
+struct Tint
+{
+	QVector<quint32> words;
+	QRgb color;
+	QImage image;
+};
+
+/**
+* The tinted tiles of every selection, costs are in kilobytes
+*/
+struct TintStore
+{
+	TintStore()
+	{
+		cache.setMaxCost(SelectionMask::tintCacheSize / 1024);
+	}
+
+	QMutex mutex;
+	QCache<qint64, Tint> cache;
+};
+
+Q_GLOBAL_STATIC(TintStore, tintStore)
+
+SelectionMask::SelectionMask()
+{
+
+}
+
+SelectionMask::~SelectionMask()
+{
+
+}
+
+/**
+* Checks if no pixel is selected
+* @return bool - true if nothing is selected
+*/
+bool SelectionMask::isEmpty() const
+{
+	return tiles.isEmpty();
+}
+
+/**
+* Returns the smallest rectangle around the selected pixels. Full tiles are
+* taken whole, the others are narrowed down a word at a time
+* @return QRect - The bounds, empty if nothing is selected
+*/
+QRect SelectionMask::bounds() const
+{
+	const int tileSize = TiledCanvas::tileSize;
+	QRect result;
+	for (QHash<qint64, QVector<quint32> >::const_iterator bits = tiles.constBegin(); bits != tiles.constEnd(); ++bits){
+		const QPoint origin(int(quint32(bits.key())) * tileSize, int(bits.key() >> 32) * tileSize);
+		if (bits->isEmpty()){
+			result = result.united(QRect(origin, QSize(tileSize, tileSize)));
+		}
+		else{
+			result = result.united(wordBounds(bits->constData()).translated(origin));
+		}
+	}
+	return result;
+}
+
+/**
+* Checks if a pixel is selected
+* @param QPoint point - The pixel
+* @return bool - true if it is selected
+*/
+bool SelectionMask::contains(const QPoint &point) const
+{
+	const int column = TiledCanvas::tileOf(point.x());
+	const int row = TiledCanvas::tileOf(point.y());
+	QHash<qint64, QVector<quint32> >::const_iterator found = tiles.constFind(TiledCanvas::key(column, row));
+	if (found == tiles.constEnd()){
+		return false;
+	}
+	if (found->isEmpty()){
+		return true;
+	}
+	const int x = point.x() - column * TiledCanvas::tileSize;
+	const int y = point.y() - row * TiledCanvas::tileSize;
+	return ((*found)[y * rowWords + (x >> 5)] & (1u << (x & 31))) != 0;
+}
+
+/**
+* Selects nothing
+*/
+void SelectionMask::clear()
+{
+	tiles.clear();
+}
+
+/**
+* Combines another selection into this one. Tiles only one of them has are
+* taken or dropped whole, the others are combined a word at a time
+* @param SelectionMask other - The selection to combine with
+* @param int operation - One of the combine constants
+*/
+void SelectionMask::combine(const SelectionMask &other, int operation)
+{
+	switch (operation){
+		case combineReplace:
+			tiles = other.tiles;
+			break;
+		case combineAdd:
+			for (QHash<qint64, QVector<quint32> >::const_iterator bits = other.tiles.constBegin(); bits != other.tiles.constEnd(); ++bits){
+				QHash<qint64, QVector<quint32> >::iterator found = tiles.find(bits.key());
+				if (found == tiles.end() || bits->isEmpty()){
+					tiles.insert(bits.key(), *bits);
+				}
+				else if (!found->isEmpty()){
+					quint32 *words = found->data();
+					const quint32 *added = bits->constData();
+					for (int i = 0; i < tileWords; ++i){
+						words[i] |= added[i];
+					}
+					normalize(bits.key());
+				}
+			}
+			break;
+		case combineSubtract:
+			for (QHash<qint64, QVector<quint32> >::const_iterator bits = other.tiles.constBegin(); bits != other.tiles.constEnd(); ++bits){
+				QHash<qint64, QVector<quint32> >::iterator found = tiles.find(bits.key());
+				if (found == tiles.end()){
+					continue;
+				}
+				if (bits->isEmpty()){
+					tiles.remove(bits.key());
+					continue;
+				}
+				if (found->isEmpty()){
+					found->fill(~0u, tileWords);
+				}
+				quint32 *words = found->data();
+				const quint32 *removed = bits->constData();
+				for (int i = 0; i < tileWords; ++i){
+					words[i] &= ~removed[i];
+				}
+				normalize(bits.key());
+			}
+			break;
+		case combineIntersect: {
+			const QList<qint64> keys = tiles.keys();
+			foreach(qint64 index, keys) {
+				QHash<qint64, QVector<quint32> >::const_iterator bits = other.tiles.constFind(index);
+				if (bits == other.tiles.constEnd()){
+					tiles.remove(index);
+					continue;
+				}
+				if (bits->isEmpty()){
+					continue;
+				}
+				QVector<quint32> &words = tiles[index];
+				if (words.isEmpty()){
+					words = *bits;
+					continue;
+				}
+				quint32 *kept = words.data();
+				const quint32 *mask = bits->constData();
+				for (int i = 0; i < tileWords; ++i){
+					kept[i] &= mask[i];
+				}
+				normalize(index);
+			}
+			break;
+		}
+	}
+}
+
+/**
+* Selects the pixels of an area that weren't selected, and nothing outside of it
+* @param QRect area - The area to invert in, usually the canvas
+*/
+void SelectionMask::invert(const QRect &area)
+{
+	SelectionMask inverted = fromRect(area);
+	inverted.combine(*this, combineSubtract);
+	tiles = inverted.tiles;
+}
+
+/**
+* Sets the bits of a tile
+* @param int column - The tile column
+* @param int row - The tile row
+* @param QVector words - The bits, tileWords of them
+*/
+void SelectionMask::setTile(int column, int row, const QVector<quint32> &words)
+{
+	const qint64 index = TiledCanvas::key(column, row);
+	tiles.insert(index, words);
+	normalize(index);
+}
+
+/**
+* Returns the tiles with selected pixels
+* @return QList<qint64> - The keys, see TiledCanvas::key()
+*/
+QList<qint64> SelectionMask::tileKeys() const
+{
+	return tiles.keys();
+}
+
+/**
+* Checks if every pixel of a tile is selected
+* @param int column - The tile column
+* @param int row - The tile row
+* @return bool - true if the whole tile is selected
+*/
+bool SelectionMask::isFull(int column, int row) const
+{
+	QHash<qint64, QVector<quint32> >::const_iterator found = tiles.constFind(TiledCanvas::key(column, row));
+	return found != tiles.constEnd() && found->isEmpty();
+}
+
+/**
+* Makes an image of the selected pixels of a tile
+* @param int column - The tile column
+* @param int row - The tile row
+* @param QColor color - The color of the selected pixels
+* @return QImage - The tile in Format_ARGB32_Premultiplied, the color where
+* it is selected and transparent elsewhere
+*/
+QImage SelectionMask::tileImage(int column, int row, const QColor &color) const
+{
+	const int tileSize = TiledCanvas::tileSize;
+	QImage image = BufferPool::global()->image(QSize(tileSize, tileSize), QImage::Format_ARGB32_Premultiplied);
+	const QRgb selected = qPremultiply(color.rgba());
+	QHash<qint64, QVector<quint32> >::const_iterator found = tiles.constFind(TiledCanvas::key(column, row));
+	if (found == tiles.constEnd()){
+		image.fill(0);
+		return image;
+	}
+	if (found->isEmpty()){
+		image.fill(selected);
+		return image;
+	}
+	image.fill(0);
+	for (int y = 0; y < tileSize; ++y){
+		QRgb *pixels = reinterpret_cast<QRgb *>(image.scanLine(y));
+		const quint32 *words = found->constData() + y * rowWords;
+		for (int i = 0; i < rowWords; ++i){
+			const quint32 word = words[i];
+			if (word == 0){
+				continue;
+			}
+			QRgb *part = pixels + i * 32;
+			if (word == ~0u){
+				std::fill(part, part + 32, selected);
+				continue;
+			}
+			for (int bit = 0; bit < 32; ++bit){
+				if (word & (1u << bit)){
+					part[bit] = selected;
+				}
+			}
+		}
+	}
+	return image;
+}
+
+/**
+* Draws the selected pixels of part of the canvas in a color. The image of a
+* partly selected tile is made once and drawn from the cache until its bits
+* change. Below minimumTintZoom nothing is drawn
+* @param QPainter* painter - The painter, in canvas coordinates
+* @param QRect area - The part of the canvas to draw
+* @param QColor color - The color, usually translucent
+* @param double zoom - The zoom the painter draws at
+*/
+void SelectionMask::draw(QPainter *painter, const QRect &area, const QColor &color, double zoom) const
+{
+	if (zoom * 100 < minimumTintZoom){
+		return;
+	}
+	const int tileSize = TiledCanvas::tileSize;
+	TintStore *store = tintStore();
+	for (QHash<qint64, QVector<quint32> >::const_iterator bits = tiles.constBegin(); bits != tiles.constEnd(); ++bits){
+		const int column = int(quint32(bits.key()));
+		const int row = int(bits.key() >> 32);
+		const QRect tileRect(column * tileSize, row * tileSize, tileSize, tileSize);
+		if (!tileRect.intersects(area)){
+			continue;
+		}
+		if (bits->isEmpty()){
+			painter->fillRect(tileRect.intersected(area), color);
+			continue;
+		}
+		QImage image;
+		{
+			QMutexLocker locker(&store->mutex);
+			const Tint *tint = store->cache.object(bits.key());
+			if (tint && tint->words.constData() == bits->constData() && tint->color == color.rgba()){
+				image = tint->image;
+			}
+		}
+		if (image.isNull()){
+			Tint *tint = new Tint;
+			tint->words = *bits;
+			tint->color = color.rgba();
+			tint->image = tileImage(column, row, color);
+			image = tint->image;
+			QMutexLocker locker(&store->mutex);
+			store->cache.insert(bits.key(), tint, (image.byteCount() + tileWords * int(sizeof(quint32))) / 1024);
+		}
+		painter->drawImage(tileRect.topLeft(), image);
+	}
+}
+
+/**
+* Returns the bytes the bits of the tiles take
+* @return qint64 - The bytes
+*/
+qint64 SelectionMask::memoryUsage() const
+{
+	qint64 bytes = 0;
+	foreach(const QVector<quint32> &words, tiles) {
+		bytes += words.size() * sizeof(quint32);
+	}
+	return bytes;
+}
+
+/**
+* Returns the memory of the tinted tiles draw() keeps, of all selections
+* @return qint64 - The bytes
+*/
+qint64 SelectionMask::tintBytes()
+{
+	QMutexLocker locker(&tintStore()->mutex);
+	return qint64(tintStore()->cache.totalCost()) * 1024;
+}
+
+/**
+* Makes a selection of a rectangle, the tiles it covers whole are full
+* @param QRect rect - The rectangle
+* @return SelectionMask - The selection
+*/
+SelectionMask SelectionMask::fromRect(const QRect &rect)
+{
+	const int tileSize = TiledCanvas::tileSize;
+	SelectionMask mask;
+	if (rect.isEmpty()){
+		return mask;
+	}
+	for (int row = TiledCanvas::tileOf(rect.top()); row <= TiledCanvas::tileOf(rect.bottom()); ++row){
+		for (int column = TiledCanvas::tileOf(rect.left()); column <= TiledCanvas::tileOf(rect.right()); ++column){
+			const QRect tileRect(column * tileSize, row * tileSize, tileSize, tileSize);
+			const QRect part = rect.intersected(tileRect);
+			QVector<quint32> words;
+			if (part != tileRect){
+				words.fill(0, tileWords);
+				for (int y = part.top(); y <= part.bottom(); ++y){
+					setBits(words.data() + (y - tileRect.top()) * rowWords, part.left() - tileRect.left(),
+						part.right() - tileRect.left());
+				}
+			}
+			mask.tiles.insert(TiledCanvas::key(column, row), words);
+		}
+	}
+	return mask;
+}
+
+/**
+* Makes a selection of the ellipse that fits in a rectangle, one span per row
+* @param QRect rect - The rectangle around the ellipse
+* @return SelectionMask - The selection
+*/
+SelectionMask SelectionMask::fromEllipse(const QRect &rect)
+{
+	SelectionMask mask;
+	if (rect.isEmpty()){
+		return mask;
+	}
+	const double radiusX = rect.width() / 2.0;
+	const double radiusY = rect.height() / 2.0;
+	const double centerX = rect.left() + radiusX;
+	const double centerY = rect.top() + radiusY;
+	for (int y = rect.top(); y <= rect.bottom(); ++y){
+		const double dy = (y + 0.5 - centerY) / radiusY;
+		const double half = radiusX * sqrt(qMax(0.0, 1.0 - dy * dy));
+		const int from = int(std::ceil(centerX - half - 0.5));
+		const int to = int(std::floor(centerX + half - 0.5));
+		if (from <= to){
+			mask.addSpan(from, to, y);
+		}
+	}
+	foreach(qint64 index, mask.tiles.keys()) {
+		mask.normalize(index);
+	}
+	return mask;
+}
+
+/**
+* Sets a run of bits of one bitmap row, a word at a time
+* @param quint32* words - The row
+* @param int first - The first bit
+* @param int last - The last bit
+*/
+void SelectionMask::setBits(quint32 *words, int first, int last)
+{
+	const quint32 head = ~0u << (first & 31);
+	const quint32 tail = ~0u >> (31 - (last & 31));
+	if (first >> 5 == last >> 5){
+		words[first >> 5] |= head & tail;
+		return;
+	}
+	words[first >> 5] |= head;
+	for (int i = (first >> 5) + 1; i < last >> 5; ++i){
+		words[i] = ~0u;
+	}
+	words[last >> 5] |= tail;
+}
+
+/**
+* Selects a span of one row, making the tiles it crosses when needed
+* @param int from - The first x coordinate
+* @param int to - The last x coordinate
+* @param int y - The y coordinate
+*/
+void SelectionMask::addSpan(int from, int to, int y)
+{
+	const int tileSize = TiledCanvas::tileSize;
+	const int row = TiledCanvas::tileOf(y);
+	for (int start = from; start <= to;){
+		const int column = TiledCanvas::tileOf(start);
+		const int end = qMin(to, column * tileSize + tileSize - 1);
+		const qint64 index = TiledCanvas::key(column, row);
+		QHash<qint64, QVector<quint32> >::iterator found = tiles.find(index);
+		if (found == tiles.end()){
+			found = tiles.insert(index, QVector<quint32>(tileWords, 0));
+		}
+		if (!found->isEmpty()){
+			setBits(found->data() + (y - row * tileSize) * rowWords, start - column * tileSize, end - column * tileSize);
+		}
+		start = end + 1;
+	}
+}
+
+/**
+* Drops a tile without selected pixels and drops the bits of a full one
+* @param qint64 index - The key of the tile
+*/
+void SelectionMask::normalize(qint64 index)
+{
+	QHash<qint64, QVector<quint32> >::iterator found = tiles.find(index);
+	if (found == tiles.end() || found->isEmpty()){
+		return;
+	}
+	const quint32 *words = found->constData();
+	quint32 any = 0;
+	quint32 all = ~0u;
+	for (int i = 0; i < tileWords; ++i){
+		any |= words[i];
+		all &= words[i];
+	}
+	if (any == 0){
+		tiles.erase(found);
+	}
+	else if (all == ~0u){
+		found->clear();
+	}
+}
+
+/**
+* Finds the selected pixels of a tile by OR'ing its rows together
+* @param quint32* words - The bits of the tile
+* @return QRect - The bounds in tile coordinates, empty if none is selected
+*/
+QRect SelectionMask::wordBounds(const quint32 *words)
+{
+	quint32 columns[rowWords];
+	std::fill(columns, columns + rowWords, 0u);
+	int top = -1;
+	int bottom = -1;
+	for (int y = 0; y < TiledCanvas::tileSize; ++y){
+		const quint32 *row = words + y * rowWords;
+		quint32 any = 0;
+		for (int i = 0; i < rowWords; ++i){
+			columns[i] |= row[i];
+			any |= row[i];
+		}
+		if (any != 0){
+			if (top < 0){
+				top = y;
+			}
+			bottom = y;
+		}
+	}
+	if (top < 0){
+		return QRect();
+	}
+	int left = 0;
+	int right = 0;
+	for (int i = 0; i < rowWords; ++i){
+		if (columns[i] != 0){
+			int bit = 0;
+			while ((columns[i] & (1u << bit)) == 0){
+				++bit;
+			}
+			left = i * 32 + bit;
+			break;
+		}
+	}
+	for (int i = rowWords - 1; i >= 0; --i){
+		if (columns[i] != 0){
+			int bit = 31;
+			while ((columns[i] & (1u << bit)) == 0){
+				--bit;
+			}
+			right = i * 32 + bit;
+			break;
+		}
+	}
+	return QRect(QPoint(left, top), QPoint(right, bottom));
+}
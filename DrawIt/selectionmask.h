@@ -0,0 +1,68 @@
+#ifndef SELECTIONMASK_H
+#define SELECTIONMASK_H
+
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QPainter>
+#include <QPoint>
+#include <QRect>
+#include <QVector>
+#include "tiledcanvas.h"
+
+/**
+* The selected pixels of a canvas, one bit per pixel in square tiles that line
+* up with the tiles of TiledCanvas. Only tiles with selected pixels are kept,
+* a tile with all of them selected is kept without its bits. Combining,
+* inverting and finding the bounds work a 32 bit word at a time and skip the
+* tiles that are empty or full, so a selection of a big canvas takes memory
+* and time in proportion to its edges rather than its area. The tinted images
+* draw() makes of the tiles that are partly selected are kept in a cache of
+* tintCacheSize bytes until the bits of the tile change.
+*/
+class SelectionMask
+{
+public:
+	SelectionMask();
+	~SelectionMask();
+	bool isEmpty() const;
+	QRect bounds() const;
+	bool contains(const QPoint &point) const;
+	void clear();
+	void combine(const SelectionMask &other, int operation);
+	void invert(const QRect &area);
+	void setTile(int column, int row, const QVector<quint32> &words);
+	QList<qint64> tileKeys() const;
+	bool isFull(int column, int row) const;
+	QImage tileImage(int column, int row, const QColor &color) const;
+	void draw(QPainter *painter, const QRect &area, const QColor &color, double zoom = 1.0) const;
+	qint64 memoryUsage() const;
+	static qint64 tintBytes();
+	static SelectionMask fromRect(const QRect &rect);
+	static SelectionMask fromEllipse(const QRect &rect);
+	static void setBits(quint32 *words, int first, int last);
+
+	static const int combineReplace = 0;
+	static const int combineAdd = 1;
+	static const int combineSubtract = 2;
+	static const int combineIntersect = 3;
+
+	//Words of a tile, one bit per pixel
+	static const int tileWords = TiledCanvas::tileSize * TiledCanvas::tileSize / 32;
+	//Words of one row of a tile
+	static const int rowWords = TiledCanvas::tileSize / 32;
+	//Memory of the tinted tiles of all selections together
+	static const int tintCacheSize = 32 * 1024 * 1024;
+	//Zoom in percent below which draw() leaves the tint out
+	static const int minimumTintZoom = 10;
+
+private:
+	//The bits of the tiles with selected pixels, empty for a full tile
+	QHash<qint64, QVector<quint32> > tiles;
+
+	void addSpan(int from, int to, int y);
+	void normalize(qint64 index);
+	static QRect wordBounds(const quint32 *words);
+};
+
+#endif // SELECTIONMASK_H
@@ -0,0 +1,247 @@
+#include "sharedimagebuffer.h"
+
+#include <QRegExp>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_LINUX
+//From linux/fcntl.h, which clashes with fcntl.h, for C libraries that don't have them yet
+#ifndef F_GET_SEALS
+#define F_GET_SEALS 1034
+#endif
+#ifndef F_SEAL_SHRINK
+#define F_SEAL_SHRINK 0x0002
+#endif
+#endif
+
+SharedImageBuffer::SharedImageBuffer()
+{
+	data = 0;
+	length = 0;
+	owner = false;
+}
+
+SharedImageBuffer::~SharedImageBuffer()
+{
+	detach();
+}
+
+/**
+* Creates a new shared memory segment for an image. The segment is removed
+* again when the buffer is detached
+* @param QString newName - The segment name, starting with a slash
+* @param QSize newSize - The image size
+* @return bool - if the segment was created
+*/
+bool SharedImageBuffer::create(const QString &newName, const QSize &newSize)
+{
+	detach();
+#ifdef Q_OS_UNIX
+	const QByteArray fileName = newName.toLocal8Bit();
+	shm_unlink(fileName.constData());
+	const int descriptor = shm_open(fileName.constData(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (descriptor < 0){
+		error = QString("could not create %1: %2").arg(newName).arg(strerror(errno));
+		return false;
+	}
+	const bool mapped = map(descriptor, newSize, true);
+	close(descriptor);
+	if (!mapped){
+		shm_unlink(fileName.constData());
+		return false;
+	}
+	segmentName = newName;
+	owner = true;
+	return true;
+#else
+	Q_UNUSED(newName);
+	Q_UNUSED(newSize);
+	error = "shared memory needs a UNIX system";
+	return false;
+#endif
+}
+
+/**
+* Maps a descriptor that another process holds, like a memfd, through its
+* /proc/<pid>/fd/<n> path. Only paths into the process on the other end of
+* the connection are accepted, so a client can't make the server write into
+* files of its own. The file has to be a regular file big enough for the image
+* and sealed with F_SEAL_SHRINK, a file the client could shrink while it is
+* mapped would crash the server with SIGBUS on the next write
+* @param QString path - The /proc path of the descriptor
+* @param QSize newSize - The image size
+* @param qint64 peerPid - The process the request came from, 0 if unknown
+* @return bool - if the file was mapped
+*/
+bool SharedImageBuffer::attachFile(const QString &path, const QSize &newSize, qint64 peerPid)
+{
+	detach();
+#ifdef Q_OS_UNIX
+	const QRegExp procPath("/proc/(\\d+)/fd/\\d+");
+	if (peerPid <= 0 || !procPath.exactMatch(path) || procPath.cap(1).toLongLong() != peerPid){
+		error = QString("%1 is not a descriptor of the client").arg(path);
+		return false;
+	}
+	const int descriptor = open(path.toLocal8Bit().constData(), O_RDWR | O_CLOEXEC);
+	if (descriptor < 0){
+		error = QString("could not open %1: %2").arg(path).arg(strerror(errno));
+		return false;
+	}
+	struct stat status;
+	if (fstat(descriptor, &status) != 0 || !S_ISREG(status.st_mode)){
+		close(descriptor);
+		error = QString("%1 is not a regular file").arg(path);
+		return false;
+	}
+#ifdef Q_OS_LINUX
+	const int seals = fcntl(descriptor, F_GET_SEALS);
+	if (seals < 0 || !(seals & F_SEAL_SHRINK)){
+		close(descriptor);
+		error = QString("%1 is not sealed against shrinking").arg(path);
+		return false;
+	}
+#endif
+	const bool mapped = map(descriptor, newSize, false);
+	close(descriptor);
+	if (mapped){
+		segmentName = path;
+	}
+	return mapped;
+#else
+	Q_UNUSED(path);
+	Q_UNUSED(newSize);
+	Q_UNUSED(peerPid);
+	error = "shared memory needs a UNIX system";
+	return false;
+#endif
+}
+
+/**
+* Unmaps the buffer, a segment the buffer created is removed
+*/
+void SharedImageBuffer::detach()
+{
+#ifdef Q_OS_UNIX
+	if (data){
+		munmap(data, length);
+	}
+	if (owner){
+		shm_unlink(segmentName.toLocal8Bit().constData());
+	}
+#endif
+	data = 0;
+	length = 0;
+	owner = false;
+	segmentName.clear();
+	imageSize = QSize();
+}
+
+/**
+* Checks if a buffer is mapped
+* @return bool - true if mapped
+*/
+bool SharedImageBuffer::isAttached() const
+{
+	return data != 0;
+}
+
+/**
+* Returns the segment name or file path of the buffer
+* @return QString - The name
+*/
+QString SharedImageBuffer::name() const
+{
+	return segmentName;
+}
+
+/**
+* Returns the size of the image in the buffer
+* @return QSize - The image size
+*/
+QSize SharedImageBuffer::size() const
+{
+	return imageSize;
+}
+
+/**
+* Returns the length of an image row in bytes
+* @return int - The row length
+*/
+int SharedImageBuffer::bytesPerLine() const
+{
+	return imageSize.width() * 4;
+}
+
+/**
+* Returns an image that paints straight into the shared memory. It is only
+* valid while the buffer stays attached
+* @return QImage - The image over the buffer
+*/
+QImage SharedImageBuffer::image()
+{
+	if (!data){
+		return QImage();
+	}
+	return QImage(data, imageSize.width(), imageSize.height(), bytesPerLine(), QImage::Format_RGB32);
+}
+
+/**
+* Returns why the last create or attach failed
+* @return QString - The error
+*/
+QString SharedImageBuffer::errorString() const
+{
+	return error;
+}
+
+/**
+* Maps an open descriptor for an image of the given size
+* @param int descriptor - The open segment or file
+* @param QSize newSize - The image size
+* @param bool grow - if the segment should be resized to fit, otherwise it has to be big enough
+* @return bool - if the buffer was mapped
+*/
+bool SharedImageBuffer::map(int descriptor, const QSize &newSize, bool grow)
+{
+#ifdef Q_OS_UNIX
+	const qint64 needed = qint64(newSize.width()) * newSize.height() * 4;
+	if (needed <= 0){
+		error = "the image is empty";
+		return false;
+	}
+	if (grow){
+		if (ftruncate(descriptor, needed) != 0){
+			error = QString("could not resize the segment: %1").arg(strerror(errno));
+			return false;
+		}
+	}
+	else{
+		struct stat status;
+		if (fstat(descriptor, &status) != 0 || status.st_size < needed){
+			error = QString("the buffer needs %1 bytes").arg(needed);
+			return false;
+		}
+	}
+	void *mapped = mmap(0, needed, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+	if (mapped == MAP_FAILED){
+		error = QString("could not map the buffer: %1").arg(strerror(errno));
+		return false;
+	}
+	data = static_cast<uchar *>(mapped);
+	length = needed;
+	imageSize = newSize;
+	return true;
+#else
+	Q_UNUSED(descriptor);
+	Q_UNUSED(newSize);
+	Q_UNUSED(grow);
+	return false;
+#endif
+}
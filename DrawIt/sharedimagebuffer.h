@@ -0,0 +1,41 @@
+#ifndef SHAREDIMAGEBUFFER_H
+#define SHAREDIMAGEBUFFER_H
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+/**
+* An Format_RGB32 image in memory that is shared with another process. The
+* buffer is either a POSIX shared memory segment this process creates or a
+* descriptor of the other process, like a memfd sealed against shrinking,
+* mapped through its /proc/<pid>/fd/<n> path. Rows are width * 4 bytes long
+* and follow each other without padding. Only available on UNIX systems.
+*/
+class SharedImageBuffer
+{
+public:
+	SharedImageBuffer();
+	~SharedImageBuffer();
+	bool create(const QString &newName, const QSize &newSize);
+	bool attachFile(const QString &path, const QSize &newSize, qint64 peerPid);
+	void detach();
+	bool isAttached() const;
+	QString name() const;
+	QSize size() const;
+	int bytesPerLine() const;
+	QImage image();
+	QString errorString() const;
+
+private:
+	QString segmentName;
+	QSize imageSize;
+	uchar *data;
+	qint64 length;
+	bool owner;
+	QString error;
+
+	bool map(int descriptor, const QSize &newSize, bool grow);
+};
+
+#endif // SHAREDIMAGEBUFFER_H
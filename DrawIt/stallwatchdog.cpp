@@ -0,0 +1,175 @@
+#include "stallwatchdog.h"
+#include "tracelog.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSettings>
+#include <QTextStream>
+
+StallWatchdog::StallWatchdog(QObject *parent)
+	: QThread(parent)
+{
+	threshold = defaultThreshold;
+	guiThread = QThread::currentThread();
+	clock.start();
+	lastBeat.storeRelease(0);
+	stopping.storeRelease(0);
+	connect(&beatTimer, SIGNAL(timeout()), this, SLOT(beat()));
+	beatTimer.start(beatInterval);
+}
+
+StallWatchdog::~StallWatchdog()
+{
+	stop();
+}
+
+/**
+* Sets how long the GUI thread may stay away from the event loop
+* @param int newThreshold - Milliseconds
+*/
+void StallWatchdog::setThreshold(int newThreshold)
+{
+	threshold = qMax(int(beatInterval), newThreshold);
+}
+
+/**
+* Returns how long the GUI thread may stay away from the event loop
+* @return int - Milliseconds
+*/
+int StallWatchdog::getThreshold()
+{
+	return threshold;
+}
+
+/**
+* Stops watching and waits for the watchdog thread to end
+*/
+void StallWatchdog::stop()
+{
+	stopping.storeRelease(1);
+	wait();
+}
+
+/**
+* Notes that the GUI thread is running its event loop
+*/
+void StallWatchdog::beat()
+{
+	lastBeat.storeRelease(clock.elapsed());
+}
+
+/**
+* Checks the beats until stopped. The open zones are taken again while a
+* stall lasts and the deepest ones are kept, the GUI thread may go on into
+* a slower part of the handler
+*/
+void StallWatchdog::run()
+{
+	TraceLog::setZoneTracking(guiThread);
+	{
+		//A stall that was still going on when the program ended last time
+		QSettings settings(QSettings::IniFormat, QSettings::UserScope, "DrawIt", "stalls");
+		const QString unfinished = settings.value("current").toString();
+		if (!unfinished.isEmpty()){
+			settings.setValue("unrecovered", settings.value("unrecovered", 0).toInt() + 1);
+			QStringList reports = settings.value("reports").toStringList();
+			reports.append(unfinished + " unrecovered");
+			while (reports.size() > keptReports){
+				reports.removeFirst();
+			}
+			settings.setValue("reports", reports);
+			settings.remove("current");
+		}
+	}
+
+	bool stalled = false;
+	qint64 stallStart = 0;
+	QStringList context;
+	while (!stopping.loadAcquire()){
+		msleep(beatInterval);
+		const qint64 beatTime = lastBeat.loadAcquire();
+		if (stalled && beatTime != stallStart){
+			stallEnded(beatTime - stallStart, context);
+			stalled = false;
+			continue;
+		}
+		const qint64 silence = clock.elapsed() - beatTime;
+		if (!stalled && silence > threshold){
+			stalled = true;
+			stallStart = beatTime;
+			context = TraceLog::openZones(guiThread);
+			const QString zones = context.isEmpty() ? QString("no trace zone") : context.join(" > ");
+			qWarning("GUI thread stalled for %lld ms in %s", silence, qPrintable(zones));
+			QSettings settings(QSettings::IniFormat, QSettings::UserScope, "DrawIt", "stalls");
+			settings.setValue("current", QDateTime::currentDateTime().toString(Qt::ISODate) + " " + zones);
+		}
+		else if (stalled){
+			const QStringList zones = TraceLog::openZones(guiThread);
+			if (zones.size() > context.size()){
+				context = zones;
+			}
+		}
+	}
+	TraceLog::setZoneTracking(0);
+}
+
+/**
+* Logs a stall that ended and adds it to the statistics
+* @param qint64 duration - Milliseconds from the last beat before the stall to the first one after
+* @param QStringList context - The trace zones open during the stall, outermost first
+*/
+void StallWatchdog::stallEnded(qint64 duration, const QStringList &context)
+{
+	const QString zones = context.isEmpty() ? QString("no trace zone") : context.join(" > ");
+	qWarning("GUI thread was stalled for %lld ms in %s", duration, qPrintable(zones));
+
+	QSettings settings(QSettings::IniFormat, QSettings::UserScope, "DrawIt", "stalls");
+	settings.remove("current");
+	settings.setValue("count", settings.value("count", 0).toInt() + 1);
+	settings.setValue("totalMs", settings.value("totalMs", 0).toLongLong() + duration);
+	settings.setValue("maximumMs", qMax(settings.value("maximumMs", 0).toLongLong(), duration));
+	if (duration > 1000){
+		settings.setValue("over1s", settings.value("over1s", 0).toInt() + 1);
+	}
+	if (duration > 5000){
+		settings.setValue("over5s", settings.value("over5s", 0).toInt() + 1);
+	}
+	QStringList reports = settings.value("reports").toStringList();
+	reports.append(QString("%1 %2 ms %3").arg(QDateTime::currentDateTime().toString(Qt::ISODate))
+		.arg(duration).arg(zones));
+	while (reports.size() > keptReports){
+		reports.removeFirst();
+	}
+	settings.setValue("reports", reports);
+}
+
+/**
+* Reads the stall statistics of this user
+* @return QJsonObject - Counts, durations and the latest reports
+*/
+QJsonObject StallWatchdog::statistics()
+{
+	QSettings settings(QSettings::IniFormat, QSettings::UserScope, "DrawIt", "stalls");
+	QJsonObject result;
+	result["file"] = settings.fileName();
+	result["count"] = settings.value("count", 0).toInt();
+	result["totalMs"] = settings.value("totalMs", 0).toDouble();
+	result["maximumMs"] = settings.value("maximumMs", 0).toDouble();
+	result["over1s"] = settings.value("over1s", 0).toInt();
+	result["over5s"] = settings.value("over5s", 0).toInt();
+	result["unrecovered"] = settings.value("unrecovered", 0).toInt();
+	result["reports"] = QJsonArray::fromStringList(settings.value("reports").toStringList());
+	return result;
+}
+
+/**
+* Prints the stall statistics as JSON
+* @return int - The exit code
+*/
+int StallWatchdog::printStatistics()
+{
+	QTextStream(stdout) << QJsonDocument(statistics()).toJson();
+	return 0;
+}
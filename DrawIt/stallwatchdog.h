@@ -0,0 +1,61 @@
+#ifndef STALLWATCHDOG_H
+#define STALLWATCHDOG_H
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+
+/**
+* Watches the GUI thread from a thread of its own. A timer on the GUI thread
+* beats while the event loop runs, when no beat comes for longer than the
+* threshold the GUI thread is stalled. The watchdog then takes the trace
+* zones open on the GUI thread, which tell the handler it is stuck in, and
+* logs a report when the stall starts and when it ends.
+*
+* Every stall is added to statistics kept in an INI file in the user
+* configuration directory (DrawIt/stalls.ini), so monitoring can collect
+* them from every machine. DrawIt --stall-statistics prints them as JSON.
+*/
+class StallWatchdog : public QThread
+{
+	Q_OBJECT
+
+public:
+	StallWatchdog(QObject *parent = 0);
+	~StallWatchdog();
+	void setThreshold(int newThreshold);
+	int getThreshold();
+	void stop();
+	static QJsonObject statistics();
+	static int printStatistics();
+
+	//Milliseconds a stall has to last by default
+	static const int defaultThreshold = 500;
+	//Milliseconds between beats, and between the checks of the watchdog
+	static const int beatInterval = 50;
+	//Reports of the latest stalls kept in the statistics
+	static const int keptReports = 20;
+
+protected:
+	void run();
+
+private slots:
+	void beat();
+
+private:
+	QTimer beatTimer;
+	QElapsedTimer clock;
+	//Milliseconds on the clock, 64 bits so it doesn't wrap in a long session
+	QAtomicInteger<qint64> lastBeat;
+	QAtomicInt stopping;
+	int threshold;
+	QThread *guiThread;
+
+	void stallEnded(qint64 duration, const QStringList &context);
+};
+
+#endif // STALLWATCHDOG_H
@@ -0,0 +1,174 @@
+#include "strokeplayer.h"
+
+#include <QCoreApplication>
+
+StrokePlayer::StrokePlayer(DrawingBoard *newBoard, QObject *parent)
+	: QObject(parent)
+{
+	board = newBoard;
+	position = 0;
+	timer.setSingleShot(true);
+	//Real time playback is used to measure latency, coarse timers would bunch the events
+	timer.setTimerType(Qt::PreciseTimer);
+	connect(&timer, SIGNAL(timeout()), this, SLOT(playDueEvents()));
+}
+
+StrokePlayer::~StrokePlayer()
+{
+
+}
+
+/**
+* Plays a recording on a new white canvas of the recorded size. Without
+* real time every event is played before the function returns
+* @param StrokeTrace newTrace - The recording
+* @param bool realTime - if the recorded timing should be kept
+*/
+void StrokePlayer::play(const StrokeTrace &newTrace, bool realTime)
+{
+	stop();
+	trace = newTrace;
+	position = 0;
+	board->newCanvas(trace.getCanvasSize());
+	if (realTime){
+		clock.start();
+		playDueEvents();
+		return;
+	}
+	while (position < trace.count()){
+		playEvent(board, trace.at(position++));
+	}
+	emit finished();
+}
+
+/**
+* Stops a playback that runs in real time
+*/
+void StrokePlayer::stop()
+{
+	timer.stop();
+	position = trace.count();
+}
+
+/**
+* Checks if a real time playback is running
+* @return bool - true if playing
+*/
+bool StrokePlayer::isPlaying()
+{
+	return timer.isActive();
+}
+
+/**
+* Plays one event on a board
+* @param DrawingBoard* board - The board to play on
+* @param StrokeTrace::Event event - The event
+*/
+void StrokePlayer::playEvent(DrawingBoard *board, const StrokeTrace::Event &event)
+{
+	const Qt::MouseButton button = Qt::MouseButton(event.buttons);
+	switch (event.type){
+		case StrokeTrace::eventPress: {
+			QMouseEvent mouseEvent(QEvent::MouseButtonPress, event.pos, button, button, Qt::NoModifier);
+			QCoreApplication::sendEvent(board, &mouseEvent);
+			break;
+		}
+		case StrokeTrace::eventMove: {
+			QMouseEvent mouseEvent(QEvent::MouseMove, event.pos, Qt::NoButton,
+				Qt::MouseButtons(event.buttons), Qt::NoModifier);
+			QCoreApplication::sendEvent(board, &mouseEvent);
+			break;
+		}
+		case StrokeTrace::eventRelease: {
+			QMouseEvent mouseEvent(QEvent::MouseButtonRelease, event.pos, button, Qt::NoButton, Qt::NoModifier);
+			QCoreApplication::sendEvent(board, &mouseEvent);
+			break;
+		}
+		case StrokeTrace::eventPaintMode:
+			board->setPaintMode(event.value);
+			break;
+		case StrokeTrace::eventPenWidth:
+			board->setPenWidth(event.value);
+			break;
+		case StrokeTrace::eventPenStyle:
+			board->setPenStyle(event.value);
+			break;
+		case StrokeTrace::eventPrimaryColor:
+			board->setPrimaryColor(QColor::fromRgba(event.value));
+			break;
+		case StrokeTrace::eventSecondaryColor:
+			board->setSecondaryColor(QColor::fromRgba(event.value));
+			break;
+		case StrokeTrace::eventColorFill:
+			board->setColorFill(QColor::fromRgba(event.value));
+			break;
+		case StrokeTrace::eventEmptyFill:
+			board->setEmptyFill();
+			break;
+		case StrokeTrace::eventBackground:
+			board->setBackgroundColor(QColor::fromRgba(event.value));
+			break;
+		case StrokeTrace::eventUndo:
+			board->undo();
+			break;
+		case StrokeTrace::eventRedo:
+			board->redo();
+			break;
+		case StrokeTrace::eventFillTolerance:
+			board->setFillTolerance(event.value);
+			break;
+		case StrokeTrace::eventCurrentLayer:
+			board->setCurrentLayer(event.value);
+			break;
+		case StrokeTrace::eventAddLayer:
+			board->addLayer();
+			break;
+		case StrokeTrace::eventRemoveLayer:
+			board->removeLayer();
+			break;
+		case StrokeTrace::eventMoveLayer:
+			board->moveLayer(event.value);
+			break;
+		case StrokeTrace::eventLayerOpacity:
+			board->setLayerOpacity(event.value);
+			break;
+		case StrokeTrace::eventLayerVisible:
+			board->setLayerVisible(event.value >> 1, (event.value & 1) != 0);
+			break;
+		case StrokeTrace::eventLayerBlendMode:
+			board->setLayerBlendMode(event.value);
+			break;
+		case StrokeTrace::eventSelectAll:
+			board->selectAll();
+			break;
+		case StrokeTrace::eventDeselect:
+			board->deselect();
+			break;
+		case StrokeTrace::eventInvertSelection:
+			board->invertSelection();
+			break;
+		case StrokeTrace::eventFillSelection:
+			board->fillSelection();
+			break;
+		case StrokeTrace::eventSelectionCombine:
+			board->setSelectionCombine(event.value);
+			break;
+	}
+}
+
+/**
+* Plays the events whose time has come and waits for the next one
+*/
+void StrokePlayer::playDueEvents()
+{
+	const qint64 now = clock.elapsed();
+	while (position < trace.count() && trace.at(position).time <= now){
+		playEvent(board, trace.at(position++));
+	}
+	if (position < trace.count()){
+		timer.start(int(trace.at(position).time - now));
+	}
+	else{
+		emit finished();
+	}
+}
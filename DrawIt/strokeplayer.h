@@ -0,0 +1,41 @@
+#ifndef STROKEPLAYER_H
+#define STROKEPLAYER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QTimer>
+#include "drawingboard.h"
+#include "stroketrace.h"
+
+/**
+* Plays a StrokeTrace back on a DrawingBoard. Mouse events are sent through
+* the normal event handlers of the board and settings through its setters,
+* either as fast as possible or with the recorded timing.
+*/
+class StrokePlayer : public QObject
+{
+	Q_OBJECT
+
+public:
+	StrokePlayer(DrawingBoard *newBoard, QObject *parent = 0);
+	~StrokePlayer();
+	void play(const StrokeTrace &newTrace, bool realTime);
+	void stop();
+	bool isPlaying();
+	static void playEvent(DrawingBoard *board, const StrokeTrace::Event &event);
+
+signals:
+	void finished();
+
+private slots:
+	void playDueEvents();
+
+private:
+	DrawingBoard *board;
+	StrokeTrace trace;
+	int position;
+	QElapsedTimer clock;
+	QTimer timer;
+};
+
+#endif // STROKEPLAYER_H
@@ -0,0 +1,270 @@
+#include "stroketrace.h"
+#include "tilefile.h"
+
+#include <QFile>
+
+#include <climits>
+
+/**
+* Appends an unsigned number, seven bits per byte with the high bit set on all but the last
+* @param QByteArray* data - The buffer to append to
+* @param quint64 number - The number
+*/
+static void writeNumber(QByteArray *data, quint64 number)
+{
+	while (number >= 0x80){
+		data->append(char((number & 0x7f) | 0x80));
+		number >>= 7;
+	}
+	data->append(char(number));
+}
+
+/**
+* Appends a signed number, small negative numbers stay short
+* @param QByteArray* data - The buffer to append to
+* @param qint64 number - The number
+*/
+static void writeSignedNumber(QByteArray *data, qint64 number)
+{
+	writeNumber(data, (quint64(number) << 1) ^ quint64(number >> 63));
+}
+
+/**
+* Reads a number written by writeNumber
+* @param QByteArray data - The buffer
+* @param int* position - The read position, moved past the number
+* @param quint64* number - Receives the number
+* @return bool - false if the buffer ended in the middle of the number
+*/
+static bool readNumber(const QByteArray &data, int *position, quint64 *number)
+{
+	*number = 0;
+	for (int shift = 0; shift < 64; shift += 7){
+		if (*position >= data.size()){
+			return false;
+		}
+		const uchar byte = data[(*position)++];
+		*number |= quint64(byte & 0x7f) << shift;
+		if (!(byte & 0x80)){
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+* Reads a number written by writeSignedNumber
+* @param QByteArray data - The buffer
+* @param int* position - The read position, moved past the number
+* @param qint64* number - Receives the number
+* @return bool - false if the buffer ended in the middle of the number
+*/
+static bool readSignedNumber(const QByteArray &data, int *position, qint64 *number)
+{
+	quint64 encoded;
+	if (!readNumber(data, position, &encoded)){
+		return false;
+	}
+	*number = qint64(encoded >> 1) ^ -qint64(encoded & 1);
+	return true;
+}
+
+StrokeTrace::StrokeTrace()
+{
+
+}
+
+StrokeTrace::~StrokeTrace()
+{
+
+}
+
+/**
+* Removes all events
+*/
+void StrokeTrace::clear()
+{
+	events.clear();
+	canvasSize = QSize();
+}
+
+/**
+* Sets the size of the canvas the recording starts on
+* @param QSize newCanvasSize - The canvas size
+*/
+void StrokeTrace::setCanvasSize(const QSize &newCanvasSize)
+{
+	canvasSize = newCanvasSize;
+}
+
+/**
+* Returns the size of the canvas the recording starts on
+* @return QSize - The canvas size
+*/
+QSize StrokeTrace::getCanvasSize() const
+{
+	return canvasSize;
+}
+
+/**
+* Adds an event at the end, its time has to be at least the time of the last event
+* @param Event event - The event
+*/
+void StrokeTrace::append(const Event &event)
+{
+	events.append(event);
+}
+
+/**
+* Returns the number of events
+* @return int - The number of events
+*/
+int StrokeTrace::count() const
+{
+	return events.size();
+}
+
+/**
+* Returns an event
+* @param int index - The event number
+* @return Event - The event
+*/
+const StrokeTrace::Event &StrokeTrace::at(int index) const
+{
+	return events.at(index);
+}
+
+/**
+* Returns the time of the last event
+* @return qint64 - The length of the recording in milliseconds
+*/
+qint64 StrokeTrace::duration() const
+{
+	return events.isEmpty() ? 0 : events.last().time;
+}
+
+/**
+* Encodes the recording
+* @return QByteArray - The encoded recording
+*/
+QByteArray StrokeTrace::toByteArray() const
+{
+	QByteArray data("DITR");
+	writeNumber(&data, version);
+	writeNumber(&data, canvasSize.width());
+	writeNumber(&data, canvasSize.height());
+	qint64 lastTime = 0;
+	QPoint lastPos;
+	foreach(const Event &event, events) {
+		data.append(char(event.type));
+		writeNumber(&data, quint64(event.time - lastTime));
+		lastTime = event.time;
+		if (event.type <= eventRelease){
+			writeSignedNumber(&data, event.pos.x() - lastPos.x());
+			writeSignedNumber(&data, event.pos.y() - lastPos.y());
+			writeNumber(&data, event.buttons);
+			lastPos = event.pos;
+		}
+		else{
+			writeNumber(&data, event.value);
+		}
+	}
+	return data;
+}
+
+/**
+* Decodes a recording written by toByteArray. A canvas without a width or a
+* height or larger than the canvases BatchRenderer lets clients make is
+* taken as a broken file
+* @param QByteArray data - The encoded recording
+* @return bool - false if the data isn't a valid recording, the trace is then empty
+*/
+bool StrokeTrace::fromByteArray(const QByteArray &data)
+{
+	clear();
+	if (!data.startsWith("DITR")){
+		return false;
+	}
+	int position = 4;
+	quint64 fileVersion;
+	quint64 width;
+	quint64 height;
+	if (!readNumber(data, &position, &fileVersion) || fileVersion != version ||
+		!readNumber(data, &position, &width) || !readNumber(data, &position, &height)){
+		return false;
+	}
+	const quint64 maximumBytes = quint64(TileFile::global()->threshold());
+	if (width == 0 || height == 0 || width > INT_MAX || height > INT_MAX
+		|| width > maximumBytes / 4 || height > maximumBytes / 4 / width){
+		return false;
+	}
+	canvasSize = QSize(int(width), int(height));
+	qint64 time = 0;
+	QPoint pos;
+	while (position < data.size()){
+		Event event;
+		event.type = uchar(data[position++]);
+		quint64 delay;
+		if (event.type > eventSelectionCombine || !readNumber(data, &position, &delay)){
+			clear();
+			return false;
+		}
+		time += delay;
+		event.time = time;
+		event.buttons = 0;
+		event.value = 0;
+		if (event.type <= eventRelease){
+			qint64 dx;
+			qint64 dy;
+			quint64 buttons;
+			if (!readSignedNumber(data, &position, &dx) || !readSignedNumber(data, &position, &dy) ||
+				!readNumber(data, &position, &buttons)){
+				clear();
+				return false;
+			}
+			pos += QPoint(int(dx), int(dy));
+			event.buttons = int(buttons);
+		}
+		else{
+			quint64 value;
+			if (!readNumber(data, &position, &value)){
+				clear();
+				return false;
+			}
+			event.value = quint32(value);
+		}
+		event.pos = pos;
+		events.append(event);
+	}
+	return true;
+}
+
+/**
+* Writes the recording to a file
+* @param QString fileName - The file to write
+* @return bool - if the file was written
+*/
+bool StrokeTrace::save(const QString &fileName) const
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly)){
+		return false;
+	}
+	const QByteArray data = toByteArray();
+	return file.write(data) == data.size();
+}
+
+/**
+* Reads a recording from a file
+* @param QString fileName - The file to read
+* @return bool - if the file held a valid recording
+*/
+bool StrokeTrace::load(const QString &fileName)
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly)){
+		clear();
+		return false;
+	}
+	return fromByteArray(file.readAll());
+}
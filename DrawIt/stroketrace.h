@@ -0,0 +1,85 @@
+#ifndef STROKETRACE_H
+#define STROKETRACE_H
+
+#include <QByteArray>
+#include <QPoint>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+/**
+* A recording of the input a DrawingBoard received: mouse presses, moves
+* and releases plus every change of the tool settings, the layers and the
+* selection, each with the time since the recording started. A recording
+* always starts on a white canvas of the recorded size, so playing it back
+* gives the same picture. Mouse positions are canvas positions, scrolling the view isn't
+* recorded.
+*
+* The file format is the magic "DITR", a version, the canvas size and then
+* one record per event. Numbers are stored as variable length integers,
+* times as the difference to the previous event and positions as the
+* difference to the previous mouse position, so a typical move takes 4 bytes.
+*/
+class StrokeTrace
+{
+public:
+	struct Event
+	{
+		int type;
+		qint64 time;
+		QPoint pos;
+		int buttons;
+		quint32 value;
+	};
+
+	StrokeTrace();
+	~StrokeTrace();
+	void clear();
+	void setCanvasSize(const QSize &newCanvasSize);
+	QSize getCanvasSize() const;
+	void append(const Event &event);
+	int count() const;
+	const Event &at(int index) const;
+	qint64 duration() const;
+	QByteArray toByteArray() const;
+	bool fromByteArray(const QByteArray &data);
+	bool save(const QString &fileName) const;
+	bool load(const QString &fileName);
+
+	//Event types. Mouse events use pos and buttons, the others use value
+	static const int eventPress = 0;
+	static const int eventMove = 1;
+	static const int eventRelease = 2;
+	static const int eventPaintMode = 3;
+	static const int eventPenWidth = 4;
+	static const int eventPenStyle = 5;
+	static const int eventPrimaryColor = 6;
+	static const int eventSecondaryColor = 7;
+	static const int eventColorFill = 8;
+	static const int eventEmptyFill = 9;
+	static const int eventBackground = 10;
+	static const int eventUndo = 11;
+	static const int eventRedo = 12;
+	static const int eventFillTolerance = 13;
+	static const int eventCurrentLayer = 14;
+	static const int eventAddLayer = 15;
+	static const int eventRemoveLayer = 16;
+	static const int eventMoveLayer = 17;
+	static const int eventLayerOpacity = 18;
+	//The value is the layer index shifted left by one, or'ed with 1 if the layer is shown
+	static const int eventLayerVisible = 19;
+	static const int eventLayerBlendMode = 20;
+	static const int eventSelectAll = 21;
+	static const int eventDeselect = 22;
+	static const int eventInvertSelection = 23;
+	static const int eventFillSelection = 24;
+	static const int eventSelectionCombine = 25;
+
+	static const int version = 1;
+
+private:
+	QSize canvasSize;
+	QVector<Event> events;
+};
+
+#endif // STROKETRACE_H
@@ -0,0 +1,804 @@
+#include "tiledcanvas.h"
+#include "bufferpool.h"
+#include "tilefile.h"
+
+#include <QCache>
+#include <QGlobalStatic>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+
+#include <algorithm>
+#include <cstring>
+
+/**
+* The mipmap levels of one tile. version tells which pixels they were made
+* from, canvases that share a serial can hold different tiles at one place
+*/
+struct Mipmap
+{
+	qint64 version;
+	QRgb solid;
+	QVector<QImage> levels;
+};
+
+typedef QCache<QPair<int, qint64>, Mipmap> MipmapCache;
+
+/**
+* The mipmaps of every canvas, costs are in kilobytes
+*/
+struct MipmapStore
+{
+	MipmapStore()
+	{
+		cache.setMaxCost(TiledCanvas::mipmapCacheSize / 1024);
+	}
+
+	QMutex mutex;
+	MipmapCache cache;
+};
+
+Q_GLOBAL_STATIC(MipmapStore, mipmapStore)
+
+QAtomicInt TiledCanvas::nextMipmapSerial;
+
+TiledCanvas::TiledCanvas()
+{
+	mipmapSerial = nextMipmapSerial.fetchAndAddRelaxed(1);
+	background = qRgb(255, 255, 255);
+	tileFormat = QImage::Format_RGB32;
+	expandable = false;
+	fileBacked = false;
+}
+
+TiledCanvas::TiledCanvas(const QSize &newSize, const QColor &color, QImage::Format format)
+{
+	tileFormat = format;
+	expandable = false;
+	setBounds(QRect(QPoint(0, 0), newSize));
+	fill(color);
+}
+
+TiledCanvas::TiledCanvas(const QSharedPointer<ImageTileSource> &newSource, const QSize &newSize)
+{
+	mipmapSerial = nextMipmapSerial.fetchAndAddRelaxed(1);
+	background = qRgb(255, 255, 255);
+	tileFormat = QImage::Format_RGB32;
+	expandable = false;
+	setBounds(QRect(QPoint(0, 0), newSize));
+	source = newSource;
+}
+
+TiledCanvas::~TiledCanvas()
+{
+
+}
+
+/**
+* Returns the size of the canvas
+* @return QSize - The canvas size
+*/
+QSize TiledCanvas::size() const
+{
+	return bounds.size();
+}
+
+/**
+* Returns the canvas rectangle. It starts at 0, 0 until an expandable canvas
+* grows to the left or the top
+* @return QRect - The canvas rectangle
+*/
+QRect TiledCanvas::rect() const
+{
+	return bounds;
+}
+
+/**
+* Sets the area of the canvas, tiles outside of it are kept
+* @param QRect newRect - The new canvas rectangle
+*/
+void TiledCanvas::setRect(const QRect &newRect)
+{
+	setBounds(newRect);
+}
+
+/**
+* Checks if the canvas has no area
+* @return bool - true if empty
+*/
+bool TiledCanvas::isNull() const
+{
+	return bounds.isEmpty();
+}
+
+/**
+* Returns the color of the tiles that were never painted
+* @return QColor - The background color
+*/
+QColor TiledCanvas::backgroundColor() const
+{
+	return QColor::fromRgba(qUnpremultiply(background));
+}
+
+/**
+* Checks if tiles that were never painted are read from an ImageTileSource
+* @return bool - true if the canvas has a source
+*/
+bool TiledCanvas::hasSource() const
+{
+	return !source.isNull();
+}
+
+/**
+* Lets the canvas grow when something is painted outside of it, instead of
+* leaving that part out. Outside of its rectangle an expandable canvas is
+* drawn and copied as its background
+* @param bool enabled - if the canvas should grow
+*/
+void TiledCanvas::setExpandable(bool enabled)
+{
+	expandable = enabled;
+}
+
+/**
+* Checks if the canvas grows when something is painted outside of it
+* @return bool - true if it grows
+*/
+bool TiledCanvas::isExpandable() const
+{
+	return expandable;
+}
+
+/**
+* Returns the area a tile covers in canvas coordinates
+* @param int column - The tile column
+* @param int row - The tile row
+* @return QRect - The tile area
+*/
+QRect TiledCanvas::tileRect(int column, int row) const
+{
+	return QRect(column * tileSize, row * tileSize, tileSize, tileSize);
+}
+
+/**
+* Returns a tile for reading. Tiles that haven't been painted on a canvas
+* with a source are decoded from the source, solid tiles are filled into a
+* new image
+* @param int column - The tile column
+* @param int row - The tile row
+* @return QImage - The tile
+*/
+QImage TiledCanvas::tile(int column, int row) const
+{
+	const QRgb solid = colorOf(column, row);
+	if (solid != noColor){
+		QImage filled = BufferPool::global()->image(QSize(tileSize, tileSize), tileFormat);
+		filled.fill(solid);
+		return filled;
+	}
+	QHash<qint64, Tile>::const_iterator found = tiles.constFind(key(column, row));
+	if (found != tiles.constEnd()){
+		return found->image;
+	}
+	return source->tile(column, row);
+}
+
+/**
+* Checks if a tile is kept as a color without pixels, tiles that were never
+* painted have the background color
+* @param int column - The tile column
+* @param int row - The tile row
+* @return bool - true if the tile is solid
+*/
+bool TiledCanvas::isSolid(int column, int row) const
+{
+	return colorOf(column, row) != noColor;
+}
+
+/**
+* Checks if a tile is kept as a color without pixels that is fully transparent
+* @param int column - The tile column
+* @param int row - The tile row
+* @return bool - true if drawing the tile changes nothing
+*/
+bool TiledCanvas::isTransparent(int column, int row) const
+{
+	const QRgb solid = colorOf(column, row);
+	return solid != noColor && qAlpha(solid) == 0;
+}
+
+/**
+* Makes a tile the same as the tile of another canvas, sharing its pixels.
+* The canvases have to have the same background and source
+* @param TiledCanvas other - The canvas to take the tile from
+* @param int column - The tile column
+* @param int row - The tile row
+*/
+void TiledCanvas::shareTile(const TiledCanvas &other, int column, int row)
+{
+	const qint64 index = key(column, row);
+	QHash<qint64, Tile>::const_iterator found = other.tiles.constFind(index);
+	if (found != other.tiles.constEnd()){
+		tiles.insert(index, *found);
+	}
+	else{
+		tiles.remove(index);
+	}
+	dropMipmaps(index);
+}
+
+/**
+* Returns the keys of the tiles that differ from the background
+* @return QList<qint64> - The keys, see key()
+*/
+QList<qint64> TiledCanvas::tileKeys() const
+{
+	return tiles.keys();
+}
+
+/**
+* Checks if the tiles are kept in the memory mapped TileFile
+* @return bool - true if the canvas is larger than the threshold of the file
+*/
+bool TiledCanvas::isFileBacked() const
+{
+	return fileBacked;
+}
+
+/**
+* Returns the number of tiles that differ from the background
+* @return int - The number of stored tiles
+*/
+int TiledCanvas::tileCount() const
+{
+	return tiles.size();
+}
+
+/**
+* Replaces the tiles painted since the last call by the tiles of the store
+* with the same pixels, so canvases that hold the same tile share its memory.
+* Solid tiles and tiles still read from the source are left alone
+* @param TileStore* store - The store to look the tiles up in
+*/
+void TiledCanvas::deduplicate(TileStore *store)
+{
+	//Looked for first so a canvas without new tiles doesn't detach the tiles it shares
+	QList<qint64> pending;
+	for (QHash<qint64, Tile>::const_iterator stored = tiles.constBegin(); stored != tiles.constEnd(); ++stored){
+		if (!stored->interned && !stored->image.isNull()){
+			pending.append(stored.key());
+		}
+	}
+	foreach(qint64 index, pending) {
+		Tile &stored = tiles[index];
+		stored.image = store->intern(stored.image);
+		stored.interned = true;
+	}
+}
+
+/**
+* Fills the whole canvas with a color. All tiles are dropped, the color
+* becomes the background
+* @param QColor color - Color to fill with
+*/
+void TiledCanvas::fill(const QColor &color)
+{
+	source.clear();
+	tiles.clear();
+	mipmapSerial = nextMipmapSerial.fetchAndAddRelaxed(1);
+	background = tileFormat == QImage::Format_RGB32 ? color.rgb() : qPremultiply(color.rgba());
+}
+
+/**
+* Replaces the canvas with the content of an image, the canvas takes the size of the image
+* @param QImage image - The image to split into tiles
+*/
+void TiledCanvas::setImage(const QImage &image)
+{
+	setBounds(QRect(QPoint(0, 0), image.size()));
+	source.clear();
+	tiles.clear();
+	mipmapSerial = nextMipmapSerial.fetchAndAddRelaxed(1);
+	background = qRgb(255, 255, 255);
+	for (int row = 0; row * tileSize < image.height(); ++row){
+		for (int column = 0; column * tileSize < image.width(); ++column){
+			QImage part = newTile();
+			part.fill(background);
+			QPainter painter(&part);
+			painter.drawImage(0, 0, image, column * tileSize, row * tileSize, tileSize, tileSize);
+			painter.end();
+			const QRgb color = uniformColor(part);
+			if (color == background){
+				continue;
+			}
+			Tile added;
+			added.image = color == noColor ? part : QImage();
+			added.solid = color;
+			added.interned = false;
+			tiles.insert(key(column, row), added);
+		}
+	}
+}
+
+/**
+* Paints on every tile that intersects the area. The painter given to the
+* draw function is translated so it uses canvas coordinates. An expandable
+* canvas first grows to take in the area
+* @param QRect area - The area that the drawing covers
+* @param std::function draw - Function that does the drawing
+*/
+void TiledCanvas::paint(const QRect &area, const std::function<void (QPainter &)> &draw)
+{
+	if (expandable && !area.isEmpty() && !bounds.contains(area)){
+		setBounds(bounds.united(area));
+	}
+	const QRect painted = area.intersected(bounds);
+	if (painted.isEmpty()){
+		return;
+	}
+	for (int row = tileOf(painted.top()); row <= tileOf(painted.bottom()); ++row){
+		for (int column = tileOf(painted.left()); column <= tileOf(painted.right()); ++column){
+			QPainter painter(&writableTile(column, row));
+			painter.translate(-column * tileSize, -row * tileSize);
+			draw(painter);
+		}
+	}
+}
+
+/**
+* Draws part of the canvas at the same coordinates on a painter. A painter
+* that scales up draws the visible part of each tile with nearest neighbour
+* scaling, one that scales down draws the mipmap level closest above the zoom
+* @param QPainter* painter - The painter to draw with
+* @param QRect area - The part of the canvas to draw
+* @param double zoom - The scale of the painter, 1 for no scaling
+*/
+void TiledCanvas::draw(QPainter *painter, const QRect &area, double zoom) const
+{
+	const QRect visible = covered(area);
+	if (visible.isEmpty()){
+		return;
+	}
+	const int level = levelFor(zoom);
+	const int firstColumn = tileOf(visible.left());
+	const int lastColumn = tileOf(visible.right());
+	const int firstRow = tileOf(visible.top());
+	const int lastRow = tileOf(visible.bottom());
+	//Zoomed far out the view holds more tiles than were ever painted, the background is filled at once.
+	//The stored tiles are drawn over it, so it has to be transparent or covered by them
+	const bool covering = qAlpha(background) == 0 || (tileFormat == QImage::Format_RGB32 && painter->opacity() == 1.0
+		&& painter->compositionMode() == QPainter::CompositionMode_SourceOver);
+	if (!source && covering && qint64(lastColumn - firstColumn + 1) * (lastRow - firstRow + 1) > tiles.size()){
+		painter->fillRect(visible, QColor::fromRgba(qUnpremultiply(background)));
+		for (QHash<qint64, Tile>::const_iterator stored = tiles.constBegin(); stored != tiles.constEnd(); ++stored){
+			const int column = int(quint32(stored.key()));
+			const int row = int(stored.key() >> 32);
+			if (column >= firstColumn && column <= lastColumn && row >= firstRow && row <= lastRow){
+				drawTile(painter, column, row, visible, level);
+			}
+		}
+		return;
+	}
+	for (int row = firstRow; row <= lastRow; ++row){
+		for (int column = firstColumn; column <= lastColumn; ++column){
+			drawTile(painter, column, row, visible, level);
+		}
+	}
+}
+
+/**
+* Copies part of the canvas into a new image. Parts outside the canvas are
+* white, or the background on an expandable canvas
+* @param QRect area - The area to copy
+* @return QImage - The copied area in Format_RGB32
+*/
+QImage TiledCanvas::copy(const QRect &area) const
+{
+	QImage copied = BufferPool::global()->image(area.size(), QImage::Format_RGB32);
+	copied.fill(qRgb(255, 255, 255));
+	copyInto(&copied, area, area.topLeft());
+	return copied;
+}
+
+/**
+* Copies part of the canvas into an existing Format_RGB32 image, the canvas
+* point origin lands on the top left pixel of the target. Parts outside the
+* canvas are left untouched, unless the canvas is expandable
+* @param QImage* target - The image to copy into, big enough for the area
+* @param QRect area - The area to copy
+* @param QPoint origin - The canvas point that maps to 0, 0 of the target
+*/
+void TiledCanvas::copyInto(QImage *target, const QRect &area, const QPoint &origin) const
+{
+	const QRect visible = covered(area);
+	if (visible.isEmpty()){
+		return;
+	}
+	for (int row = tileOf(visible.top()); row <= tileOf(visible.bottom()); ++row){
+		for (int column = tileOf(visible.left()); column <= tileOf(visible.right()); ++column){
+			const QRect part = tileRect(column, row).intersected(visible);
+			const QRgb solid = colorOf(column, row);
+			if (solid != noColor){
+				for (int y = part.top(); y <= part.bottom(); ++y){
+					QRgb *line = reinterpret_cast<QRgb *>(target->scanLine(y - origin.y())) + part.left() - origin.x();
+					std::fill(line, line + part.width(), solid);
+				}
+				continue;
+			}
+			const QImage sourceTile = tile(column, row);
+			for (int y = part.top(); y <= part.bottom(); ++y){
+				memcpy(target->scanLine(y - origin.y()) + (part.left() - origin.x()) * 4,
+					sourceTile.constScanLine(y - row * tileSize) + (part.left() - column * tileSize) * 4,
+					part.width() * 4);
+			}
+		}
+	}
+}
+
+/**
+* Copies the whole canvas into one image
+* @return QImage - The canvas in Format_RGB32
+*/
+QImage TiledCanvas::toImage() const
+{
+	return copy(rect());
+}
+
+/**
+* Adds up the bytes of the tiles that hold their own pixels. Tiles still read
+* from the source and solid tiles don't count
+* @param QSet* counted - Cache keys of tiles counted before, a tile shared with
+* another canvas is only counted once. The keys of this canvas are added
+* @return qint64 - The bytes not counted before
+*/
+qint64 TiledCanvas::memoryUsage(QSet<qint64> *counted) const
+{
+	qint64 bytes = 0;
+	foreach(const Tile &stored, tiles) {
+		if (!stored.image.isNull() && !counted->contains(stored.image.cacheKey())){
+			counted->insert(stored.image.cacheKey());
+			bytes += stored.image.byteCount();
+		}
+	}
+	return bytes;
+}
+
+/**
+* Returns the memory of the tiles the source keeps decoded
+* @return qint64 - The bytes, 0 without a source
+*/
+qint64 TiledCanvas::sourceCacheBytes() const
+{
+	return source ? source->cacheBytes() : 0;
+}
+
+/**
+* Returns the memory of the mipmaps made for zoomed out drawing, of all canvases
+* @return qint64 - The bytes
+*/
+qint64 TiledCanvas::mipmapBytes()
+{
+	QMutexLocker locker(&mipmapStore()->mutex);
+	return qint64(mipmapStore()->cache.totalCost()) * 1024;
+}
+
+/**
+* Notes what the tiles are now
+* @return Versions - The versions to give to changedTiles() later
+*/
+TiledCanvas::Versions TiledCanvas::versions() const
+{
+	Versions current;
+	current.background = background;
+	current.source = source.data();
+	for (QHash<qint64, Tile>::const_iterator stored = tiles.constBegin(); stored != tiles.constEnd(); ++stored){
+		//Cache keys start above 2^32, they don't meet the colors
+		current.tiles.insert(stored.key(), stored->image.isNull() ? qint64(stored->solid) : stored->image.cacheKey());
+	}
+	return current;
+}
+
+/**
+* Returns the tiles that were painted, added or dropped since the versions
+* were taken. A new background or source changes the whole canvas
+* @param Versions previous - Versions taken before
+* @return QVector<QRect> - The areas of the changed tiles
+*/
+QVector<QRect> TiledCanvas::changedTiles(const Versions &previous) const
+{
+	QVector<QRect> changed;
+	if (previous.background != background || previous.source != source.data()){
+		changed.append(bounds);
+		return changed;
+	}
+	for (QHash<qint64, Tile>::const_iterator stored = tiles.constBegin(); stored != tiles.constEnd(); ++stored){
+		const qint64 version = stored->image.isNull() ? qint64(stored->solid) : stored->image.cacheKey();
+		if (previous.tiles.value(stored.key(), -1) != version){
+			changed.append(tileRect(int(quint32(stored.key())), int(stored.key() >> 32)));
+		}
+	}
+	for (QHash<qint64, qint64>::const_iterator old = previous.tiles.constBegin(); old != previous.tiles.constEnd(); ++old){
+		if (!tiles.contains(old.key())){
+			changed.append(tileRect(int(quint32(old.key())), int(old.key() >> 32)));
+		}
+	}
+	return changed;
+}
+
+/**
+* Sets the area of the canvas, the tiles are kept
+* @param QRect newBounds - The new area
+*/
+void TiledCanvas::setBounds(const QRect &newBounds)
+{
+	bounds = newBounds;
+	fileBacked = qint64(bounds.width()) * bounds.height() * 4 > TileFile::global()->threshold();
+}
+
+/**
+* Returns the part of an area the canvas has pixels for
+* @param QRect area - The area
+* @return QRect - The whole area on an expandable canvas, the part inside the canvas otherwise
+*/
+QRect TiledCanvas::covered(const QRect &area) const
+{
+	return expandable ? area : area.intersected(bounds);
+}
+
+/**
+* Returns the color of a tile that is kept without pixels
+* @param int column - The tile column
+* @param int row - The tile row
+* @return QRgb - The color, noColor if the tile has pixels or comes from the source
+*/
+QRgb TiledCanvas::colorOf(int column, int row) const
+{
+	QHash<qint64, Tile>::const_iterator found = tiles.constFind(key(column, row));
+	if (found != tiles.constEnd()){
+		return found->solid;
+	}
+	if (source && column >= 0 && row >= 0 && column * tileSize < source->size().width()
+		&& row * tileSize < source->size().height()){
+		return noColor;
+	}
+	return background;
+}
+
+/**
+* Returns a tile for painting. Tiles that were never painted are made from
+* the source or the background first
+* @param int column - The tile column
+* @param int row - The tile row
+* @return QImage& - The tile
+*/
+QImage &TiledCanvas::writableTile(int column, int row)
+{
+	const qint64 index = key(column, row);
+	QHash<qint64, Tile>::iterator found = tiles.find(index);
+	if (found == tiles.end()){
+		Tile added;
+		added.solid = colorOf(column, row);
+		if (added.solid == noColor){
+			added.image = source->tile(column, row);
+		}
+		found = tiles.insert(index, added);
+	}
+	Tile &stored = found.value();
+	stored.interned = false;
+	dropMipmaps(index);
+	if (stored.solid != noColor){
+		stored.image = newTile();
+		stored.image.fill(stored.solid);
+		stored.solid = noColor;
+		return stored.image;
+	}
+	//Tiles shared with other canvases are copied here, into a pooled or mapped buffer, instead of by QImage
+	if (!stored.image.isDetached()){
+		if (fileBacked){
+			QImage copied = newTile();
+			for (int y = 0; y < tileSize; ++y){
+				memcpy(copied.scanLine(y), stored.image.constScanLine(y), tileSize * 4);
+			}
+			stored.image = copied;
+		}
+		else{
+			stored.image = BufferPool::global()->copy(stored.image);
+		}
+	}
+	return stored.image;
+}
+
+/**
+* Draws the part of a tile that is visible
+* @param QPainter* painter - The painter to draw with
+* @param int column - The tile column
+* @param int row - The tile row
+* @param QRect visible - The area of the canvas that is drawn
+* @param int level - The mipmap level to draw, 0 for the tile itself
+*/
+void TiledCanvas::drawTile(QPainter *painter, int column, int row, const QRect &visible, int level) const
+{
+	const QRect part = tileRect(column, row).intersected(visible);
+	const QRgb solid = colorOf(column, row);
+	if (solid != noColor){
+		painter->fillRect(part, QColor::fromRgba(qUnpremultiply(solid)));
+		return;
+	}
+	const QRect inTile = part.translated(-column * tileSize, -row * tileSize);
+	if (level == 0){
+		painter->drawImage(part.topLeft(), tile(column, row), inTile);
+		return;
+	}
+	QRgb mipmapColor;
+	const QImage levelImage = mipmap(column, row, level, &mipmapColor);
+	if (mipmapColor != noColor){
+		painter->fillRect(part, QColor::fromRgba(qUnpremultiply(mipmapColor)));
+		return;
+	}
+	const double scale = 1.0 / (1 << level);
+	painter->drawImage(QRectF(part), levelImage,
+		QRectF(inTile.x() * scale, inTile.y() * scale, inTile.width() * scale, inTile.height() * scale));
+}
+
+/**
+* Returns a mipmap level of a tile, the levels up to it are made when they
+* are missing. A tile found to be one color when its first level is made
+* has no levels, only the color
+* @param int column - The tile column
+* @param int row - The tile row
+* @param int level - The level, from 1 to maximumLevel
+* @param QRgb* solid - Set to the color of a tile of one color, noColor otherwise
+* @return QImage - The tile at 1 / 2^level of its size, null for a tile of one color
+*/
+QImage TiledCanvas::mipmap(int column, int row, int level, QRgb *solid) const
+{
+	const qint64 index = key(column, row);
+	QHash<qint64, Tile>::const_iterator stored = tiles.constFind(index);
+	//Tiles still read from the source don't change until they are painted, which stores them
+	const qint64 version = stored != tiles.constEnd() ? stored->image.cacheKey() : 0;
+	const QPair<int, qint64> cacheKey(mipmapSerial, index);
+	MipmapStore *store = mipmapStore();
+	Mipmap levels;
+	{
+		QMutexLocker locker(&store->mutex);
+		const Mipmap *cached = store->cache.object(cacheKey);
+		if (cached && cached->version == version){
+			if (cached->solid != noColor || cached->levels.size() >= level){
+				*solid = cached->solid;
+				return cached->solid != noColor ? QImage() : cached->levels.at(level - 1);
+			}
+			levels = *cached;
+		}
+	}
+	//The levels are made without the lock, another thread making the same ones only costs time
+	if (levels.levels.isEmpty()){
+		const QImage full = tile(column, row);
+		levels.version = version;
+		levels.solid = uniformColor(full);
+		if (levels.solid == noColor){
+			levels.levels.append(halve(full));
+		}
+	}
+	while (levels.solid == noColor && levels.levels.size() < level){
+		levels.levels.append(halve(levels.levels.last()));
+	}
+	qint64 bytes = 0;
+	foreach(const QImage &made, levels.levels) {
+		bytes += made.byteCount();
+	}
+	*solid = levels.solid;
+	const QImage result = levels.solid != noColor ? QImage() : levels.levels.at(level - 1);
+	QMutexLocker locker(&store->mutex);
+	store->cache.insert(cacheKey, new Mipmap(levels), int(qMax<qint64>(1, bytes / 1024)));
+	return result;
+}
+
+/**
+* Drops the mipmaps of a tile that is about to change
+* @param qint64 index - The key of the tile
+*/
+void TiledCanvas::dropMipmaps(qint64 index)
+{
+	MipmapStore *store = mipmapStore();
+	QMutexLocker locker(&store->mutex);
+	store->cache.remove(qMakePair(mipmapSerial, index));
+}
+
+/**
+* Makes an uninitialized tile in the format of the canvas, in the TileFile
+* when the canvas is file backed and the file can still grow, from the
+* BufferPool otherwise
+* @return QImage - The tile
+*/
+QImage TiledCanvas::newTile() const
+{
+	if (fileBacked){
+		const QImage mapped = TileFile::global()->tile(tileFormat);
+		if (!mapped.isNull()){
+			return mapped;
+		}
+	}
+	return BufferPool::global()->image(QSize(tileSize, tileSize), tileFormat);
+}
+
+/**
+* Returns the key of a tile in the hash
+* @param int column - The tile column
+* @param int row - The tile row
+* @return qint64 - The key
+*/
+qint64 TiledCanvas::key(int column, int row)
+{
+	return qint64(row) << 32 | quint32(column);
+}
+
+/**
+* Returns the tile column or row a coordinate is in, also for negative coordinates
+* @param int coordinate - The x or y coordinate
+* @return int - The column or row
+*/
+int TiledCanvas::tileOf(int coordinate)
+{
+	return coordinate >= 0 ? coordinate / tileSize : -((-coordinate - 1) / tileSize) - 1;
+}
+
+/**
+* Returns the mipmap level to draw at a zoom, the smallest that still has a
+* pixel for every pixel on screen
+* @param double zoom - The scale the canvas is drawn at
+* @return int - The level, 0 from a zoom of 1 on
+*/
+int TiledCanvas::levelFor(double zoom)
+{
+	int level = 0;
+	while (level < maximumLevel && zoom <= 0.5){
+		zoom *= 2;
+		++level;
+	}
+	return level;
+}
+
+/**
+* Scales an image to half its size, every pixel is the average of four
+* @param QImage image - A Format_RGB32 or premultiplied image with an even size
+* @return QImage - The smaller image
+*/
+QImage TiledCanvas::halve(const QImage &image)
+{
+	QImage half(image.width() / 2, image.height() / 2, image.format());
+	for (int y = 0; y < half.height(); ++y){
+		const QRgb *top = reinterpret_cast<const QRgb *>(image.constScanLine(y * 2));
+		const QRgb *bottom = reinterpret_cast<const QRgb *>(image.constScanLine(y * 2 + 1));
+		QRgb *line = reinterpret_cast<QRgb *>(half.scanLine(y));
+		for (int x = 0; x < half.width(); ++x){
+			const QRgb a = top[x * 2];
+			const QRgb b = top[x * 2 + 1];
+			const QRgb c = bottom[x * 2];
+			const QRgb d = bottom[x * 2 + 1];
+			line[x] = qRgba((qRed(a) + qRed(b) + qRed(c) + qRed(d) + 2) / 4,
+				(qGreen(a) + qGreen(b) + qGreen(c) + qGreen(d) + 2) / 4,
+				(qBlue(a) + qBlue(b) + qBlue(c) + qBlue(d) + 2) / 4,
+				(qAlpha(a) + qAlpha(b) + qAlpha(c) + qAlpha(d) + 2) / 4);
+		}
+	}
+	return half;
+}
+
+/**
+* Returns the color of an image that has only one
+* @param QImage image - A tile
+* @return QRgb - The color, noColor if the pixels differ
+*/
+QRgb TiledCanvas::uniformColor(const QImage &image)
+{
+	const QRgb color = image.pixel(0, 0);
+	for (int y = 0; y < image.height(); ++y){
+		const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+		for (int x = 0; x < image.width(); ++x){
+			if (line[x] != color){
+				return noColor;
+			}
+		}
+	}
+	return color;
+}
@@ -0,0 +1,137 @@
+#ifndef TILEDCANVAS_H
+#define TILEDCANVAS_H
+
+#include <QAtomicInt>
+#include <QColor>
+#include <QHash>
+#include <QImage>
+#include <QPainter>
+#include <QRect>
+#include <QSet>
+#include <QSharedPointer>
+#include <QSize>
+#include <QVector>
+#include <functional>
+#include "imagetilesource.h"
+#include "tilestore.h"
+
+/**
+* A canvas stored as square tiles, kept in a hash by their column and row.
+* Only tiles that differ from the background are stored, so the memory of a
+* canvas follows the area that was painted and not its size. Copies share
+* their tiles, so painting into a copy only duplicates the tiles that are
+* touched. A canvas can be backed by an ImageTileSource, tiles that haven't
+* been painted are then read from the source when they are needed. Tiles of
+* one solid color are kept as just the color until something is painted on
+* them, tiles with pixels can be shared with other canvases through a
+* TileStore. Canvases larger than the threshold of the TileFile keep their
+* tiles in that memory mapped file instead of on the heap.
+*
+* An expandable canvas grows in every direction, also to negative
+* coordinates, when something is painted outside of it.
+*
+* For zoomed out views tiles get a pyramid of mipmaps, each level half the
+* size of the one before. A level is made from the one above it the first
+* time it is drawn, painting on a tile drops its pyramid. The pyramids of all
+* canvases share one cache of mipmapCacheSize bytes, the ones drawn least
+* recently are dropped first. A tile that turns out to be one color keeps
+* only the color, and tiles past the edge of the source are the background
+* without being read.
+*
+* Tiles are Format_RGB32, or Format_ARGB32_Premultiplied for the transparent
+* layers of a LayerStack. Only Format_RGB32 canvases can be copied out.
+*/
+class TiledCanvas
+{
+public:
+	/**
+	* What the tiles of a canvas were at one moment, changedTiles() compares
+	* with it. Tiles are told apart by their QImage cache key or solid color,
+	* no pixels are compared or kept
+	*/
+	struct Versions
+	{
+		QRgb background;
+		const ImageTileSource *source;
+		QHash<qint64, qint64> tiles;
+	};
+
+	TiledCanvas();
+	TiledCanvas(const QSize &newSize, const QColor &color = Qt::white, QImage::Format format = QImage::Format_RGB32);
+	TiledCanvas(const QSharedPointer<ImageTileSource> &newSource, const QSize &newSize);
+	~TiledCanvas();
+	QSize size() const;
+	QRect rect() const;
+	void setRect(const QRect &newRect);
+	bool isNull() const;
+	QColor backgroundColor() const;
+	bool hasSource() const;
+	void setExpandable(bool enabled);
+	bool isExpandable() const;
+	QRect tileRect(int column, int row) const;
+	QImage tile(int column, int row) const;
+	void fill(const QColor &color);
+	void setImage(const QImage &image);
+	void paint(const QRect &area, const std::function<void (QPainter &)> &draw);
+	void draw(QPainter *painter, const QRect &area, double zoom = 1.0) const;
+	QImage copy(const QRect &area) const;
+	void copyInto(QImage *target, const QRect &area, const QPoint &origin) const;
+	QImage toImage() const;
+	bool isSolid(int column, int row) const;
+	QRgb colorOf(int column, int row) const;
+	bool isTransparent(int column, int row) const;
+	void shareTile(const TiledCanvas &other, int column, int row);
+	QList<qint64> tileKeys() const;
+	bool isFileBacked() const;
+	int tileCount() const;
+	void deduplicate(TileStore *store);
+	qint64 memoryUsage(QSet<qint64> *counted) const;
+	qint64 sourceCacheBytes() const;
+	static qint64 mipmapBytes();
+	Versions versions() const;
+	QVector<QRect> changedTiles(const Versions &previous) const;
+
+	static const int tileSize = 256;
+	//Tile::solid of a tile with pixels, neither an opaque nor a premultiplied color
+	static const QRgb noColor = 0x00ffffff;
+	//Smallest mipmap level, a tile of one pixel
+	static const int maximumLevel = 8;
+	//Memory of the mipmaps of all canvases together
+	static const int mipmapCacheSize = 64 * 1024 * 1024;
+
+	static qint64 key(int column, int row);
+	static int tileOf(int coordinate);
+
+private:
+	struct Tile
+	{
+		QImage image;
+		QRgb solid;
+		bool interned;
+	};
+
+	QRect bounds;
+	QRgb background;
+	QImage::Format tileFormat;
+	bool expandable;
+	bool fileBacked;
+	QHash<qint64, Tile> tiles;
+	QSharedPointer<ImageTileSource> source;
+	//Names the pixels of the canvas in the mipmap cache, copies keep it, filling or replacing the canvas changes it
+	int mipmapSerial;
+
+	static QAtomicInt nextMipmapSerial;
+
+	void setBounds(const QRect &newBounds);
+	QRect covered(const QRect &area) const;
+	QImage &writableTile(int column, int row);
+	void drawTile(QPainter *painter, int column, int row, const QRect &visible, int level) const;
+	QImage mipmap(int column, int row, int level, QRgb *solid) const;
+	void dropMipmaps(qint64 index);
+	QImage newTile() const;
+	static int levelFor(double zoom);
+	static QImage halve(const QImage &image);
+	static QRgb uniformColor(const QImage &image);
+};
+
+#endif // TILEDCANVAS_H
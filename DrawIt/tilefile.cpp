@@ -0,0 +1,138 @@
+#include "tilefile.h"
+#include "tiledcanvas.h"
+
+#include <QDir>
+#include <QGlobalStatic>
+#include <QMutexLocker>
+
+Q_GLOBAL_STATIC(TileFile, globalFile)
+
+//Bytes of one Format_RGB32 tile
+static const int tileBytes = TiledCanvas::tileSize * TiledCanvas::tileSize * 4;
+
+TileFile::TileFile()
+	: file(QDir::tempPath() + "/drawit-tiles-XXXXXX")
+{
+	failed = false;
+	bool ok = false;
+	const int megabytes = qgetenv("DRAWIT_TILE_FILE_THRESHOLD").toInt(&ok);
+	thresholdBytes = qint64(ok ? megabytes : defaultThreshold) * 1024 * 1024;
+}
+
+TileFile::~TileFile()
+{
+	//Closing the file unmaps the chunks
+	qDeleteAll(blocks);
+}
+
+/**
+* Returns the file the canvases share
+* @return TileFile* - The tile file
+*/
+TileFile *TileFile::global()
+{
+	return globalFile();
+}
+
+/**
+* Makes an uninitialized tile in the file
+* @param QImage::Format format - A format with 32 bits per pixel
+* @return QImage - The tile, a null image if the file can't be grown
+*/
+QImage TileFile::tile(QImage::Format format)
+{
+	QMutexLocker locker(&mutex);
+	if (freeBlocks.isEmpty() && !grow()){
+		return QImage();
+	}
+	Slot *slot = freeBlocks.takeLast();
+	return QImage(slot->data, TiledCanvas::tileSize, TiledCanvas::tileSize, TiledCanvas::tileSize * 4,
+		format, release, slot);
+}
+
+/**
+* Returns the canvas size from which tiles are kept in the file
+* @return qint64 - The size in bytes
+*/
+qint64 TileFile::threshold()
+{
+	QMutexLocker locker(&mutex);
+	return thresholdBytes;
+}
+
+/**
+* Returns the size of the file
+* @return qint64 - The bytes
+*/
+qint64 TileFile::fileBytes()
+{
+	QMutexLocker locker(&mutex);
+	return qint64(blocks.size()) * tileBytes;
+}
+
+/**
+* Returns the memory of the tiles in use, the system decides how much of it is resident
+* @return qint64 - The bytes
+*/
+qint64 TileFile::usedBytes()
+{
+	QMutexLocker locker(&mutex);
+	return qint64(blocks.size() - freeBlocks.size()) * tileBytes;
+}
+
+/**
+* Adds a chunk of tiles to the end of the file and maps it
+* @return bool - if the chunk could be added
+*/
+bool TileFile::grow()
+{
+	if (failed){
+		return false;
+	}
+	if (!file.isOpen() && !file.open()){
+		qWarning("Can't create the tile file in %s", qPrintable(QDir::tempPath()));
+		failed = true;
+		return false;
+	}
+	const qint64 offset = qint64(blocks.size()) * tileBytes;
+	const qint64 bytes = qint64(chunkTiles) * tileBytes;
+	uchar *data = 0;
+	if (file.resize(offset + bytes)){
+		data = file.map(offset, bytes);
+	}
+	if (!data){
+		qWarning("Can't grow the tile file %s to %lld MB", qPrintable(file.fileName()), (offset + bytes) >> 20);
+		failed = true;
+		return false;
+	}
+	for (int i = 0; i < chunkTiles; ++i){
+		Slot *slot = new Slot;
+		slot->data = data + qint64(i) * tileBytes;
+		blocks.append(slot);
+		freeBlocks.append(slot);
+	}
+	return true;
+}
+
+/**
+* Makes the slot of a tile free for the next one
+* @param Slot* slot - The slot
+*/
+void TileFile::give(Slot *slot)
+{
+	QMutexLocker locker(&mutex);
+	freeBlocks.append(slot);
+}
+
+/**
+* Cleanup function of the tiles
+* @param void* slot - The Slot of the tile
+*/
+void TileFile::release(void *slot)
+{
+	//Tiles can outlive the file at exit, the mapping is gone with it
+	if (globalFile.isDestroyed()){
+		return;
+	}
+	globalFile()->give(static_cast<Slot *>(slot));
+}
@@ -0,0 +1,54 @@
+#ifndef TILEFILE_H
+#define TILEFILE_H
+
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QTemporaryFile>
+
+/**
+* Gives out canvas tiles whose pixels live in a memory mapped temporary file
+* instead of on the heap. The file grows in chunks of tiles that are mapped
+* one by one, so tiles that aren't touched can be paged out by the system and
+* a canvas isn't bound by the memory of the machine. The slot of a tile is
+* reused when the last QImage using it goes away, the file doesn't shrink
+* until the program ends.
+*
+* Canvases larger than the threshold use it, set DRAWIT_TILE_FILE_THRESHOLD
+* to the size in MB, the default is 1024.
+*/
+class TileFile
+{
+public:
+	TileFile();
+	~TileFile();
+	static TileFile *global();
+	QImage tile(QImage::Format format);
+	qint64 threshold();
+	qint64 fileBytes();
+	qint64 usedBytes();
+
+	//Tiles mapped at once when the file grows, 64 MB
+	static const int chunkTiles = 256;
+	//Canvas size in MB from which tiles are kept in the file
+	static const int defaultThreshold = 1024;
+
+private:
+	struct Slot
+	{
+		uchar *data;
+	};
+
+	QMutex mutex;
+	QTemporaryFile file;
+	bool failed;
+	QList<Slot *> blocks;
+	QList<Slot *> freeBlocks;
+	qint64 thresholdBytes;
+
+	bool grow();
+	void give(Slot *slot);
+	static void release(void *slot);
+};
+
+#endif // TILEFILE_H
@@ -0,0 +1,170 @@
+#include "tilestore.h"
+
+#include <QGlobalStatic>
+#include <QMutexLocker>
+#include <cstring>
+
+Q_GLOBAL_STATIC(TileStore, globalStore)
+
+TileStore::TileStore()
+{
+	count = 0;
+	storedBytes = 0;
+	hits = 0;
+	saved = 0;
+}
+
+TileStore::~TileStore()
+{
+
+}
+
+/**
+* Returns the store the canvases of the drawing engine share
+* @return TileStore* - The store
+*/
+TileStore *TileStore::global()
+{
+	return globalStore();
+}
+
+/**
+* Looks up a tile by its pixels, a tile that isn't stored yet is added
+* @param QImage tile - The tile, with 32 bits per pixel
+* @return QImage - The stored tile with the same pixels, use it instead of the given one
+*/
+QImage TileStore::intern(const QImage &tile)
+{
+	const quint64 key = hash(tile);
+	QMutexLocker locker(&mutex);
+	QList<QImage> &candidates = tiles[key];
+	foreach(const QImage &stored, candidates) {
+		if (stored.cacheKey() == tile.cacheKey()){
+			return stored;
+		}
+		if (samePixels(stored, tile)){
+			++hits;
+			saved += tile.byteCount();
+			return stored;
+		}
+	}
+	candidates.append(tile);
+	++count;
+	storedBytes += tile.byteCount();
+	return tile;
+}
+
+/**
+* Drops the tiles only the store still holds
+*/
+void TileStore::collect()
+{
+	QMutexLocker locker(&mutex);
+	QHash<quint64, QList<QImage> >::iterator entry = tiles.begin();
+	while (entry != tiles.end()){
+		QList<QImage> &candidates = entry.value();
+		for (int i = candidates.size() - 1; i >= 0; --i){
+			if (candidates.at(i).isDetached()){
+				storedBytes -= candidates.at(i).byteCount();
+				--count;
+				candidates.removeAt(i);
+			}
+		}
+		if (candidates.isEmpty()){
+			entry = tiles.erase(entry);
+		}
+		else{
+			++entry;
+		}
+	}
+}
+
+/**
+* Returns the number of distinct tiles in the store
+* @return int - The number of tiles
+*/
+int TileStore::tileCount()
+{
+	QMutexLocker locker(&mutex);
+	return count;
+}
+
+/**
+* Returns the memory of the distinct tiles in the store
+* @return qint64 - The bytes
+*/
+qint64 TileStore::bytes()
+{
+	QMutexLocker locker(&mutex);
+	return storedBytes;
+}
+
+/**
+* Returns how many tiles were found to be stored already
+* @return qint64 - The number of duplicates
+*/
+qint64 TileStore::hitCount()
+{
+	QMutexLocker locker(&mutex);
+	return hits;
+}
+
+/**
+* Returns the memory of the duplicate tiles that were replaced by stored ones
+* @return qint64 - The bytes
+*/
+qint64 TileStore::savedBytes()
+{
+	QMutexLocker locker(&mutex);
+	return saved;
+}
+
+/**
+* Hashes the pixels of an image eight bytes at a time, the padding at the end
+* of the rows is left out
+* @param QImage image - An image with 32 bits per pixel
+* @return quint64 - The hash
+*/
+quint64 TileStore::hash(const QImage &image)
+{
+	const quint64 multiplier = Q_UINT64_C(0x9e3779b97f4a7c15);
+	quint64 value = quint64(image.width()) << 32 | quint64(image.height());
+	const int words = image.width() / 2;
+	for (int y = 0; y < image.height(); ++y){
+		const uchar *line = image.constScanLine(y);
+		for (int i = 0; i < words; ++i){
+			quint64 word;
+			memcpy(&word, line + i * 8, 8);
+			value = (value ^ word) * multiplier;
+			value ^= value >> 29;
+		}
+		if (image.width() % 2){
+			quint32 pixel;
+			memcpy(&pixel, line + words * 8, 4);
+			value = (value ^ pixel) * multiplier;
+		}
+	}
+	value ^= value >> 33;
+	value *= Q_UINT64_C(0xff51afd7ed558ccd);
+	value ^= value >> 33;
+	return value;
+}
+
+/**
+* Compares two images pixel by pixel, the padding at the end of the rows is left out
+* @param QImage first - An image with 32 bits per pixel
+* @param QImage second - The image to compare with
+* @return bool - true if size, format and pixels are the same
+*/
+bool TileStore::samePixels(const QImage &first, const QImage &second)
+{
+	if (first.size() != second.size() || first.format() != second.format()){
+		return false;
+	}
+	for (int y = 0; y < first.height(); ++y){
+		if (memcmp(first.constScanLine(y), second.constScanLine(y), first.width() * 4) != 0){
+			return false;
+		}
+	}
+	return true;
+}
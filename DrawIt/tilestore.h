@@ -0,0 +1,42 @@
+#ifndef TILESTORE_H
+#define TILESTORE_H
+
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+
+/**
+* Keeps one copy of every distinct tile the canvases hold. A tile given to
+* intern() is hashed with a 64 bit hash of its pixels, when the store already
+* has a tile with the same pixels that one is handed back and the given copy
+* can go away. The live canvas and the undo and redo history share the tiles
+* through the reference counting of QImage, a tile is dropped from the store
+* by collect() once no canvas uses it anymore.
+*/
+class TileStore
+{
+public:
+	TileStore();
+	~TileStore();
+	static TileStore *global();
+	QImage intern(const QImage &tile);
+	void collect();
+	int tileCount();
+	qint64 bytes();
+	qint64 hitCount();
+	qint64 savedBytes();
+	static quint64 hash(const QImage &image);
+
+private:
+	QMutex mutex;
+	QHash<quint64, QList<QImage> > tiles;
+	int count;
+	qint64 storedBytes;
+	qint64 hits;
+	qint64 saved;
+
+	static bool samePixels(const QImage &first, const QImage &second);
+};
+
+#endif // TILESTORE_H
@@ -0,0 +1,282 @@
+#include "tracelog.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSharedPointer>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadStorage>
+#include <QVector>
+
+QAtomicInt TraceLog::modeFlags;
+QThread *TraceLog::trackedThread = 0;
+
+/**
+* The zones of one thread. Only its thread writes, the lock is there for
+* save() and clear() which run on another one. The open zones are read by
+* other threads without the lock, the names are literals and the depth is
+* atomic so a reader at worst sees a zone that was just left
+*/
+struct TraceBuffer
+{
+	struct Zone
+	{
+		const char *name;
+		qint64 start;
+		qint64 end;
+	};
+
+	QMutex mutex;
+	QVector<Zone> zones;
+	quint64 written;
+	int threadId;
+	QString threadName;
+	QThread *thread;
+	const char *open[TraceLog::maximumDepth];
+	QAtomicInt depth;
+};
+
+static QMutex registryMutex;
+static QList<QSharedPointer<TraceBuffer> > buffers;
+static QThreadStorage<QSharedPointer<TraceBuffer> > threadBuffer;
+//The buffer of the tracked thread, found without the thread storage
+static TraceBuffer *trackedBuffer = 0;
+static QElapsedTimer traceClock;
+static QString exitFileName;
+static int modeBits = 0;
+
+/**
+* Returns the buffer of a thread, made and added to the registry the first
+* time. Call with the registry locked
+* @param QThread* thread - The thread
+* @return QSharedPointer - The buffer
+*/
+static QSharedPointer<TraceBuffer> bufferOf(QThread *thread)
+{
+	foreach(const QSharedPointer<TraceBuffer> &buffer, buffers) {
+		if (buffer->thread == thread){
+			return buffer;
+		}
+	}
+	QSharedPointer<TraceBuffer> buffer(new TraceBuffer);
+	buffer->written = 0;
+	buffer->thread = thread;
+	buffer->threadName = thread->objectName();
+	if (buffer->threadName.isEmpty()){
+		buffer->threadName = QCoreApplication::instance() && thread == QCoreApplication::instance()->thread()
+			? QString("main") : QString("thread %1").arg(quintptr(thread), 0, 16);
+	}
+	buffer->threadId = buffers.size() + 1;
+	buffers.append(buffer);
+	return buffer;
+}
+
+/**
+* Returns the buffer of the calling thread, made on its first zone. The
+* registry keeps it after the thread ends so its zones can still be saved
+* @return TraceBuffer* - The buffer
+*/
+static TraceBuffer *currentBuffer()
+{
+	if (trackedBuffer && QThread::currentThread() == trackedBuffer->thread){
+		return trackedBuffer;
+	}
+	if (!threadBuffer.hasLocalData()){
+		QMutexLocker locker(&registryMutex);
+		threadBuffer.setLocalData(bufferOf(QThread::currentThread()));
+	}
+	return threadBuffer.localData().data();
+}
+
+/**
+* Turns recording on or off. Zones already recorded are kept
+* @param bool enabled - if zones should be recorded
+*/
+void TraceLog::setEnabled(bool enabled)
+{
+	QMutexLocker locker(&registryMutex);
+	if (!traceClock.isValid()){
+		traceClock.start();
+	}
+	modeBits = enabled ? modeBits | modeRecording : modeBits & ~modeRecording;
+	modeFlags.storeRelease(modeBits);
+}
+
+/**
+* Keeps track of the zones open on a thread without recording them
+* @param QThread* thread - The thread to track, 0 to stop tracking
+*/
+void TraceLog::setZoneTracking(QThread *thread)
+{
+	QMutexLocker locker(&registryMutex);
+	if (!traceClock.isValid()){
+		traceClock.start();
+	}
+	if (thread){
+		//The buffer stays when tracking stops, zones still open on the thread leave through it
+		trackedBuffer = bufferOf(thread).data();
+		trackedThread = thread;
+	}
+	modeBits = thread ? modeBits | modeTracking : modeBits & ~modeTracking;
+	modeFlags.storeRelease(modeBits);
+}
+
+/**
+* Returns the time on the trace clock
+* @return qint64 - Nanoseconds since tracing or tracking was first turned on
+*/
+qint64 TraceLog::now()
+{
+	return traceClock.nsecsElapsed();
+}
+
+/**
+* Pushes a zone on the open zones of the calling thread
+* @param char* name - The zone name, a string that stays valid
+*/
+void TraceLog::enter(const char *name)
+{
+	TraceBuffer *buffer = currentBuffer();
+	const int depth = buffer->depth.load();
+	if (depth < maximumDepth){
+		buffer->open[depth] = name;
+	}
+	buffer->depth.storeRelease(depth + 1);
+}
+
+/**
+* Pops the innermost open zone of the calling thread and records it when tracing is on
+* @param qint64 start - When the zone started, from now()
+*/
+void TraceLog::leave(qint64 start)
+{
+	TraceBuffer *buffer = currentBuffer();
+	const int depth = buffer->depth.load() - 1;
+	buffer->depth.storeRelease(depth);
+	if (depth < maximumDepth && isEnabled()){
+		record(buffer->open[depth], start, now());
+	}
+}
+
+/**
+* Returns the zones open on a thread, tracked while tracing or zone tracking is on
+* @param QThread* thread - The thread
+* @return QStringList - The zone names, outermost first
+*/
+QStringList TraceLog::openZones(QThread *thread)
+{
+	QStringList names;
+	QMutexLocker locker(&registryMutex);
+	foreach(const QSharedPointer<TraceBuffer> &buffer, buffers) {
+		if (buffer->thread != thread){
+			continue;
+		}
+		const int depth = qMin(buffer->depth.loadAcquire(), int(maximumDepth));
+		for (int i = 0; i < depth; ++i){
+			names.append(buffer->open[i]);
+		}
+	}
+	return names;
+}
+
+/**
+* Adds a zone to the buffer of the calling thread
+* @param char* name - The zone name, a string that stays valid
+* @param qint64 start - When the zone started, from now()
+* @param qint64 end - When it ended
+*/
+void TraceLog::record(const char *name, qint64 start, qint64 end)
+{
+	TraceBuffer *buffer = currentBuffer();
+	QMutexLocker locker(&buffer->mutex);
+	if (buffer->zones.isEmpty()){
+		buffer->zones.resize(bufferEvents);
+	}
+	TraceBuffer::Zone &zone = buffer->zones[int(buffer->written % bufferEvents)];
+	zone.name = name;
+	zone.start = start;
+	zone.end = end;
+	++buffer->written;
+}
+
+/**
+* Forgets every recorded zone
+*/
+void TraceLog::clear()
+{
+	QMutexLocker locker(&registryMutex);
+	foreach(const QSharedPointer<TraceBuffer> &buffer, buffers) {
+		QMutexLocker bufferLocker(&buffer->mutex);
+		buffer->written = 0;
+	}
+}
+
+/**
+* Writes the recorded zones as a Chrome trace event JSON file, one complete
+* event per zone and the thread names as metadata
+* @param QString fileName - The file to write
+* @return bool - if the file was written
+*/
+bool TraceLog::save(const QString &fileName)
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Text)){
+		return false;
+	}
+	QTextStream out(&file);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	const qint64 processId = QCoreApplication::applicationPid();
+	bool first = true;
+	QMutexLocker locker(&registryMutex);
+	foreach(const QSharedPointer<TraceBuffer> &buffer, buffers) {
+		QMutexLocker bufferLocker(&buffer->mutex);
+		QString threadName = buffer->threadName;
+		threadName.replace('\\', "\\\\").replace('"', "\\\"");
+		out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << processId
+			<< ",\"tid\":" << buffer->threadId << ",\"args\":{\"name\":\"" << threadName << "\"}}";
+		first = false;
+		const quint64 count = qMin(buffer->written, quint64(bufferEvents));
+		for (quint64 i = buffer->written - count; i < buffer->written; ++i){
+			const TraceBuffer::Zone &zone = buffer->zones[int(i % bufferEvents)];
+			out << ",\n{\"name\":\"" << zone.name << "\",\"ph\":\"X\",\"pid\":" << processId
+				<< ",\"tid\":" << buffer->threadId
+				<< ",\"ts\":" << QString::number(zone.start / 1e3, 'f', 3)
+				<< ",\"dur\":" << QString::number((zone.end - zone.start) / 1e3, 'f', 3) << "}";
+		}
+	}
+	out << "\n]}\n";
+	out.flush();
+	return file.error() == QFile::NoError;
+}
+
+/**
+* Turns tracing on when DRAWIT_TRACE names a file, and saves the trace to it
+* when the application object goes away. %p in the name is replaced by the
+* process id, the workers of --farm see the same variable. Call after the
+* application object is made
+*/
+void TraceLog::startFromEnvironment()
+{
+	exitFileName = QString::fromLocal8Bit(qgetenv("DRAWIT_TRACE"));
+	if (exitFileName.isEmpty()){
+		return;
+	}
+	exitFileName.replace("%p", QString::number(QCoreApplication::applicationPid()));
+	setEnabled(true);
+	qAddPostRoutine(saveAtExit);
+}
+
+/**
+* Saves the trace to the file of DRAWIT_TRACE
+*/
+void TraceLog::saveAtExit()
+{
+	setEnabled(false);
+	if (!save(exitFileName)){
+		QTextStream(stderr) << "could not write the trace to " << exitFileName << '\n';
+	}
+}
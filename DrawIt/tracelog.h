@@ -0,0 +1,128 @@
+#ifndef TRACELOG_H
+#define TRACELOG_H
+
+#include <QAtomicInt>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+
+/**
+* Records how long named zones of the code take, in one ring buffer per
+* thread, and saves them in the Chrome trace event format that
+* chrome://tracing and Perfetto open. A zone is the scope of a TRACE_ZONE:
+*
+*   void DrawingEngine::undo(){
+*       TRACE_ZONE("DrawingEngine::undo");
+*       ...
+*
+* While tracing is off a zone costs one atomic load. The zones open on one
+* thread can also be tracked without recording them, StallWatchdog uses that
+* to tell which handler the GUI thread is stuck in, zones on the other
+* threads then only add a comparison of the current thread. Setting the
+* environment variable DRAWIT_TRACE to a file name turns tracing on at start
+* and saves the trace to that file at exit, in every mode of the program, %p
+* in the name stands for the process id. Defining DRAWIT_NO_TRACE compiles
+* the zones away.
+*/
+class TraceLog
+{
+public:
+	static void setEnabled(bool enabled);
+	static bool isEnabled();
+	static void setZoneTracking(QThread *thread);
+	static int mode();
+	static bool isUsed(int flags);
+	static qint64 now();
+	static void enter(const char *name);
+	static void leave(qint64 start);
+	static QStringList openZones(QThread *thread);
+	static void clear();
+	static bool save(const QString &fileName);
+	static void startFromEnvironment();
+
+	//Zones kept per thread, older ones are overwritten
+	static const int bufferEvents = 65536;
+	//Nested zones tracked per thread, deeper ones are left out of openZones()
+	static const int maximumDepth = 32;
+
+	//Bits of mode()
+	static const int modeRecording = 1;
+	static const int modeTracking = 2;
+
+private:
+	static QAtomicInt modeFlags;
+	//Set before modeTracking is turned on, read after it was seen
+	static QThread *trackedThread;
+	static void record(const char *name, qint64 start, qint64 end);
+	static void saveAtExit();
+};
+
+/**
+* Returns what zones are used for, 0 when they are skipped
+* @return int - modeRecording and modeTracking or'ed together
+*/
+inline int TraceLog::mode()
+{
+	return modeFlags.loadAcquire();
+}
+
+/**
+* Checks if the zones of the calling thread are recorded or tracked
+* @param int flags - The mode() the zone saw
+* @return bool - true if the zone has to be entered
+*/
+inline bool TraceLog::isUsed(int flags)
+{
+	return (flags & modeRecording) != 0
+		|| ((flags & modeTracking) != 0 && QThread::currentThread() == trackedThread);
+}
+
+/**
+* Checks if zones are recorded
+* @return bool - true if tracing is on
+*/
+inline bool TraceLog::isEnabled()
+{
+	return (mode() & modeRecording) != 0;
+}
+
+/**
+* Records the time from its construction to the end of its scope, see TRACE_ZONE
+*/
+class TraceZone
+{
+public:
+	explicit TraceZone(const char *newName)
+	{
+		const int flags = TraceLog::mode();
+		name = flags && TraceLog::isUsed(flags) ? newName : 0;
+		start = 0;
+		if (name){
+			start = TraceLog::now();
+			TraceLog::enter(name);
+		}
+	}
+
+	~TraceZone()
+	{
+		if (name){
+			TraceLog::leave(start);
+		}
+	}
+
+private:
+	const char *name;
+	qint64 start;
+};
+
+#define TRACE_ZONE_CONCAT2(a, b) a##b
+#define TRACE_ZONE_CONCAT(a, b) TRACE_ZONE_CONCAT2(a, b)
+
+#ifdef DRAWIT_NO_TRACE
+#define TRACE_ZONE(name)
+#else
+//The name has to be a string that stays valid, like a literal
+#define TRACE_ZONE(name) TraceZone TRACE_ZONE_CONCAT(traceZone, __LINE__)(name)
+#endif
+
+#endif // TRACELOG_H